@@ -0,0 +1,286 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * networkcheck - Loopback check of network ingest channels
+ *
+ * We start a vmpserverd instance whose only video channel is a `network`
+ * channel receiving RTP over UDP on loopback. A local sender pushes an H.264
+ * test stream to that port, and an RTSP client connects to the mountpoint of
+ * the channel. The check passes once the client received the given number of
+ * video frames.
+ *
+ * Like rtspload, the client does not decode. A video frame is counted when an
+ * RTP packet with the marker bit set arrives.
+ */
+
+#import <Foundation/Foundation.h>
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/rtsp/gstrtsptransport.h>
+
+#define USAGE_MSG                                                                                  \
+	"Usage: networkcheck [OPTION]...\n"                                                            \
+	"\n"                                                                                           \
+	"  -h, --help\t\t\tPrint this help message\n"                                                  \
+	"  -s, --server=PATH\t\tPath to the vmpserverd binary\n"                                       \
+	"  -c, --config=PATH\t\tPath to the vmpserverd configuration file\n"                          \
+	"  -u, --url=URL\t\t\tRTSP URL of the mountpoint of the network channel\n"                     \
+	"  -p, --rtp-port=PORT\t\tUDP port of the network channel\n"                                   \
+	"  -n, --frames=N\t\tVideo frames the client has to receive (default: 60)\n"                   \
+	"  -t, --timeout=SECONDS\tTime the client has to receive them (default: 30)\n"
+
+// Maximum time we wait for the server to accept RTSP connections
+#define SERVER_STARTUP_TIMEOUT (20 * G_USEC_PER_SEC)
+
+// Live H.264 test stream, payloaded like the stream of an IP camera
+#define SENDER_PIPELINE                                                                            \
+	"videotestsrc is-live=1 ! video/x-raw, width=640, height=360, framerate=30/1 ! "               \
+	"x264enc tune=zerolatency speed-preset=ultrafast key-int-max=30 ! "                            \
+	"rtph264pay config-interval=-1 pt=96 ! udpsink host=127.0.0.1 port=%u sync=0"
+
+typedef struct {
+	GstElement *pipeline;
+	// Number of completed video frames. Updated from the streaming thread.
+	gint frames;
+} VMPCheckClient;
+
+#pragma mark - RTSP client
+
+static void countFrameInBuffer(VMPCheckClient *client, GstBuffer *buffer) {
+	GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+	gboolean marker;
+
+	if (!gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp)) {
+		return;
+	}
+	marker = gst_rtp_buffer_get_marker(&rtp);
+	gst_rtp_buffer_unmap(&rtp);
+
+	if (marker) {
+		g_atomic_int_inc(&client->frames);
+	}
+}
+
+static GstPadProbeReturn videoProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											gpointer user_data) {
+	VMPCheckClient *client = user_data;
+
+	if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+		countFrameInBuffer(client, GST_PAD_PROBE_INFO_BUFFER(info));
+	} else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+		GstBufferList *list;
+		guint length;
+
+		list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+		length = gst_buffer_list_length(list);
+		for (guint i = 0; i < length; i++) {
+			countFrameInBuffer(client, gst_buffer_list_get(list, i));
+		}
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+static void padAddedCallback(GstElement *src, GstPad *pad, gpointer user_data) {
+	VMPCheckClient *client = user_data;
+	GstElement *sink;
+	GstPad *sinkpad;
+	GstCaps *caps;
+	const gchar *media;
+
+	sink = gst_element_factory_make("fakesink", NULL);
+	g_object_set(sink, "sync", FALSE, "async", FALSE, NULL);
+	gst_bin_add(GST_BIN(client->pipeline), sink);
+	gst_element_sync_state_with_parent(sink);
+
+	sinkpad = gst_element_get_static_pad(sink, "sink");
+	gst_pad_link(pad, sinkpad);
+	gst_object_unref(sinkpad);
+
+	caps = gst_pad_get_current_caps(pad);
+	if (!caps) {
+		caps = gst_pad_query_caps(pad, NULL);
+	}
+	media = gst_structure_get_string(gst_caps_get_structure(caps, 0), "media");
+	if (g_strcmp0(media, "video") == 0) {
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+						  videoProbeCallback, client, NULL);
+	}
+	gst_caps_unref(caps);
+}
+
+static BOOL startClient(VMPCheckClient *client, NSString *url) {
+	GstElement *src;
+
+	client->pipeline = gst_pipeline_new(NULL);
+	src = gst_element_factory_make("rtspsrc", NULL);
+	if (!src) {
+		return NO;
+	}
+
+	g_object_set(src, "location", [url UTF8String], "latency", 0, "protocols",
+				 GST_RTSP_LOWER_TRANS_TCP, NULL);
+	g_signal_connect(src, "pad-added", G_CALLBACK(padAddedCallback), client);
+	gst_bin_add(GST_BIN(client->pipeline), src);
+
+	return gst_element_set_state(client->pipeline, GST_STATE_PLAYING) !=
+		   GST_STATE_CHANGE_FAILURE;
+}
+
+#pragma mark - Helpers
+
+static BOOL waitForPort(NSURL *url, gint64 timeout) {
+	struct sockaddr_in addr;
+	gint64 deadline;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons([[url port] unsignedShortValue]);
+	if (inet_pton(AF_INET, [[url host] UTF8String], &addr.sin_addr) != 1) {
+		return NO;
+	}
+
+	deadline = g_get_monotonic_time() + timeout;
+	while (g_get_monotonic_time() < deadline) {
+		int fd;
+		int ret;
+
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		ret = connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+		close(fd);
+		if (ret == 0) {
+			return YES;
+		}
+		g_usleep(100 * 1000);
+	}
+
+	return NO;
+}
+
+int main(int argc, char *argv[]) {
+	gst_init(&argc, &argv);
+
+	@autoreleasepool {
+		NSString *serverPath = nil;
+		NSString *configPath = nil;
+		NSString *url = @"rtsp://127.0.0.1:18555/network";
+		guint rtpPort = 15004;
+		gint requiredFrames = 60;
+		NSTimeInterval timeout = 30;
+		VMPCheckClient client = {0};
+		GstElement *sender;
+		GError *error = NULL;
+		gchar *description;
+		NSTask *task;
+		gint64 deadline;
+		gint frames;
+
+		struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+									{"server", required_argument, NULL, 's'},
+									{"config", required_argument, NULL, 'c'},
+									{"url", required_argument, NULL, 'u'},
+									{"rtp-port", required_argument, NULL, 'p'},
+									{"frames", required_argument, NULL, 'n'},
+									{"timeout", required_argument, NULL, 't'},
+									{NULL, 0, NULL, 0}};
+		int ch;
+		while ((ch = getopt_long(argc, argv, "hs:c:u:p:n:t:", longopts, NULL)) != -1) {
+			switch (ch) {
+			case 'h':
+				fputs(USAGE_MSG, stderr);
+				return EXIT_SUCCESS;
+			case 's':
+				serverPath = [NSString stringWithUTF8String:optarg];
+				break;
+			case 'c':
+				configPath = [NSString stringWithUTF8String:optarg];
+				break;
+			case 'u':
+				url = [NSString stringWithUTF8String:optarg];
+				break;
+			case 'p':
+				rtpPort = (guint) atoi(optarg);
+				break;
+			case 'n':
+				requiredFrames = atoi(optarg);
+				break;
+			case 't':
+				timeout = atof(optarg);
+				break;
+			default:
+				fputs(USAGE_MSG, stderr);
+				return EXIT_FAILURE;
+			}
+		}
+
+		if (!serverPath || !configPath || rtpPort == 0 || requiredFrames <= 0 || timeout <= 0) {
+			fputs(USAGE_MSG, stderr);
+			return EXIT_FAILURE;
+		}
+
+		task = [[NSTask alloc] init];
+		[task setLaunchPath:serverPath];
+		[task setArguments:@[ @"-c", configPath ]];
+		[task setStandardOutput:[NSFileHandle fileHandleWithNullDevice]];
+		[task setStandardError:[NSFileHandle fileHandleWithNullDevice]];
+		[task launch];
+
+		if (!waitForPort([NSURL URLWithString:url], SERVER_STARTUP_TIMEOUT)) {
+			fprintf(stderr, "networkcheck: server did not accept connections for %s\n",
+					[url UTF8String]);
+			[task terminate];
+			return EXIT_FAILURE;
+		}
+
+		description = g_strdup_printf(SENDER_PIPELINE, rtpPort);
+		sender = gst_parse_launch(description, &error);
+		g_free(description);
+		if (error) {
+			fprintf(stderr, "networkcheck: failed to create sender: %s\n", error->message);
+			g_error_free(error);
+			[task terminate];
+			return EXIT_FAILURE;
+		}
+		gst_element_set_state(sender, GST_STATE_PLAYING);
+
+		if (!startClient(&client, url)) {
+			fputs("networkcheck: failed to start RTSP client\n", stderr);
+		}
+
+		// Frames only arrive once the channel received a keyframe of the sender
+		deadline = g_get_monotonic_time() + (gint64) (timeout * G_USEC_PER_SEC);
+		do {
+			g_usleep(100 * 1000);
+			frames = g_atomic_int_get(&client.frames);
+		} while (frames < requiredFrames && g_get_monotonic_time() < deadline && [task isRunning]);
+
+		if (client.pipeline) {
+			gst_element_set_state(client.pipeline, GST_STATE_NULL);
+			gst_object_unref(client.pipeline);
+		}
+		gst_element_set_state(sender, GST_STATE_NULL);
+		gst_object_unref(sender);
+
+		if (![task isRunning]) {
+			fputs("networkcheck: server terminated unexpectedly\n", stderr);
+			return EXIT_FAILURE;
+		}
+		[task terminate];
+		[task waitUntilExit];
+
+		fprintf(stderr, "networkcheck: received %d of %d frames\n", frames, requiredFrames);
+		return frames >= requiredFrames ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+}
@@ -0,0 +1,546 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * rtspload - End-to-end RTSP load benchmark for vmpserverd
+ *
+ * We start a vmpserverd instance with a loopback-only configuration and ramp
+ * up the number of concurrent RTSP clients in steps. For every step we record
+ *  - the time from connecting to the first complete video frame,
+ *  - the number of video frames delivered per second in steady state,
+ *  - the CPU usage and resident set size of the server, in total and per client.
+ *
+ * The per-client figures only count the usage on top of the idle server.
+ *
+ * Clients do not decode. A video frame is counted when an RTP packet with the
+ * marker bit set arrives, so the client side stays cheap and the measurement
+ * is independent of the codec used by the profile.
+ *
+ * Results are written as JSON, so that runs of different releases can be
+ * compared by a script.
+ */
+
+#import <Foundation/Foundation.h>
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+#include <gst/rtp/gstrtpbuffer.h>
+#include <gst/rtsp/gstrtsptransport.h>
+
+#define USAGE_MSG                                                                                  \
+	"Usage: rtspload [OPTION]...\n"                                                                \
+	"\n"                                                                                           \
+	"  -h, --help\t\t\tPrint this help message\n"                                                  \
+	"  -s, --server=PATH\t\tPath to the vmpserverd binary\n"                                       \
+	"  -c, --config=PATH\t\tPath to the vmpserverd configuration file\n"                          \
+	"  -f, --force-platform=PLATFORM\tForce vmpserverd to use PLATFORM\n"                         \
+	"  -u, --url=URL\t\t\tRTSP URL of the mountpoint under test\n"                                 \
+	"  -n, --clients=N[,N...]\tConcurrent clients per step (default: 1,2,4,8)\n"                   \
+	"  -d, --duration=SECONDS\tDuration of each step (default: 10)\n"                              \
+	"  -o, --output=PATH\t\tWrite JSON results to PATH (default: stdout)\n"
+
+// Maximum time we wait for the server to accept RTSP connections
+#define SERVER_STARTUP_TIMEOUT (20 * G_USEC_PER_SEC)
+// Time the server may settle after startup before the baseline is sampled
+#define SERVER_SETTLE_TIME (2 * G_USEC_PER_SEC)
+// Length of the window in which the CPU usage of the idle server is measured
+#define IDLE_SAMPLE_TIME (2 * G_USEC_PER_SEC)
+
+typedef struct {
+	GstElement *pipeline;
+	// Monotonic time in microseconds at which the client was set to PLAYING
+	gint64 connectedAt;
+	// Monotonic time in microseconds at which the first frame was completed
+	gint64 firstFrameAt;
+	// Number of completed video frames. Updated from the streaming thread.
+	gint frames;
+	// Set (atomically) after firstFrameAt was written
+	gint ready;
+} VMPBenchClient;
+
+typedef struct {
+	guint64 cpuTicks;
+	guint64 rssKiB;
+	gint64 sampledAt;
+} VMPProcessSample;
+
+#pragma mark - Process sampling
+
+static BOOL sampleProcess(pid_t pid, VMPProcessSample *sample) {
+	NSString *path, *stat, *status;
+	NSRange range;
+	unsigned long utime, stime;
+
+	path = [NSString stringWithFormat:@"/proc/%d/stat", pid];
+	stat = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+	if (!stat) {
+		return NO;
+	}
+
+	// The command name may contain spaces, so we start parsing after the closing
+	// parenthesis. utime and stime are the 14th and 15th field (see proc(5)).
+	range = [stat rangeOfString:@")" options:NSBackwardsSearch];
+	if (range.location == NSNotFound) {
+		return NO;
+	}
+	if (sscanf([[stat substringFromIndex:range.location + 1] UTF8String],
+			   " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2) {
+		return NO;
+	}
+
+	path = [NSString stringWithFormat:@"/proc/%d/status", pid];
+	status = [NSString stringWithContentsOfFile:path encoding:NSUTF8StringEncoding error:NULL];
+	if (!status) {
+		return NO;
+	}
+
+	sample->rssKiB = 0;
+	for (NSString *line in [status componentsSeparatedByString:@"\n"]) {
+		if ([line hasPrefix:@"VmRSS:"]) {
+			sample->rssKiB = strtoull([[line substringFromIndex:6] UTF8String], NULL, 10);
+			break;
+		}
+	}
+
+	sample->cpuTicks = utime + stime;
+	sample->sampledAt = g_get_monotonic_time();
+
+	return YES;
+}
+
+// CPU usage in percent of a single core between two samples
+static double cpuPercentBetweenSamples(VMPProcessSample *from, VMPProcessSample *to) {
+	double seconds;
+	double cpuSeconds;
+
+	seconds = (double) (to->sampledAt - from->sampledAt) / G_USEC_PER_SEC;
+	if (seconds <= 0) {
+		return 0;
+	}
+	cpuSeconds = (double) (to->cpuTicks - from->cpuTicks) / sysconf(_SC_CLK_TCK);
+
+	return 100.0 * cpuSeconds / seconds;
+}
+
+#pragma mark - RTSP clients
+
+static void countFrameInBuffer(VMPBenchClient *client, GstBuffer *buffer) {
+	GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+	gboolean marker;
+
+	if (!gst_rtp_buffer_map(buffer, GST_MAP_READ, &rtp)) {
+		return;
+	}
+	marker = gst_rtp_buffer_get_marker(&rtp);
+	gst_rtp_buffer_unmap(&rtp);
+
+	if (!marker) {
+		return;
+	}
+
+	// Previous value was zero, so this is the first frame
+	if (g_atomic_int_add(&client->frames, 1) == 0) {
+		client->firstFrameAt = g_get_monotonic_time();
+		g_atomic_int_set(&client->ready, 1);
+	}
+}
+
+static GstPadProbeReturn videoProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											gpointer user_data) {
+	VMPBenchClient *client = user_data;
+
+	if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+		countFrameInBuffer(client, GST_PAD_PROBE_INFO_BUFFER(info));
+	} else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+		GstBufferList *list;
+		guint length;
+
+		list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+		length = gst_buffer_list_length(list);
+		for (guint i = 0; i < length; i++) {
+			countFrameInBuffer(client, gst_buffer_list_get(list, i));
+		}
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+static void padAddedCallback(GstElement *src, GstPad *pad, gpointer user_data) {
+	VMPBenchClient *client = user_data;
+	GstElement *sink;
+	GstPad *sinkpad;
+	GstCaps *caps;
+	const gchar *media;
+
+	sink = gst_element_factory_make("fakesink", NULL);
+	g_object_set(sink, "sync", FALSE, "async", FALSE, NULL);
+	gst_bin_add(GST_BIN(client->pipeline), sink);
+	gst_element_sync_state_with_parent(sink);
+
+	sinkpad = gst_element_get_static_pad(sink, "sink");
+	gst_pad_link(pad, sinkpad);
+	gst_object_unref(sinkpad);
+
+	caps = gst_pad_get_current_caps(pad);
+	if (!caps) {
+		caps = gst_pad_query_caps(pad, NULL);
+	}
+	media = gst_structure_get_string(gst_caps_get_structure(caps, 0), "media");
+	if (g_strcmp0(media, "video") == 0) {
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+						  videoProbeCallback, client, NULL);
+	}
+	gst_caps_unref(caps);
+}
+
+static BOOL startClient(VMPBenchClient *client, NSString *url) {
+	GstElement *src;
+
+	memset(client, 0, sizeof(VMPBenchClient));
+
+	client->pipeline = gst_pipeline_new(NULL);
+	src = gst_element_factory_make("rtspsrc", NULL);
+	if (!src) {
+		gst_object_unref(client->pipeline);
+		client->pipeline = NULL;
+		return NO;
+	}
+
+	// TCP interleaving avoids UDP port exhaustion with many clients
+	g_object_set(src, "location", [url UTF8String], "latency", 0, "protocols",
+				 GST_RTSP_LOWER_TRANS_TCP, NULL);
+	g_signal_connect(src, "pad-added", G_CALLBACK(padAddedCallback), client);
+	gst_bin_add(GST_BIN(client->pipeline), src);
+
+	client->connectedAt = g_get_monotonic_time();
+	if (gst_element_set_state(client->pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+		return NO;
+	}
+
+	return YES;
+}
+
+static void stopClient(VMPBenchClient *client) {
+	if (client->pipeline) {
+		gst_element_set_state(client->pipeline, GST_STATE_NULL);
+		gst_object_unref(client->pipeline);
+		client->pipeline = NULL;
+	}
+}
+
+#pragma mark - Helpers
+
+static BOOL waitForPort(NSURL *url, gint64 timeout) {
+	struct sockaddr_in addr;
+	gint64 deadline;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons([[url port] unsignedShortValue]);
+	if (inet_pton(AF_INET, [[url host] UTF8String], &addr.sin_addr) != 1) {
+		return NO;
+	}
+
+	deadline = g_get_monotonic_time() + timeout;
+	while (g_get_monotonic_time() < deadline) {
+		int fd;
+		int ret;
+
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		ret = connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+		close(fd);
+		if (ret == 0) {
+			return YES;
+		}
+		g_usleep(100 * 1000);
+	}
+
+	return NO;
+}
+
+static id percentile(NSArray<NSNumber *> *sorted, double p) {
+	NSUInteger index;
+
+	if ([sorted count] == 0) {
+		return [NSNull null];
+	}
+	index = (NSUInteger) (p * ([sorted count] - 1) + 0.5);
+	return sorted[index];
+}
+
+static NSDictionary *summary(NSArray<NSNumber *> *values) {
+	NSArray<NSNumber *> *sorted;
+	double sum = 0;
+
+	sorted = [values sortedArrayUsingSelector:@selector(compare:)];
+	for (NSNumber *n in sorted) {
+		sum += [n doubleValue];
+	}
+
+	return @{
+		@"min" : percentile(sorted, 0.0),
+		@"median" : percentile(sorted, 0.5),
+		@"p95" : percentile(sorted, 0.95),
+		@"max" : percentile(sorted, 1.0),
+		@"mean" : [sorted count] ? (id) @(sum / [sorted count]) : [NSNull null],
+	};
+}
+
+#pragma mark - Benchmark
+
+// Returns nil if the server could not be sampled
+static NSDictionary *runStep(NSUInteger numberOfClients, NSString *url, NSTimeInterval duration,
+							 pid_t server, VMPProcessSample *baseline, double idleCPUPercent) {
+	VMPBenchClient *clients;
+	VMPProcessSample windowStart, windowEnd;
+	NSMutableArray<NSNumber *> *ttff, *fps;
+	gint *framesAtWindowStart;
+	gint64 stepStart;
+	NSUInteger connected = 0;
+	double cpuPercent, clientCPUPercent;
+	double rssDelta;
+	BOOL sampled;
+
+	clients = g_new0(VMPBenchClient, numberOfClients);
+	framesAtWindowStart = g_new0(gint, numberOfClients);
+	ttff = [NSMutableArray arrayWithCapacity:numberOfClients];
+	fps = [NSMutableArray arrayWithCapacity:numberOfClients];
+
+	stepStart = g_get_monotonic_time();
+	for (NSUInteger i = 0; i < numberOfClients; i++) {
+		if (!startClient(&clients[i], url)) {
+			fprintf(stderr, "rtspload: failed to start client %lu\n", (unsigned long) i);
+		}
+	}
+
+	// The first half of each step is warm-up. Frame delivery and resource usage
+	// is measured in the second half.
+	g_usleep((gulong) (duration / 2 * G_USEC_PER_SEC));
+	for (NSUInteger i = 0; i < numberOfClients; i++) {
+		framesAtWindowStart[i] = g_atomic_int_get(&clients[i].frames);
+	}
+	sampled = sampleProcess(server, &windowStart);
+
+	g_usleep((gulong) (duration / 2 * G_USEC_PER_SEC));
+	sampled = sampleProcess(server, &windowEnd) && sampled;
+
+	for (NSUInteger i = 0; i < numberOfClients; i++) {
+		VMPBenchClient *c = &clients[i];
+		gint frames;
+
+		frames = g_atomic_int_get(&c->frames);
+		if (g_atomic_int_get(&c->ready)) {
+			connected++;
+			[ttff addObject:@((double) (c->firstFrameAt - c->connectedAt) / 1000.0)];
+		}
+		[fps addObject:@((frames - framesAtWindowStart[i]) / (duration / 2))];
+		stopClient(c);
+	}
+
+	g_free(framesAtWindowStart);
+	g_free(clients);
+
+	if (!sampled) {
+		fprintf(stderr, "rtspload: %lu clients: failed to sample the server\n",
+				(unsigned long) numberOfClients);
+		return nil;
+	}
+
+	// The idle server already runs the channel pipelines. Only the CPU usage on top of it is
+	// caused by the clients.
+	cpuPercent = cpuPercentBetweenSamples(&windowStart, &windowEnd);
+	clientCPUPercent = MAX(cpuPercent - idleCPUPercent, 0);
+	rssDelta = (double) windowEnd.rssKiB - (double) baseline->rssKiB;
+
+	fprintf(stderr, "rtspload: %lu clients: %lu connected, %.1f%% CPU, %llu KiB RSS (%.1fs)\n",
+			(unsigned long) numberOfClients, (unsigned long) connected, cpuPercent,
+			(unsigned long long) windowEnd.rssKiB,
+			(double) (g_get_monotonic_time() - stepStart) / G_USEC_PER_SEC);
+
+	return @{
+		@"clients" : @(numberOfClients),
+		@"connectedClients" : @(connected),
+		@"timeToFirstFrameMs" : summary(ttff),
+		@"framesPerSecond" : summary(fps),
+		@"serverCPUPercent" : @(cpuPercent),
+		@"serverCPUPercentPerClient" : @(clientCPUPercent / numberOfClients),
+		@"serverRSSKiB" : @(windowEnd.rssKiB),
+		@"serverRSSKiBPerClient" : @(rssDelta / numberOfClients),
+	};
+}
+
+int main(int argc, char *argv[]) {
+	gst_init(&argc, &argv);
+
+	@autoreleasepool {
+		NSString *serverPath = nil;
+		NSString *configPath = nil;
+		NSString *platform = nil;
+		NSString *url = @"rtsp://127.0.0.1:18554/single";
+		NSString *outputPath = nil;
+		NSArray<NSString *> *steps = @[ @"1", @"2", @"4", @"8" ];
+		NSTimeInterval duration = 10;
+		NSMutableArray *serverArgs;
+		NSMutableArray *results;
+		NSTask *task;
+		VMPProcessSample idleStart, baseline;
+		double idleCPUPercent;
+		NSDictionary *report;
+		NSData *json;
+		BOOL failed = NO;
+
+		struct option longopts[] = {{"help", no_argument, NULL, 'h'},
+									{"server", required_argument, NULL, 's'},
+									{"config", required_argument, NULL, 'c'},
+									{"force-platform", required_argument, NULL, 'f'},
+									{"url", required_argument, NULL, 'u'},
+									{"clients", required_argument, NULL, 'n'},
+									{"duration", required_argument, NULL, 'd'},
+									{"output", required_argument, NULL, 'o'},
+									{NULL, 0, NULL, 0}};
+		int ch;
+		while ((ch = getopt_long(argc, argv, "hs:c:f:u:n:d:o:", longopts, NULL)) != -1) {
+			switch (ch) {
+			case 'h':
+				fputs(USAGE_MSG, stderr);
+				return EXIT_SUCCESS;
+			case 's':
+				serverPath = [NSString stringWithUTF8String:optarg];
+				break;
+			case 'c':
+				configPath = [NSString stringWithUTF8String:optarg];
+				break;
+			case 'f':
+				platform = [NSString stringWithUTF8String:optarg];
+				break;
+			case 'u':
+				url = [NSString stringWithUTF8String:optarg];
+				break;
+			case 'n':
+				steps = [[NSString stringWithUTF8String:optarg] componentsSeparatedByString:@","];
+				break;
+			case 'd':
+				duration = atof(optarg);
+				break;
+			case 'o':
+				outputPath = [NSString stringWithUTF8String:optarg];
+				break;
+			default:
+				fputs(USAGE_MSG, stderr);
+				return EXIT_FAILURE;
+			}
+		}
+
+		if (!serverPath || !configPath || duration <= 0) {
+			fputs(USAGE_MSG, stderr);
+			return EXIT_FAILURE;
+		}
+
+		serverArgs = [NSMutableArray arrayWithObjects:@"-c", configPath, nil];
+		if (platform) {
+			[serverArgs addObjectsFromArray:@[ @"-f", platform ]];
+		}
+
+		task = [[NSTask alloc] init];
+		[task setLaunchPath:serverPath];
+		[task setArguments:serverArgs];
+		[task setStandardOutput:[NSFileHandle fileHandleWithNullDevice]];
+		[task setStandardError:[NSFileHandle fileHandleWithNullDevice]];
+		[task launch];
+
+		if (!waitForPort([NSURL URLWithString:url], SERVER_STARTUP_TIMEOUT)) {
+			fprintf(stderr, "rtspload: server did not accept connections for %s\n",
+					[url UTF8String]);
+			[task terminate];
+			return EXIT_FAILURE;
+		}
+
+		// Accepting connections does not mean the channel pipelines are running yet, so
+		// startup work must not be measured as idle load
+		g_usleep(SERVER_SETTLE_TIME);
+
+		// Sample the idle server
+		if (!sampleProcess([task processIdentifier], &idleStart)) {
+			fputs("rtspload: failed to sample the server\n", stderr);
+			[task terminate];
+			return EXIT_FAILURE;
+		}
+		g_usleep(IDLE_SAMPLE_TIME);
+		if (!sampleProcess([task processIdentifier], &baseline)) {
+			fputs("rtspload: failed to sample the server\n", stderr);
+			[task terminate];
+			return EXIT_FAILURE;
+		}
+		idleCPUPercent = cpuPercentBetweenSamples(&idleStart, &baseline);
+
+		results = [NSMutableArray arrayWithCapacity:[steps count]];
+		for (NSString *step in steps) {
+			NSUInteger n;
+			NSDictionary *result;
+
+			n = (NSUInteger) [step integerValue];
+			if (n == 0) {
+				continue;
+			}
+
+			result = runStep(n, url, duration, [task processIdentifier], &baseline,
+							 idleCPUPercent);
+			if (!result || [result[@"connectedClients"] unsignedIntegerValue] != n) {
+				failed = YES;
+			}
+			// Skip steps without samples
+			if (result) {
+				[results addObject:result];
+			}
+
+			if (![task isRunning]) {
+				fputs("rtspload: server terminated unexpectedly\n", stderr);
+				failed = YES;
+				break;
+			}
+		}
+
+		if ([task isRunning]) {
+			[task terminate];
+			[task waitUntilExit];
+		}
+
+		report = @{
+			@"benchmark" : @"rtspload",
+			@"date" : [[[NSISO8601DateFormatter alloc] init] stringFromDate:[NSDate date]],
+			@"url" : url,
+			@"platform" : platform ? platform : @"auto",
+			@"stepDurationSeconds" : @(duration),
+			@"idle" : @{
+				@"serverCPUPercent" : @(idleCPUPercent),
+				@"serverRSSKiB" : @(baseline.rssKiB),
+			},
+			@"steps" : results,
+		};
+
+		json = [NSJSONSerialization dataWithJSONObject:report
+											   options:NSJSONWritingPrettyPrinted
+												 error:NULL];
+		if (outputPath) {
+			if (![json writeToFile:outputPath atomically:YES]) {
+				fprintf(stderr, "rtspload: failed to write results to %s\n",
+						[outputPath UTF8String]);
+				return EXIT_FAILURE;
+			}
+		} else {
+			fwrite([json bytes], 1, [json length], stdout);
+			fputc('\n', stdout);
+		}
+
+		return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+}
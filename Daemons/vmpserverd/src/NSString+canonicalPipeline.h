@@ -0,0 +1,18 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/NSString.h>
+
+@interface NSString (canonicalPipeline)
+/**
+ * @brief Canonical form of a pipeline description
+ *
+ * Whitespace is collapsed, links are written as " ! ", and the properties of
+ * every element are sorted, so equivalent descriptions compare equal. Quoted
+ * values are kept as is.
+ */
+- (NSString *)canonicalPipelineDescription;
+@end
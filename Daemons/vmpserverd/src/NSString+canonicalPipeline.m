@@ -0,0 +1,114 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "NSString+canonicalPipeline.h"
+
+@implementation NSString (canonicalPipeline)
+
+// Split a description into elements, properties, and "!". Whitespace next to "," and "=" is
+// dropped, so "video/x-raw, width=1920" is a single token.
+- (NSArray<NSString *> *)_pipelineTokens {
+	NSCharacterSet *whitespace;
+	NSMutableArray<NSString *> *tokens;
+	NSMutableString *token;
+	NSUInteger length;
+	BOOL quoted = NO;
+
+	whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+	tokens = [NSMutableArray array];
+	token = [NSMutableString string];
+	length = [self length];
+
+	for (NSUInteger i = 0; i < length; i++) {
+		unichar c = [self characterAtIndex:i];
+
+		if (c == '"' && (i == 0 || [self characterAtIndex:i - 1] != '\\')) {
+			quoted = !quoted;
+		} else if (!quoted && [whitespace characterIsMember:c]) {
+			NSUInteger next = i + 1;
+
+			while (next < length && [whitespace characterIsMember:[self characterAtIndex:next]]) {
+				next++;
+			}
+			if (([token hasSuffix:@","] || [token hasSuffix:@"="]) ||
+				(next < length &&
+				 ([self characterAtIndex:next] == ',' || [self characterAtIndex:next] == '='))) {
+				i = next - 1;
+				continue;
+			}
+			if ([token length] > 0) {
+				[tokens addObject:token];
+				token = [NSMutableString string];
+			}
+			i = next - 1;
+			continue;
+		} else if (!quoted && c == '!') {
+			if ([token length] > 0) {
+				[tokens addObject:token];
+				token = [NSMutableString string];
+			}
+			[tokens addObject:@"!"];
+			continue;
+		}
+
+		[token appendFormat:@"%C", c];
+	}
+	if ([token length] > 0) {
+		[tokens addObject:token];
+	}
+
+	return tokens;
+}
+
+- (NSString *)canonicalPipelineDescription {
+	NSMutableString *description;
+	NSMutableArray<NSMutableArray<NSString *> *> *elements;
+	NSMutableArray<NSNumber *> *links;
+	BOOL linked = NO;
+
+	elements = [NSMutableArray array];
+	links = [NSMutableArray array];
+	for (NSString *token in [self _pipelineTokens]) {
+		if ([token isEqualToString:@"!"]) {
+			linked = YES;
+			continue;
+		}
+
+		// A property belongs to the preceding element. Tokens behind a link (e.g. caps) start a
+		// new element.
+		if (!linked && [elements count] > 0 && [token containsString:@"="]) {
+			[[elements lastObject] addObject:token];
+			continue;
+		}
+
+		[elements addObject:[NSMutableArray arrayWithObject:token]];
+		[links addObject:@(linked)];
+		linked = NO;
+	}
+
+	description = [NSMutableString string];
+	for (NSUInteger i = 0; i < [elements count]; i++) {
+		NSArray<NSString *> *element, *properties;
+
+		element = elements[i];
+		properties = [[element subarrayWithRange:NSMakeRange(1, [element count] - 1)]
+			sortedArrayUsingSelector:@selector(compare:)];
+
+		if (i > 0) {
+			[description appendString:[links[i] boolValue] ? @" ! " : @" "];
+		}
+		[description appendString:element[0]];
+		for (NSString *property in properties) {
+			[description appendFormat:@" %@", property];
+		}
+	}
+
+	return description;
+}
+
+@end
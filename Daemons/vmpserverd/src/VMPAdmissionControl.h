@@ -0,0 +1,128 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Estimated bandwidth of the audio stream and the RTP overhead of a session in kbit/s
+extern const NSUInteger kVMPAdmissionSessionOverhead;
+
+/**
+ * @brief Limits the number of RTSP sessions and their estimated bandwidth
+ *
+ * Global limits are configured with the optional "admission" dictionary of the
+ * server configuration, and limits of a mountpoint with the optional
+ * "admission" property of the mountpoint:
+ *
+ * @code
+ * <key>admission</key>
+ * <dict>
+ *     <key>maxSessions</key>
+ *     <integer>200</integer>
+ *     <key>maxBandwidth</key>
+ *     <integer>400000</integer>
+ * </dict>
+ * @endcode
+ *
+ * "maxBandwidth" is the estimated outbound bandwidth of all sessions in
+ * kbit/s. A missing limit, or 0, means no limit. The bandwidth of a session is
+ * estimated from the bitrate of the encoder of the mountpoint plus
+ * kVMPAdmissionSessionOverhead, unless the mountpoint configures
+ * "sessionBandwidth" in kbit/s.
+ *
+ * A client, or an RTSP session, is admitted to a mountpoint once, and counted
+ * until it is released. All methods are thread-safe.
+ */
+@interface VMPAdmissionControl : NSObject
+
+/**
+ * @brief Parse the global "admission" dictionary
+ *
+ * @param propertyList The dictionary, or nil for no global limits
+ *
+ * @returns an admission control, or nil if the property list is invalid
+ */
++ (nullable instancetype)admissionControlWithPropertyList:(nullable id)propertyList
+													 error:(NSError **)error;
+
+- (nullable instancetype)initWithPropertyList:(nullable id)propertyList error:(NSError **)error;
+
+/**
+ * @brief Parse the "admission" property of a mountpoint
+ *
+ * Must be called before the RTSP server is started.
+ *
+ * @returns NO if the property list is invalid
+ */
+- (BOOL)setLimitsWithPropertyList:(id)propertyList
+					forMountpoint:(NSString *)name
+							error:(NSError **)error;
+
+/**
+ * @brief Check whether one more session fits into the limits
+ *
+ * Nothing is reserved. Used to reject clients before their media is prepared.
+ * A failed check is counted as a rejection.
+ *
+ * @param bitrate The current encoder bitrate of the mountpoint in kbit/s
+ */
+- (BOOL)canAdmitToMountpoint:(NSString *)name bitrate:(NSUInteger)bitrate;
+
+/**
+ * @brief Reserve a session of a client
+ *
+ * Succeeds without reserving another session if the client was already
+ * admitted to the mountpoint. A rejected client is counted as a rejection.
+ *
+ * @param client An identifier of the client, e.g. the address of its RTSP
+ * session
+ * @param bitrate The current encoder bitrate of the mountpoint in kbit/s
+ *
+ * @returns YES if the client was admitted
+ */
+- (BOOL)admitClient:(const void *)client toMountpoint:(NSString *)name bitrate:(NSUInteger)bitrate;
+
+/// Release all sessions of a client
+- (void)releaseClient:(const void *)client;
+
+/// Release the session of a client for a mountpoint, if any
+- (void)releaseClient:(const void *)client fromMountpoint:(NSString *)name;
+
+/**
+ * @brief Move all sessions of a client to another identifier
+ *
+ * Used to hand sessions reserved before an RTSP session existed over to the
+ * RTSP session. Sessions for mountpoints the other identifier was already
+ * admitted to are released.
+ */
+- (void)moveClient:(const void *)client toClient:(const void *)other;
+
+/**
+ * @brief Current utilisation and rejections
+ *
+ * Example structure of the returned dictionary:
+ * @code
+ * {
+ *     "sessions": 120,
+ *     "bandwidth": 316800, // Estimated kbit/s
+ *     "maxSessions": 200, // Only if limited
+ *     "maxBandwidth": 400000, // Only if limited
+ *     "sessionUtilization": 0.6, // Only if limited
+ *     "bandwidthUtilization": 0.79, // Only if limited
+ *     "rejections": 14,
+ *     "mountpoints": {
+ *         "comb": {"sessions": 120, "bandwidth": 316800, "maxSessions": 150,
+ *                  "rejections": 14}
+ *     }
+ * }
+ * @endcode
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,319 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import "VMPAdmissionControl.h"
+#import "VMPErrors.h"
+#import "VMPJournal.h"
+
+const NSUInteger kVMPAdmissionSessionOverhead = 128;
+
+// Parse a dictionary of limits. Keys other than the given ones are rejected.
+static NSDictionary<NSString *, NSNumber *> *parseLimits(id propertyList, NSArray<NSString *> *keys,
+														 NSError **error) {
+	NSMutableDictionary<NSString *, NSNumber *> *limits;
+
+	if (![propertyList isKindOfClass:[NSDictionary class]]) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError, @"'admission' must be a dictionary");
+		return nil;
+	}
+
+	limits = [NSMutableDictionary dictionary];
+	for (NSString *key in propertyList) {
+		id value = propertyList[key];
+
+		if (![keys containsObject:key]) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"Unknown key '%@' in 'admission'. Expected one of %@", key,
+						   [keys componentsJoinedByString:@", "]);
+			return nil;
+		}
+		if (![value isKindOfClass:[NSNumber class]] || [value integerValue] < 0) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'%@' of 'admission' must be a non-negative integer", key);
+			return nil;
+		}
+		limits[key] = @([value unsignedIntegerValue]);
+	}
+
+	return limits;
+}
+
+@implementation VMPAdmissionControl {
+	// Immutable after startup. 0 means no limit.
+	NSUInteger _maxSessions;
+	NSUInteger _maxBandwidth;
+	NSMutableDictionary<NSString *, NSDictionary<NSString *, NSNumber *> *> *_mountpointLimits;
+
+	// Protected by @synchronized(self)
+	// Estimated bandwidth of the sessions of a client by mountpoint, keyed by client
+	NSMutableDictionary<NSValue *, NSMutableDictionary<NSString *, NSNumber *> *> *_clients;
+	NSMutableDictionary<NSString *, NSNumber *> *_sessions;
+	NSMutableDictionary<NSString *, NSNumber *> *_bandwidth;
+	NSMutableDictionary<NSString *, NSNumber *> *_rejections;
+	NSUInteger _totalSessions;
+	NSUInteger _totalBandwidth;
+	NSUInteger _totalRejections;
+	// Whether the last request was rejected. Only the first rejection of a series is logged.
+	BOOL _rejecting;
+}
+
++ (instancetype)admissionControlWithPropertyList:(id)propertyList error:(NSError **)error {
+	return [[VMPAdmissionControl alloc] initWithPropertyList:propertyList error:error];
+}
+
+- (instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error {
+	NSDictionary<NSString *, NSNumber *> *limits = @{};
+
+	if (propertyList) {
+		limits = parseLimits(propertyList, @[ @"maxSessions", @"maxBandwidth" ], error);
+		if (!limits) {
+			return nil;
+		}
+	}
+
+	self = [super init];
+	if (self) {
+		_maxSessions = [limits[@"maxSessions"] unsignedIntegerValue];
+		_maxBandwidth = [limits[@"maxBandwidth"] unsignedIntegerValue];
+		_mountpointLimits = [NSMutableDictionary dictionary];
+		_clients = [NSMutableDictionary dictionary];
+		_sessions = [NSMutableDictionary dictionary];
+		_bandwidth = [NSMutableDictionary dictionary];
+		_rejections = [NSMutableDictionary dictionary];
+
+		if (_maxSessions > 0 || _maxBandwidth > 0) {
+			VMPInfo(@"Admitting at most %lu sessions, and %lu kbit/s (0 is unlimited)",
+					(unsigned long) _maxSessions, (unsigned long) _maxBandwidth);
+		}
+	}
+	return self;
+}
+
+- (BOOL)setLimitsWithPropertyList:(id)propertyList
+					forMountpoint:(NSString *)name
+							error:(NSError **)error {
+	NSDictionary<NSString *, NSNumber *> *limits;
+
+	limits = parseLimits(propertyList, @[ @"maxSessions", @"maxBandwidth", @"sessionBandwidth" ],
+						 error);
+	if (!limits) {
+		return NO;
+	}
+
+	_mountpointLimits[name] = limits;
+	return YES;
+}
+
+// Estimated bandwidth of a session of a mountpoint in kbit/s
+- (NSUInteger)_bandwidthOfMountpoint:(NSString *)name bitrate:(NSUInteger)bitrate {
+	NSUInteger configured;
+
+	configured = [_mountpointLimits[name][@"sessionBandwidth"] unsignedIntegerValue];
+	return configured > 0 ? configured : bitrate + kVMPAdmissionSessionOverhead;
+}
+
+// The limit one more session of a mountpoint would exceed, or nil. Must be called with
+// @synchronized(self).
+- (NSString *)_exceededLimitForMountpoint:(NSString *)name bandwidth:(NSUInteger)bandwidth {
+	NSDictionary<NSString *, NSNumber *> *limits;
+	NSUInteger maxSessions, maxBandwidth;
+
+	limits = _mountpointLimits[name];
+	maxSessions = [limits[@"maxSessions"] unsignedIntegerValue];
+	maxBandwidth = [limits[@"maxBandwidth"] unsignedIntegerValue];
+
+	if (_maxSessions > 0 && _totalSessions >= _maxSessions) {
+		return @"global session limit";
+	}
+	if (maxSessions > 0 && [_sessions[name] unsignedIntegerValue] >= maxSessions) {
+		return @"session limit of the mountpoint";
+	}
+	if (_maxBandwidth > 0 && _totalBandwidth + bandwidth > _maxBandwidth) {
+		return @"global bandwidth limit";
+	}
+	if (maxBandwidth > 0 && [_bandwidth[name] unsignedIntegerValue] + bandwidth > maxBandwidth) {
+		return @"bandwidth limit of the mountpoint";
+	}
+
+	return nil;
+}
+
+// Must be called with @synchronized(self)
+- (void)_rejectForMountpoint:(NSString *)name limit:(NSString *)limit {
+	_totalRejections++;
+	_rejections[name] = @([_rejections[name] unsignedIntegerValue] + 1);
+
+	if (!_rejecting) {
+		VMPWarn(@"Rejecting clients of mountpoint '%@' with 453 Not Enough Bandwidth: %@ reached",
+				name, limit);
+		_rejecting = YES;
+	}
+}
+
+- (BOOL)canAdmitToMountpoint:(NSString *)name bitrate:(NSUInteger)bitrate {
+	NSUInteger bandwidth;
+	NSString *limit;
+
+	bandwidth = [self _bandwidthOfMountpoint:name bitrate:bitrate];
+	@synchronized(self) {
+		limit = [self _exceededLimitForMountpoint:name bandwidth:bandwidth];
+		if (limit) {
+			[self _rejectForMountpoint:name limit:limit];
+			return NO;
+		}
+	}
+
+	return YES;
+}
+
+- (BOOL)admitClient:(const void *)client toMountpoint:(NSString *)name bitrate:(NSUInteger)bitrate {
+	NSMutableDictionary<NSString *, NSNumber *> *admissions;
+	NSUInteger bandwidth;
+	NSValue *key;
+	NSString *limit;
+
+	key = [NSValue valueWithPointer:client];
+	bandwidth = [self _bandwidthOfMountpoint:name bitrate:bitrate];
+	@synchronized(self) {
+		admissions = _clients[key];
+		if (admissions[name]) {
+			return YES;
+		}
+
+		limit = [self _exceededLimitForMountpoint:name bandwidth:bandwidth];
+		if (limit) {
+			[self _rejectForMountpoint:name limit:limit];
+			return NO;
+		}
+
+		if (!admissions) {
+			admissions = [NSMutableDictionary dictionary];
+			_clients[key] = admissions;
+		}
+		admissions[name] = @(bandwidth);
+		_sessions[name] = @([_sessions[name] unsignedIntegerValue] + 1);
+		_bandwidth[name] = @([_bandwidth[name] unsignedIntegerValue] + bandwidth);
+		_totalSessions++;
+		_totalBandwidth += bandwidth;
+		_rejecting = NO;
+	}
+
+	return YES;
+}
+
+// Must be called with @synchronized(self)
+- (void)_releaseSessionOfMountpoint:(NSString *)name bandwidth:(NSUInteger)bandwidth {
+	_sessions[name] = @([_sessions[name] unsignedIntegerValue] - 1);
+	_bandwidth[name] = @([_bandwidth[name] unsignedIntegerValue] - bandwidth);
+	_totalSessions--;
+	_totalBandwidth -= bandwidth;
+	_rejecting = NO;
+}
+
+- (void)releaseClient:(const void *)client {
+	NSValue *key;
+
+	key = [NSValue valueWithPointer:client];
+	@synchronized(self) {
+		NSDictionary<NSString *, NSNumber *> *admissions = _clients[key];
+
+		for (NSString *name in admissions) {
+			[self _releaseSessionOfMountpoint:name
+									bandwidth:[admissions[name] unsignedIntegerValue]];
+		}
+		[_clients removeObjectForKey:key];
+	}
+}
+
+- (void)releaseClient:(const void *)client fromMountpoint:(NSString *)name {
+	NSValue *key;
+
+	key = [NSValue valueWithPointer:client];
+	@synchronized(self) {
+		NSMutableDictionary<NSString *, NSNumber *> *admissions = _clients[key];
+		NSNumber *bandwidth = admissions[name];
+
+		if (!bandwidth) {
+			return;
+		}
+		[self _releaseSessionOfMountpoint:name bandwidth:[bandwidth unsignedIntegerValue]];
+		[admissions removeObjectForKey:name];
+		if ([admissions count] == 0) {
+			[_clients removeObjectForKey:key];
+		}
+	}
+}
+
+- (void)moveClient:(const void *)client toClient:(const void *)other {
+	NSValue *key, *otherKey;
+
+	key = [NSValue valueWithPointer:client];
+	otherKey = [NSValue valueWithPointer:other];
+	@synchronized(self) {
+		NSMutableDictionary<NSString *, NSNumber *> *admissions = _clients[key];
+		NSMutableDictionary<NSString *, NSNumber *> *otherAdmissions = _clients[otherKey];
+
+		if (!admissions) {
+			return;
+		}
+		[_clients removeObjectForKey:key];
+		if (!otherAdmissions) {
+			_clients[otherKey] = admissions;
+			return;
+		}
+
+		// Keep a single session per mountpoint
+		for (NSString *name in admissions) {
+			if (otherAdmissions[name]) {
+				[self _releaseSessionOfMountpoint:name
+										bandwidth:[admissions[name] unsignedIntegerValue]];
+			} else {
+				otherAdmissions[name] = admissions[name];
+			}
+		}
+	}
+}
+
+- (NSDictionary *)statistics {
+	NSMutableDictionary *statistics, *mountpoints;
+	NSMutableSet<NSString *> *names;
+
+	@synchronized(self) {
+		statistics = [NSMutableDictionary dictionaryWithDictionary:@{
+			@"sessions" : @(_totalSessions),
+			@"bandwidth" : @(_totalBandwidth),
+			@"rejections" : @(_totalRejections),
+		}];
+		if (_maxSessions > 0) {
+			statistics[@"maxSessions"] = @(_maxSessions);
+			statistics[@"sessionUtilization"] = @((double) _totalSessions / _maxSessions);
+		}
+		if (_maxBandwidth > 0) {
+			statistics[@"maxBandwidth"] = @(_maxBandwidth);
+			statistics[@"bandwidthUtilization"] = @((double) _totalBandwidth / _maxBandwidth);
+		}
+
+		names = [NSMutableSet setWithArray:[_mountpointLimits allKeys]];
+		[names addObjectsFromArray:[_sessions allKeys]];
+		[names addObjectsFromArray:[_rejections allKeys]];
+
+		mountpoints = [NSMutableDictionary dictionaryWithCapacity:[names count]];
+		for (NSString *name in names) {
+			NSMutableDictionary *info;
+
+			info = [NSMutableDictionary dictionaryWithDictionary:_mountpointLimits[name] ?: @{}];
+			info[@"sessions"] = _sessions[name] ?: @0;
+			info[@"bandwidth"] = _bandwidth[name] ?: @0;
+			info[@"rejections"] = _rejections[name] ?: @0;
+			mountpoints[name] = info;
+		}
+		statistics[@"mountpoints"] = mountpoints;
+	}
+
+	return statistics;
+}
+
+@end
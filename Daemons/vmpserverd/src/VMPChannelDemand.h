@@ -0,0 +1,87 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Name of the capsfilter defining the output format of a channel pipeline
+extern NSString *const kVMPScaleFilterName;
+
+/**
+ * @brief Resolution and framerate consumed by a pipeline from a channel
+ *
+ * A width, height, or framerate numerator of 0 means that the consumer takes
+ * whatever the channel produces.
+ */
+typedef struct {
+	gint width;
+	gint height;
+	gint framerateNumerator;
+	gint framerateDenominator;
+} VMPConsumerFormat;
+
+/**
+ * @brief Adapts the output of a channel to its current consumers
+ *
+ * Channel templates scale to a fixed size in a capsfilter named
+ * kVMPScaleFilterName. The caps of this capsfilter are the upper bound of the
+ * channel output.
+ *
+ * Every mountpoint or recording reading from the channel registers the format
+ * it consumes. The capsfilter is then set to the largest width, height, and
+ * framerate of all consumers, and the channel renegotiates on the next buffer.
+ * If a consumer does not constrain the format, or no consumers exist, the
+ * upper bound is used.
+ */
+@interface VMPChannelDemand : NSObject
+
+@property (nonatomic, readonly) NSString *channel;
+
++ (instancetype)demandWithChannel:(NSString *)channel;
+
+- (instancetype)initWithChannel:(NSString *)channel;
+
+/**
+ * @brief Determine the format consumed from an intervideosrc
+ *
+ * Follows the stream downstream until a capsfilter with a fixed size, or a
+ * mixer pad with a width and height property (e.g. a compositor pad) is found.
+ *
+ * @returns the consumed format. All fields are 0 if the format is not
+ * constrained.
+ */
++ (VMPConsumerFormat)consumerFormatOfSource:(GstElement *)source;
+
+/**
+ * @brief Connect to the scale capsfilter of a channel pipeline
+ *
+ * Called for every pipeline created for the channel, including restarts. The
+ * current demand is applied immediately.
+ */
+- (void)attachToChannelPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Register a consumer
+ *
+ * @returns a token for removeConsumer:
+ */
+- (id)addConsumerWithFormat:(VMPConsumerFormat)format;
+
+/// Unregister a consumer and renegotiate the channel output
+- (void)removeConsumer:(id)token;
+
+/**
+ * @brief Consumer count and current output format
+ *
+ * @returns a dictionary with the keys "consumers", "caps", and "maximumCaps"
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,316 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import "VMPChannelDemand.h"
+#import "VMPGStreamerUtils.h"
+#import "VMPJournal.h"
+
+NSString *const kVMPScaleFilterName = @"vmpscale";
+
+// Number of elements followed downstream of an intervideosrc
+static const NSUInteger kMaximumSearchDepth = 16;
+
+// Read a fixed size, and an optional framerate from a capsfilter
+static BOOL formatFromCapsfilter(GstElement *capsfilter, VMPConsumerFormat *format) {
+	GstCaps *caps = NULL;
+	GstStructure *structure;
+	BOOL found = NO;
+
+	// Transfer: FULL
+	g_object_get(capsfilter, "caps", &caps, NULL);
+	if (!caps) {
+		return NO;
+	}
+
+	if (!gst_caps_is_any(caps) && !gst_caps_is_empty(caps)) {
+		// Transfer: NONE
+		structure = gst_caps_get_structure(caps, 0);
+		if (gst_structure_get_int(structure, "width", &format->width) &&
+			gst_structure_get_int(structure, "height", &format->height)) {
+			found = YES;
+			if (!gst_structure_get_fraction(structure, "framerate", &format->framerateNumerator,
+											&format->framerateDenominator)) {
+				format->framerateNumerator = 0;
+				format->framerateDenominator = 1;
+			}
+		}
+	}
+	gst_caps_unref(caps);
+
+	return found;
+}
+
+@implementation VMPChannelDemand {
+	NSMutableDictionary<NSNumber *, NSValue *> *_consumers;
+	NSUInteger _nextToken;
+	GWeakRef _capsfilter;
+	// Caps of the capsfilter in the channel template
+	GstCaps *_maximumCaps;
+	GstCaps *_currentCaps;
+	// Whether the channel pipeline can change its framerate
+	BOOL _adjustsFramerate;
+}
+
++ (instancetype)demandWithChannel:(NSString *)channel {
+	return [[VMPChannelDemand alloc] initWithChannel:channel];
+}
+
+- (instancetype)initWithChannel:(NSString *)channel {
+	self = [super init];
+	if (self) {
+		_channel = [channel copy];
+		_consumers = [NSMutableDictionary dictionary];
+		g_weak_ref_init(&_capsfilter, NULL);
+	}
+	return self;
+}
+
++ (VMPConsumerFormat)consumerFormatOfSource:(GstElement *)source {
+	VMPConsumerFormat format = {0, 0, 0, 1};
+	GstPad *pad;
+
+	// Transfer: FULL
+	pad = gst_element_get_static_pad(source, "src");
+	for (NSUInteger depth = 0; pad && depth < kMaximumSearchDepth; depth++) {
+		GstPad *peer;
+		GstElement *element;
+		GObjectClass *klass;
+		const gchar *factoryName;
+
+		// Transfer: FULL
+		peer = gst_pad_get_peer(pad);
+		gst_object_unref(pad);
+		pad = NULL;
+		if (!peer) {
+			break;
+		}
+
+		// Mixer pads scale their input to the size of the pad
+		klass = G_OBJECT_GET_CLASS(peer);
+		if (g_object_class_find_property(klass, "width") &&
+			g_object_class_find_property(klass, "height")) {
+			g_object_get(peer, "width", &format.width, "height", &format.height, NULL);
+			gst_object_unref(peer);
+			break;
+		}
+
+		// Transfer: FULL
+		element = gst_pad_get_parent_element(peer);
+		gst_object_unref(peer);
+		if (!element) {
+			break;
+		}
+
+		factoryName = VMPElementFactoryName(element);
+		if (factoryName && g_str_equal(factoryName, "capsfilter") &&
+			formatFromCapsfilter(element, &format)) {
+			gst_object_unref(element);
+			break;
+		}
+
+		// Only follow elements with a single output
+		GST_OBJECT_LOCK(element);
+		if (element->numsrcpads == 1) {
+			pad = gst_object_ref(GST_PAD(element->srcpads->data));
+		}
+		GST_OBJECT_UNLOCK(element);
+		gst_object_unref(element);
+	}
+
+	if (pad) {
+		gst_object_unref(pad);
+	}
+
+	return format;
+}
+
+- (void)attachToChannelPipeline:(GstElement *)pipeline {
+	GstElement *capsfilter;
+	__block BOOL hasVideorate = NO;
+
+	if (!GST_IS_BIN(pipeline)) {
+		return;
+	}
+
+	// Transfer: FULL
+	capsfilter = gst_bin_get_by_name(GST_BIN(pipeline), [kVMPScaleFilterName UTF8String]);
+	if (!capsfilter) {
+		VMPDebug(@"Channel %@ has no capsfilter named '%@'. Output is not adapted.", _channel,
+				 kVMPScaleFilterName);
+		return;
+	}
+
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+	  const gchar *factoryName = VMPElementFactoryName(element);
+	  if (factoryName && g_str_equal(factoryName, "videorate")) {
+		  hasVideorate = YES;
+	  }
+	});
+
+	@synchronized(self) {
+		g_weak_ref_set(&_capsfilter, capsfilter);
+		gst_caps_replace(&_maximumCaps, NULL);
+		gst_caps_replace(&_currentCaps, NULL);
+		// Transfer: FULL
+		g_object_get(capsfilter, "caps", &_maximumCaps, NULL);
+		_adjustsFramerate = hasVideorate;
+
+		[self _apply];
+	}
+
+	gst_object_unref(capsfilter);
+}
+
+- (id)addConsumerWithFormat:(VMPConsumerFormat)format {
+	NSNumber *token;
+
+	@synchronized(self) {
+		token = @(_nextToken++);
+		_consumers[token] = [NSValue valueWithBytes:&format objCType:@encode(VMPConsumerFormat)];
+
+		VMPInfo(@"Channel %@ has a new consumer of %dx%d at %d/%d fps", _channel, format.width,
+				format.height, format.framerateNumerator, format.framerateDenominator);
+		[self _apply];
+	}
+
+	return token;
+}
+
+- (void)removeConsumer:(id)token {
+	@synchronized(self) {
+		[_consumers removeObjectForKey:token];
+		[self _apply];
+	}
+}
+
+// Must be called with the lock held. Transfer: FULL
+- (GstCaps *)_copyDemandedCaps {
+	GstCaps *caps;
+	GstStructure *structure;
+	gint width = 0, height = 0, maxWidth, maxHeight;
+	gint rateNumerator = 0, rateDenominator = 1, maxNumerator, maxDenominator;
+	BOOL unconstrainedSize = NO, unconstrainedRate = !_adjustsFramerate;
+
+	caps = gst_caps_copy(_maximumCaps);
+	if ([_consumers count] == 0 || gst_caps_is_any(caps) || gst_caps_is_empty(caps)) {
+		return caps;
+	}
+
+	for (NSValue *value in [_consumers allValues]) {
+		VMPConsumerFormat format;
+
+		[value getValue:&format];
+		if (format.width <= 0 || format.height <= 0) {
+			unconstrainedSize = YES;
+		} else {
+			width = MAX(width, format.width);
+			height = MAX(height, format.height);
+		}
+
+		if (format.framerateNumerator <= 0 || format.framerateDenominator <= 0) {
+			unconstrainedRate = YES;
+		} else if (gst_util_fraction_compare(format.framerateNumerator,
+											 format.framerateDenominator, rateNumerator,
+											 rateDenominator) > 0) {
+			rateNumerator = format.framerateNumerator;
+			rateDenominator = format.framerateDenominator;
+		}
+	}
+
+	// Transfer: NONE
+	structure = gst_caps_get_structure(caps, 0);
+
+	// Never exceed the size of the template
+	if (!unconstrainedSize) {
+		if (gst_structure_get_int(structure, "width", &maxWidth) &&
+			gst_structure_get_int(structure, "height", &maxHeight)) {
+			width = MIN(width, maxWidth);
+			height = MIN(height, maxHeight);
+		}
+		gst_structure_set(structure, "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
+						  NULL);
+	}
+
+	if (!unconstrainedRate) {
+		if (gst_structure_get_fraction(structure, "framerate", &maxNumerator, &maxDenominator) &&
+			gst_util_fraction_compare(rateNumerator, rateDenominator, maxNumerator,
+									  maxDenominator) > 0) {
+			rateNumerator = maxNumerator;
+			rateDenominator = maxDenominator;
+		}
+		gst_structure_set(structure, "framerate", GST_TYPE_FRACTION, rateNumerator,
+						  rateDenominator, NULL);
+	}
+
+	return caps;
+}
+
+// Must be called with the lock held
+- (void)_apply {
+	GstElement *capsfilter;
+	GstCaps *caps;
+	gchar *str;
+
+	if (!_maximumCaps) {
+		return;
+	}
+
+	// Transfer: FULL
+	capsfilter = g_weak_ref_get(&_capsfilter);
+	if (!capsfilter) {
+		return;
+	}
+
+	// Transfer: FULL
+	caps = [self _copyDemandedCaps];
+	if (!_currentCaps || !gst_caps_is_equal(caps, _currentCaps)) {
+		str = gst_caps_to_string(caps);
+		VMPInfo(@"Renegotiating channel %@ for %lu consumers: %s", _channel,
+				(unsigned long) [_consumers count], str);
+		g_free(str);
+
+		// The capsfilter sends a reconfigure event upstream
+		g_object_set(capsfilter, "caps", caps, NULL);
+		gst_caps_replace(&_currentCaps, caps);
+	}
+
+	gst_caps_unref(caps);
+	gst_object_unref(capsfilter);
+}
+
+- (NSDictionary *)statistics {
+	NSString *current, *maximum;
+	gchar *str;
+
+	@synchronized(self) {
+		current = @"";
+		maximum = @"";
+		if (_currentCaps) {
+			str = gst_caps_to_string(_currentCaps);
+			current = @(str);
+			g_free(str);
+		}
+		if (_maximumCaps) {
+			str = gst_caps_to_string(_maximumCaps);
+			maximum = @(str);
+			g_free(str);
+		}
+
+		return @{
+			@"consumers" : @([_consumers count]),
+			@"caps" : current,
+			@"maximumCaps" : maximum,
+		};
+	}
+}
+
+- (void)dealloc {
+	g_weak_ref_clear(&_capsfilter);
+	gst_caps_replace(&_maximumCaps, NULL);
+	gst_caps_replace(&_currentCaps, NULL);
+}
+
+@end
@@ -0,0 +1,72 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Name of the appsink receiving the low-resolution proxy of a recording
+extern NSString *const kVMPChapterSinkName;
+
+/// Name of the muxer of a recording
+extern NSString *const kVMPRecordingMuxerName;
+
+/**
+ * @brief Detects slide changes while recording, and writes chapters and a
+ * thumbnail sprite sheet
+ *
+ * The recording pipeline feeds a low-resolution proxy (e.g. 160x90 RGB at
+ * 2 fps) of the video channel into an appsink named kVMPChapterSinkName. A new
+ * chapter starts when a frame differs from the first frame of the current
+ * chapter, after the picture was stable for one proxy frame, and at least
+ * five seconds after the previous chapter. This skips transitions and videos
+ * within slides.
+ *
+ * For every chapter:
+ * @li The table of contents of the muxer (kVMPRecordingMuxerName) is updated,
+ * so Matroska chapters are written when the recording is finalised.
+ * @li The proxy frame is added to a sprite sheet with ten thumbnails per row,
+ * written as JPEG next to the recording ("<name>.thumbnails.jpg").
+ * @li The chapter index ("<name>.chapters.json") with the start time and the
+ * sprite position of every chapter is rewritten.
+ *
+ * Files are replaced atomically, so they are usable while recording. The sprite
+ * sheet is encoded on a serial queue, as encoding it takes longer the more
+ * chapters it holds. The streaming thread only pastes the thumbnail.
+ */
+@interface VMPChapterIndexer : NSObject
+
+/// Path of the sprite sheet
+@property (nonatomic, readonly) NSURL *spriteSheetPath;
+
+/// Path of the chapter index
+@property (nonatomic, readonly) NSURL *indexPath;
+
+/**
+ * @brief Create an indexer for a recording
+ *
+ * @param recordingPath Path of the recording. The sprite sheet and index are
+ * placed next to it.
+ */
++ (instancetype)indexerWithRecordingPath:(NSURL *)recordingPath;
+
+- (instancetype)initWithRecordingPath:(NSURL *)recordingPath;
+
+/// Connect to the proxy appsink and the muxer of a recording pipeline
+- (void)attachToRecordingPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Chapter count and processing cost
+ *
+ * @returns a dictionary with the keys "chapters", "framesAnalyzed", and
+ * "processingTime" (in seconds)
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
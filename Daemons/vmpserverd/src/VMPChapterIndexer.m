@@ -0,0 +1,442 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdlib.h>
+
+#import <gst/app/app.h>
+#import <gst/video/video.h>
+
+#import "VMPChapterIndexer.h"
+#import "VMPJournal.h"
+
+NSString *const kVMPChapterSinkName = @"vmpchapters";
+NSString *const kVMPRecordingMuxerName = @"mux";
+
+// Mean absolute difference to the first frame of a chapter starting a new chapter
+static const double kChangeThreshold = 6.0;
+// Mean absolute difference to the previous frame of a stable picture
+static const double kStableThreshold = 2.0;
+// Minimum duration of a chapter
+static const GstClockTime kMinimumChapterDuration = 5 * GST_SECOND;
+
+static const NSUInteger kSpriteColumns = 10;
+// Chapters beyond this count are indexed without a thumbnail
+static const NSUInteger kMaximumThumbnails = 500;
+
+@interface VMPChapterIndexer ()
+- (void)_handleSample:(GstSample *)sample;
+@end
+
+// Called from the streaming thread of the appsink
+static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
+	__unsafe_unretained VMPChapterIndexer *indexer = (__bridge id) user_data;
+	GstSample *sample;
+
+	// Transfer: FULL
+	sample = gst_app_sink_pull_sample(appsink);
+	if (!sample) {
+		return GST_FLOW_EOS;
+	}
+
+	@autoreleasepool {
+		[indexer _handleSample:sample];
+	}
+	gst_sample_unref(sample);
+
+	return GST_FLOW_OK;
+}
+
+static void release_indexer_cb(gpointer user_data) {
+	// Balance the retain from attachToRecordingPipeline:
+	(void) (__bridge_transfer VMPChapterIndexer *) user_data;
+}
+
+// Mean absolute difference of two packed frames of equal size
+static double frameDifference(NSData *a, NSData *b) {
+	const guint8 *pa = [a bytes], *pb = [b bytes];
+	NSUInteger length = [a length];
+	guint64 sum = 0;
+
+	if (length == 0 || length != [b length]) {
+		return G_MAXDOUBLE;
+	}
+
+	for (NSUInteger i = 0; i < length; i++) {
+		sum += (guint64) abs((gint) pa[i] - (gint) pb[i]);
+	}
+
+	return (double) sum / length;
+}
+
+@implementation VMPChapterIndexer {
+	GWeakRef _muxer;
+
+	// Only accessed from the streaming thread of the appsink
+	GstVideoInfo _proxyInfo;
+	NSData *_previousFrame;
+	NSData *_chapterFrame;
+	GstVideoInfo _sheetInfo;
+	NSMutableData *_sheet;
+
+	// Encodes and writes the sprite sheet off the streaming thread
+	dispatch_queue_t _queue;
+
+	// Protected by @synchronized(self)
+	NSMutableArray<NSDictionary *> *_chapters;
+	// Latest sprite sheet not yet picked up by the queue, or nil
+	NSData *_pendingSheet;
+	GstVideoInfo _pendingSheetInfo;
+	NSUInteger _framesAnalyzed;
+	gint64 _processingTime;
+}
+
++ (instancetype)indexerWithRecordingPath:(NSURL *)recordingPath {
+	return [[VMPChapterIndexer alloc] initWithRecordingPath:recordingPath];
+}
+
+- (instancetype)initWithRecordingPath:(NSURL *)recordingPath {
+	self = [super init];
+	if (self) {
+		NSURL *base = [recordingPath URLByDeletingPathExtension];
+
+		_spriteSheetPath = [base URLByAppendingPathExtension:@"thumbnails.jpg"];
+		_indexPath = [base URLByAppendingPathExtension:@"chapters.json"];
+		_chapters = [NSMutableArray array];
+		_queue = dispatch_queue_create("com.hugomelder.vmpserverd.chapters", DISPATCH_QUEUE_SERIAL);
+		g_weak_ref_init(&_muxer, NULL);
+	}
+	return self;
+}
+
+- (void)attachToRecordingPipeline:(GstElement *)pipeline {
+	GstElement *appsink, *muxer;
+	GstAppSinkCallbacks callbacks = {0};
+
+	if (!GST_IS_BIN(pipeline)) {
+		return;
+	}
+
+	// Transfer: FULL
+	muxer = gst_bin_get_by_name(GST_BIN(pipeline), [kVMPRecordingMuxerName UTF8String]);
+	if (!muxer || !GST_IS_TOC_SETTER(muxer)) {
+		VMPWarn(@"Recording has no muxer named '%@' supporting chapters", kVMPRecordingMuxerName);
+	} else {
+		g_weak_ref_set(&_muxer, muxer);
+	}
+	if (muxer) {
+		gst_object_unref(muxer);
+	}
+
+	// Transfer: FULL
+	appsink = gst_bin_get_by_name(GST_BIN(pipeline), [kVMPChapterSinkName UTF8String]);
+	if (!appsink || !GST_IS_APP_SINK(appsink)) {
+		VMPError(@"Recording has no appsink named '%@'. Chapters are disabled.",
+				 kVMPChapterSinkName);
+		if (appsink) {
+			gst_object_unref(appsink);
+		}
+		return;
+	}
+
+	callbacks.new_sample = new_sample_cb;
+	gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &callbacks, (__bridge_retained void *) self,
+							   release_indexer_cb);
+	gst_object_unref(appsink);
+}
+
+- (void)_handleSample:(GstSample *)sample {
+	GstBuffer *buffer;
+	GstCaps *caps;
+	const GstSegment *segment;
+	GstVideoInfo info;
+	GstVideoFrame frame;
+	NSMutableData *packed;
+	GstClockTime time;
+	const guint8 *data;
+	gsize rowLength;
+	gint height, stride;
+	gint64 begin;
+
+	begin = g_get_monotonic_time();
+
+	// Transfer: NONE
+	buffer = gst_sample_get_buffer(sample);
+	caps = gst_sample_get_caps(sample);
+	segment = gst_sample_get_segment(sample);
+	if (!buffer || !caps || !gst_video_info_from_caps(&info, caps) ||
+		GST_VIDEO_INFO_FORMAT(&info) != GST_VIDEO_FORMAT_RGB) {
+		return;
+	}
+
+	// Start a new sheet if the proxy format changed
+	if (!_sheet || GST_VIDEO_INFO_WIDTH(&info) != GST_VIDEO_INFO_WIDTH(&_proxyInfo) ||
+		GST_VIDEO_INFO_HEIGHT(&info) != GST_VIDEO_INFO_HEIGHT(&_proxyInfo)) {
+		_proxyInfo = info;
+		_sheet = [NSMutableData data];
+		_previousFrame = nil;
+		_chapterFrame = nil;
+	}
+
+	if (!gst_video_frame_map(&frame, &info, buffer, GST_MAP_READ)) {
+		return;
+	}
+
+	// Copy into a packed frame to drop the padding of the rows
+	rowLength = (gsize) GST_VIDEO_INFO_WIDTH(&info) * 3;
+	height = GST_VIDEO_INFO_HEIGHT(&info);
+	data = GST_VIDEO_FRAME_PLANE_DATA(&frame, 0);
+	stride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+
+	packed = [NSMutableData dataWithLength:rowLength * height];
+	for (gint y = 0; y < height; y++) {
+		memcpy((guint8 *) [packed mutableBytes] + y * rowLength, data + (gsize) y * stride,
+			   rowLength);
+	}
+	gst_video_frame_unmap(&frame);
+
+	time = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+	if (!GST_CLOCK_TIME_IS_VALID(time)) {
+		time = 0;
+	}
+
+	if (!_chapterFrame) {
+		[self _addChapterWithFrame:packed time:time];
+	} else if (frameDifference(packed, _previousFrame) <= kStableThreshold &&
+			   frameDifference(packed, _chapterFrame) > kChangeThreshold) {
+		GstClockTime start;
+
+		@synchronized(self) {
+			start = [[_chapters lastObject][@"start"] unsignedLongLongValue];
+		}
+		if (time >= start + kMinimumChapterDuration) {
+			[self _addChapterWithFrame:packed time:time];
+		}
+	}
+	_previousFrame = packed;
+
+	@synchronized(self) {
+		_framesAnalyzed++;
+		_processingTime += g_get_monotonic_time() - begin;
+	}
+}
+
+- (void)_addChapterWithFrame:(NSData *)frame time:(GstClockTime)time {
+	NSMutableDictionary *chapter;
+	NSUInteger number;
+	NSArray *chapters;
+
+	_chapterFrame = frame;
+
+	@synchronized(self) {
+		number = [_chapters count];
+	}
+
+	chapter = [NSMutableDictionary dictionaryWithDictionary:@{
+		@"start" : @(time),
+		@"title" : [NSString stringWithFormat:@"Slide %lu", (unsigned long) number + 1],
+	}];
+	if (number < kMaximumThumbnails) {
+		NSUInteger width = GST_VIDEO_INFO_WIDTH(&_proxyInfo);
+		NSUInteger height = GST_VIDEO_INFO_HEIGHT(&_proxyInfo);
+
+		[self _appendThumbnail:frame index:number];
+		chapter[@"thumbnail"] = @{
+			@"x" : @((number % kSpriteColumns) * width),
+			@"y" : @((number / kSpriteColumns) * height),
+			@"width" : @(width),
+			@"height" : @(height),
+		};
+	}
+
+	@synchronized(self) {
+		[_chapters addObject:chapter];
+		chapters = [_chapters copy];
+	}
+
+	VMPInfo(@"Chapter %lu of recording starts at %" GST_TIME_FORMAT, (unsigned long) number + 1,
+			GST_TIME_ARGS(time));
+
+	[self _updateTocWithChapters:chapters];
+	[self _writeIndexWithChapters:chapters];
+}
+
+// Paste a thumbnail into the sprite sheet, and schedule a rewrite of the sheet
+- (void)_appendThumbnail:(NSData *)frame index:(NSUInteger)index {
+	gint width, height, sheetWidth, sheetHeight;
+	gsize rowLength, sheetStride, x, y;
+	BOOL scheduled;
+
+	width = GST_VIDEO_INFO_WIDTH(&_proxyInfo);
+	height = GST_VIDEO_INFO_HEIGHT(&_proxyInfo);
+	sheetWidth = width * (gint) kSpriteColumns;
+	sheetHeight = height * (gint) (index / kSpriteColumns + 1);
+
+	gst_video_info_set_format(&_sheetInfo, GST_VIDEO_FORMAT_RGB, sheetWidth, sheetHeight);
+	sheetStride = GST_VIDEO_INFO_PLANE_STRIDE(&_sheetInfo, 0);
+
+	// Rows are appended at the end, so existing thumbnails keep their position
+	if ([_sheet length] < sheetStride * sheetHeight) {
+		[_sheet setLength:sheetStride * sheetHeight];
+	}
+
+	rowLength = (gsize) width * 3;
+	x = (index % kSpriteColumns) * rowLength;
+	y = (index / kSpriteColumns) * height;
+	for (gint row = 0; row < height; row++) {
+		memcpy((guint8 *) [_sheet mutableBytes] + (y + row) * sheetStride + x,
+			   (const guint8 *) [frame bytes] + row * rowLength, rowLength);
+	}
+
+	// Encoding the sheet takes longer the more chapters it holds. Only the latest sheet is
+	// encoded if chapters start faster than the queue writes them.
+	@synchronized(self) {
+		scheduled = _pendingSheet != nil;
+		_pendingSheet = [NSData dataWithBytes:[_sheet bytes] length:sheetStride * sheetHeight];
+		_pendingSheetInfo = _sheetInfo;
+	}
+	if (!scheduled) {
+		dispatch_async(_queue, ^{
+		  [self _writePendingSpriteSheet];
+		});
+	}
+}
+
+// Called on the queue. Encode the latest sprite sheet as JPEG, and replace the file.
+- (void)_writePendingSpriteSheet {
+	NSData *sheet, *data;
+	GstVideoInfo info;
+	GstBuffer *buffer;
+	GstCaps *caps, *jpegCaps;
+	GstSample *sample, *jpeg;
+	GstMapInfo map;
+	GError *err = NULL;
+
+	@synchronized(self) {
+		sheet = _pendingSheet;
+		info = _pendingSheetInfo;
+		_pendingSheet = nil;
+	}
+	if (!sheet) {
+		return;
+	}
+
+	// Transfer: FULL
+	buffer = gst_buffer_new_memdup([sheet bytes], [sheet length]);
+	caps = gst_video_info_to_caps(&info);
+	sample = gst_sample_new(buffer, caps, NULL, NULL);
+	gst_buffer_unref(buffer);
+	gst_caps_unref(caps);
+
+	jpegCaps = gst_caps_new_empty_simple("image/jpeg");
+	jpeg = gst_video_convert_sample(sample, jpegCaps, GST_SECOND, &err);
+	gst_caps_unref(jpegCaps);
+	gst_sample_unref(sample);
+
+	if (!jpeg) {
+		VMPError(@"Failed to encode thumbnail sprite sheet: %s", err ? err->message : "unknown");
+		g_clear_error(&err);
+		return;
+	}
+
+	// Transfer: NONE
+	buffer = gst_sample_get_buffer(jpeg);
+	if (!buffer || !gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+		gst_sample_unref(jpeg);
+		return;
+	}
+	data = [NSData dataWithBytes:map.data length:map.size];
+	gst_buffer_unmap(buffer, &map);
+	gst_sample_unref(jpeg);
+
+	if (![data writeToURL:_spriteSheetPath atomically:YES]) {
+		VMPError(@"Failed to write thumbnail sprite sheet %@", _spriteSheetPath);
+	}
+}
+
+- (void)_updateTocWithChapters:(NSArray<NSDictionary *> *)chapters {
+	GstElement *muxer;
+	GstToc *toc;
+	GstTocEntry *edition;
+
+	// Transfer: FULL
+	muxer = g_weak_ref_get(&_muxer);
+	if (!muxer) {
+		return;
+	}
+
+	toc = gst_toc_new(GST_TOC_SCOPE_GLOBAL);
+	edition = gst_toc_entry_new(GST_TOC_ENTRY_TYPE_EDITION, "slides");
+
+	[chapters enumerateObjectsUsingBlock:^(NSDictionary *chapter, NSUInteger idx, BOOL *stop) {
+	  GstTocEntry *entry;
+	  gchar *uid;
+	  gint64 start, end;
+
+	  start = (gint64) [chapter[@"start"] unsignedLongLongValue];
+	  end = idx + 1 < [chapters count]
+				? (gint64) [chapters[idx + 1][@"start"] unsignedLongLongValue]
+				: -1;
+
+	  uid = g_strdup_printf("slide-%lu", (unsigned long) idx + 1);
+	  entry = gst_toc_entry_new(GST_TOC_ENTRY_TYPE_CHAPTER, uid);
+	  g_free(uid);
+
+	  gst_toc_entry_set_start_stop_times(entry, start, end);
+	  gst_toc_entry_set_tags(entry,
+							 gst_tag_list_new(GST_TAG_TITLE, [chapter[@"title"] UTF8String], NULL));
+	  // Transfer: FULL (entry)
+	  gst_toc_entry_append_sub_entry(edition, entry);
+	}];
+
+	// Transfer: FULL (edition)
+	gst_toc_append_entry(toc, edition);
+
+	// The muxer writes the chapters when the recording is finalised
+	gst_toc_setter_set_toc(GST_TOC_SETTER(muxer), toc);
+	gst_toc_unref(toc);
+	gst_object_unref(muxer);
+}
+
+- (void)_writeIndexWithChapters:(NSArray<NSDictionary *> *)chapters {
+	NSMutableArray *entries;
+	NSData *data;
+	NSError *error = nil;
+
+	entries = [NSMutableArray arrayWithCapacity:[chapters count]];
+	for (NSDictionary *chapter in chapters) {
+		NSMutableDictionary *entry = [chapter mutableCopy];
+
+		// Seconds are easier to consume than nanoseconds
+		entry[@"start"] = @([chapter[@"start"] unsignedLongLongValue] / (double) GST_SECOND);
+		[entries addObject:entry];
+	}
+
+	data = [NSJSONSerialization dataWithJSONObject:@{
+		@"spriteSheet" : [_spriteSheetPath lastPathComponent],
+		@"chapters" : entries,
+	}
+										   options:0
+											 error:&error];
+	if (!data || ![data writeToURL:_indexPath atomically:YES]) {
+		VMPError(@"Failed to write chapter index %@: %@", _indexPath, error);
+	}
+}
+
+- (NSDictionary *)statistics {
+	@synchronized(self) {
+		return @{
+			@"chapters" : @([_chapters count]),
+			@"framesAnalyzed" : @(_framesAnalyzed),
+			@"processingTime" : @((double) _processingTime / G_USEC_PER_SEC),
+		};
+	}
+}
+
+- (void)dealloc {
+	g_weak_ref_clear(&_muxer);
+}
+
+@end
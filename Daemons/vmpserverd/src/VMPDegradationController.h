@@ -0,0 +1,130 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+@class VMPDegradationController;
+
+@protocol VMPDegradationControllerDelegate <NSObject>
+
+/**
+ * @brief Total number of QoS messages posted by all pipelines so far
+ *
+ * Called on the queue of the controller.
+ */
+- (NSUInteger)numberOfQoSMessagesForDegradationController:(VMPDegradationController *)controller;
+
+/**
+ * @brief Apply the limits of a new level to all mountpoints
+ *
+ * @param limits The step of the ladder, or nil for full quality. @see
+ * VMPEncoderSettings.applyLimits:pipeline:
+ *
+ * Called on the queue of the controller.
+ */
+- (void)degradationController:(VMPDegradationController *)controller
+			  didChangeLimits:(nullable NSDictionary *)limits;
+
+@end
+
+/**
+ * @brief Steps mountpoints down a quality ladder under load or heat
+ *
+ * Configured with the optional "degradation" dictionary of the server
+ * configuration:
+ *
+ * @code
+ * <key>degradation</key>
+ * <dict>
+ *     <key>ladder</key>
+ *     <array>
+ *         <dict>
+ *             <key>bitrate</key>
+ *             <integer>1800</integer>
+ *         </dict>
+ *         <dict>
+ *             <key>bitrate</key>
+ *             <integer>1200</integer>
+ *             <key>framerate</key>
+ *             <integer>15</integer>
+ *         </dict>
+ *         <dict>
+ *             <key>bitrate</key>
+ *             <integer>800</integer>
+ *             <key>framerate</key>
+ *             <integer>15</integer>
+ *             <key>width</key>
+ *             <integer>1280</integer>
+ *             <key>height</key>
+ *             <integer>720</integer>
+ *         </dict>
+ *     </array>
+ * </dict>
+ * @endcode
+ *
+ * Every "interval" seconds (default 2), the controller samples the CPU
+ * utilisation of the system (/proc/stat), the hottest thermal zone
+ * (/sys/class/thermal), and the rate of QoS messages of all pipelines. If one
+ * of them exceeds its threshold ("cpuThreshold" as a fraction, default 0.9,
+ * "temperatureThreshold" in degrees Celsius, default 80, and "qosThreshold"
+ * in messages per second, default 5), the controller steps down the ladder by
+ * one level, at most once every "stepDownInterval" seconds (default 10).
+ *
+ * Once the CPU utilisation is below 80% of its threshold, the temperature 5
+ * degrees below its threshold, and the QoS rate below 20% of its threshold
+ * for "recoveryTime" seconds (default 60), the controller steps up by one
+ * level. Between both bands, the level is kept.
+ */
+@interface VMPDegradationController : NSObject
+
+/// Current level. 0 is full quality, and n is the n-th step of the ladder.
+@property (atomic, readonly) NSUInteger level;
+
+@property (nonatomic, weak, nullable) id<VMPDegradationControllerDelegate> delegate;
+
++ (nullable instancetype)controllerWithPropertyList:(id)propertyList error:(NSError **)error;
+
+- (nullable instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error;
+
+/// Start sampling. The delegate must be set before.
+- (void)start;
+
+/**
+ * @brief Stop sampling
+ *
+ * Called automatically on deallocation.
+ */
+- (void)invalidate;
+
+/**
+ * @brief Current level, pressure, and recent transitions
+ *
+ * Example structure of the returned dictionary:
+ * @code
+ * {
+ *     "level": 1,
+ *     "numberOfLevels": 4, // Including full quality
+ *     "limits": {"bitrate": 1800}, // Empty at full quality
+ *     "cpu": 0.93,
+ *     "temperature": 81.5, // Only if the system has thermal zones
+ *     "qos": 0.5, // Messages per second
+ *     "numberOfTransitions": 3,
+ *     "transitions": [
+ *         {"time": "2024-06-01T12:00:00+0000", "from": 0, "to": 1,
+ *          "reason": "temperature 81.5 > 80.0"}
+ *     ]
+ * }
+ * @endcode
+ *
+ * At most the 20 most recent transitions are kept.
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,395 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdio.h>
+
+#import <dispatch/dispatch.h>
+
+#import "VMPDegradationController.h"
+#import "VMPErrors.h"
+#import "VMPJournal.h"
+
+static const NSTimeInterval kDefaultInterval = 2;
+static const NSTimeInterval kDefaultStepDownInterval = 10;
+static const NSTimeInterval kDefaultRecoveryTime = 60;
+static const double kDefaultCPUThreshold = 0.9;
+static const double kDefaultTemperatureThreshold = 80;
+static const double kDefaultQoSThreshold = 5;
+
+// Recovery band below the thresholds. The level is kept between the band and the threshold.
+static const double kCPURecoveryFactor = 0.8;
+static const double kTemperatureRecoveryMargin = 5;
+static const double kQoSRecoveryFactor = 0.2;
+
+static const NSUInteger kMaximumTransitions = 20;
+
+static NSString *const kThermalZoneDirectory = @"/sys/class/thermal";
+
+// Aggregated busy and total jiffies of all CPUs. Returns NO if /proc/stat is unavailable.
+static BOOL readCPUTimes(unsigned long long *busy, unsigned long long *total) {
+	unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
+	FILE *file;
+	int fields;
+
+	file = fopen("/proc/stat", "re");
+	if (!file) {
+		return NO;
+	}
+	user = nice = system = idle = iowait = irq = softirq = steal = 0;
+	fields = fscanf(file, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &user, &nice, &system,
+					&idle, &iowait, &irq, &softirq, &steal);
+	fclose(file);
+	if (fields < 4) {
+		return NO;
+	}
+
+	*busy = user + nice + system + irq + softirq + steal;
+	*total = *busy + idle + iowait;
+	return YES;
+}
+
+// Positive number of a key, or the default if the key is not present. -1 if invalid.
+static double positiveNumber(NSDictionary *propertyList, NSString *key, double defaultValue) {
+	id value = propertyList[key];
+
+	if (!value) {
+		return defaultValue;
+	}
+	if (![value isKindOfClass:[NSNumber class]] || [value doubleValue] <= 0) {
+		return -1;
+	}
+	return [value doubleValue];
+}
+
+@interface VMPDegradationController ()
+@property (atomic, readwrite) NSUInteger level;
+@end
+
+@implementation VMPDegradationController {
+	NSArray<NSDictionary *> *_ladder;
+	NSTimeInterval _interval;
+	NSTimeInterval _stepDownInterval;
+	NSTimeInterval _recoveryTime;
+	double _cpuThreshold;
+	double _temperatureThreshold;
+	double _qosThreshold;
+	NSArray<NSString *> *_thermalZones;
+
+	dispatch_queue_t _queue;
+	dispatch_source_t _timer;
+
+	// Only accessed on _queue
+	unsigned long long _lastBusy;
+	unsigned long long _lastTotal;
+	NSUInteger _lastQoSMessages;
+	NSTimeInterval _lastSample;
+	NSTimeInterval _lastStepDown;
+	// Start of the current period without pressure, or -1
+	NSTimeInterval _relaxedSince;
+
+	// Protected by @synchronized(self)
+	double _cpu;
+	double _temperature;
+	double _qos;
+	NSUInteger _numberOfTransitions;
+	NSMutableArray<NSDictionary *> *_transitions;
+}
+
++ (instancetype)controllerWithPropertyList:(id)propertyList error:(NSError **)error {
+	return [[VMPDegradationController alloc] initWithPropertyList:propertyList error:error];
+}
+
++ (NSDictionary *)_stepWithPropertyList:(id)propertyList error:(NSError **)error {
+	NSMutableDictionary *step;
+
+	if (![propertyList isKindOfClass:[NSDictionary class]] || [propertyList count] == 0) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"Every step of the 'ladder' must be a non-empty dictionary");
+		return nil;
+	}
+
+	step = [NSMutableDictionary dictionary];
+	for (NSString *key in @[ @"framerate", @"width", @"height", @"bitrate" ]) {
+		double value = positiveNumber(propertyList, key, 0);
+
+		if (value < 0 || value != (double) (NSUInteger) value) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'%@' of a step of the 'ladder' must be a positive integer", key);
+			return nil;
+		}
+		if (value > 0) {
+			step[key] = @((NSUInteger) value);
+		}
+	}
+
+	if (!step[@"width"] != !step[@"height"] || [step[@"width"] unsignedIntegerValue] % 2 != 0 ||
+		[step[@"height"] unsignedIntegerValue] % 2 != 0) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"A step of the 'ladder' needs an even 'width' and 'height'");
+		return nil;
+	}
+	if ([step count] != [propertyList count]) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"Unknown key in a step of the 'ladder'. Expected 'framerate', 'width', "
+					   @"'height', or 'bitrate'");
+		return nil;
+	}
+
+	return step;
+}
+
+- (instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error {
+	NSMutableArray<NSDictionary *> *ladder;
+	NSMutableArray<NSString *> *zones;
+	double interval, stepDownInterval, recoveryTime;
+	double cpuThreshold, temperatureThreshold, qosThreshold;
+
+	if (![propertyList isKindOfClass:[NSDictionary class]] ||
+		![propertyList[@"ladder"] isKindOfClass:[NSArray class]] ||
+		[propertyList[@"ladder"] count] == 0) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'degradation' must be a dictionary with a non-empty 'ladder'");
+		return nil;
+	}
+
+	ladder = [NSMutableArray array];
+	for (id plist in propertyList[@"ladder"]) {
+		NSDictionary *step = [VMPDegradationController _stepWithPropertyList:plist error:error];
+		if (!step) {
+			return nil;
+		}
+		[ladder addObject:step];
+	}
+
+	interval = positiveNumber(propertyList, @"interval", kDefaultInterval);
+	stepDownInterval = positiveNumber(propertyList, @"stepDownInterval", kDefaultStepDownInterval);
+	recoveryTime = positiveNumber(propertyList, @"recoveryTime", kDefaultRecoveryTime);
+	cpuThreshold = positiveNumber(propertyList, @"cpuThreshold", kDefaultCPUThreshold);
+	temperatureThreshold =
+		positiveNumber(propertyList, @"temperatureThreshold", kDefaultTemperatureThreshold);
+	qosThreshold = positiveNumber(propertyList, @"qosThreshold", kDefaultQoSThreshold);
+	if (interval < 0 || stepDownInterval < 0 || recoveryTime < 0 || cpuThreshold < 0 ||
+		cpuThreshold > 1 || temperatureThreshold < 0 || qosThreshold < 0) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"Intervals and thresholds of 'degradation' must be positive numbers, and "
+					   @"'cpuThreshold' at most 1");
+		return nil;
+	}
+
+	// Thermal zones do not change at runtime
+	zones = [NSMutableArray array];
+	for (NSString *name in
+		 [[NSFileManager defaultManager] contentsOfDirectoryAtPath:kThermalZoneDirectory
+															 error:NULL]) {
+		if ([name hasPrefix:@"thermal_zone"]) {
+			[zones addObject:[kThermalZoneDirectory
+								 stringByAppendingPathComponent:
+									 [name stringByAppendingPathComponent:@"temp"]]];
+		}
+	}
+
+	self = [super init];
+	if (self) {
+		_ladder = [ladder copy];
+		_interval = interval;
+		_stepDownInterval = stepDownInterval;
+		_recoveryTime = recoveryTime;
+		_cpuThreshold = cpuThreshold;
+		_temperatureThreshold = temperatureThreshold;
+		_qosThreshold = qosThreshold;
+		_thermalZones = [zones copy];
+		_queue = dispatch_queue_create("com.hugomelder.vmpserverd.degradation",
+									   DISPATCH_QUEUE_SERIAL);
+		_lastSample = -1;
+		_lastStepDown = -1;
+		_relaxedSince = -1;
+		_temperature = -1;
+		_transitions = [NSMutableArray array];
+
+		VMPInfo(@"Quality degradation with %lu steps, and %lu thermal zones",
+				(unsigned long) [_ladder count], (unsigned long) [_thermalZones count]);
+	}
+	return self;
+}
+
+- (void)start {
+	__weak VMPDegradationController *weakSelf = self;
+
+	@synchronized(self) {
+		if (_timer) {
+			return;
+		}
+
+		_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+		dispatch_source_set_timer(_timer, dispatch_time(DISPATCH_TIME_NOW, 0),
+								  (uint64_t) (_interval * NSEC_PER_SEC),
+								  (uint64_t) (_interval * NSEC_PER_SEC / 10));
+		dispatch_source_set_event_handler(_timer, ^{
+		  [weakSelf _sample];
+		});
+		dispatch_resume(_timer);
+	}
+}
+
+// Temperature of the hottest thermal zone in degrees Celsius, or -1
+- (double)_readTemperature {
+	double hottest = -1;
+
+	for (NSString *path in _thermalZones) {
+		long millidegrees;
+		FILE *file;
+
+		file = fopen([path fileSystemRepresentation], "re");
+		if (!file) {
+			continue;
+		}
+		if (fscanf(file, "%ld", &millidegrees) == 1) {
+			hottest = MAX(hottest, millidegrees / 1000.0);
+		}
+		fclose(file);
+	}
+
+	return hottest;
+}
+
+// Called on _queue
+- (void)_sample {
+	unsigned long long busy = 0, total = 0;
+	NSUInteger qosMessages;
+	NSTimeInterval now;
+	double cpu = 0, temperature, qos = 0;
+	NSString *reason = nil;
+	BOOL relaxed;
+
+	now = [[NSProcessInfo processInfo] systemUptime];
+	qosMessages = [[self delegate] numberOfQoSMessagesForDegradationController:self];
+	temperature = [self _readTemperature];
+
+	if (readCPUTimes(&busy, &total) && _lastSample >= 0 && total > _lastTotal) {
+		cpu = (double) (busy - _lastBusy) / (double) (total - _lastTotal);
+	}
+	if (_lastSample >= 0 && now > _lastSample) {
+		qos = (double) (qosMessages - MIN(qosMessages, _lastQoSMessages)) / (now - _lastSample);
+	}
+	_lastBusy = busy;
+	_lastTotal = total;
+	_lastQoSMessages = qosMessages;
+	if (_lastSample < 0) {
+		// Rates need two samples
+		_lastSample = now;
+		return;
+	}
+	_lastSample = now;
+
+	@synchronized(self) {
+		_cpu = cpu;
+		_temperature = temperature;
+		_qos = qos;
+	}
+
+	if (cpu > _cpuThreshold) {
+		reason = [NSString stringWithFormat:@"cpu %.2f > %.2f", cpu, _cpuThreshold];
+	} else if (temperature > _temperatureThreshold) {
+		reason = [NSString
+			stringWithFormat:@"temperature %.1f > %.1f", temperature, _temperatureThreshold];
+	} else if (qos > _qosThreshold) {
+		reason = [NSString stringWithFormat:@"qos %.1f/s > %.1f/s", qos, _qosThreshold];
+	}
+	relaxed = cpu < _cpuThreshold * kCPURecoveryFactor &&
+			  temperature < _temperatureThreshold - kTemperatureRecoveryMargin &&
+			  qos < _qosThreshold * kQoSRecoveryFactor;
+
+	if (reason) {
+		_relaxedSince = -1;
+		if ([self level] < [_ladder count] &&
+			(_lastStepDown < 0 || now - _lastStepDown >= _stepDownInterval)) {
+			_lastStepDown = now;
+			[self _changeToLevel:[self level] + 1 reason:reason];
+		}
+	} else if (!relaxed) {
+		_relaxedSince = -1;
+	} else if (_relaxedSince < 0) {
+		_relaxedSince = now;
+	} else if ([self level] > 0 && now - _relaxedSince >= _recoveryTime) {
+		// Another period without pressure is needed for the next step
+		_relaxedSince = now;
+		[self _changeToLevel:[self level] - 1
+					  reason:[NSString stringWithFormat:@"no pressure for %.0f seconds",
+														_recoveryTime]];
+	}
+}
+
+// Called on _queue
+- (void)_changeToLevel:(NSUInteger)level reason:(NSString *)reason {
+	NSUInteger previous;
+	NSDictionary *limits, *transition;
+
+	previous = [self level];
+	limits = level > 0 ? _ladder[level - 1] : nil;
+	transition = @{
+		@"time" : [[[NSISO8601DateFormatter alloc] init] stringFromDate:[NSDate date]],
+		@"from" : @(previous),
+		@"to" : @(level),
+		@"reason" : reason,
+	};
+
+	if (level > previous) {
+		VMPWarn(@"Degrading quality from level %lu to %lu (%@): %@", (unsigned long) previous,
+				(unsigned long) level, reason, limits);
+	} else {
+		VMPInfo(@"Restoring quality from level %lu to %lu (%@)", (unsigned long) previous,
+				(unsigned long) level, reason);
+	}
+
+	[self setLevel:level];
+	@synchronized(self) {
+		_numberOfTransitions++;
+		[_transitions addObject:transition];
+		if ([_transitions count] > kMaximumTransitions) {
+			[_transitions removeObjectAtIndex:0];
+		}
+	}
+
+	[[self delegate] degradationController:self didChangeLimits:limits];
+}
+
+- (void)invalidate {
+	@synchronized(self) {
+		if (_timer) {
+			dispatch_source_cancel(_timer);
+			_timer = nil;
+		}
+	}
+}
+
+- (NSDictionary *)statistics {
+	NSMutableDictionary *statistics;
+	NSUInteger level;
+
+	level = [self level];
+	@synchronized(self) {
+		statistics = [NSMutableDictionary dictionaryWithDictionary:@{
+			@"level" : @(level),
+			@"numberOfLevels" : @([_ladder count] + 1),
+			@"limits" : level > 0 ? _ladder[level - 1] : @{},
+			@"cpu" : @(_cpu),
+			@"qos" : @(_qos),
+			@"numberOfTransitions" : @(_numberOfTransitions),
+			@"transitions" : [_transitions copy],
+		}];
+		if (_temperature >= 0) {
+			statistics[@"temperature"] = @(_temperature);
+		}
+	}
+
+	return statistics;
+}
+
+- (void)dealloc {
+	[self invalidate];
+}
+
+@end
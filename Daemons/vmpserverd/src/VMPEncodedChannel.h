@@ -0,0 +1,86 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// H.264 byte-stream with access unit alignment
+extern NSString *const kVMPEncodingH264;
+/// Motion JPEG
+extern NSString *const kVMPEncodingMJPEG;
+
+/// Name of the appsink in the channel pipeline receiving the encoded stream
+extern NSString *const kVMPEncodedSinkName;
+/// Name of the valve in front of the decoder in the channel pipeline
+extern NSString *const kVMPDecodeValveName;
+/// Name prefix of appsrc elements consuming the encoded stream. Followed by the channel name.
+extern NSString *const kVMPEncodedSourcePrefix;
+
+/**
+ * @brief Distributes the encoded output of a passthrough channel
+ *
+ * Many cameras deliver H.264 or MJPEG. Instead of decoding and re-encoding
+ * the stream for every mountpoint, a passthrough channel pipeline splits the
+ * encoded stream with a tee:
+ *
+ * @li One branch ends in an appsink named kVMPEncodedSinkName. Samples are
+ * forwarded to every appsrc named kVMPEncodedSourcePrefix + channel name, e.g.
+ * in a mountpoint that only payloads the stream.
+ * @li The other branch decodes the stream into an intervideosink for consumers
+ * requiring raw frames (e.g. a compositor or a recording). A valve named
+ * kVMPDecodeValveName in front of the decoder is only opened while at least one
+ * raw consumer exists, so no decoding happens otherwise. Once opened, the
+ * valve requests a keyframe upstream and drops delta units until a keyframe
+ * passes.
+ *
+ * Consumers start with the next keyframe. Timestamps are translated from the
+ * running time of the channel pipeline to the running time of the consumer.
+ */
+@interface VMPEncodedChannel : NSObject
+
+@property (nonatomic, readonly) NSString *name;
+
+/// kVMPEncodingH264 or kVMPEncodingMJPEG
+@property (nonatomic, readonly) NSString *encoding;
+
++ (instancetype)channelWithName:(NSString *)name encoding:(NSString *)encoding;
+
+- (instancetype)initWithName:(NSString *)name encoding:(NSString *)encoding;
+
+/**
+ * @brief Connect to the appsink and valve of a channel pipeline
+ *
+ * Called for every pipeline created for the channel, including restarts.
+ */
+- (void)attachToChannelPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Forward the encoded stream to an appsrc
+ *
+ * The appsrc is configured as a live source. It is removed automatically
+ * when it is destroyed.
+ */
+- (void)addConsumer:(GstElement *)appsrc;
+
+/// Open the decoder valve. Calls must be balanced with releaseRawConsumer.
+- (void)retainRawConsumer;
+
+/// Close the decoder valve once the last raw consumer is gone
+- (void)releaseRawConsumer;
+
+/**
+ * @brief Consumer counts and forwarded samples
+ *
+ * @returns a dictionary with the keys "encoding", "consumers", "rawConsumers",
+ * "samples", and "keyframes"
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
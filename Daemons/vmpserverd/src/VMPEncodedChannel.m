@@ -0,0 +1,333 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <gst/app/app.h>
+#import <gst/video/video.h>
+
+#import "VMPEncodedChannel.h"
+#import "VMPJournal.h"
+
+NSString *const kVMPEncodingH264 = @"h264";
+NSString *const kVMPEncodingMJPEG = @"mjpeg";
+
+NSString *const kVMPEncodedSinkName = @"vmpencoded";
+NSString *const kVMPDecodeValveName = @"vmpdecode";
+NSString *const kVMPEncodedSourcePrefix = @"vmpencoded-";
+
+// Upper bound of data queued in a consumer that does not keep up
+static const guint64 kConsumerMaxBytes = 8 * 1024 * 1024;
+
+// An appsrc receiving the encoded stream
+@interface _VMPEncodedConsumer : NSObject
+// Only accessed from the streaming thread of the appsink
+@property (nonatomic) BOOL waitingForKeyframe;
+- (instancetype)initWithSource:(GstElement *)appsrc;
+// Transfer: FULL. NULL if the appsrc was destroyed.
+- (GstElement *)copySource;
+// Set the caps of the appsrc if they changed
+- (void)updateCaps:(GstCaps *)caps;
+@end
+
+@implementation _VMPEncodedConsumer {
+	GWeakRef _source;
+	GstCaps *_caps;
+}
+
+- (instancetype)initWithSource:(GstElement *)appsrc {
+	self = [super init];
+	if (self) {
+		g_weak_ref_init(&_source, appsrc);
+		_waitingForKeyframe = YES;
+	}
+	return self;
+}
+
+- (GstElement *)copySource {
+	return g_weak_ref_get(&_source);
+}
+
+- (void)updateCaps:(GstCaps *)caps {
+	GstElement *appsrc;
+
+	if (_caps && gst_caps_is_equal(_caps, caps)) {
+		return;
+	}
+	gst_caps_replace(&_caps, caps);
+
+	// Transfer: FULL
+	appsrc = [self copySource];
+	if (appsrc) {
+		gst_app_src_set_caps(GST_APP_SRC(appsrc), caps);
+		gst_object_unref(appsrc);
+	}
+}
+
+- (void)dealloc {
+	g_weak_ref_clear(&_source);
+	gst_caps_replace(&_caps, NULL);
+}
+
+@end
+
+@interface VMPEncodedChannel ()
+- (GstFlowReturn)_handleSample:(GstSample *)sample channelBaseTime:(GstClockTime)baseTime;
+@end
+
+// Called from the streaming thread of the appsink
+static GstFlowReturn new_sample_cb(GstAppSink *appsink, gpointer user_data) {
+	__unsafe_unretained VMPEncodedChannel *channel = (__bridge id) user_data;
+	GstSample *sample;
+	GstFlowReturn ret;
+
+	// Transfer: FULL
+	sample = gst_app_sink_pull_sample(appsink);
+	if (!sample) {
+		return GST_FLOW_EOS;
+	}
+
+	@autoreleasepool {
+		ret = [channel _handleSample:sample
+					 channelBaseTime:gst_element_get_base_time(GST_ELEMENT(appsink))];
+	}
+	gst_sample_unref(sample);
+
+	return ret;
+}
+
+// Called from the streaming thread of the valve. The decoder must start at a keyframe, so delta
+// units are dropped after the valve was opened until the next keyframe passes.
+static GstPadProbeReturn keyframe_probe_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+	GstBuffer *buffer;
+
+	// Transfer: NONE
+	buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+	if (buffer && GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+		return GST_PAD_PROBE_DROP;
+	}
+
+	return GST_PAD_PROBE_REMOVE;
+}
+
+static void release_channel_cb(gpointer user_data) {
+	// Balance the retain from attachToChannelPipeline:
+	(void) (__bridge_transfer VMPEncodedChannel *) user_data;
+}
+
+@implementation VMPEncodedChannel {
+	NSMutableArray<_VMPEncodedConsumer *> *_consumers;
+	NSUInteger _rawConsumers;
+	GWeakRef _valve;
+	NSUInteger _samples;
+	NSUInteger _keyframes;
+}
+
++ (instancetype)channelWithName:(NSString *)name encoding:(NSString *)encoding {
+	return [[VMPEncodedChannel alloc] initWithName:name encoding:encoding];
+}
+
+- (instancetype)initWithName:(NSString *)name encoding:(NSString *)encoding {
+	self = [super init];
+	if (self) {
+		_name = [name copy];
+		_encoding = [encoding copy];
+		_consumers = [NSMutableArray array];
+		g_weak_ref_init(&_valve, NULL);
+	}
+	return self;
+}
+
+- (void)attachToChannelPipeline:(GstElement *)pipeline {
+	GstElement *appsink, *valve;
+	GstAppSinkCallbacks callbacks = {0};
+
+	if (!GST_IS_BIN(pipeline)) {
+		return;
+	}
+
+	// Transfer: FULL
+	appsink = gst_bin_get_by_name(GST_BIN(pipeline), [kVMPEncodedSinkName UTF8String]);
+	if (!appsink || !GST_IS_APP_SINK(appsink)) {
+		VMPError(@"Passthrough channel %@ has no appsink named '%@'", _name, kVMPEncodedSinkName);
+		if (appsink) {
+			gst_object_unref(appsink);
+		}
+		return;
+	}
+
+	callbacks.new_sample = new_sample_cb;
+	gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &callbacks, (__bridge_retained void *) self,
+							   release_channel_cb);
+	gst_object_unref(appsink);
+
+	// Transfer: FULL
+	valve = gst_bin_get_by_name(GST_BIN(pipeline), [kVMPDecodeValveName UTF8String]);
+	g_weak_ref_set(&_valve, valve);
+	if (valve) {
+		[self _updateValve];
+		gst_object_unref(valve);
+	} else {
+		VMPWarn(@"Passthrough channel %@ has no valve named '%@'. Decoding always.", _name,
+				kVMPDecodeValveName);
+	}
+}
+
+- (void)addConsumer:(GstElement *)appsrc {
+	GObjectClass *klass;
+
+	VMP_ASSERT(GST_IS_APP_SRC(appsrc), @"Consumer must be an appsrc");
+
+	g_object_set(appsrc, "is-live", TRUE, "format", GST_FORMAT_TIME, "max-bytes",
+				 kConsumerMaxBytes, "block", FALSE, NULL);
+
+	// Drop the oldest data instead of new data (since GStreamer 1.20)
+	klass = G_OBJECT_GET_CLASS(appsrc);
+	if (g_object_class_find_property(klass, "leaky-type")) {
+		gst_util_set_object_arg(G_OBJECT(appsrc), "leaky-type", "downstream");
+	}
+
+	@synchronized(self) {
+		[_consumers addObject:[[_VMPEncodedConsumer alloc] initWithSource:appsrc]];
+	}
+
+	VMPInfo(@"Added consumer %s to passthrough channel %@", GST_OBJECT_NAME(appsrc), _name);
+}
+
+- (void)retainRawConsumer {
+	@synchronized(self) {
+		_rawConsumers++;
+		if (_rawConsumers == 1) {
+			VMPInfo(@"Enabling decoder of passthrough channel %@", _name);
+			[self _updateValve];
+		}
+	}
+}
+
+- (void)releaseRawConsumer {
+	@synchronized(self) {
+		VMP_ASSERT(_rawConsumers > 0, @"Unbalanced releaseRawConsumer");
+		_rawConsumers--;
+		if (_rawConsumers == 0) {
+			VMPInfo(@"Disabling decoder of passthrough channel %@", _name);
+			[self _updateValve];
+		}
+	}
+}
+
+- (void)_updateValve {
+	GstElement *valve;
+	GstPad *pad;
+	gboolean drop;
+
+	// Transfer: FULL
+	valve = g_weak_ref_get(&_valve);
+	if (!valve) {
+		return;
+	}
+
+	drop = _rawConsumers == 0;
+	if (!drop) {
+		// Hold back delta units until the next keyframe, and ask the camera for one, so the
+		// decoder does not output corrupted frames in the meantime
+		// Transfer: FULL
+		pad = gst_element_get_static_pad(valve, "src");
+		if (pad) {
+			gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, keyframe_probe_cb, NULL, NULL);
+			gst_pad_send_event(
+				pad, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+			gst_object_unref(pad);
+		}
+	}
+	g_object_set(valve, "drop", drop, NULL);
+	gst_object_unref(valve);
+}
+
+- (GstFlowReturn)_handleSample:(GstSample *)sample channelBaseTime:(GstClockTime)baseTime {
+	NSArray<_VMPEncodedConsumer *> *consumers;
+	GstBuffer *buffer;
+	GstCaps *caps;
+	BOOL keyframe;
+
+	// Transfer: NONE
+	buffer = gst_sample_get_buffer(sample);
+	caps = gst_sample_get_caps(sample);
+	if (!buffer || !caps) {
+		return GST_FLOW_OK;
+	}
+
+	keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+	@synchronized(self) {
+		_samples++;
+		if (keyframe) {
+			_keyframes++;
+		}
+		consumers = [_consumers copy];
+	}
+
+	for (_VMPEncodedConsumer *consumer in consumers) {
+		GstElement *appsrc;
+		GstBuffer *out;
+		GstClockTimeDiff offset;
+
+		// Transfer: FULL
+		appsrc = [consumer copySource];
+		if (!appsrc) {
+			@synchronized(self) {
+				[_consumers removeObject:consumer];
+			}
+			continue;
+		}
+
+		// Live consumers only have a base time once they are playing. Decoding
+		// must start at a keyframe.
+		if (GST_STATE(appsrc) != GST_STATE_PLAYING ||
+			([consumer waitingForKeyframe] && !keyframe)) {
+			[consumer setWaitingForKeyframe:YES];
+			gst_object_unref(appsrc);
+			continue;
+		}
+		[consumer setWaitingForKeyframe:NO];
+		[consumer updateCaps:caps];
+
+		// Translate from the running time of the channel to the running time of the consumer
+		offset = GST_CLOCK_DIFF(gst_element_get_base_time(appsrc), baseTime);
+
+		// Only copies the metadata. The memory is shared.
+		out = gst_buffer_copy(buffer);
+		if (GST_BUFFER_PTS_IS_VALID(out)) {
+			GstClockTimeDiff pts = (GstClockTimeDiff) GST_BUFFER_PTS(out) + offset;
+			GST_BUFFER_PTS(out) = (GstClockTime) MAX(pts, 0);
+		}
+		if (GST_BUFFER_DTS_IS_VALID(out)) {
+			GstClockTimeDiff dts = (GstClockTimeDiff) GST_BUFFER_DTS(out) + offset;
+			GST_BUFFER_DTS(out) = (GstClockTime) MAX(dts, 0);
+		}
+
+		// Transfer: FULL (buffer)
+		gst_app_src_push_buffer(GST_APP_SRC(appsrc), out);
+		gst_object_unref(appsrc);
+	}
+
+	return GST_FLOW_OK;
+}
+
+- (NSDictionary *)statistics {
+	@synchronized(self) {
+		return @{
+			@"encoding" : _encoding,
+			@"consumers" : @([_consumers count]),
+			@"rawConsumers" : @(_rawConsumers),
+			@"samples" : @(_samples),
+			@"keyframes" : @(_keyframes),
+		};
+	}
+}
+
+- (void)dealloc {
+	g_weak_ref_clear(&_valve);
+}
+
+@end
@@ -0,0 +1,155 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Bitrate of mountpoint encoders in kbit/s if not configured
+extern const NSUInteger kVMPEncoderDefaultBitrate;
+
+/**
+ * @brief Encoder parameters of a mountpoint
+ *
+ * Configured with the optional "encoder" property of a mountpoint:
+ *
+ * @code
+ * <key>encoder</key>
+ * <dict>
+ *     <key>bitrate</key>
+ *     <integer>4000</integer>
+ *     <key>rateControl</key>
+ *     <string>cbr</string>
+ *     <key>keyframeInterval</key>
+ *     <integer>60</integer>
+ *     <key>preset</key>
+ *     <string>veryfast</string>
+ *     <key>profile</key>
+ *     <string>main</string>
+ * </dict>
+ * @endcode
+ *
+ * All keys are optional. "bitrate" is in kbit/s, and substituted for {BITRATE}
+ * in the mountpoint template. "rateControl" is one of "cbr", "vbr", or "cqp".
+ * "keyframeInterval" is the maximum distance between keyframes in frames.
+ * "preset" is passed to the preset property of the encoder as is (e.g.
+ * "speed-preset" of x264enc, or "target-usage" of vah264enc). "profile" is
+ * enforced with a caps filter behind the encoder.
+ *
+ * The settings are applied to the video encoders of every constructed media.
+ * Bitrate and keyframe interval can be changed while the media is playing.
+ * Encoders that cannot change their keyframe interval while playing are asked
+ * for a keyframe once the interval elapsed without one.
+ */
+@interface VMPEncoderSettings : NSObject
+
+/// Bitrate in kbit/s
+@property (atomic, readonly) NSUInteger bitrate;
+
+/// Maximum distance between keyframes in frames, or 0 for the encoder default
+@property (atomic, readonly) NSUInteger keyframeInterval;
+
+/// "cbr", "vbr", "cqp", or nil for the encoder default
+@property (nonatomic, readonly, nullable) NSString *rateControl;
+
+/// Value of the preset property of the encoder, or nil
+@property (nonatomic, readonly, nullable) NSString *preset;
+
+/// Codec profile (e.g. "main"), or nil
+@property (nonatomic, readonly, nullable) NSString *profile;
+
+/**
+ * @brief Whether a videorate is inserted in front of each video encoder
+ *
+ * Frame rate limits require the filter. Defaults to NO, so media that are never
+ * degraded, or must not buffer an additional frame, are left untouched. Must be
+ * set before the settings are applied to a pipeline.
+ */
+@property (atomic) BOOL framerateLimitable;
+
+/**
+ * @brief Parse and validate the "encoder" property
+ *
+ * @param propertyList The "encoder" dictionary, or nil for the defaults
+ *
+ * @returns settings, or nil if the property list is invalid
+ */
++ (nullable instancetype)settingsWithPropertyList:(nullable id)propertyList
+											error:(NSError **)error;
+
+- (nullable instancetype)initWithPropertyList:(nullable id)propertyList error:(NSError **)error;
+
+/// Number of video encoders of a pipeline
++ (NSUInteger)numberOfEncodersInPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Configure all video encoders of a pipeline
+ *
+ * Must be called before the pipeline is set to PLAYING.
+ */
+- (void)applyToPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Change bitrate and keyframe interval
+ *
+ * @param bitrate The new bitrate in kbit/s, or 0 to keep the current one
+ * @param keyframeInterval The new keyframe interval in frames, or 0 to keep
+ * the current one
+ * @param pipeline The running media, or NULL if the settings only apply to
+ * the next media
+ *
+ * Fails without changing the settings if a video encoder of the pipeline
+ * cannot change its bitrate while playing.
+ *
+ * @returns YES if the settings were changed
+ */
+- (BOOL)updateBitrate:(NSUInteger)bitrate
+	 keyframeInterval:(NSUInteger)keyframeInterval
+			 pipeline:(nullable GstElement *)pipeline
+				error:(NSError **)error;
+
+/**
+ * @brief Temporary quality limits, or nil
+ *
+ * @see applyLimits:pipeline:
+ */
+@property (atomic, readonly, copy, nullable) NSDictionary *limits;
+
+/**
+ * @brief Temporarily lower the quality below the settings
+ *
+ * @param limits A dictionary with the optional keys "framerate" (frames per
+ * second), "width" and "height" (pixels), and "bitrate" (kbit/s), or nil to
+ * lift all limits
+ * @param pipeline The running media, or NULL
+ *
+ * The frame rate is lowered by a videorate in front of the encoder, which
+ * renegotiates the caps so the rate control of the encoder sees the lower frame
+ * rate. Frame rate limits are ignored unless framerateLimitable is set. The
+ * bitrate of the settings is capped. The resolution is only lowered if the
+ * size of the encoder input is determined by a scaler followed by a caps
+ * filter, and not e.g. by a compositor. The limits also apply to media
+ * constructed later on.
+ */
+- (void)applyLimits:(nullable NSDictionary *)limits pipeline:(nullable GstElement *)pipeline;
+
+/// The bitrate in kbit/s, capped by the bitrate limit if one is applied
+- (NSUInteger)effectiveBitrate;
+
+/**
+ * @brief Current settings
+ *
+ * @returns a dictionary with the keys "bitrate", "keyframeInterval",
+ * "forcedKeyframes", "droppedFrames", the configured keys of "rateControl",
+ * "preset", and "profile", and "limits" and "effectiveBitrate" while limits
+ * are applied
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
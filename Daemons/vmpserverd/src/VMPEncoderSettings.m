@@ -0,0 +1,781 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdatomic.h>
+
+#import <gst/video/video.h>
+
+#import "VMPEncoderSettings.h"
+#import "VMPErrors.h"
+#import "VMPGStreamerUtils.h"
+#import "VMPJournal.h"
+
+const NSUInteger kVMPEncoderDefaultBitrate = 2500;
+
+// Upper bound of the bitrate in kbit/s
+static const NSUInteger kMaximumBitrate = 100000;
+
+// Upper bound of the keyframe interval in frames
+static const NSUInteger kMaximumKeyframeInterval = 1000;
+
+// Properties of the supported encoders. NULL if the encoder has no equivalent. The last entry is
+// used for unknown encoders.
+static const struct {
+	const gchar *factory;
+	const gchar *bitrate;
+	// Bitrate unit of the encoder relative to kbit/s
+	guint bitrateScale;
+	const gchar *keyframeInterval;
+	const gchar *rateControl;
+	// Values of the rate control property for "cbr", "vbr", and "cqp"
+	const gchar *cbr;
+	const gchar *vbr;
+	const gchar *cqp;
+	const gchar *preset;
+} kEncoders[] = {
+	{"x264enc", "bitrate", 1, "key-int-max", "pass", "cbr", "qual", "quant", "speed-preset"},
+	{"vah264enc", "bitrate", 1, "key-int-max", "rate-control", "cbr", "vbr", "cqp", "target-usage"},
+	{"vah265enc", "bitrate", 1, "key-int-max", "rate-control", "cbr", "vbr", "cqp", "target-usage"},
+	{"nvh264enc", "bitrate", 1, "gop-size", "rc-mode", "cbr", "vbr", "constqp", "preset"},
+	// Jetson. The control-rate enum has no stable nicks.
+	{"nvv4l2h264enc", "bitrate", 1000, "iframeinterval", "control-rate", "1", "0", NULL,
+	 "preset-level"},
+	{NULL, "bitrate", 1, "key-int-max", NULL, NULL, NULL, NULL, NULL},
+};
+
+// Shared between the settings and the keyframe probes, which may outlive each other
+typedef struct {
+	gint refcount;
+	_Atomic guint keyframeInterval;
+	_Atomic guint forcedKeyframes;
+	_Atomic guint droppedFrames;
+} VMPEncoderState;
+
+// State of the keyframe probe of a single encoder
+typedef struct {
+	VMPEncoderState *shared;
+	// Frames since the last keyframe. Only accessed from the streaming thread.
+	guint frames;
+	gboolean requested;
+} VMPKeyframeProbe;
+
+static VMPEncoderState *encoderStateRef(VMPEncoderState *state) {
+	g_atomic_int_inc(&state->refcount);
+	return state;
+}
+
+static void encoderStateUnref(VMPEncoderState *state) {
+	if (g_atomic_int_dec_and_test(&state->refcount)) {
+		g_free(state);
+	}
+}
+
+static void keyframeProbeFree(gpointer data) {
+	VMPKeyframeProbe *probe = data;
+
+	encoderStateUnref(probe->shared);
+	g_free(probe);
+}
+
+static void encoderStateUnrefClosure(gpointer data, GClosure *closure) {
+	encoderStateUnref(data);
+}
+
+// Called from the streaming thread when the frame rate filter in front of an encoder dropped a
+// frame
+static void framerateFilterDropCallback(GObject *filter, GParamSpec *pspec, gpointer user_data) {
+	VMPEncoderState *state = user_data;
+
+	atomic_fetch_add_explicit(&state->droppedFrames, 1, memory_order_relaxed);
+}
+
+// Called from the streaming thread of the encoder. Requests a keyframe if the encoder did not
+// produce one within the keyframe interval.
+static GstPadProbeReturn keyframeProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											   gpointer user_data) {
+	VMPKeyframeProbe *probe = user_data;
+	GstBuffer *buffer;
+	guint interval;
+
+	buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+	if (!buffer || GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_HEADER)) {
+		return GST_PAD_PROBE_OK;
+	}
+
+	if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+		probe->frames = 0;
+		probe->requested = FALSE;
+		return GST_PAD_PROBE_OK;
+	}
+
+	probe->frames++;
+	interval = atomic_load_explicit(&probe->shared->keyframeInterval, memory_order_relaxed);
+	if (interval > 0 && probe->frames >= interval && !probe->requested) {
+		probe->requested = TRUE;
+		atomic_fetch_add(&probe->shared->forcedKeyframes, 1);
+		gst_pad_send_event(pad, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE,
+																			 TRUE, 0));
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+static BOOL isVideoEncoder(GstElement *element) {
+	GstElementFactory *factory;
+
+	// Transfer: NONE
+	factory = gst_element_get_factory(element);
+	return factory &&
+		   gst_element_factory_list_is_type(factory, GST_ELEMENT_FACTORY_TYPE_VIDEO_ENCODER);
+}
+
+static gsize encoderIndex(GstElement *element) {
+	const gchar *factoryName;
+	gsize i;
+
+	factoryName = VMPElementFactoryName(element);
+	for (i = 0; i < G_N_ELEMENTS(kEncoders) - 1; i++) {
+		if (factoryName && g_str_equal(factoryName, kEncoders[i].factory)) {
+			break;
+		}
+	}
+	return i;
+}
+
+// Deserialize value into a property of element. Properties the element does not have are skipped.
+static BOOL setProperty(GstElement *element, const gchar *_Nullable name, const gchar *value) {
+	GParamSpec *pspec;
+	GValue gvalue = G_VALUE_INIT;
+
+	if (!name) {
+		return NO;
+	}
+	pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(element), name);
+	if (!pspec) {
+		return NO;
+	}
+
+	g_value_init(&gvalue, G_PARAM_SPEC_VALUE_TYPE(pspec));
+	if (!gst_value_deserialize(&gvalue, value) || g_param_value_validate(pspec, &gvalue)) {
+		VMPWarn(@"Invalid value '%s' for property '%s' of encoder %s", value, name,
+				GST_OBJECT_NAME(element));
+		g_value_unset(&gvalue);
+		return NO;
+	}
+
+	g_object_set_property(G_OBJECT(element), name, &gvalue);
+	g_value_unset(&gvalue);
+	return YES;
+}
+
+// Whether the property can be changed while the element is playing
+static BOOL isMutableWhilePlaying(GstElement *element, const gchar *_Nullable name) {
+	GParamSpec *pspec;
+
+	if (!name) {
+		return NO;
+	}
+	pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(element), name);
+	return pspec && (pspec->flags & GST_PARAM_MUTABLE_PLAYING);
+}
+
+static BOOL isScaler(GstElement *element) {
+	return VMPElementHasClassification(element, "Video/Scaler");
+}
+
+// Marks the frame rate filters inserted in front of encoders
+static const gchar *const kFramerateFilterKey = "vmp-framerate-filter";
+
+// Transfer: FULL. The element linked to the sink pad of element, or NULL.
+static GstElement *copyUpstreamElement(GstElement *element) {
+	GstPad *pad, *peer;
+	GstElement *upstream;
+
+	// Transfer: FULL
+	pad = gst_element_get_static_pad(element, "sink");
+	if (!pad) {
+		return NULL;
+	}
+	// Transfer: FULL
+	peer = gst_pad_get_peer(pad);
+	gst_object_unref(pad);
+	if (!peer) {
+		return NULL;
+	}
+	upstream = gst_pad_get_parent_element(peer);
+	gst_object_unref(peer);
+	return upstream;
+}
+
+// Transfer: FULL. The caps filter of a scaler in front of the encoder, or NULL if the output size
+// is not determined by a scaler (e.g. by a compositor).
+static GstElement *copyScalingFilter(GstElement *encoder) {
+	GstElement *element;
+
+	// Transfer: FULL
+	element = copyUpstreamElement(encoder);
+	// Skip elements like queues, which have a single sink pad
+	for (int hops = 0; element && hops < 4; hops++) {
+		const gchar *factoryName = VMPElementFactoryName(element);
+		GstElement *upstream;
+
+		// Transfer: FULL
+		upstream = copyUpstreamElement(element);
+		if (factoryName && g_str_equal(factoryName, "capsfilter")) {
+			BOOL scaled = upstream && isScaler(upstream);
+
+			if (upstream) {
+				gst_object_unref(upstream);
+			}
+			if (scaled) {
+				return element;
+			}
+			break;
+		}
+		gst_object_unref(element);
+		element = upstream;
+	}
+
+	if (element) {
+		gst_object_unref(element);
+	}
+	return NULL;
+}
+
+// Lower the output size of the scaler in front of the encoder, or restore the original size
+static void limitResolution(GstElement *encoder, NSUInteger width, NSUInteger height) {
+	static const gchar *const kOriginalCapsKey = "vmp-original-caps";
+	GstElement *filter;
+	GstCaps *original, *caps, *current = NULL;
+	GstStructure *structure;
+	gint originalWidth = 0, originalHeight = 0;
+
+	// Transfer: FULL
+	filter = copyScalingFilter(encoder);
+	if (!filter) {
+		if (width > 0) {
+			VMPDebug(@"Resolution of encoder %s is not determined by a scaler",
+					 GST_OBJECT_NAME(encoder));
+		}
+		return;
+	}
+
+	// Transfer: NONE
+	original = g_object_get_data(G_OBJECT(filter), kOriginalCapsKey);
+	if (!original) {
+		// Transfer: FULL
+		g_object_get(filter, "caps", &original, NULL);
+		if (!original) {
+			gst_object_unref(filter);
+			return;
+		}
+		g_object_set_data_full(G_OBJECT(filter), kOriginalCapsKey, original,
+							   (GDestroyNotify) gst_caps_unref);
+	}
+
+	caps = gst_caps_copy(original);
+	if (width > 0 && gst_caps_get_size(caps) > 0) {
+		// Transfer: NONE
+		structure = gst_caps_get_structure(caps, 0);
+		if (gst_structure_get_int(structure, "width", &originalWidth) &&
+			gst_structure_get_int(structure, "height", &originalHeight) &&
+			(NSUInteger) originalWidth > width) {
+			gst_structure_set(structure, "width", G_TYPE_INT, (gint) width, "height", G_TYPE_INT,
+							  (gint) height, NULL);
+		}
+	}
+
+	// Only renegotiate if the caps changed
+	// Transfer: FULL
+	g_object_get(filter, "caps", &current, NULL);
+	if (!current || !gst_caps_is_equal(current, caps)) {
+		g_object_set(filter, "caps", caps, NULL);
+	}
+	if (current) {
+		gst_caps_unref(current);
+	}
+
+	gst_caps_unref(caps);
+	gst_object_unref(filter);
+}
+
+// Transfer: FULL. The frame rate filter in front of the encoder, or NULL.
+static GstElement *copyFramerateFilter(GstElement *encoder) {
+	GstElement *element;
+
+	// Transfer: FULL
+	element = copyUpstreamElement(encoder);
+	if (element && !g_object_get_data(G_OBJECT(element), kFramerateFilterKey)) {
+		gst_object_unref(element);
+		return NULL;
+	}
+	return element;
+}
+
+// Lower the frame rate in front of the encoder, or restore the original frame rate. The caps are
+// renegotiated, so the rate control of the encoder sees the frame rate it is fed with.
+static void limitFramerate(GstElement *encoder, NSUInteger framerate) {
+	GstElement *filter;
+	gint current;
+
+	// Transfer: FULL
+	filter = copyFramerateFilter(encoder);
+	if (!filter) {
+		return;
+	}
+
+	// Only renegotiate if the limit changed
+	g_object_get(filter, "max-rate", &current, NULL);
+	if (framerate == 0 || framerate > G_MAXINT) {
+		framerate = G_MAXINT;
+	}
+	if ((NSUInteger) current != framerate) {
+		g_object_set(filter, "max-rate", (gint) framerate, NULL);
+	}
+
+	gst_object_unref(filter);
+}
+
+static NSString *bitrateValue(gsize index, NSUInteger bitrate) {
+	return [NSString
+		stringWithFormat:@"%lu", (unsigned long) (bitrate * kEncoders[index].bitrateScale)];
+}
+
+@interface VMPEncoderSettings ()
+@property (atomic, readwrite) NSUInteger bitrate;
+@property (atomic, readwrite) NSUInteger keyframeInterval;
+@property (atomic, readwrite, copy, nullable) NSDictionary *limits;
+@end
+
+@implementation VMPEncoderSettings {
+	VMPEncoderState *_state;
+}
+
++ (instancetype)settingsWithPropertyList:(id)propertyList error:(NSError **)error {
+	return [[VMPEncoderSettings alloc] initWithPropertyList:propertyList error:error];
+}
+
+- (instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error {
+	NSUInteger bitrate, keyframeInterval;
+	NSString *rateControl = nil, *preset = nil, *profile = nil;
+	id value;
+
+	bitrate = kVMPEncoderDefaultBitrate;
+	keyframeInterval = 0;
+	if (propertyList && ![propertyList isKindOfClass:[NSDictionary class]]) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError, @"'encoder' must be a dictionary");
+		return nil;
+	}
+
+	value = propertyList[@"bitrate"];
+	if (value) {
+		if (![value isKindOfClass:[NSNumber class]] || [value integerValue] <= 0 ||
+			[value unsignedIntegerValue] > kMaximumBitrate) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'bitrate' in 'encoder' must be between 1 and %lu kbit/s",
+						   (unsigned long) kMaximumBitrate);
+			return nil;
+		}
+		bitrate = [value unsignedIntegerValue];
+	}
+
+	value = propertyList[@"keyframeInterval"];
+	if (value) {
+		if (![value isKindOfClass:[NSNumber class]] || [value integerValue] <= 0 ||
+			[value unsignedIntegerValue] > kMaximumKeyframeInterval) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'keyframeInterval' in 'encoder' must be between 1 and %lu frames",
+						   (unsigned long) kMaximumKeyframeInterval);
+			return nil;
+		}
+		keyframeInterval = [value unsignedIntegerValue];
+	}
+
+	rateControl = propertyList[@"rateControl"];
+	if (rateControl && ![@[ @"cbr", @"vbr", @"cqp" ] containsObject:rateControl]) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'rateControl' in 'encoder' must be 'cbr', 'vbr', or 'cqp'");
+		return nil;
+	}
+
+	// target-usage of VA encoders is an integer
+	value = propertyList[@"preset"];
+	if ([value isKindOfClass:[NSNumber class]]) {
+		preset = [value stringValue];
+	} else if (value) {
+		if (![value isKindOfClass:[NSString class]] || [value length] == 0) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'preset' in 'encoder' must be a string or a number");
+			return nil;
+		}
+		preset = value;
+	}
+
+	// The profile is a value in a caps string
+	profile = propertyList[@"profile"];
+	if (profile &&
+		(![profile isKindOfClass:[NSString class]] || [profile length] == 0 ||
+		 [profile rangeOfCharacterFromSet:[[NSCharacterSet characterSetWithCharactersInString:
+													  @"abcdefghijklmnopqrstuvwxyz0123456789-"]
+											  invertedSet]]
+				 .location != NSNotFound)) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'profile' in 'encoder' must be a codec profile (e.g. 'main')");
+		return nil;
+	}
+
+	self = [super init];
+	if (self) {
+		_bitrate = bitrate;
+		_keyframeInterval = keyframeInterval;
+		_rateControl = [rateControl copy];
+		_preset = [preset copy];
+		_profile = [profile copy];
+		_state = g_new0(VMPEncoderState, 1);
+		_state->refcount = 1;
+		atomic_init(&_state->keyframeInterval, (guint) keyframeInterval);
+		atomic_init(&_state->forcedKeyframes, 0);
+		atomic_init(&_state->droppedFrames, 0);
+	}
+	return self;
+}
+
+- (NSUInteger)effectiveBitrate {
+	NSUInteger bitrate, limit;
+
+	bitrate = [self bitrate];
+	limit = [[self limits][@"bitrate"] unsignedIntegerValue];
+	return limit > 0 ? MIN(bitrate, limit) : bitrate;
+}
+
+// Encoders of a pipeline. Transfer: FULL for every element.
+- (NSArray<NSValue *> *)_copyEncodersOfPipeline:(GstElement *)pipeline {
+	NSMutableArray<NSValue *> *encoders;
+
+	encoders = [NSMutableArray array];
+	if (!GST_IS_BIN(pipeline)) {
+		return encoders;
+	}
+
+	// The iterator may return an element twice after a resync
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+	  NSValue *value = [NSValue valueWithPointer:element];
+
+	  if (isVideoEncoder(element) && ![encoders containsObject:value]) {
+		  gst_object_ref(element);
+		  [encoders addObject:value];
+	  }
+	});
+	return encoders;
+}
+
++ (NSUInteger)numberOfEncodersInPipeline:(GstElement *)pipeline {
+	NSMutableSet<NSValue *> *encoders;
+
+	encoders = [NSMutableSet set];
+	if (!GST_IS_BIN(pipeline)) {
+		return 0;
+	}
+
+	// The iterator may return an element twice after a resync
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+	  if (isVideoEncoder(element)) {
+		  [encoders addObject:[NSValue valueWithPointer:element]];
+	  }
+	});
+	return [encoders count];
+}
+
+- (void)_insertProfileFilterBehindEncoder:(GstElement *)encoder {
+	GstPad *srcpad, *peer, *filterpad;
+	GstCaps *templateCaps, *caps;
+	GstElement *filter, *parent;
+
+	// Transfer: FULL
+	srcpad = gst_element_get_static_pad(encoder, "src");
+	if (!srcpad) {
+		return;
+	}
+	// Transfer: FULL
+	peer = gst_pad_get_peer(srcpad);
+	templateCaps = gst_pad_get_pad_template_caps(srcpad);
+	parent = GST_ELEMENT(gst_element_get_parent(encoder));
+	if (!peer || !parent || gst_caps_is_empty(templateCaps)) {
+		VMPWarn(@"Profile '%@' is not enforced for encoder %s", _profile,
+				GST_OBJECT_NAME(encoder));
+		goto out;
+	}
+
+	caps = gst_caps_new_simple(gst_structure_get_name(gst_caps_get_structure(templateCaps, 0)),
+							   "profile", G_TYPE_STRING, [_profile UTF8String], NULL);
+	filter = gst_element_factory_make("capsfilter", NULL);
+	g_object_set(filter, "caps", caps, NULL);
+	gst_caps_unref(caps);
+
+	gst_bin_add(GST_BIN(parent), filter);
+	gst_pad_unlink(srcpad, peer);
+	// Transfer: FULL
+	filterpad = gst_element_get_static_pad(filter, "src");
+	if (!gst_element_link(encoder, filter) || gst_pad_link(filterpad, peer) != GST_PAD_LINK_OK) {
+		VMPError(@"Failed to insert profile filter behind encoder %s", GST_OBJECT_NAME(encoder));
+	}
+	gst_object_unref(filterpad);
+
+out:
+	if (peer) {
+		gst_object_unref(peer);
+	}
+	if (parent) {
+		gst_object_unref(parent);
+	}
+	gst_caps_unref(templateCaps);
+	gst_object_unref(srcpad);
+}
+
+// Insert a videorate in front of the encoder. Its maximum rate is lowered by frame rate limits.
+- (void)_insertFramerateFilterInFrontOfEncoder:(GstElement *)encoder {
+	GstPad *sinkpad, *peer, *filterpad;
+	GstElement *filter, *parent;
+
+	// Transfer: FULL
+	sinkpad = gst_element_get_static_pad(encoder, "sink");
+	if (!sinkpad) {
+		return;
+	}
+	// Transfer: FULL
+	peer = gst_pad_get_peer(sinkpad);
+	parent = GST_ELEMENT(gst_element_get_parent(encoder));
+	filter = gst_element_factory_make("videorate", NULL);
+	if (!peer || !parent || !filter) {
+		VMPWarn(@"Frame rate limits are not applied to encoder %s", GST_OBJECT_NAME(encoder));
+		if (filter) {
+			gst_object_unref(filter);
+		}
+		goto out;
+	}
+
+	// Never duplicate frames. Drops are notified to count them.
+	g_object_set(filter, "drop-only", TRUE, "silent", FALSE, NULL);
+	g_object_set_data(G_OBJECT(filter), kFramerateFilterKey, GINT_TO_POINTER(TRUE));
+	g_signal_connect_data(filter, "notify::drop", G_CALLBACK(framerateFilterDropCallback),
+						  encoderStateRef(_state), encoderStateUnrefClosure, 0);
+
+	gst_bin_add(GST_BIN(parent), filter);
+	gst_pad_unlink(peer, sinkpad);
+	// Transfer: FULL
+	filterpad = gst_element_get_static_pad(filter, "sink");
+	if (gst_pad_link(peer, filterpad) != GST_PAD_LINK_OK || !gst_element_link(filter, encoder)) {
+		VMPError(@"Failed to insert frame rate filter in front of encoder %s",
+				 GST_OBJECT_NAME(encoder));
+	}
+	gst_object_unref(filterpad);
+
+out:
+	if (peer) {
+		gst_object_unref(peer);
+	}
+	if (parent) {
+		gst_object_unref(parent);
+	}
+	gst_object_unref(sinkpad);
+}
+
+- (void)applyToPipeline:(GstElement *)pipeline {
+	NSArray<NSValue *> *encoders;
+	NSDictionary *limits;
+	NSUInteger bitrate, keyframeInterval;
+
+	bitrate = [self effectiveBitrate];
+	keyframeInterval = [self keyframeInterval];
+	limits = [self limits];
+	encoders = [self _copyEncodersOfPipeline:pipeline];
+	for (NSValue *value in encoders) {
+		GstElement *encoder = [value pointerValue];
+		gsize index = encoderIndex(encoder);
+		VMPKeyframeProbe *probe;
+		GstPad *pad;
+
+		setProperty(encoder, kEncoders[index].bitrate, [bitrateValue(index, bitrate) UTF8String]);
+		if (keyframeInterval > 0) {
+			setProperty(encoder, kEncoders[index].keyframeInterval,
+						[[NSString stringWithFormat:@"%lu", (unsigned long) keyframeInterval]
+							UTF8String]);
+		}
+		if (_rateControl) {
+			const gchar *mode;
+
+			if ([_rateControl isEqualToString:@"cbr"]) {
+				mode = kEncoders[index].cbr;
+			} else if ([_rateControl isEqualToString:@"vbr"]) {
+				mode = kEncoders[index].vbr;
+			} else {
+				mode = kEncoders[index].cqp;
+			}
+			if (!mode || !setProperty(encoder, kEncoders[index].rateControl, mode)) {
+				VMPWarn(@"Rate control '%@' is not supported by encoder %s", _rateControl,
+						GST_OBJECT_NAME(encoder));
+			}
+		}
+		if (_preset && !setProperty(encoder, kEncoders[index].preset, [_preset UTF8String])) {
+			VMPWarn(@"Preset '%@' is not supported by encoder %s", _preset,
+					GST_OBJECT_NAME(encoder));
+		}
+		if (_profile) {
+			[self _insertProfileFilterBehindEncoder:encoder];
+		}
+
+		// Keyframe requests for interval changes the encoder cannot apply while playing
+		// Transfer: FULL
+		pad = gst_element_get_static_pad(encoder, "src");
+		if (pad) {
+			probe = g_new0(VMPKeyframeProbe, 1);
+			probe->shared = encoderStateRef(_state);
+			gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, keyframeProbeCallback, probe,
+							  keyframeProbeFree);
+			gst_object_unref(pad);
+		}
+
+		// Frame rate limit
+		if ([self framerateLimitable]) {
+			[self _insertFramerateFilterInFrontOfEncoder:encoder];
+			limitFramerate(encoder, [limits[@"framerate"] unsignedIntegerValue]);
+		}
+		if (limits[@"width"]) {
+			limitResolution(encoder, [limits[@"width"] unsignedIntegerValue],
+							[limits[@"height"] unsignedIntegerValue]);
+		}
+
+		gst_object_unref(encoder);
+	}
+
+	VMPInfo(@"Configured %lu encoders of pipeline %s with %lu kbit/s",
+			(unsigned long) [encoders count], GST_OBJECT_NAME(pipeline), (unsigned long) bitrate);
+}
+
+- (BOOL)updateBitrate:(NSUInteger)bitrate
+	 keyframeInterval:(NSUInteger)keyframeInterval
+			 pipeline:(GstElement *)pipeline
+				error:(NSError **)error {
+	NSArray<NSValue *> *encoders;
+	BOOL supported = YES;
+
+	if (bitrate > kMaximumBitrate || keyframeInterval > kMaximumKeyframeInterval) {
+		VMP_FAST_ERROR(error, VMPErrorCodeEncoderError,
+					   @"Bitrate must be at most %lu kbit/s, and the keyframe interval at most "
+					   @"%lu frames",
+					   (unsigned long) kMaximumBitrate, (unsigned long) kMaximumKeyframeInterval);
+		return NO;
+	}
+
+	encoders = pipeline ? [self _copyEncodersOfPipeline:pipeline] : @[];
+	for (NSValue *value in encoders) {
+		GstElement *encoder = [value pointerValue];
+
+		if (bitrate > 0 &&
+			!isMutableWhilePlaying(encoder, kEncoders[encoderIndex(encoder)].bitrate)) {
+			VMP_FAST_ERROR(error, VMPErrorCodeEncoderError,
+						   @"Encoder %s cannot change its bitrate while playing",
+						   GST_OBJECT_NAME(encoder));
+			supported = NO;
+			break;
+		}
+	}
+
+	for (NSValue *value in encoders) {
+		GstElement *encoder = [value pointerValue];
+		gsize index = encoderIndex(encoder);
+
+		if (supported && bitrate > 0) {
+			NSUInteger limit = [[self limits][@"bitrate"] unsignedIntegerValue];
+
+			setProperty(encoder, kEncoders[index].bitrate,
+						[bitrateValue(index, limit > 0 ? MIN(bitrate, limit) : bitrate)
+							UTF8String]);
+		}
+		// Otherwise, keyframes are requested by the probe
+		if (supported && keyframeInterval > 0 &&
+			isMutableWhilePlaying(encoder, kEncoders[index].keyframeInterval)) {
+			setProperty(encoder, kEncoders[index].keyframeInterval,
+						[[NSString stringWithFormat:@"%lu", (unsigned long) keyframeInterval]
+							UTF8String]);
+		}
+		gst_object_unref(encoder);
+	}
+	if (!supported) {
+		return NO;
+	}
+
+	if (bitrate > 0) {
+		[self setBitrate:bitrate];
+	}
+	if (keyframeInterval > 0) {
+		[self setKeyframeInterval:keyframeInterval];
+		atomic_store(&_state->keyframeInterval, (guint) keyframeInterval);
+	}
+
+	VMPInfo(@"Encoder settings changed to %lu kbit/s and a keyframe interval of %lu frames",
+			(unsigned long) [self bitrate], (unsigned long) [self keyframeInterval]);
+	return YES;
+}
+
+- (void)applyLimits:(NSDictionary *)limits pipeline:(GstElement *)pipeline {
+	NSArray<NSValue *> *encoders;
+	NSUInteger bitrate;
+
+	[self setLimits:[limits count] > 0 ? limits : nil];
+
+	bitrate = [self effectiveBitrate];
+	encoders = pipeline ? [self _copyEncodersOfPipeline:pipeline] : @[];
+	for (NSValue *value in encoders) {
+		GstElement *encoder = [value pointerValue];
+		gsize index = encoderIndex(encoder);
+
+		if (isMutableWhilePlaying(encoder, kEncoders[index].bitrate)) {
+			setProperty(encoder, kEncoders[index].bitrate,
+						[bitrateValue(index, bitrate) UTF8String]);
+		} else {
+			VMPWarn(@"Encoder %s cannot change its bitrate while playing",
+					GST_OBJECT_NAME(encoder));
+		}
+		limitFramerate(encoder, [limits[@"framerate"] unsignedIntegerValue]);
+		limitResolution(encoder, [limits[@"width"] unsignedIntegerValue],
+						[limits[@"height"] unsignedIntegerValue]);
+		gst_object_unref(encoder);
+	}
+}
+
+- (NSDictionary *)statistics {
+	NSMutableDictionary *statistics;
+	NSDictionary *limits;
+
+	statistics = [NSMutableDictionary dictionaryWithDictionary:@{
+		@"bitrate" : @([self bitrate]),
+		@"keyframeInterval" : @([self keyframeInterval]),
+		@"forcedKeyframes" : @(atomic_load(&_state->forcedKeyframes)),
+		@"droppedFrames" : @(atomic_load(&_state->droppedFrames)),
+	}];
+	limits = [self limits];
+	if (limits) {
+		statistics[@"limits"] = limits;
+		statistics[@"effectiveBitrate"] = @([self effectiveBitrate]);
+	}
+	if (_rateControl) {
+		statistics[@"rateControl"] = _rateControl;
+	}
+	if (_preset) {
+		statistics[@"preset"] = _preset;
+	}
+	if (_profile) {
+		statistics[@"profile"] = _profile;
+	}
+	return statistics;
+}
+
+- (void)dealloc {
+	encoderStateUnref(_state);
+}
+
+@end
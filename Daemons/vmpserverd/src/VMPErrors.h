@@ -43,5 +43,9 @@ typedef NS_ENUM(NSInteger, VMPErrorCode) {
 	/// Property list parsing error.
 	VMPErrorCodePropertyListError = 11,
 	/// Error originating from Graphviz libraries
-	VMPErrorCodeGraphvizError = 12
+	VMPErrorCodeGraphvizError = 12,
+	/// Profiling session error. Used in VMPRTSPServer.
+	VMPErrorCodeProfilerError = 13,
+	/// Encoder parameter error. Used in VMPEncoderSettings.
+	VMPErrorCodeEncoderError = 14
 };
\ No newline at end of file
@@ -0,0 +1,92 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Number of events retained per timeline
+extern const NSUInteger kVMPEventTimelineCapacity;
+
+/// State change of the top-level pipeline
+extern NSString *const kVMPEventTypeStateChanged;
+extern NSString *const kVMPEventTypeError;
+extern NSString *const kVMPEventTypeWarning;
+extern NSString *const kVMPEventTypeEOS;
+/// Summary of the QoS messages received in the last second
+extern NSString *const kVMPEventTypeQoS;
+/// Buffer flow stall reported by the watchdog. @see VMPFlowWatchdog
+extern NSString *const kVMPEventTypeStall;
+extern NSString *const kVMPEventTypeRestart;
+
+/**
+ * @brief Bounded history of the bus events of a channel
+ *
+ * The timeline keeps the most recent kVMPEventTimelineCapacity events in a ring
+ * buffer, so its memory usage is constant. Every event is assigned a sequence
+ * number, which is used as a cursor for pagination.
+ *
+ * State changes of elements other than the top-level pipeline are not
+ * recorded. QoS messages are aggregated into at most one event per second.
+ *
+ * All pipelines of a channel, including those created by restarts, share one
+ * timeline.
+ */
+@interface VMPEventTimeline : NSObject
+
+/**
+ * @brief Record a bus message
+ *
+ * Messages of unrelated types are ignored.
+ *
+ * @param message The bus message
+ * @param pipeline The top-level pipeline the bus belongs to
+ */
+- (void)recordBusMessage:(GstMessage *)message pipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Record an event that did not originate from the bus
+ *
+ * @param type The event type (e.g. kVMPEventTypeRestart)
+ * @param source Name of the element or component, or nil
+ * @param message A human-readable description
+ */
+- (void)recordEventWithType:(NSString *)type
+					 source:(nullable NSString *)source
+					message:(NSString *)message;
+
+/**
+ * @brief Events recorded after a cursor, oldest first
+ *
+ * @param cursor Sequence number of the last event seen by the client, or 0 to
+ * start with the oldest retained event
+ * @param limit Maximum number of events to return
+ *
+ * Example structure of the returned dictionary:
+ * @code
+ * {
+ *     "events": [
+ *         {
+ *             "cursor": 42,
+ *             "timestamp": 1043511.25, // Monotonic time in seconds
+ *             "type": "error",
+ *             "source": "v4l2src0",
+ *             "message": "Could not read from resource."
+ *         }
+ *     ],
+ *     "cursor": 42, // Pass as cursor to continue
+ *     "more": false, // Whether more events are available after this page
+ *     "missed": 0, // Events after the cursor that were already overwritten
+ *     "now": 1043519.5 // Current monotonic time in seconds
+ * }
+ * @endcode
+ */
+- (NSDictionary *)eventsAfterCursor:(NSUInteger)cursor limit:(NSUInteger)limit;
+
+@end
+
+NS_ASSUME_NONNULL_END
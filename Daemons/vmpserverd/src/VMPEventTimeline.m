@@ -0,0 +1,231 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import "VMPEventTimeline.h"
+#import "VMPFlowWatchdog.h"
+
+const NSUInteger kVMPEventTimelineCapacity = 256;
+
+NSString *const kVMPEventTypeStateChanged = @"state-changed";
+NSString *const kVMPEventTypeError = @"error";
+NSString *const kVMPEventTypeWarning = @"warning";
+NSString *const kVMPEventTypeEOS = @"eos";
+NSString *const kVMPEventTypeQoS = @"qos";
+NSString *const kVMPEventTypeStall = @"stall";
+NSString *const kVMPEventTypeRestart = @"restart";
+
+// Minimum time between two QoS summaries in microseconds
+static const gint64 kQoSSummaryInterval = G_USEC_PER_SEC;
+
+@implementation VMPEventTimeline {
+	// Ring buffer. The event with sequence number n is stored at (n - 1) % capacity.
+	NSMutableArray<NSDictionary *> *_ring;
+	// Sequence number of the next event. Starts at 1, so 0 is a valid initial cursor.
+	NSUInteger _nextSequence;
+
+	// Latest QoS statistics per element since the last summary
+	NSMutableDictionary<NSString *, NSArray<NSNumber *> *> *_qos;
+	NSUInteger _pendingQoSMessages;
+	gint64 _lastQoSSummary;
+}
+
+- (instancetype)init {
+	self = [super init];
+	if (self) {
+		_ring = [NSMutableArray arrayWithCapacity:kVMPEventTimelineCapacity];
+		_nextSequence = 1;
+		_qos = [NSMutableDictionary dictionary];
+	}
+	return self;
+}
+
+// Must be called with the lock held
+- (void)_appendEventWithType:(NSString *)type
+					  source:(NSString *)source
+					 message:(NSString *)message
+				   timestamp:(gint64)timestamp {
+	NSMutableDictionary *event;
+	NSUInteger sequence;
+
+	sequence = _nextSequence++;
+	event = [NSMutableDictionary dictionaryWithDictionary:@{
+		@"cursor" : @(sequence),
+		@"timestamp" : @((double) timestamp / G_USEC_PER_SEC),
+		@"type" : type,
+		@"message" : message,
+	}];
+	if (source) {
+		event[@"source"] = source;
+	}
+
+	if ([_ring count] < kVMPEventTimelineCapacity) {
+		[_ring addObject:event];
+	} else {
+		_ring[(sequence - 1) % kVMPEventTimelineCapacity] = event;
+	}
+}
+
+// Must be called with the lock held
+- (void)_flushQoSSummaryAt:(gint64)now {
+	NSMutableArray<NSString *> *elements;
+
+	if (_pendingQoSMessages == 0) {
+		return;
+	}
+
+	elements = [NSMutableArray arrayWithCapacity:[_qos count]];
+	for (NSString *name in [[_qos allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+		NSArray<NSNumber *> *stats = _qos[name];
+		[elements addObject:[NSString stringWithFormat:@"%@ dropped %@ of %@", name, stats[1],
+													   stats[0]]];
+	}
+
+	[self _appendEventWithType:kVMPEventTypeQoS
+						source:nil
+					   message:[NSString stringWithFormat:@"%lu QoS messages: %@",
+														  (unsigned long) _pendingQoSMessages,
+														  [elements componentsJoinedByString:@", "]]
+					 timestamp:now];
+
+	[_qos removeAllObjects];
+	_pendingQoSMessages = 0;
+	_lastQoSSummary = now;
+}
+
+- (void)_recordQoSMessage:(GstMessage *)message source:(NSString *)source {
+	GstFormat format;
+	guint64 processed = 0, dropped = 0;
+	gint64 now;
+
+	gst_message_parse_qos_stats(message, &format, &processed, &dropped);
+	now = g_get_monotonic_time();
+
+	@synchronized(self) {
+		// Statistics are cumulative, so the latest message of an element is sufficient
+		_qos[source] = @[ @(processed), @(dropped) ];
+		_pendingQoSMessages++;
+
+		if (now - _lastQoSSummary >= kQoSSummaryInterval) {
+			[self _flushQoSSummaryAt:now];
+		}
+	}
+}
+
+- (void)recordEventWithType:(NSString *)type source:(NSString *)source message:(NSString *)message {
+	gint64 now = g_get_monotonic_time();
+
+	@synchronized(self) {
+		// Keep the summary in order with the following event
+		[self _flushQoSSummaryAt:now];
+		[self _appendEventWithType:type source:source message:message timestamp:now];
+	}
+}
+
+- (void)recordBusMessage:(GstMessage *)message pipeline:(GstElement *)pipeline {
+	NSString *source;
+	GError *err = NULL;
+	gchar *debug = NULL;
+
+	source = GST_MESSAGE_SRC(message) ? @(GST_MESSAGE_SRC_NAME(message)) : nil;
+
+	switch (GST_MESSAGE_TYPE(message)) {
+	case GST_MESSAGE_STATE_CHANGED: {
+		GstState oldState, newState;
+
+		if (GST_MESSAGE_SRC(message) != GST_OBJECT(pipeline)) {
+			break;
+		}
+
+		gst_message_parse_state_changed(message, &oldState, &newState, NULL);
+		[self recordEventWithType:kVMPEventTypeStateChanged
+						   source:source
+						  message:[NSString stringWithFormat:@"%s -> %s",
+															 gst_element_state_get_name(oldState),
+															 gst_element_state_get_name(newState)]];
+		break;
+	}
+	case GST_MESSAGE_ERROR:
+		// Transfer: FULL
+		gst_message_parse_error(message, &err, &debug);
+		[self recordEventWithType:kVMPEventTypeError source:source message:@(err->message)];
+		g_error_free(err);
+		g_free(debug);
+		break;
+	case GST_MESSAGE_WARNING:
+		// Transfer: FULL
+		gst_message_parse_warning(message, &err, &debug);
+		[self recordEventWithType:kVMPEventTypeWarning source:source message:@(err->message)];
+		g_error_free(err);
+		g_free(debug);
+		break;
+	case GST_MESSAGE_EOS:
+		[self recordEventWithType:kVMPEventTypeEOS source:source message:@"End of stream"];
+		break;
+	case GST_MESSAGE_QOS:
+		[self _recordQoSMessage:message source:source ?: @"unknown"];
+		break;
+	case GST_MESSAGE_ELEMENT: {
+		const GstStructure *structure;
+		const gchar *location;
+		gdouble stalledFor = 0;
+
+		if (!gst_message_has_name(message, [kVMPWatchdogMessageName UTF8String])) {
+			break;
+		}
+
+		// Transfer: NONE
+		structure = gst_message_get_structure(message);
+		location = gst_structure_get_string(structure, "location");
+		gst_structure_get_double(structure, "stalled-for", &stalledFor);
+
+		[self recordEventWithType:kVMPEventTypeStall
+						   source:source
+						  message:[NSString stringWithFormat:@"No buffers at the %s for %.1f seconds",
+															 location ? location : "pipeline",
+															 stalledFor]];
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+- (NSDictionary *)eventsAfterCursor:(NSUInteger)cursor limit:(NSUInteger)limit {
+	NSMutableArray<NSDictionary *> *events;
+	NSUInteger oldest, first, last, missed;
+	gint64 now;
+
+	now = g_get_monotonic_time();
+
+	@synchronized(self) {
+		[self _flushQoSSummaryAt:now];
+
+		// A cursor from before a daemon restart. Start over.
+		if (cursor >= _nextSequence) {
+			cursor = 0;
+		}
+
+		oldest = _nextSequence - [_ring count];
+		first = MAX(cursor + 1, oldest);
+		missed = first > cursor + 1 ? first - (cursor + 1) : 0;
+		last = MIN(_nextSequence, first + limit);
+
+		events = [NSMutableArray arrayWithCapacity:last > first ? last - first : 0];
+		for (NSUInteger sequence = first; sequence < last; sequence++) {
+			[events addObject:_ring[(sequence - 1) % kVMPEventTimelineCapacity]];
+		}
+
+		return @{
+			@"events" : events,
+			@"cursor" : @(last > first ? last - 1 : MAX(cursor, first - 1)),
+			@"more" : @(last < _nextSequence),
+			@"missed" : @(missed),
+			@"now" : @((double) now / G_USEC_PER_SEC),
+		};
+	}
+}
+
+@end
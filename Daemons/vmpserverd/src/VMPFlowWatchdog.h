@@ -0,0 +1,74 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * @brief Name of the element message posted when buffer flow stalls
+ *
+ * The message structure contains the fields "location" (string, "source" or
+ * "sink"), and "stalled-for" (double, seconds since the last buffer).
+ */
+extern NSString *const kVMPWatchdogMessageName;
+
+/**
+ * @brief Detects pipelines that stopped producing buffers
+ *
+ * Some failures (e.g. an HDMI source without signal, or a hung encoder) post
+ * neither EOS nor an error. The watchdog installs buffer probes on the source
+ * pads of all source elements, and on the sink pads of all sink elements. Each
+ * probe only stores the current monotonic time in an atomic variable.
+ *
+ * Source bins like rtspsrc create their elements and src pads while running.
+ * Their src pads are probed once added, and elements added to the pipeline
+ * later on are probed as well. Sources are not checked before the first source
+ * pad is probed.
+ *
+ * A timer checks the timestamps while the pipeline is PLAYING. If no buffer
+ * passed the sources or the sinks for longer than the timeout, an element
+ * message with the name kVMPWatchdogMessageName is posted on the pipeline bus,
+ * where the owner can handle it like any other bus event (e.g. by restarting
+ * the pipeline). The message is posted once per stall.
+ */
+@interface VMPFlowWatchdog : NSObject
+
+/// Time without buffer flow after which a stall is reported
+@property (nonatomic, readonly) NSTimeInterval timeout;
+
+/**
+ * @brief Install the probes and start monitoring a pipeline
+ *
+ * @param pipeline The top-level pipeline. The watchdog does not keep the
+ * pipeline alive, and stops monitoring after it was destroyed.
+ * @param timeout The stall timeout in seconds
+ *
+ * Must be called before the pipeline is set to PLAYING.
+ */
++ (instancetype)watchdogWithPipeline:(GstElement *)pipeline timeout:(NSTimeInterval)timeout;
+
+- (instancetype)initWithPipeline:(GstElement *)pipeline timeout:(NSTimeInterval)timeout;
+
+/**
+ * @brief Stop monitoring
+ *
+ * Called automatically on deallocation.
+ */
+- (void)invalidate;
+
+/**
+ * @brief Time since the last buffer at the sources and sinks
+ *
+ * @returns a dictionary with the keys "timeout", "source", "sink" (seconds),
+ * and "numberOfStalls"
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,299 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdatomic.h>
+
+#import <dispatch/dispatch.h>
+
+#import "VMPFlowWatchdog.h"
+#import "VMPGStreamerUtils.h"
+#import "VMPJournal.h"
+
+NSString *const kVMPWatchdogMessageName = @"vmp-watchdog-stall";
+
+// Shared between the watchdog and the probes, which may outlive each other
+typedef struct {
+	gint refcount;
+	// Monotonic time in microseconds of the last buffer
+	_Atomic gint64 lastSource;
+	_Atomic gint64 lastSink;
+	// Number of probed source pads. Sources without a probe cannot be checked.
+	_Atomic guint sourceProbes;
+} VMPFlowState;
+
+static VMPFlowState *flowStateRef(VMPFlowState *state) {
+	g_atomic_int_inc(&state->refcount);
+	return state;
+}
+
+static void flowStateUnref(gpointer data) {
+	VMPFlowState *state = data;
+
+	if (g_atomic_int_dec_and_test(&state->refcount)) {
+		g_free(state);
+	}
+}
+
+static GstPadProbeReturn sourceProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											 gpointer user_data) {
+	VMPFlowState *state = user_data;
+
+	atomic_store_explicit(&state->lastSource, g_get_monotonic_time(), memory_order_relaxed);
+	return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn sinkProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+										   gpointer user_data) {
+	VMPFlowState *state = user_data;
+
+	atomic_store_explicit(&state->lastSink, g_get_monotonic_time(), memory_order_relaxed);
+	return GST_PAD_PROBE_OK;
+}
+
+// A bin acting as a single source (e.g. rtspsrc), which creates its sources and src pads while
+// running. Bins containing a source also have the source flag, but have sink pads.
+static BOOL isSourceBin(GstElement *element) {
+	return GST_IS_BIN(element) && GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SOURCE) &&
+		   element->numsinkpads == 0 && !GST_IS_PIPELINE(element);
+}
+
+// Whether an element is created by a source bin. Its buffers are seen at the src pads of the bin.
+static BOOL isInSourceBin(GstElement *element) {
+	GstObject *parent;
+	BOOL inside = NO;
+
+	// Transfer: FULL
+	parent = gst_object_get_parent(GST_OBJECT(element));
+	while (parent && !inside) {
+		GstObject *next;
+
+		inside = isSourceBin(GST_ELEMENT(parent));
+		// Transfer: FULL
+		next = gst_object_get_parent(parent);
+		gst_object_unref(parent);
+		parent = next;
+	}
+	if (parent) {
+		gst_object_unref(parent);
+	}
+
+	return inside;
+}
+
+// The timeout of a new source starts when it is probed
+static gboolean addSourceProbe(GstElement *element, GstPad *pad, gpointer user_data) {
+	VMPFlowState *state = user_data;
+
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+					  sourceProbeCallback, flowStateRef(state), flowStateUnref);
+	atomic_store_explicit(&state->lastSource, g_get_monotonic_time(), memory_order_relaxed);
+	atomic_fetch_add(&state->sourceProbes, 1);
+	return TRUE;
+}
+
+static gboolean addSinkProbe(GstElement *element, GstPad *pad, gpointer user_data) {
+	VMPFlowState *state = user_data;
+
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+					  sinkProbeCallback, flowStateRef(state), flowStateUnref);
+	return TRUE;
+}
+
+// Called when a source adds a src pad while running
+static void sourcePadAddedCallback(GstElement *element, GstPad *pad, gpointer user_data) {
+	if (GST_PAD_IS_SRC(pad)) {
+		addSourceProbe(element, pad, user_data);
+	}
+}
+
+static void flowStateUnrefClosure(gpointer data, GClosure *closure) {
+	flowStateUnref(data);
+}
+
+// Probe the pads of a source or sink element. Elements within bins are skipped, unless the bin
+// is a source bin.
+static void installProbes(GstElement *element, VMPFlowState *state) {
+	if (isInSourceBin(element)) {
+		return;
+	}
+
+	if (isSourceBin(element) || (!GST_IS_BIN(element) &&
+								 GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SOURCE))) {
+		// Connected first, so no pad is missed. A pad probed twice is harmless.
+		g_signal_connect_data(element, "pad-added", G_CALLBACK(sourcePadAddedCallback),
+							  flowStateRef(state), flowStateUnrefClosure, 0);
+		gst_element_foreach_src_pad(element, addSourceProbe, state);
+	}
+	if (!GST_IS_BIN(element) && GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK)) {
+		gst_element_foreach_sink_pad(element, addSinkProbe, state);
+	}
+}
+
+// Called when an element is added to the pipeline, or to one of its bins, while running
+static void deepElementAddedCallback(GstBin *bin, GstBin *subBin, GstElement *element,
+									 gpointer user_data) {
+	installProbes(element, user_data);
+}
+
+@implementation VMPFlowWatchdog {
+	VMPFlowState *_state;
+	GWeakRef _pipeline;
+	dispatch_source_t _timer;
+	// Only accessed on the timer queue
+	BOOL _stalled;
+	NSUInteger _numberOfStalls;
+}
+
++ (instancetype)watchdogWithPipeline:(GstElement *)pipeline timeout:(NSTimeInterval)timeout {
+	return [[VMPFlowWatchdog alloc] initWithPipeline:pipeline timeout:timeout];
+}
+
+- (instancetype)initWithPipeline:(GstElement *)pipeline timeout:(NSTimeInterval)timeout {
+	VMP_ASSERT(GST_IS_BIN(pipeline), @"pipeline must be a bin");
+
+	self = [super init];
+	if (self) {
+		NSTimeInterval interval;
+		gint64 now;
+
+		_timeout = timeout;
+		_state = g_new0(VMPFlowState, 1);
+		_state->refcount = 1;
+		now = g_get_monotonic_time();
+		atomic_init(&_state->lastSource, now);
+		atomic_init(&_state->lastSink, now);
+		atomic_init(&_state->sourceProbes, 0);
+		g_weak_ref_init(&_pipeline, pipeline);
+
+		[self _installProbesInPipeline:pipeline];
+
+		// Check a few times per timeout period, but not more than necessary
+		interval = MAX(MIN(timeout / 4, 1.0), 0.1);
+
+		__weak VMPFlowWatchdog *weakSelf = self;
+		_timer =
+			dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+								   dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+		dispatch_source_set_timer(
+			_timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t) (interval * NSEC_PER_SEC)),
+			(uint64_t) (interval * NSEC_PER_SEC), (uint64_t) (interval * NSEC_PER_SEC / 10));
+		dispatch_source_set_event_handler(_timer, ^{
+		  [weakSelf _check];
+		});
+		dispatch_resume(_timer);
+	}
+	return self;
+}
+
+- (void)_installProbesInPipeline:(GstElement *)pipeline {
+	VMPFlowState *state = _state;
+
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+	  installProbes(element, state);
+	});
+
+	// Elements created while running. Elements created by source bins are skipped.
+	g_signal_connect_data(pipeline, "deep-element-added", G_CALLBACK(deepElementAddedCallback),
+						  flowStateRef(_state), flowStateUnrefClosure, 0);
+}
+
+// Called on the timer queue
+- (void)_check {
+	GstElement *pipeline;
+	GstState current;
+	gint64 now, sourceAge, sinkAge;
+	const gchar *location;
+
+	// Transfer: FULL
+	pipeline = g_weak_ref_get(&_pipeline);
+	if (!pipeline) {
+		[self invalidate];
+		return;
+	}
+
+	now = g_get_monotonic_time();
+	gst_element_get_state(pipeline, &current, NULL, 0);
+
+	// Only a playing pipeline is expected to produce buffers
+	if (current != GST_STATE_PLAYING) {
+		atomic_store(&_state->lastSource, now);
+		atomic_store(&_state->lastSink, now);
+		gst_object_unref(pipeline);
+		return;
+	}
+
+	sourceAge = now - atomic_load(&_state->lastSource);
+	sinkAge = now - atomic_load(&_state->lastSink);
+
+	// A stalled source also stalls the sinks, so report the source first. Sources are only
+	// checked once a probe is installed, e.g. after a source bin added its pads.
+	location = NULL;
+	if (atomic_load(&_state->sourceProbes) > 0 && sourceAge > _timeout * G_USEC_PER_SEC) {
+		location = "source";
+	} else if (sinkAge > _timeout * G_USEC_PER_SEC) {
+		location = "sink";
+	}
+
+	if (location && !_stalled) {
+		GstStructure *structure;
+		double stalledFor;
+
+		_stalled = YES;
+		@synchronized(self) {
+			_numberOfStalls++;
+		}
+
+		stalledFor = g_str_equal(location, "source") ? sourceAge : sinkAge;
+		stalledFor /= G_USEC_PER_SEC;
+
+		VMPWarn(@"No buffers at the %s elements of pipeline %s for %.1f seconds", location,
+				GST_OBJECT_NAME(pipeline), stalledFor);
+
+		structure = gst_structure_new([kVMPWatchdogMessageName UTF8String], "location",
+									  G_TYPE_STRING, location, "stalled-for", G_TYPE_DOUBLE,
+									  stalledFor, NULL);
+		gst_element_post_message(pipeline,
+								 gst_message_new_element(GST_OBJECT(pipeline), structure));
+	} else if (!location) {
+		_stalled = NO;
+	}
+
+	gst_object_unref(pipeline);
+}
+
+- (void)invalidate {
+	@synchronized(self) {
+		if (_timer) {
+			dispatch_source_cancel(_timer);
+			_timer = nil;
+		}
+	}
+}
+
+- (NSDictionary *)statistics {
+	gint64 now;
+	NSUInteger stalls;
+
+	now = g_get_monotonic_time();
+	@synchronized(self) {
+		stalls = _numberOfStalls;
+	}
+
+	return @{
+		@"timeout" : @(_timeout),
+		@"source" : @((double) (now - atomic_load(&_state->lastSource)) / G_USEC_PER_SEC),
+		@"sink" : @((double) (now - atomic_load(&_state->lastSink)) / G_USEC_PER_SEC),
+		@"numberOfStalls" : @(stalls),
+	};
+}
+
+- (void)dealloc {
+	[self invalidate];
+	g_weak_ref_clear(&_pipeline);
+	flowStateUnref(_state);
+}
+
+@end
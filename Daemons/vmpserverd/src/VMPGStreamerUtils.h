@@ -0,0 +1,44 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * @brief Call block for every element in bin, recursing into child bins
+ *
+ * The bin itself is not passed to the block. The iteration is restarted if
+ * the bin is modified concurrently, so the block may be called more than once
+ * for the same element in this case.
+ */
+void VMPForEachElement(GstBin *bin, void (^block)(GstElement *element));
+
+/**
+ * @brief Returns the name of the factory that created element, or NULL
+ */
+const gchar *_Nullable VMPElementFactoryName(GstElement *element);
+
+/**
+ * @brief Check if the element classification contains all given components
+ *
+ * @param element The element to check
+ * @param klass A slash-separated classification (e.g. "Encoder/Video")
+ *
+ * The order of the components does not matter, so "Encoder/Video" matches an
+ * element with the classification "Codec/Encoder/Video/Hardware".
+ */
+BOOL VMPElementHasClassification(GstElement *element, const gchar *klass);
+
+/**
+ * @brief Returns the top-level ancestor of element, or element itself
+ *
+ * Transfer: FULL
+ */
+GstElement *VMPCopyTopLevelElement(GstElement *element);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,87 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import "VMPGStreamerUtils.h"
+
+void VMPForEachElement(GstBin *bin, void (^block)(GstElement *element)) {
+	GstIterator *it;
+	GValue item = G_VALUE_INIT;
+	BOOL done = NO;
+
+	// Transfer: FULL
+	it = gst_bin_iterate_recurse(bin);
+	while (!done) {
+		switch (gst_iterator_next(it, &item)) {
+		case GST_ITERATOR_OK:
+			block(GST_ELEMENT(g_value_get_object(&item)));
+			g_value_reset(&item);
+			break;
+		case GST_ITERATOR_RESYNC:
+			gst_iterator_resync(it);
+			break;
+		case GST_ITERATOR_ERROR:
+		case GST_ITERATOR_DONE:
+			done = YES;
+			break;
+		}
+	}
+
+	g_value_unset(&item);
+	gst_iterator_free(it);
+}
+
+const gchar *VMPElementFactoryName(GstElement *element) {
+	GstElementFactory *factory;
+
+	// Transfer: NONE
+	factory = gst_element_get_factory(element);
+	if (!factory) {
+		return NULL;
+	}
+
+	return gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory));
+}
+
+BOOL VMPElementHasClassification(GstElement *element, const gchar *klass) {
+	GstElementFactory *factory;
+	const gchar *elementKlass;
+	gchar **components;
+	BOOL match = YES;
+
+	factory = gst_element_get_factory(element);
+	if (!factory) {
+		return NO;
+	}
+
+	elementKlass = gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS);
+	if (!elementKlass) {
+		return NO;
+	}
+
+	components = g_strsplit(klass, "/", -1);
+	for (gchar **c = components; *c != NULL; c++) {
+		if (!strstr(elementKlass, *c)) {
+			match = NO;
+			break;
+		}
+	}
+	g_strfreev(components);
+
+	return match;
+}
+
+GstElement *VMPCopyTopLevelElement(GstElement *element) {
+	GstObject *current, *parent;
+
+	current = gst_object_ref(GST_OBJECT(element));
+	// Transfer: FULL
+	while ((parent = gst_object_get_parent(current))) {
+		gst_object_unref(current);
+		current = parent;
+	}
+
+	return GST_ELEMENT(current);
+}
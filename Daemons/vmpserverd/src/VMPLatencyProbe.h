@@ -0,0 +1,79 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Stage at the end of a channel pipeline (capture, conversion, and scaling)
+extern NSString *const kVMPLatencyStageCapture;
+/// Stage after the inter-pipeline handoff and compositing (encoder input)
+extern NSString *const kVMPLatencyStageComposite;
+/// Stage after encoding (encoder output)
+extern NSString *const kVMPLatencyStageEncode;
+/// Stage after RTP payloading
+extern NSString *const kVMPLatencyStagePayload;
+
+/**
+ * @brief Buffer latency measurement across pipeline stages
+ *
+ * In a channel pipeline, buffers are stamped with the current clock time when
+ * they leave the source element. The stamp is carried as a
+ * GstReferenceTimestampMeta with the reference caps "timestamp/x-vmp-capture",
+ * and survives the inter-pipeline handoff, encoding, and payloading.
+ *
+ * All pipelines of the daemon run in the same process and use the monotonic
+ * system clock, so a probe further down the chain can compute the latency of a
+ * buffer by subtracting the stamp from the current clock time.
+ *
+ * The last samples of every stage are kept in a fixed-size ring, and
+ * percentiles are computed on request. Latencies are cumulative, i.e. the
+ * latency of the payload stage is the glass-to-glass latency as seen by the
+ * RTSP server.
+ *
+ * @note Aggregators (e.g. compositor) do not copy metadata from their inputs. We
+ * forward the newest stamp that entered an aggregator to its output buffers.
+ */
+@interface VMPLatencyProbe : NSObject
+
+/**
+ * @brief Stamp buffers at the source, and measure the capture stage
+ *
+ * @param pipeline The channel pipeline
+ *
+ * Must be called after the pipeline was constructed, and before it is set to
+ * PLAYING.
+ */
+- (void)attachToChannelPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Measure the composite, encode, and payload stages
+ *
+ * @param element The top-level element of a mountpoint media
+ *
+ * The element is usually obtained in the media-constructed callback of the RTSP
+ * media factory. Probes are removed together with the media.
+ */
+- (void)attachToMountpointElement:(GstElement *)element;
+
+/**
+ * @brief Latency percentiles for all stages with at least one sample
+ *
+ * @returns a dictionary with the stage name as key, and a dictionary with the
+ * keys "count", "p50", "p90", "p99", and "max" as value. Latencies are in
+ * milliseconds.
+ */
+- (NSDictionary<NSString *, NSDictionary *> *)statistics;
+
+/**
+ * @brief Discard all samples
+ */
+- (void)reset;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,349 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import "VMPLatencyProbe.h"
+#import "VMPGStreamerUtils.h"
+#import "VMPJournal.h"
+
+NSString *const kVMPLatencyStageCapture = @"capture";
+NSString *const kVMPLatencyStageComposite = @"composite";
+NSString *const kVMPLatencyStageEncode = @"encode";
+NSString *const kVMPLatencyStagePayload = @"payload";
+
+// Number of samples kept per stage
+#define VMP_LATENCY_RING_SIZE 1024
+
+enum {
+	VMPStageCapture = 0,
+	VMPStageComposite,
+	VMPStageEncode,
+	VMPStagePayload,
+	VMPStageCount
+};
+
+// Reference caps of the capture timestamp meta
+static GstCaps *captureReferenceCaps;
+
+typedef struct {
+	GstClockTime samples[VMP_LATENCY_RING_SIZE];
+	// Total number of samples written to the ring
+	guint64 count;
+} VMPLatencyRing;
+
+// State of a measurement probe. Only accessed from the streaming thread of the pad.
+typedef struct {
+	// Unretained VMPLatencyProbe
+	void *probe;
+	guint stage;
+	// Stamp of the last measured buffer. Used to skip repeated frames.
+	GstClockTime lastStamp;
+} VMPStageProbeData;
+
+// State shared between the sink and source pads of an aggregator
+typedef struct {
+	GMutex lock;
+	GstClockTime newestStamp;
+	gint refcount;
+} VMPCarryProbeData;
+
+@interface VMPLatencyProbe ()
+- (void)_addSample:(GstClockTime)latency stage:(guint)stage;
+@end
+
+#pragma mark - Pad probes
+
+static GstBuffer *bufferFromProbeInfo(GstPadProbeInfo *info) {
+	if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+		return GST_PAD_PROBE_INFO_BUFFER(info);
+	}
+	if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+		GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+		if (gst_buffer_list_length(list) > 0) {
+			return gst_buffer_list_get(list, 0);
+		}
+	}
+	return NULL;
+}
+
+// Attach the current time to buffers that do not carry a capture stamp yet
+static GstPadProbeReturn stampProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											gpointer user_data) {
+	GstBuffer *buffer;
+
+	buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+	if (gst_buffer_get_reference_timestamp_meta(buffer, captureReferenceCaps)) {
+		return GST_PAD_PROBE_OK;
+	}
+
+	buffer = gst_buffer_make_writable(buffer);
+	gst_buffer_add_reference_timestamp_meta(buffer, captureReferenceCaps, gst_util_get_timestamp(),
+											GST_CLOCK_TIME_NONE);
+	GST_PAD_PROBE_INFO_DATA(info) = buffer;
+
+	return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn measureProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											  gpointer user_data) {
+	VMPStageProbeData *data = user_data;
+	GstReferenceTimestampMeta *meta;
+	GstBuffer *buffer;
+
+	buffer = bufferFromProbeInfo(info);
+	if (!buffer) {
+		return GST_PAD_PROBE_OK;
+	}
+
+	meta = gst_buffer_get_reference_timestamp_meta(buffer, captureReferenceCaps);
+	if (!meta || meta->timestamp == data->lastStamp) {
+		return GST_PAD_PROBE_OK;
+	}
+	data->lastStamp = meta->timestamp;
+
+	__unsafe_unretained VMPLatencyProbe *probe = (__bridge id) data->probe;
+	[probe _addSample:gst_util_get_timestamp() - meta->timestamp stage:data->stage];
+
+	return GST_PAD_PROBE_OK;
+}
+
+// Remember the newest stamp entering an aggregator
+static GstPadProbeReturn carrySinkProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+												gpointer user_data) {
+	VMPCarryProbeData *data = user_data;
+	GstReferenceTimestampMeta *meta;
+
+	meta = gst_buffer_get_reference_timestamp_meta(GST_PAD_PROBE_INFO_BUFFER(info),
+												   captureReferenceCaps);
+	if (meta) {
+		g_mutex_lock(&data->lock);
+		if (data->newestStamp == GST_CLOCK_TIME_NONE || meta->timestamp > data->newestStamp) {
+			data->newestStamp = meta->timestamp;
+		}
+		g_mutex_unlock(&data->lock);
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+// Attach the newest input stamp to the aggregated output buffer
+static GstPadProbeReturn carrySrcProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											   gpointer user_data) {
+	VMPCarryProbeData *data = user_data;
+	GstClockTime stamp;
+	GstBuffer *buffer;
+
+	g_mutex_lock(&data->lock);
+	stamp = data->newestStamp;
+	g_mutex_unlock(&data->lock);
+
+	buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+	if (stamp == GST_CLOCK_TIME_NONE ||
+		gst_buffer_get_reference_timestamp_meta(buffer, captureReferenceCaps)) {
+		return GST_PAD_PROBE_OK;
+	}
+
+	buffer = gst_buffer_make_writable(buffer);
+	gst_buffer_add_reference_timestamp_meta(buffer, captureReferenceCaps, stamp,
+											GST_CLOCK_TIME_NONE);
+	GST_PAD_PROBE_INFO_DATA(info) = buffer;
+
+	return GST_PAD_PROBE_OK;
+}
+
+static void carryProbeDataUnref(gpointer user_data) {
+	VMPCarryProbeData *data = user_data;
+
+	if (g_atomic_int_dec_and_test(&data->refcount)) {
+		g_mutex_clear(&data->lock);
+		g_free(data);
+	}
+}
+
+#pragma mark - VMPLatencyProbe
+
+@implementation VMPLatencyProbe {
+	GMutex _lock;
+	VMPLatencyRing _rings[VMPStageCount];
+}
+
++ (void)initialize {
+	if (self == [VMPLatencyProbe class]) {
+		captureReferenceCaps = gst_caps_new_empty_simple("timestamp/x-vmp-capture");
+	}
+}
+
++ (NSString *)_nameForStage:(guint)stage {
+	switch (stage) {
+	case VMPStageCapture:
+		return kVMPLatencyStageCapture;
+	case VMPStageComposite:
+		return kVMPLatencyStageComposite;
+	case VMPStageEncode:
+		return kVMPLatencyStageEncode;
+	default:
+		return kVMPLatencyStagePayload;
+	}
+}
+
+- (instancetype)init {
+	self = [super init];
+	if (self) {
+		g_mutex_init(&_lock);
+		memset(_rings, 0, sizeof(_rings));
+	}
+	return self;
+}
+
+- (void)_addMeasureProbeToPad:(GstPad *)pad stage:(guint)stage {
+	VMPStageProbeData *data;
+
+	data = g_new0(VMPStageProbeData, 1);
+	data->probe = (__bridge void *) self;
+	data->stage = stage;
+	data->lastStamp = GST_CLOCK_TIME_NONE;
+
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+					  measureProbeCallback, data, g_free);
+}
+
+- (void)_addCarryProbesToAggregator:(GstElement *)element {
+	VMPCarryProbeData *data;
+
+	data = g_new0(VMPCarryProbeData, 1);
+	g_mutex_init(&data->lock);
+	data->newestStamp = GST_CLOCK_TIME_NONE;
+	data->refcount = 1;
+
+	for (GList *l = element->sinkpads; l != NULL; l = l->next) {
+		g_atomic_int_inc(&data->refcount);
+		gst_pad_add_probe(GST_PAD(l->data), GST_PAD_PROBE_TYPE_BUFFER, carrySinkProbeCallback,
+						  data, carryProbeDataUnref);
+	}
+	for (GList *l = element->srcpads; l != NULL; l = l->next) {
+		g_atomic_int_inc(&data->refcount);
+		gst_pad_add_probe(GST_PAD(l->data), GST_PAD_PROBE_TYPE_BUFFER, carrySrcProbeCallback,
+						  data, carryProbeDataUnref);
+	}
+
+	// Drop our initial reference
+	carryProbeDataUnref(data);
+}
+
+- (void)attachToChannelPipeline:(GstElement *)pipeline {
+	if (!GST_IS_BIN(pipeline)) {
+		return;
+	}
+
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+		if (GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SOURCE)) {
+			for (GList *l = element->srcpads; l != NULL; l = l->next) {
+				gst_pad_add_probe(GST_PAD(l->data), GST_PAD_PROBE_TYPE_BUFFER, stampProbeCallback,
+								  NULL, NULL);
+			}
+		} else if (g_strcmp0(VMPElementFactoryName(element), "intervideosink") == 0) {
+			for (GList *l = element->sinkpads; l != NULL; l = l->next) {
+				[self _addMeasureProbeToPad:GST_PAD(l->data) stage:VMPStageCapture];
+			}
+		}
+	});
+}
+
+- (void)attachToMountpointElement:(GstElement *)element {
+	if (!GST_IS_BIN(element)) {
+		return;
+	}
+
+	VMPForEachElement(GST_BIN(element), ^(GstElement *child) {
+		GstPad *pad;
+
+		if (VMPElementHasClassification(child, "Encoder/Video")) {
+			pad = gst_element_get_static_pad(child, "sink");
+			if (pad) {
+				[self _addMeasureProbeToPad:pad stage:VMPStageComposite];
+				gst_object_unref(pad);
+			}
+			pad = gst_element_get_static_pad(child, "src");
+			if (pad) {
+				[self _addMeasureProbeToPad:pad stage:VMPStageEncode];
+				gst_object_unref(pad);
+			}
+		} else if (VMPElementHasClassification(child, "Video/Compositor")) {
+			[self _addCarryProbesToAggregator:child];
+		} else if (g_strcmp0(GST_OBJECT_NAME(child), "pay0") == 0) {
+			pad = gst_element_get_static_pad(child, "src");
+			if (pad) {
+				[self _addMeasureProbeToPad:pad stage:VMPStagePayload];
+				gst_object_unref(pad);
+			}
+		}
+	});
+}
+
+// Called from streaming threads
+- (void)_addSample:(GstClockTime)latency stage:(guint)stage {
+	VMPLatencyRing *ring;
+
+	g_mutex_lock(&_lock);
+	ring = &_rings[stage];
+	ring->samples[ring->count % VMP_LATENCY_RING_SIZE] = latency;
+	ring->count++;
+	g_mutex_unlock(&_lock);
+}
+
+static int compareClockTime(const void *a, const void *b) {
+	GstClockTime x = *(const GstClockTime *) a;
+	GstClockTime y = *(const GstClockTime *) b;
+
+	return (x > y) - (x < y);
+}
+
+- (NSDictionary<NSString *, NSDictionary *> *)statistics {
+	NSMutableDictionary *result;
+	GstClockTime sorted[VMP_LATENCY_RING_SIZE];
+
+	result = [NSMutableDictionary dictionaryWithCapacity:VMPStageCount];
+
+	for (guint stage = 0; stage < VMPStageCount; stage++) {
+		guint64 count;
+		guint n;
+
+		g_mutex_lock(&_lock);
+		count = _rings[stage].count;
+		n = (guint) MIN(count, VMP_LATENCY_RING_SIZE);
+		memcpy(sorted, _rings[stage].samples, n * sizeof(GstClockTime));
+		g_mutex_unlock(&_lock);
+
+		if (n == 0) {
+			continue;
+		}
+
+		qsort(sorted, n, sizeof(GstClockTime), compareClockTime);
+
+#define PERCENTILE_MS(p) @((double) sorted[(guint) ((p) * (n - 1))] / GST_MSECOND)
+		result[[VMPLatencyProbe _nameForStage:stage]] = @{
+			@"count" : @(count),
+			@"p50" : PERCENTILE_MS(0.50),
+			@"p90" : PERCENTILE_MS(0.90),
+			@"p99" : PERCENTILE_MS(0.99),
+			@"max" : PERCENTILE_MS(1.0),
+		};
+#undef PERCENTILE_MS
+	}
+
+	return result;
+}
+
+- (void)reset {
+	g_mutex_lock(&_lock);
+	memset(_rings, 0, sizeof(_rings));
+	g_mutex_unlock(&_lock);
+}
+
+- (void)dealloc {
+	g_mutex_clear(&_lock);
+}
+
+@end
@@ -0,0 +1,66 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// RTSP latency of low-latency mountpoints in milliseconds
+extern const guint kVMPLowLatencyRTSPLatency;
+
+/**
+ * @brief Tunes a mountpoint pipeline for minimal latency
+ *
+ * Enabled with the boolean "lowLatency" property of a mountpoint. Before the
+ * media is prerolled:
+ *
+ * @li Queues on the video path are made leaky (downstream), and hold at most
+ * one buffer. Audio buffers are small and bursty, so audio queues, and queues
+ * whose media type cannot be determined from their neighbours, are unchanged.
+ * @li Video encoders are tuned for zero latency without B-frames and
+ * lookahead, and use intra refresh instead of periodic keyframes where
+ * supported. Only properties of the respective encoder are set (e.g.
+ * "tune", "bframes", and "intra-refresh" of x264enc, or "b-frames" of
+ * vah264enc).
+ *
+ * The RTSP latency of the mountpoint is lowered to kVMPLowLatencyRTSPLatency
+ * by the owner.
+ *
+ * The intervideosrc of a mountpoint is not tuned. It has no timing property
+ * other than the timeout of its black-frame fallback, and outputs the most
+ * recent frame of the channel at the negotiated frame rate, which delays a
+ * frame by at most one frame interval.
+ */
+@interface VMPLowLatency : NSObject
+
+/// Number of video queues tuned in the most recent media
+@property (atomic, readonly) NSUInteger numberOfQueues;
+
+/// Number of encoders tuned in the most recent media
+@property (atomic, readonly) NSUInteger numberOfEncoders;
+
+/**
+ * @brief Tune all queues and video encoders of a pipeline
+ *
+ * @param pipeline The top-level element of a mountpoint media
+ *
+ * Must be called before the pipeline is set to PLAYING, and after a memory
+ * budget was applied.
+ */
+- (void)applyToPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Tuned elements and RTSP latency
+ *
+ * @returns a dictionary with the keys "queues", "encoders", and "rtspLatency"
+ * (in milliseconds)
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
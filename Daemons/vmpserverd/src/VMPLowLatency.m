@@ -0,0 +1,172 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import "VMPGStreamerUtils.h"
+#import "VMPJournal.h"
+#import "VMPLowLatency.h"
+
+const guint kVMPLowLatencyRTSPLatency = 20;
+
+// Encoder properties and their low-latency values. Properties an encoder does not have are
+// skipped.
+static const struct {
+	const gchar *property;
+	const gchar *value;
+} kEncoderSettings[] = {
+	// x264enc. Zero-latency tuning also disables lookahead, and enables sliced threads.
+	{"tune", "zerolatency"},
+	{"bframes", "0"},
+	{"intra-refresh", "true"},
+	// vah264enc, vah265enc
+	{"b-frames", "0"},
+	// nvh264enc
+	{"zerolatency", "true"},
+	{"rc-lookahead", "0"},
+	// nvv4l2h264enc (Jetson)
+	{"num-B-Frames", "0"},
+	{"EnableTwopassCBR", "false"},
+};
+
+// Elements with a leaky property and queue levels (queue, but not queue2 or multiqueue)
+static BOOL isQueue(GstElement *element) {
+	GObjectClass *klass = G_OBJECT_GET_CLASS(element);
+
+	return g_object_class_find_property(klass, "leaky") &&
+		   g_object_class_find_property(klass, "max-size-buffers");
+}
+
+typedef NS_ENUM(NSInteger, VMPMediaType) {
+	VMPMediaTypeUnknown,
+	VMPMediaTypeVideo,
+	VMPMediaTypeAudio,
+};
+
+static VMPMediaType mediaTypeOfCaps(GstCaps *caps) {
+	VMPMediaType type = VMPMediaTypeUnknown;
+
+	if (!caps || gst_caps_is_any(caps)) {
+		return VMPMediaTypeUnknown;
+	}
+
+	for (guint i = 0; i < gst_caps_get_size(caps); i++) {
+		GstStructure *structure = gst_caps_get_structure(caps, i);
+		const gchar *name = gst_structure_get_name(structure);
+		const gchar *media = gst_structure_get_string(structure, "media");
+
+		// Payloaded streams carry the media type in a field
+		if (g_str_has_prefix(name, "audio/") || g_strcmp0(media, "audio") == 0) {
+			return VMPMediaTypeAudio;
+		}
+		if (g_str_has_prefix(name, "video/") || g_str_has_prefix(name, "image/") ||
+			g_strcmp0(media, "video") == 0) {
+			type = VMPMediaTypeVideo;
+		}
+	}
+
+	return type;
+}
+
+// Media type of the stream passing a queue. The pipeline is not negotiated yet, so the caps
+// its neighbours accept are queried instead.
+static VMPMediaType mediaTypeOfQueue(GstElement *queue) {
+	VMPMediaType types[2] = {VMPMediaTypeUnknown, VMPMediaTypeUnknown};
+	const gchar *pads[2] = {"src", "sink"};
+
+	for (gsize i = 0; i < G_N_ELEMENTS(pads); i++) {
+		GstPad *pad;
+		GstCaps *caps;
+
+		// Transfer: FULL
+		pad = gst_element_get_static_pad(queue, pads[i]);
+		if (!pad) {
+			continue;
+		}
+		// Transfer: FULL
+		caps = gst_pad_peer_query_caps(pad, NULL);
+		types[i] = mediaTypeOfCaps(caps);
+		if (caps) {
+			gst_caps_unref(caps);
+		}
+		gst_object_unref(pad);
+	}
+
+	if (types[0] == VMPMediaTypeAudio || types[1] == VMPMediaTypeAudio) {
+		return VMPMediaTypeAudio;
+	}
+	if (types[0] == VMPMediaTypeVideo || types[1] == VMPMediaTypeVideo) {
+		return VMPMediaTypeVideo;
+	}
+	return VMPMediaTypeUnknown;
+}
+
+static BOOL isVideoEncoder(GstElement *element) {
+	GstElementFactory *factory;
+
+	// Transfer: NONE
+	factory = gst_element_get_factory(element);
+	return factory &&
+		   gst_element_factory_list_is_type(factory, GST_ELEMENT_FACTORY_TYPE_VIDEO_ENCODER);
+}
+
+@interface VMPLowLatency ()
+@property (atomic, readwrite) NSUInteger numberOfQueues;
+@property (atomic, readwrite) NSUInteger numberOfEncoders;
+@end
+
+@implementation VMPLowLatency
+
+- (void)applyToPipeline:(GstElement *)pipeline {
+	NSMutableSet<NSValue *> *queues, *encoders;
+
+	if (!GST_IS_BIN(pipeline)) {
+		return;
+	}
+
+	// The iterator may return an element twice after a resync
+	queues = [NSMutableSet set];
+	encoders = [NSMutableSet set];
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+	  NSValue *value = [NSValue valueWithPointer:element];
+
+	  if (isQueue(element)) {
+		  // Audio buffers are small and bursty, so audio queues keep their levels
+		  if ([queues containsObject:value] || mediaTypeOfQueue(element) != VMPMediaTypeVideo) {
+			  return;
+		  }
+		  [queues addObject:value];
+		  g_object_set(element, "max-size-buffers", 1, "max-size-bytes", 0, "max-size-time",
+					   (guint64) 0, NULL);
+		  gst_util_set_object_arg(G_OBJECT(element), "leaky", "downstream");
+	  } else if (isVideoEncoder(element) && ![encoders containsObject:value]) {
+		  GObjectClass *klass = G_OBJECT_GET_CLASS(element);
+
+		  [encoders addObject:value];
+		  for (gsize i = 0; i < G_N_ELEMENTS(kEncoderSettings); i++) {
+			  if (g_object_class_find_property(klass, kEncoderSettings[i].property)) {
+				  gst_util_set_object_arg(G_OBJECT(element), kEncoderSettings[i].property,
+										  kEncoderSettings[i].value);
+			  }
+		  }
+	  }
+	});
+
+	[self setNumberOfQueues:[queues count]];
+	[self setNumberOfEncoders:[encoders count]];
+
+	VMPInfo(@"Tuned %lu queues and %lu encoders of pipeline %s for low latency",
+			(unsigned long) [queues count], (unsigned long) [encoders count],
+			GST_OBJECT_NAME(pipeline));
+}
+
+- (NSDictionary *)statistics {
+	return @{
+		@"queues" : @([self numberOfQueues]),
+		@"encoders" : @([self numberOfEncoders]),
+		@"rtspLatency" : @(kVMPLowLatencyRTSPLatency),
+	};
+}
+
+@end
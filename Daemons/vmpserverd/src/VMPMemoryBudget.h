@@ -0,0 +1,111 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Queues block upstream when full
+extern NSString *const kVMPLeakyNone;
+/// Queues drop new buffers when full
+extern NSString *const kVMPLeakyUpstream;
+/// Queues drop the oldest buffers when full
+extern NSString *const kVMPLeakyDownstream;
+
+/**
+ * @brief Memory budget of a channel or mountpoint pipeline
+ *
+ * The budget is configured with the optional "memoryBudget" dictionary in the
+ * properties of a channel or mountpoint:
+ *
+ * @code
+ * <key>memoryBudget</key>
+ * <dict>
+ *     <key>megabytes</key>
+ *     <integer>32</integer>
+ *     <key>leaky</key>
+ *     <string>downstream</string>
+ * </dict>
+ * @endcode
+ *
+ * The budget is split evenly across all queue elements of the pipeline, and
+ * replaces their byte limit. Queues are made leaky according to "leaky" ("no",
+ * "upstream", or "downstream". Default: "downstream"), so a stalled consumer
+ * results in dropped frames instead of unbounded memory growth. Every overrun
+ * of a queue is counted.
+ *
+ * Buffer pools are not resized, but their configured size is reported.
+ */
+@interface VMPMemoryBudget : NSObject
+
+/// Budget in bytes
+@property (nonatomic, readonly) NSUInteger maxBytes;
+
+/// One of kVMPLeakyNone, kVMPLeakyUpstream, or kVMPLeakyDownstream
+@property (nonatomic, readonly) NSString *leaky;
+
+/// Number of queue overruns since the budget was created
+@property (atomic, readonly) NSUInteger numberOfOverruns;
+
+/**
+ * @brief Parse and validate the "memoryBudget" dictionary
+ *
+ * @returns a budget, or nil if the property list is invalid
+ */
++ (nullable instancetype)budgetWithPropertyList:(id)propertyList error:(NSError **)error;
+
+- (nullable instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error;
+
+/**
+ * @brief Bound all queues of a pipeline
+ *
+ * @param pipeline A channel pipeline, or the top-level element of a mountpoint
+ * media
+ *
+ * Must be called before the pipeline is set to PLAYING.
+ */
+- (void)applyToPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Budget configuration and overrun count
+ *
+ * @returns a dictionary with the keys "maxBytes", "leaky", and
+ * "numberOfOverruns"
+ */
+- (NSDictionary *)propertyList;
+
+/**
+ * @brief Queue and buffer pool occupancy of a pipeline
+ *
+ * @param pipeline Any bin. Works with and without a memory budget.
+ *
+ * Example structure of the returned dictionary:
+ * @code
+ * {
+ *     "queues": [
+ *         {
+ *             "name": "queue0",
+ *             "leaky": "downstream",
+ *             "current": {"bytes": 6220800, "buffers": 2, "time": 66666666},
+ *             "limit": {"bytes": 16777216, "buffers": 200, "time": 1000000000}
+ *         }
+ *     ],
+ *     "bufferPools": [
+ *         {"element": "v4l2src0", "size": 3110400, "minBuffers": 4, "maxBuffers": 4}
+ *     ],
+ *     "queuedBytes": 6220800, // Sum of the current queue levels
+ *     "pooledBytes": 12441600 // Sum of size * max(minBuffers, maxBuffers) of all pools
+ * }
+ * @endcode
+ *
+ * Times are in nanoseconds. A limit of 0 means unlimited.
+ */
++ (NSDictionary *)memoryStatisticsForPipeline:(GstElement *)pipeline;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,231 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <gst/base/base.h>
+
+#import "VMPErrors.h"
+#import "VMPGStreamerUtils.h"
+#import "VMPJournal.h"
+#import "VMPMemoryBudget.h"
+
+NSString *const kVMPLeakyNone = @"no";
+NSString *const kVMPLeakyUpstream = @"upstream";
+NSString *const kVMPLeakyDownstream = @"downstream";
+
+// Elements with a leaky property and queue levels (queue, but not queue2 or multiqueue)
+static BOOL isLeakyQueue(GstElement *element) {
+	GObjectClass *klass = G_OBJECT_GET_CLASS(element);
+
+	return g_object_class_find_property(klass, "leaky") &&
+		   g_object_class_find_property(klass, "current-level-bytes");
+}
+
+static NSString *leakyNick(GstElement *queue) {
+	GParamSpec *pspec;
+	GEnumValue *value;
+	gint leaky;
+
+	pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(queue), "leaky");
+	if (!G_IS_PARAM_SPEC_ENUM(pspec)) {
+		return kVMPLeakyNone;
+	}
+
+	g_object_get(queue, "leaky", &leaky, NULL);
+	value = g_enum_get_value(G_PARAM_SPEC_ENUM(pspec)->enum_class, leaky);
+
+	return value ? @(value->value_nick) : kVMPLeakyNone;
+}
+
+// Transfer: FULL. The buffer pool negotiated by a base class element, or NULL.
+static GstBufferPool *copyBufferPool(GstElement *element) {
+	if (GST_IS_BASE_SRC(element)) {
+		return gst_base_src_get_buffer_pool(GST_BASE_SRC(element));
+	} else if (GST_IS_BASE_TRANSFORM(element)) {
+		return gst_base_transform_get_buffer_pool(GST_BASE_TRANSFORM(element));
+	} else if (GST_IS_AGGREGATOR(element)) {
+		return gst_aggregator_get_buffer_pool(GST_AGGREGATOR(element));
+	}
+	return NULL;
+}
+
+@interface VMPMemoryBudget ()
+@property (atomic, readwrite) NSUInteger numberOfOverruns;
+@end
+
+// Called from the streaming thread of the queue
+static void queue_overrun_cb(GstElement *queue, gpointer user_data) {
+	__unsafe_unretained VMPMemoryBudget *budget = (__bridge id) user_data;
+	NSUInteger overruns;
+
+	@synchronized(budget) {
+		overruns = [budget numberOfOverruns] + 1;
+		[budget setNumberOfOverruns:overruns];
+	}
+
+	// Avoid flooding the journal while a consumer is stalled
+	if (overruns == 1 || overruns % 1000 == 0) {
+		VMPWarn(@"Queue %s reached its memory budget (%lu overruns). Buffers are %@.",
+				GST_OBJECT_NAME(queue), (unsigned long) overruns,
+				[[budget leaky] isEqualToString:kVMPLeakyNone] ? @"blocked" : @"dropped");
+	}
+}
+
+@implementation VMPMemoryBudget
+
++ (instancetype)budgetWithPropertyList:(id)propertyList error:(NSError **)error {
+	return [[VMPMemoryBudget alloc] initWithPropertyList:propertyList error:error];
+}
+
+- (instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error {
+	id megabytes, leaky;
+
+	if (![propertyList isKindOfClass:[NSDictionary class]]) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'memoryBudget' must be a dictionary");
+		return nil;
+	}
+
+	megabytes = propertyList[@"megabytes"];
+	leaky = propertyList[@"leaky"];
+
+	if (![megabytes isKindOfClass:[NSNumber class]] || [megabytes doubleValue] <= 0) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'megabytes' in 'memoryBudget' must be a positive number");
+		return nil;
+	}
+	if (leaky && !([leaky isEqual:kVMPLeakyNone] || [leaky isEqual:kVMPLeakyUpstream] ||
+				   [leaky isEqual:kVMPLeakyDownstream])) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'leaky' in 'memoryBudget' must be 'no', 'upstream', or 'downstream'");
+		return nil;
+	}
+
+	self = [super init];
+	if (self) {
+		_maxBytes = (NSUInteger) ([megabytes doubleValue] * 1024 * 1024);
+		_leaky = leaky ? [leaky copy] : kVMPLeakyDownstream;
+	}
+	return self;
+}
+
+- (void)applyToPipeline:(GstElement *)pipeline {
+	NSMutableArray<NSValue *> *queues;
+	guint share;
+
+	if (!GST_IS_BIN(pipeline)) {
+		return;
+	}
+
+	queues = [NSMutableArray array];
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+	  NSValue *value = [NSValue valueWithPointer:element];
+
+	  // The iterator may return an element twice after a resync
+	  if (isLeakyQueue(element) && ![queues containsObject:value]) {
+		  [queues addObject:value];
+	  }
+	});
+
+	if ([queues count] == 0) {
+		VMPDebug(@"No queues to bound in pipeline %s", GST_OBJECT_NAME(pipeline));
+		return;
+	}
+
+	share = (guint) MIN(_maxBytes / [queues count], G_MAXUINT);
+
+	for (NSValue *value in queues) {
+		GstElement *queue = [value pointerValue];
+
+		g_object_set(queue, "max-size-bytes", share, NULL);
+		gst_util_set_object_arg(G_OBJECT(queue), "leaky", [_leaky UTF8String]);
+		g_signal_connect(queue, "overrun", G_CALLBACK(queue_overrun_cb), (__bridge void *) self);
+	}
+
+	VMPInfo(@"Bounded %lu queues in pipeline %s to %u bytes each (leaky: %@)",
+			(unsigned long) [queues count], GST_OBJECT_NAME(pipeline), share, _leaky);
+}
+
+- (NSDictionary *)propertyList {
+	return @{
+		@"maxBytes" : @(_maxBytes),
+		@"leaky" : _leaky,
+		@"numberOfOverruns" : @([self numberOfOverruns]),
+	};
+}
+
++ (NSDictionary *)memoryStatisticsForPipeline:(GstElement *)pipeline {
+	NSMutableDictionary<NSString *, NSDictionary *> *queues, *pools;
+	__block guint64 queuedBytes = 0, pooledBytes = 0;
+
+	queues = [NSMutableDictionary dictionary];
+	pools = [NSMutableDictionary dictionary];
+
+	if (!GST_IS_BIN(pipeline)) {
+		return @{@"queues" : @[], @"bufferPools" : @[], @"queuedBytes" : @0, @"pooledBytes" : @0};
+	}
+
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+	  NSString *name;
+	  GstBufferPool *pool;
+
+	  // Keyed by name, as the iterator may return an element twice after a resync
+	  name = @(GST_OBJECT_NAME(element));
+
+	  if (isLeakyQueue(element)) {
+		  guint curBuffers, curBytes, maxBuffers, maxBytes;
+		  guint64 curTime, maxTime;
+
+		  g_object_get(element, "current-level-buffers", &curBuffers, "current-level-bytes",
+					   &curBytes, "current-level-time", &curTime, "max-size-buffers", &maxBuffers,
+					   "max-size-bytes", &maxBytes, "max-size-time", &maxTime, NULL);
+
+		  queues[name] = @{
+			  @"name" : name,
+			  @"leaky" : leakyNick(element),
+			  @"current" : @{@"bytes" : @(curBytes), @"buffers" : @(curBuffers), @"time" : @(curTime)},
+			  @"limit" : @{@"bytes" : @(maxBytes), @"buffers" : @(maxBuffers), @"time" : @(maxTime)},
+		  };
+	  }
+
+	  // Transfer: FULL
+	  pool = copyBufferPool(element);
+	  if (pool) {
+		  GstStructure *config;
+		  guint size, minBuffers, maxBuffers;
+
+		  // Transfer: FULL
+		  config = gst_buffer_pool_get_config(pool);
+		  if (gst_buffer_pool_config_get_params(config, NULL, &size, &minBuffers, &maxBuffers)) {
+			  pools[name] = @{
+				  @"element" : name,
+				  @"size" : @(size),
+				  @"minBuffers" : @(minBuffers),
+				  @"maxBuffers" : @(maxBuffers),
+			  };
+		  }
+		  gst_structure_free(config);
+		  gst_object_unref(pool);
+	  }
+	});
+
+	for (NSDictionary *queue in [queues allValues]) {
+		queuedBytes += [queue[@"current"][@"bytes"] unsignedLongLongValue];
+	}
+	for (NSDictionary *pool in [pools allValues]) {
+		// maxBuffers is 0 for unlimited pools, so the minimum is a lower bound
+		pooledBytes += (guint64) [pool[@"size"] unsignedIntValue] *
+					   MAX([pool[@"minBuffers"] unsignedIntValue], [pool[@"maxBuffers"] unsignedIntValue]);
+	}
+
+	return @{
+		@"queues" : [queues allValues],
+		@"bufferPools" : [pools allValues],
+		@"queuedBytes" : @(queuedBytes),
+		@"pooledBytes" : @(pooledBytes),
+	};
+}
+
+@end
@@ -0,0 +1,106 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+#import "VMPProfileModel.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Name of the compositor blending the overlays into a mountpoint
+extern NSString *const kVMPOverlayCompositorName;
+
+/// A static image (e.g. a logo)
+extern NSString *const kVMPOverlayTypeImage;
+/// The wall-clock time, updated at most once a second
+extern NSString *const kVMPOverlayTypeClock;
+/// A static "LIVE" badge
+extern NSString *const kVMPOverlayTypeLive;
+
+/**
+ * @brief Overlays of a mountpoint, composited at the encoder input
+ *
+ * The overlays are configured with the optional "overlays" array in the
+ * properties of a mountpoint:
+ *
+ * @code
+ * <key>overlays</key>
+ * <array>
+ *     <dict>
+ *         <key>type</key>
+ *         <string>image</string>
+ *         <key>path</key>
+ *         <string>/etc/vmpserverd/logo.png</string>
+ *         <key>x</key>
+ *         <integer>32</integer>
+ *         <key>y</key>
+ *         <integer>32</integer>
+ *     </dict>
+ *     <dict>
+ *         <key>type</key>
+ *         <string>clock</string>
+ *         <key>format</key>
+ *         <string>%H:%M:%S</string>
+ *     </dict>
+ * </array>
+ * @endcode
+ *
+ * Every overlay is a separate input of a compositor in front of the encoder.
+ * The profile templates "overlay", "overlayImage", and "overlayText" select
+ * the compositor and upload of the platform, so the video stays in GPU memory
+ * on hardware paths.
+ *
+ * Default positions and sizes are given for a 1080p stream, and scaled to the
+ * negotiated output size of the compositor. Defaults in the right or bottom
+ * half keep their distance to that edge. Configured values are used as is.
+ *
+ * Images and the live badge are rendered and uploaded once, and repeated by
+ * the compositor. The clock is re-rendered only when its text changes, and at
+ * most once a second.
+ */
+@interface VMPOverlay : NSObject
+
+/// Number of configured overlays
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ * @brief Parse and validate the "overlays" array
+ *
+ * @returns the overlays, or nil if the property list is invalid
+ */
++ (nullable instancetype)overlayWithPropertyList:(id)propertyList error:(NSError **)error;
+
+- (nullable instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error;
+
+/**
+ * @brief Pipeline fragment of the compositor
+ *
+ * Substituted for the {OVERLAY} variable in front of the encoder of a
+ * mountpoint template. The fragment ends with a link to the encoder.
+ */
+- (nullable NSString *)compositorWithProfile:(VMPProfileModel *)profile error:(NSError **)error;
+
+/// Pipeline fragment of the overlay sources, appended to the mountpoint pipeline
+- (nullable NSString *)sourcesWithProfile:(VMPProfileModel *)profile error:(NSError **)error;
+
+/**
+ * @brief Start rendering the text overlays of a constructed media
+ *
+ * Rendering stops when the media is destroyed.
+ */
+- (void)attachToMountpointElement:(GstElement *)element;
+
+/**
+ * @brief Overlay count and text updates
+ *
+ * @returns a dictionary with the keys "overlays" and "textUpdates"
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,466 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <gst/app/app.h>
+#import <gst/video/video.h>
+#import <time.h>
+
+#import "VMPErrors.h"
+#import "VMPJournal.h"
+#import "VMPOverlay.h"
+
+NSString *const kVMPOverlayCompositorName = @"vmpoverlay";
+
+NSString *const kVMPOverlayTypeImage = @"image";
+NSString *const kVMPOverlayTypeClock = @"clock";
+NSString *const kVMPOverlayTypeLive = @"live";
+
+// Text overlays are read from appsrc elements named "vmpoverlay-<index>"
+static NSString *const kVMPOverlaySourcePrefix = @"vmpoverlay-";
+
+static NSString *const kDefaultClockFormat = @"%H:%M:%S";
+static NSString *const kDefaultFont = @"Sans Bold 28";
+
+// Interval of checking the clock for a new text. The text is only rendered if it changed.
+static const NSTimeInterval kClockCheckInterval = 0.25;
+
+// Default positions and sizes are given for a stream of this size, and scaled to the negotiated
+// size of the compositor output
+static const gint kReferenceWidth = 1920;
+static const gint kReferenceHeight = 1080;
+
+@interface VMPOverlay ()
+- (void)_layoutCompositor:(GstElement *)compositor caps:(GstCaps *)caps;
+@end
+
+// Called from the streaming thread of the compositor
+static GstPadProbeReturn compositorCapsProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+													 gpointer user_data) {
+	__unsafe_unretained VMPOverlay *overlay = (__bridge id) user_data;
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+	GstElement *compositor;
+	GstCaps *caps;
+
+	if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS) {
+		return GST_PAD_PROBE_OK;
+	}
+
+	// Transfer: NONE
+	gst_event_parse_caps(event, &caps);
+	// Transfer: FULL
+	compositor = gst_pad_get_parent_element(pad);
+	if (compositor) {
+		@autoreleasepool {
+			[overlay _layoutCompositor:compositor caps:caps];
+		}
+		gst_object_unref(compositor);
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+static void releaseOverlay(gpointer user_data) {
+	// Balance the retain from attachToMountpointElement:
+	(void) (__bridge_transfer VMPOverlay *) user_data;
+}
+
+// Push a text buffer to an appsrc. The buffer has no duration, so the compositor shows the
+// rendered text until the next one arrives.
+static void pushMarkup(GstElement *appsrc, NSString *markup) {
+	const gchar *str = [markup UTF8String];
+	gsize len = strlen(str);
+	GstBuffer *buffer;
+
+	buffer = gst_buffer_new_wrapped(g_strndup(str, len), len);
+	// Transfer: FULL
+	gst_app_src_push_buffer(GST_APP_SRC(appsrc), buffer);
+}
+
+static NSString *clockMarkup(NSString *format) {
+	gchar buf[128], *escaped;
+	struct tm tm;
+	time_t now;
+	NSString *markup;
+
+	now = time(NULL);
+	localtime_r(&now, &tm);
+	if (strftime(buf, sizeof(buf), [format UTF8String], &tm) == 0) {
+		return @"";
+	}
+
+	escaped = g_markup_escape_text(buf, -1);
+	markup = @(escaped);
+	g_free(escaped);
+
+	return markup;
+}
+
+@implementation VMPOverlay {
+	// Normalised overlay configurations
+	NSArray<NSDictionary *> *_overlays;
+	// Protected by @synchronized(self)
+	NSUInteger _textUpdates;
+}
+
++ (instancetype)overlayWithPropertyList:(id)propertyList error:(NSError **)error {
+	return [[VMPOverlay alloc] initWithPropertyList:propertyList error:error];
+}
+
+- (instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error {
+	NSMutableArray<NSDictionary *> *overlays;
+
+	if (![propertyList isKindOfClass:[NSArray class]] || [propertyList count] == 0) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'overlays' must be a non-empty array");
+		return nil;
+	}
+
+	overlays = [NSMutableArray arrayWithCapacity:[propertyList count]];
+	for (id entry in propertyList) {
+		NSMutableDictionary *overlay;
+		NSString *type;
+
+		if (![entry isKindOfClass:[NSDictionary class]]) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"Every entry in 'overlays' must be a dictionary");
+			return nil;
+		}
+		for (NSString *key in @[ @"x", @"y", @"width", @"height" ]) {
+			if (entry[key] &&
+				(![entry[key] isKindOfClass:[NSNumber class]] || [entry[key] integerValue] < 0)) {
+				VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+							   @"'x', 'y', 'width', and 'height' of an overlay must be positive "
+							   @"numbers");
+				return nil;
+			}
+		}
+
+		type = entry[@"type"];
+		overlay = [NSMutableDictionary dictionaryWithDictionary:entry];
+		// Defaults place the overlays in the corners of a 1080p stream. The keys of the defaults
+		// are kept to scale them to the negotiated size.
+		if ([type isEqual:kVMPOverlayTypeImage]) {
+			NSString *path = entry[@"path"];
+
+			// The path is quoted in the pipeline description
+			if (![path isKindOfClass:[NSString class]] || [path containsString:@"\""]) {
+				VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+							   @"Image overlay is missing a valid 'path'");
+				return nil;
+			}
+			[overlay addEntriesFromDictionary:@{
+				@"x" : entry[@"x"] ?: @32,
+				@"y" : entry[@"y"] ?: @32,
+			}];
+		} else if ([type isEqual:kVMPOverlayTypeClock]) {
+			if (entry[@"format"] && ![entry[@"format"] isKindOfClass:[NSString class]]) {
+				VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+							   @"'format' of a clock overlay must be a string");
+				return nil;
+			}
+			[overlay addEntriesFromDictionary:@{
+				@"x" : entry[@"x"] ?: @1568,
+				@"y" : entry[@"y"] ?: @32,
+				@"width" : entry[@"width"] ?: @320,
+				@"height" : entry[@"height"] ?: @64,
+				@"format" : entry[@"format"] ?: kDefaultClockFormat,
+			}];
+		} else if ([type isEqual:kVMPOverlayTypeLive]) {
+			if (entry[@"text"] && ![entry[@"text"] isKindOfClass:[NSString class]]) {
+				VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+							   @"'text' of a live overlay must be a string");
+				return nil;
+			}
+			[overlay addEntriesFromDictionary:@{
+				@"x" : entry[@"x"] ?: @32,
+				@"y" : entry[@"y"] ?: @984,
+				@"width" : entry[@"width"] ?: @160,
+				@"height" : entry[@"height"] ?: @64,
+				@"text" : entry[@"text"] ?: @"LIVE",
+			}];
+		} else {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'type' of an overlay must be 'image', 'clock', or 'live'");
+			return nil;
+		}
+
+		NSMutableArray<NSString *> *defaults = [NSMutableArray array];
+		for (NSString *key in @[ @"x", @"y", @"width", @"height" ]) {
+			if (!entry[key] && overlay[key]) {
+				[defaults addObject:key];
+			}
+		}
+		overlay[@"defaults"] = defaults;
+
+		if (overlay[@"font"] && ![overlay[@"font"] isKindOfClass:[NSString class]]) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'font' of an overlay must be a Pango font description");
+			return nil;
+		}
+		[overlays addObject:overlay];
+	}
+
+	self = [super init];
+	if (self) {
+		_overlays = [overlays copy];
+	}
+	return self;
+}
+
+- (NSUInteger)count {
+	return [_overlays count];
+}
+
+// The video is linked to sink_0 of the compositor. Overlays follow in their configured order.
+- (NSString *)_padAtIndex:(NSUInteger)index {
+	return [NSString stringWithFormat:@"sink_%lu", (unsigned long) index + 1];
+}
+
+- (NSString *)compositorWithProfile:(VMPProfileModel *)profile error:(NSError **)error {
+	NSMutableString *pads;
+	NSString *compositor;
+
+	pads = [NSMutableString string];
+	[_overlays enumerateObjectsUsingBlock:^(NSDictionary *overlay, NSUInteger idx, BOOL *stop) {
+	  NSString *pad = [self _padAtIndex:idx];
+
+	  // Keep the last frame of overlays which are rendered once
+	  [pads appendFormat:@" %@::xpos=%@ %@::ypos=%@ %@::zorder=%lu %@::repeat-after-eos=1", pad,
+						 overlay[@"x"], pad, overlay[@"y"], pad, (unsigned long) idx + 1, pad];
+	  if ([overlay[@"type"] isEqual:kVMPOverlayTypeImage] && overlay[@"width"] &&
+		  overlay[@"height"]) {
+		  [pads appendFormat:@" %@::width=%@ %@::height=%@", pad, overlay[@"width"], pad,
+							 overlay[@"height"]];
+	  }
+	}];
+
+	compositor = [profile pipelineForMountpointType:@"overlay"
+										  variables:@{@"PADS" : pads}
+											  error:error];
+	if (!compositor) {
+		return nil;
+	}
+
+	return [compositor stringByAppendingString:@" ! "];
+}
+
+- (NSString *)sourcesWithProfile:(VMPProfileModel *)profile error:(NSError **)error {
+	NSMutableString *sources;
+
+	sources = [NSMutableString string];
+	for (NSUInteger i = 0; i < [_overlays count]; i++) {
+		NSDictionary *overlay = _overlays[i];
+		NSDictionary *vars;
+		NSString *source, *templateType;
+
+		if ([overlay[@"type"] isEqual:kVMPOverlayTypeImage]) {
+			templateType = @"overlayImage";
+			vars = @{@"PATH" : overlay[@"path"], @"PAD" : [self _padAtIndex:i]};
+		} else {
+			templateType = @"overlayText";
+			vars = @{
+				@"NAME" : [NSString stringWithFormat:@"%@%lu", kVMPOverlaySourcePrefix,
+													(unsigned long) i],
+				@"FONT" : overlay[@"font"] ?: kDefaultFont,
+				@"WIDTH" : [overlay[@"width"] stringValue],
+				@"HEIGHT" : [overlay[@"height"] stringValue],
+				@"PAD" : [self _padAtIndex:i],
+			};
+		}
+
+		source = [profile pipelineForMountpointType:templateType variables:vars error:error];
+		if (!source) {
+			return nil;
+		}
+		[sources appendFormat:@" %@", source];
+	}
+
+	return sources;
+}
+
+- (void)attachToMountpointElement:(GstElement *)element {
+	GstElement *compositor;
+	GstPad *srcpad;
+
+	if (!GST_IS_BIN(element)) {
+		return;
+	}
+
+	// Transfer: FULL
+	compositor = gst_bin_get_by_name(GST_BIN(element), [kVMPOverlayCompositorName UTF8String]);
+	if (!compositor) {
+		VMPWarn(@"Mountpoint pipeline has no compositor named '%@'. Overlays are not shown.",
+				kVMPOverlayCompositorName);
+		return;
+	}
+	// Scale the default positions and sizes once the output size is known
+	// Transfer: FULL
+	srcpad = gst_element_get_static_pad(compositor, "src");
+	if (srcpad) {
+		gst_pad_add_probe(srcpad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, compositorCapsProbeCallback,
+						  (__bridge_retained void *) self, releaseOverlay);
+		gst_object_unref(srcpad);
+	}
+	gst_object_unref(compositor);
+
+	for (NSUInteger i = 0; i < [_overlays count]; i++) {
+		NSDictionary *overlay = _overlays[i];
+		NSString *name;
+		GstElement *appsrc;
+
+		if ([overlay[@"type"] isEqual:kVMPOverlayTypeImage]) {
+			continue;
+		}
+
+		name = [NSString stringWithFormat:@"%@%lu", kVMPOverlaySourcePrefix, (unsigned long) i];
+		// Transfer: FULL
+		appsrc = gst_bin_get_by_name(GST_BIN(element), [name UTF8String]);
+		if (!appsrc || !GST_IS_APP_SRC(appsrc)) {
+			VMPWarn(@"Mountpoint pipeline has no appsrc named '%@'", name);
+			if (appsrc) {
+				gst_object_unref(appsrc);
+			}
+			continue;
+		}
+
+		if ([overlay[@"type"] isEqual:kVMPOverlayTypeLive]) {
+			gchar *escaped = g_markup_escape_text([overlay[@"text"] UTF8String], -1);
+
+			// Rendered once, and repeated by the compositor
+			pushMarkup(appsrc, [NSString stringWithFormat:@"<span background=\"#c00000\" "
+														  @"foreground=\"white\"> %s </span>",
+														  escaped]);
+			gst_app_src_end_of_stream(GST_APP_SRC(appsrc));
+			g_free(escaped);
+			@synchronized(self) {
+				_textUpdates++;
+			}
+		} else {
+			[self _startClock:overlay[@"format"] source:appsrc];
+		}
+
+		gst_object_unref(appsrc);
+	}
+}
+
+// Place the overlays with default positions or sizes relative to the output size. Defaults on the
+// right and bottom half of the reference stream keep their distance to the right and bottom edge.
+- (void)_layoutCompositor:(GstElement *)compositor caps:(GstCaps *)caps {
+	GstStructure *structure;
+	gint width, height;
+	double scale;
+
+	if (gst_caps_get_size(caps) == 0) {
+		return;
+	}
+	// Transfer: NONE
+	structure = gst_caps_get_structure(caps, 0);
+	if (!gst_structure_get_int(structure, "width", &width) ||
+		!gst_structure_get_int(structure, "height", &height) || height <= 0) {
+		return;
+	}
+	scale = (double) height / kReferenceHeight;
+
+	for (NSUInteger i = 0; i < [_overlays count]; i++) {
+		NSDictionary *overlay = _overlays[i];
+		NSArray<NSString *> *defaults = overlay[@"defaults"];
+		gint x, y, overlayWidth, overlayHeight;
+		GstPad *pad;
+
+		if ([defaults count] == 0) {
+			continue;
+		}
+
+		// Transfer: FULL
+		pad = gst_element_get_static_pad(compositor, [[self _padAtIndex:i] UTF8String]);
+		if (!pad) {
+			continue;
+		}
+
+		x = [overlay[@"x"] intValue];
+		y = [overlay[@"y"] intValue];
+		overlayWidth = [overlay[@"width"] intValue];
+		overlayHeight = [overlay[@"height"] intValue];
+		if ([defaults containsObject:@"width"]) {
+			g_object_set(pad, "width", (gint) (overlayWidth * scale), NULL);
+		}
+		if ([defaults containsObject:@"height"]) {
+			g_object_set(pad, "height", (gint) (overlayHeight * scale), NULL);
+		}
+		if ([defaults containsObject:@"x"]) {
+			x = x > kReferenceWidth / 2 ? width - (gint) ((kReferenceWidth - x) * scale)
+										: (gint) (x * scale);
+			g_object_set(pad, "xpos", MAX(x, 0), NULL);
+		}
+		if ([defaults containsObject:@"y"]) {
+			y = y > kReferenceHeight / 2 ? height - (gint) ((kReferenceHeight - y) * scale)
+										 : (gint) (y * scale);
+			g_object_set(pad, "ypos", MAX(y, 0), NULL);
+		}
+
+		gst_object_unref(pad);
+	}
+
+	VMPDebug(@"Overlays placed for an output of %dx%d", width, height);
+}
+
+// Render the clock whenever its text changes, until the appsrc is destroyed
+- (void)_startClock:(NSString *)format source:(GstElement *)appsrc {
+	dispatch_source_t timer;
+	GWeakRef *source;
+	__block NSString *lastMarkup = nil;
+	__weak VMPOverlay *weakSelf = self;
+
+	source = g_new0(GWeakRef, 1);
+	g_weak_ref_init(source, appsrc);
+
+	timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+								   dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+	dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, 0),
+							  (uint64_t) (kClockCheckInterval * NSEC_PER_SEC),
+							  (uint64_t) (kClockCheckInterval * NSEC_PER_SEC / 10));
+	dispatch_source_set_event_handler(timer, ^{
+	  GstElement *element;
+	  NSString *markup;
+
+	  // Transfer: FULL
+	  element = g_weak_ref_get(source);
+	  if (!element) {
+		  dispatch_source_cancel(timer);
+		  return;
+	  }
+
+	  markup = clockMarkup(format);
+	  if (![markup isEqualToString:lastMarkup]) {
+		  VMPOverlay *strongSelf = weakSelf;
+
+		  pushMarkup(element, markup);
+		  lastMarkup = markup;
+		  if (strongSelf) {
+			  @synchronized(strongSelf) {
+				  strongSelf->_textUpdates++;
+			  }
+		  }
+	  }
+	  gst_object_unref(element);
+	});
+	dispatch_source_set_cancel_handler(timer, ^{
+	  g_weak_ref_clear(source);
+	  g_free(source);
+	});
+	dispatch_resume(timer);
+}
+
+- (NSDictionary *)statistics {
+	@synchronized(self) {
+		return @{
+			@"overlays" : @([_overlays count]),
+			@"textUpdates" : @(_textUpdates),
+		};
+	}
+}
+
+@end
@@ -0,0 +1,33 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import "VMPPipelineManager.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+// A category for (re)defining properties and declaring methods for internal use
+@interface VMPPipelineManager ()
+
+@property (nonatomic, readwrite) NSString *state;
+@property (nonatomic, readwrite) NSString *channel;
+@property (nonatomic, readwrite) NSMutableDictionary *statistics;
+
+/**
+ * @brief The underlying GStreamer pipeline
+ *
+ * NULL if the pipeline was not created yet, or was stopped. The pipeline is
+ * owned by the manager. Take a reference if you need it beyond the current
+ * run loop iteration.
+ */
+@property (nonatomic, nullable) GstElement *pipeline;
+
+// Pipeline management
+- (BOOL)_createPipelineWithError:(NSError **)error;
+- (BOOL)_resumePipelineWithError:(NSError **)error;
+
+@end
+
+NS_ASSUME_NONNULL_END
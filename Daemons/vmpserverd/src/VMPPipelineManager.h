@@ -7,6 +7,16 @@
 #import <Foundation/Foundation.h>
 #import <gst/gst.h>
 
+#import "VMPChannelDemand.h"
+#import "VMPEncodedChannel.h"
+#import "VMPEventTimeline.h"
+#import "VMPFlowWatchdog.h"
+#import "VMPLatencyProbe.h"
+#import "VMPMemoryBudget.h"
+#import "VMPSignalSlate.h"
+#import "VMPStaticContentDetector.h"
+#import "VMPThreadMonitor.h"
+
 NS_ASSUME_NONNULL_BEGIN
 
 /// The initial state of the pipeline after creation
@@ -54,6 +64,15 @@ extern NSString *const kVMPStatisticsNumberOfRestarts;
  * forward this event if the delegate implemented this method.
  */
 - (void)onBusEvent:(GstMessage *)message manager:(VMPPipelineManager *)mgr;
+
+/**
+ * @brief Called when a new pipeline was created, before it starts playing
+ *
+ * @param pipeline The GStreamer pipeline
+ *
+ * This is called once for every pipeline, including restarts.
+ */
+- (void)onPipelineCreated:(GstElement *)pipeline manager:(VMPPipelineManager *)mgr;
 @end
 
 /**
@@ -114,6 +133,96 @@ extern NSString *const kVMPStatisticsNumberOfRestarts;
  */
 @property (nonatomic, readonly) NSDictionary *statistics;
 
+/**
+ * @brief Streaming threads and CPU usage of the pipeline
+ *
+ * The monitor is created with the manager, and attached to every pipeline
+ * created by it, so statistics survive restarts. @see VMPThreadMonitor
+ */
+@property (nonatomic, readonly) VMPThreadMonitor *threadMonitor;
+
+/**
+ * @brief Recent bus events and restarts of the pipeline
+ *
+ * Like the thread monitor, the timeline is shared by all pipelines created by
+ * the manager. @see VMPEventTimeline
+ */
+@property (nonatomic, readonly) VMPEventTimeline *timeline;
+
+/**
+ * @brief Optional latency probe for the pipeline
+ *
+ * If set, buffers are stamped at the source, and the latency of the capture
+ * stage is measured at the intervideosink. @see VMPLatencyProbe
+ *
+ * @note Changing the probe takes effect on the next pipeline restart.
+ */
+@property (nonatomic, strong, nullable) VMPLatencyProbe *latencyProbe;
+
+/**
+ * @brief Distributor of the encoded stream of a passthrough channel
+ *
+ * If set, it is attached to every pipeline created by the manager.
+ * @see VMPEncodedChannel
+ */
+@property (nonatomic, strong, nullable) VMPEncodedChannel *encodedChannel;
+
+/**
+ * @brief Adapts the output format of the channel to its consumers
+ *
+ * If set, it is attached to every pipeline created by the manager.
+ * @see VMPChannelDemand
+ */
+@property (nonatomic, strong, nullable) VMPChannelDemand *demand;
+
+/**
+ * @brief Optional static-content detector of the channel
+ *
+ * If set, it is attached to every pipeline created by the manager.
+ * @see VMPStaticContentDetector
+ */
+@property (nonatomic, strong, nullable) VMPStaticContentDetector *staticContentDetector;
+
+/**
+ * @brief Optional slate shown while the channel has no signal
+ *
+ * If set, it is attached to every pipeline created by the manager.
+ * @see VMPSignalSlate
+ */
+@property (nonatomic, strong, nullable) VMPSignalSlate *slate;
+
+/**
+ * @brief Optional memory budget for the queues of the pipeline
+ *
+ * @see VMPMemoryBudget
+ *
+ * @note Changing the budget takes effect on the next pipeline restart.
+ */
+@property (nonatomic, strong, nullable) VMPMemoryBudget *memoryBudget;
+
+/**
+ * @brief Stall timeout of the buffer-flow watchdog in seconds
+ *
+ * If greater than zero, a VMPFlowWatchdog is created for every pipeline. A
+ * stall is reported to the delegate as an element message on the bus.
+ * Defaults to 0 (disabled).
+ *
+ * @note Changing the timeout takes effect on the next pipeline restart.
+ */
+@property (nonatomic, assign) NSTimeInterval watchdogTimeout;
+
+/// The watchdog of the current pipeline, or nil if disabled or stopped
+@property (nonatomic, readonly, nullable) VMPFlowWatchdog *watchdog;
+
+/**
+ * @brief Restart the pipeline after an error
+ *
+ * By default, only an EOS or a stall restarts the pipeline. Sources which may
+ * lose their connection (e.g. network streams) report this as an error, and
+ * are reconnected by a restart. Defaults to NO.
+ */
+@property (nonatomic, assign) BOOL restartOnError;
+
 /**
  * @brief The VMPPipelineManager convenience initialiser
  *
@@ -170,6 +279,24 @@ extern NSString *const kVMPStatisticsNumberOfRestarts;
  */
 - (nullable NSData *)pipelineDotGraph;
 
+/**
+ * @brief The current GStreamer pipeline
+ *
+ * Safe to call from any thread. The pipeline may be stopped concurrently, so
+ * the returned reference must be released with gst_object_unref().
+ *
+ * @returns the pipeline (Transfer: FULL), or NULL if it is not running
+ */
+- (nullable GstElement *)copyPipeline;
+
+/**
+ * @brief Live element graph of the pipeline
+ *
+ * @returns the topology as described in VMPPipelineTopology, or nil if the
+ * pipeline is not running
+ */
+- (nullable NSDictionary *)pipelineTopology;
+
 /**
  * @brief Starts the pipeline manager
  *
@@ -8,7 +8,8 @@
 
 #import "VMPErrors.h"
 #import "VMPJournal.h"
-#import "VMPPipelineManager.h"
+#import "VMPPipelineManager+Private.h"
+#import "VMPPipelineTopology.h"
 
 NSString *const kVMPStateCreated = @"created";
 NSString *const kVMPStatePlaying = @"playing";
@@ -29,6 +30,10 @@ static gboolean gstreamer_bus_cb(GstBus *bus, GstMessage *message, void *mgr) {
 	__unsafe_unretained VMPPipelineManager *localManager = (__bridge id) mgr;
 
 	if (localManager != nil) {
+		if ([localManager pipeline] != NULL) {
+			[[localManager timeline] recordBusMessage:message pipeline:[localManager pipeline]];
+		}
+
 		// If the delegate responds to the onBusEvent:manager: selector, call it
 		if ([[localManager delegate] respondsToSelector:@selector(onBusEvent:manager:)]) {
 			[[localManager delegate] onBusEvent:message manager:localManager];
@@ -39,20 +44,6 @@ static gboolean gstreamer_bus_cb(GstBus *bus, GstMessage *message, void *mgr) {
 	return TRUE;
 }
 
-// A category for (re)defining properties and declaring classes for private use
-@interface VMPPipelineManager ()
-
-@property (nonatomic, readwrite) NSString *state;
-@property (nonatomic, readwrite) NSString *channel;
-@property (nonatomic) GstElement *pipeline;
-@property (nonatomic, readwrite) NSMutableDictionary *statistics;
-
-// Pipeline management
-- (BOOL)_createPipelineWithError:(NSError **)error;
-- (BOOL)_resumePipelineWithError:(NSError **)error;
-
-@end
-
 @implementation VMPPipelineManager {
   @protected
 	BOOL _pipelineCreated;
@@ -87,6 +78,8 @@ static gboolean gstreamer_bus_cb(GstBus *bus, GstMessage *message, void *mgr) {
 		_pipeline = NULL;
 		_pipelineCreated = NO;
 		_statistics = [NSMutableDictionary dictionaryWithDictionary:initialStatistics];
+		_threadMonitor = [VMPThreadMonitor monitorWithName:channel];
+		_timeline = [[VMPEventTimeline alloc] init];
 		_description = [NSString stringWithFormat:@"<%@: %p> channel: %@, launch args: %@",
 												  NSStringFromClass([self class]), self, _channel,
 												  _launchArgs];
@@ -94,17 +87,27 @@ static gboolean gstreamer_bus_cb(GstBus *bus, GstMessage *message, void *mgr) {
 	return self;
 }
 
+- (GstElement *)copyPipeline {
+	@synchronized(self) {
+		return _pipeline ? gst_object_ref(_pipeline) : NULL;
+	}
+}
+
 - (NSData *)pipelineDotGraph {
 	NSData *data;
-	GstBin *bin;
+	GstElement *pipeline;
 	gchar *dot;
 
-	if (_pipeline == NULL || !GST_IS_BIN(_pipeline)) {
+	// Transfer: FULL
+	pipeline = [self copyPipeline];
+	if (pipeline == NULL) {
 		return nil;
 	}
 
-	bin = GST_BIN(_pipeline);
-	dot = gst_debug_bin_to_dot_data(bin, GST_DEBUG_GRAPH_SHOW_ALL);
+	dot = GST_IS_BIN(pipeline) ? gst_debug_bin_to_dot_data(GST_BIN(pipeline),
+														   GST_DEBUG_GRAPH_SHOW_ALL)
+							   : NULL;
+	gst_object_unref(pipeline);
 	if (dot == NULL) {
 		return nil;
 	}
@@ -115,6 +118,21 @@ static gboolean gstreamer_bus_cb(GstBus *bus, GstMessage *message, void *mgr) {
 	return data;
 }
 
+- (NSDictionary *)pipelineTopology {
+	NSDictionary *topology;
+	GstElement *pipeline;
+
+	// Transfer: FULL
+	pipeline = [self copyPipeline];
+	if (pipeline == NULL) {
+		return nil;
+	}
+
+	topology = VMPPipelineTopology(pipeline);
+	gst_object_unref(pipeline);
+	return topology;
+}
+
 - (BOOL)start {
 	NSError *error = nil;
 
@@ -126,12 +144,21 @@ static gboolean gstreamer_bus_cb(GstBus *bus, GstMessage *message, void *mgr) {
 
 	// Update restart statistics
 	_statistics[kVMPStatisticsNumberOfRestarts] = [NSNumber numberWithInteger:_numberOfStarts];
+	if (_numberOfStarts > 0) {
+		[_timeline recordEventWithType:kVMPEventTypeRestart
+								source:nil
+							   message:[NSString stringWithFormat:@"Restart #%ld",
+																  (long) _numberOfStarts]];
+	}
 	_numberOfStarts++;
 
 	// Start pipeline immediately
 	if (![self _createPipelineWithError:&error]) {
 		if (error != nil) {
 			VMPError(@"%@", error);
+			[_timeline recordEventWithType:kVMPEventTypeError
+									source:nil
+								   message:[error localizedDescription]];
 		}
 
 		if (error != nil && [error code] == VMPErrorCodeGStreamerParseError) {
@@ -149,6 +176,7 @@ static gboolean gstreamer_bus_cb(GstBus *bus, GstMessage *message, void *mgr) {
  * Subsequent calls will return YES.
  */
 - (BOOL)_createPipelineWithError:(NSError **)error {
+	GstElement *pipeline;
 	GstBus *bus;
 	GstStateChangeReturn ret;
 	GError *gerror = NULL;
@@ -159,7 +187,11 @@ static gboolean gstreamer_bus_cb(GstBus *bus, GstMessage *message, void *mgr) {
 	_pipelineCreated = YES;
 
 	// Transfer: Full. Deallocation (decreasing reference count) in dealloc:
-	_pipeline = gst_parse_launch([_launchArgs UTF8String], &gerror);
+	pipeline = gst_parse_launch([_launchArgs UTF8String], &gerror);
+	// Read by copyPipeline from other threads
+	@synchronized(self) {
+		_pipeline = pipeline;
+	}
 	if (_pipeline == NULL) {
 		VMPError(@"gst_parse_launch returned NULL while parsing launch args: %@", _launchArgs);
 
@@ -180,6 +212,34 @@ static gboolean gstreamer_bus_cb(GstBus *bus, GstMessage *message, void *mgr) {
 
 	VMPDebug(@"Created pipeline with launch args: %@", _launchArgs);
 
+	if (_latencyProbe) {
+		[_latencyProbe attachToChannelPipeline:_pipeline];
+	}
+	if (_memoryBudget) {
+		[_memoryBudget applyToPipeline:_pipeline];
+	}
+	if (_encodedChannel) {
+		[_encodedChannel attachToChannelPipeline:_pipeline];
+	}
+	if (_demand) {
+		[_demand attachToChannelPipeline:_pipeline];
+	}
+	if (_staticContentDetector) {
+		[_staticContentDetector attachToChannelPipeline:_pipeline];
+	}
+	if (_slate) {
+		[_slate attachToChannelPipeline:_pipeline];
+	}
+	if (_watchdogTimeout > 0) {
+		_watchdog = [VMPFlowWatchdog watchdogWithPipeline:_pipeline timeout:_watchdogTimeout];
+	}
+	if ([[self delegate] respondsToSelector:@selector(onPipelineCreated:manager:)]) {
+		[[self delegate] onPipelineCreated:_pipeline manager:self];
+	}
+
+	// Name and track streaming threads as they are created
+	[_threadMonitor attachToPipeline:_pipeline];
+
 	// Transfer: Full
 	bus = gst_element_get_bus(_pipeline);
 	if (bus != NULL) {
@@ -242,11 +302,20 @@ static gboolean gstreamer_bus_cb(GstBus *bus, GstMessage *message, void *mgr) {
 }
 
 - (void)stop {
+	[_watchdog invalidate];
+	_watchdog = nil;
+
 	if ([self pipeline] != NULL) {
-		gst_element_set_state([self pipeline], GST_STATE_NULL);
-		gst_object_unref(_pipeline);
+		GstElement *pipeline;
+
+		// Callers of copyPipeline keep their reference
+		@synchronized(self) {
+			pipeline = _pipeline;
+			_pipeline = NULL;
+		}
+		gst_element_set_state(pipeline, GST_STATE_NULL);
+		gst_object_unref(pipeline);
 
-		_pipeline = NULL;
 		_pipelineCreated = NO;
 
 		[self setState:kVMPStateCreated];
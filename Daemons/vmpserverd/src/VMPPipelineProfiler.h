@@ -0,0 +1,86 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Upper bound for the duration of a profiling session in seconds
+extern const NSTimeInterval kVMPProfilerMaximumDuration;
+
+/**
+ * @brief Time-bounded tracing of a running pipeline
+ *
+ * GStreamer tracers (GST_TRACERS) can only be enabled when the process starts,
+ * and are active for all pipelines. The profiler instead attaches pad probes
+ * to the elements of a single pipeline for a bounded time window, and removes
+ * them afterwards. Nothing is installed while no session is running.
+ *
+ * The following data is aggregated into per-element histograms:
+ * @li "proctime" - Time between a buffer entering a sink pad, and the element
+ * pushing a buffer on a source pad in the same thread. This is the same
+ * definition as used by the proctime tracer.
+ * @li "latency" - Time between the capture time of a buffer (running time of
+ * its PTS) and its arrival at a sink element, or at an RTP payloader.
+ * @li "queue" - Fill level of queue elements, sampled every 50ms.
+ *
+ * The report is kept in memory until the next session is started.
+ */
+@interface VMPPipelineProfiler : NSObject
+
+/// Name of the profiled pipeline (e.g. the channel or mountpoint name)
+@property (nonatomic, readonly) NSString *name;
+
+/// Duration of the session in seconds
+@property (nonatomic, readonly) NSTimeInterval duration;
+
+/// Date at which the session was started
+@property (nonatomic, readonly) NSDate *startedAt;
+
+/// YES while probes are attached to the pipeline
+@property (atomic, readonly, getter=isRunning) BOOL running;
+
+/**
+ * @brief Start profiling a pipeline
+ *
+ * @param element The pipeline, or the top-level bin of a mountpoint media
+ * @param name The name of the pipeline used in the report
+ * @param duration The duration of the session. Clamped to
+ * kVMPProfilerMaximumDuration.
+ *
+ * The session stops automatically after the duration elapsed.
+ *
+ * @returns a running profiler
+ */
++ (instancetype)profilerWithElement:(GstElement *)element
+							   name:(NSString *)name
+						   duration:(NSTimeInterval)duration;
+
+- (instancetype)initWithElement:(GstElement *)element
+						   name:(NSString *)name
+					   duration:(NSTimeInterval)duration;
+
+/**
+ * @brief Stop the session early and detach all probes
+ */
+- (void)stop;
+
+/**
+ * @brief JSON-compatible report of the session
+ *
+ * Histograms are in microseconds (queue levels additionally in buffers and
+ * bytes). Each histogram has the keys "count", "min", "max", "mean", "p50",
+ * "p90", "p99", and "buckets". "buckets" is an array of [upperBound, count]
+ * pairs with power-of-two upper bounds, and only contains non-empty buckets.
+ *
+ * The report can be requested while the session is running.
+ */
+- (NSDictionary *)report;
+
+@end
+
+NS_ASSUME_NONNULL_END
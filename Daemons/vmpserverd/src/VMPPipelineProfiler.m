@@ -0,0 +1,476 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <dispatch/dispatch.h>
+
+#import "VMPGStreamerUtils.h"
+#import "VMPJournal.h"
+#import "VMPPipelineProfiler.h"
+
+const NSTimeInterval kVMPProfilerMaximumDuration = 60.0;
+
+// Number of power-of-two buckets per histogram
+#define VMP_HISTOGRAM_BUCKETS 40
+// Interval at which queue levels are sampled
+#define VMP_QUEUE_SAMPLE_INTERVAL (50 * NSEC_PER_MSEC)
+
+typedef struct {
+	guint64 count;
+	guint64 sum;
+	guint64 min;
+	guint64 max;
+	// Bucket i contains values v with 2^(i-1) <= v < 2^i. Bucket 0 contains zero.
+	guint64 buckets[VMP_HISTOGRAM_BUCKETS];
+} VMPHistogram;
+
+typedef struct _VMPProfileSession VMPProfileSession;
+
+// Per-element state. Probe callbacks and the queue sampler lock the trace.
+typedef struct {
+	VMPProfileSession *session;
+	GstElement *element;
+	gchar *name;
+	gchar *factory;
+	BOOL isQueue;
+	guint maxSizeBuffers;
+	guint maxSizeBytes;
+	guint64 maxSizeTime;
+
+	GMutex lock;
+	// Thread and time of the last buffer entering a sink pad
+	GThread *entryThread;
+	GstClockTime entryTime;
+
+	VMPHistogram proctime;
+	VMPHistogram latency;
+	VMPHistogram queueTime;
+	VMPHistogram queueBuffers;
+	VMPHistogram queueBytes;
+} VMPElementTrace;
+
+// Shared between the profiler, the installed probes, and the queue sampler
+struct _VMPProfileSession {
+	gint refcount;
+	GPtrArray *traces;
+};
+
+typedef struct {
+	GstPad *pad;
+	gulong id;
+} VMPInstalledProbe;
+
+#pragma mark - Histograms
+
+static void histogramAdd(VMPHistogram *h, guint64 value) {
+	guint bucket;
+
+	bucket = value == 0 ? 0 : MIN(g_bit_storage(value), VMP_HISTOGRAM_BUCKETS - 1);
+	h->buckets[bucket]++;
+	if (h->count == 0 || value < h->min) {
+		h->min = value;
+	}
+	if (value > h->max) {
+		h->max = value;
+	}
+	h->sum += value;
+	h->count++;
+}
+
+static guint64 histogramPercentile(VMPHistogram *h, double p) {
+	guint64 target, cumulative = 0;
+
+	target = (guint64) (p * h->count);
+	for (guint i = 0; i < VMP_HISTOGRAM_BUCKETS; i++) {
+		cumulative += h->buckets[i];
+		if (cumulative > target || cumulative == h->count) {
+			// Upper bound of the bucket, but never beyond the observed maximum
+			return MIN(i == 0 ? 0 : (G_GUINT64_CONSTANT(1) << i) - 1, h->max);
+		}
+	}
+	return h->max;
+}
+
+static NSDictionary *histogramPropertyList(VMPHistogram *h) {
+	NSMutableArray *buckets;
+
+	buckets = [NSMutableArray array];
+	for (guint i = 0; i < VMP_HISTOGRAM_BUCKETS; i++) {
+		if (h->buckets[i] > 0) {
+			[buckets addObject:@[ @(G_GUINT64_CONSTANT(1) << i), @(h->buckets[i]) ]];
+		}
+	}
+
+	return @{
+		@"count" : @(h->count),
+		@"min" : @(h->min),
+		@"max" : @(h->max),
+		@"mean" : @((double) h->sum / h->count),
+		@"p50" : @(histogramPercentile(h, 0.50)),
+		@"p90" : @(histogramPercentile(h, 0.90)),
+		@"p99" : @(histogramPercentile(h, 0.99)),
+		@"buckets" : buckets,
+	};
+}
+
+#pragma mark - Session
+
+static void traceFree(gpointer data) {
+	VMPElementTrace *trace = data;
+
+	gst_object_unref(trace->element);
+	g_free(trace->name);
+	g_free(trace->factory);
+	g_mutex_clear(&trace->lock);
+	g_free(trace);
+}
+
+static VMPProfileSession *sessionRef(VMPProfileSession *session) {
+	g_atomic_int_inc(&session->refcount);
+	return session;
+}
+
+static void sessionUnref(VMPProfileSession *session) {
+	if (g_atomic_int_dec_and_test(&session->refcount)) {
+		g_ptr_array_free(session->traces, TRUE);
+		g_free(session);
+	}
+}
+
+// Destroy notify of pad probes
+static void traceProbeRemoved(gpointer data) {
+	VMPElementTrace *trace = data;
+
+	sessionUnref(trace->session);
+}
+
+#pragma mark - Pad probes
+
+static GstBuffer *bufferFromProbeInfo(GstPadProbeInfo *info) {
+	if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+		return GST_PAD_PROBE_INFO_BUFFER(info);
+	}
+	if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+		GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+		if (gst_buffer_list_length(list) > 0) {
+			return gst_buffer_list_get(list, 0);
+		}
+	}
+	return NULL;
+}
+
+static GstPadProbeReturn entryProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											gpointer user_data) {
+	VMPElementTrace *trace = user_data;
+
+	g_mutex_lock(&trace->lock);
+	trace->entryThread = g_thread_self();
+	trace->entryTime = gst_util_get_timestamp();
+	g_mutex_unlock(&trace->lock);
+
+	return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn exitProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+										   gpointer user_data) {
+	VMPElementTrace *trace = user_data;
+	GstClockTime now;
+
+	now = gst_util_get_timestamp();
+
+	g_mutex_lock(&trace->lock);
+	// Only the first output after an input counts, and only in the same thread
+	if (trace->entryThread == g_thread_self()) {
+		histogramAdd(&trace->proctime, (now - trace->entryTime) / GST_USECOND);
+		trace->entryThread = NULL;
+	}
+	g_mutex_unlock(&trace->lock);
+
+	return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn latencyProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											  gpointer user_data) {
+	VMPElementTrace *trace = user_data;
+	const GstSegment *segment;
+	GstClockTime runningTime, now, baseTime;
+	GstBuffer *buffer;
+	GstEvent *event;
+	GstClock *clock;
+
+	buffer = bufferFromProbeInfo(info);
+	if (!buffer || !GST_BUFFER_PTS_IS_VALID(buffer)) {
+		return GST_PAD_PROBE_OK;
+	}
+
+	// Transfer: FULL
+	event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+	if (!event) {
+		return GST_PAD_PROBE_OK;
+	}
+	gst_event_parse_segment(event, &segment);
+	runningTime = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+	gst_event_unref(event);
+
+	// Transfer: FULL
+	clock = gst_element_get_clock(trace->element);
+	if (!clock || !GST_CLOCK_TIME_IS_VALID(runningTime)) {
+		if (clock) {
+			gst_object_unref(clock);
+		}
+		return GST_PAD_PROBE_OK;
+	}
+	now = gst_clock_get_time(clock);
+	gst_object_unref(clock);
+
+	baseTime = gst_element_get_base_time(trace->element);
+	if (now > baseTime + runningTime) {
+		g_mutex_lock(&trace->lock);
+		histogramAdd(&trace->latency, (now - baseTime - runningTime) / GST_USECOND);
+		g_mutex_unlock(&trace->lock);
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+#pragma mark - VMPPipelineProfiler
+
+@implementation VMPPipelineProfiler {
+	VMPProfileSession *_session;
+	GArray *_probes;
+	dispatch_queue_t _queue;
+	dispatch_source_t _sampler;
+}
+
++ (instancetype)profilerWithElement:(GstElement *)element
+							   name:(NSString *)name
+						   duration:(NSTimeInterval)duration {
+	return [[VMPPipelineProfiler alloc] initWithElement:element name:name duration:duration];
+}
+
+- (instancetype)initWithElement:(GstElement *)element
+						   name:(NSString *)name
+					   duration:(NSTimeInterval)duration {
+	VMP_ASSERT(element, @"element cannot be NULL");
+	VMP_ASSERT(GST_IS_BIN(element), @"element must be a bin");
+
+	self = [super init];
+	if (self) {
+		_name = [name copy];
+		_duration = MAX(MIN(duration, kVMPProfilerMaximumDuration), 1.0);
+		_startedAt = [NSDate date];
+		_session = g_new0(VMPProfileSession, 1);
+		_session->refcount = 1;
+		_session->traces = g_ptr_array_new_with_free_func(traceFree);
+		_probes = g_array_new(FALSE, FALSE, sizeof(VMPInstalledProbe));
+		_queue = dispatch_queue_create("com.hugomelder.vmpserverd.profiler", DISPATCH_QUEUE_SERIAL);
+
+		[self _attachToBin:GST_BIN(element)];
+		[self _startQueueSampler];
+		_running = YES;
+
+		VMPInfo(@"Profiling pipeline '%@' for %.0f seconds (%u elements)", _name, _duration,
+				_session->traces->len);
+
+		__weak VMPPipelineProfiler *weakSelf = self;
+		dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t) (_duration * NSEC_PER_SEC)),
+					   _queue, ^{
+						 [weakSelf stop];
+					   });
+	}
+	return self;
+}
+
+- (void)_addProbeToPad:(GstPad *)pad
+				  type:(GstPadProbeType)type
+			  callback:(GstPadProbeCallback)callback
+				 trace:(VMPElementTrace *)trace {
+	VMPInstalledProbe probe;
+
+	sessionRef(_session);
+	probe.pad = gst_object_ref(pad);
+	probe.id = gst_pad_add_probe(pad, type, callback, trace, traceProbeRemoved);
+	g_array_append_val(_probes, probe);
+}
+
+- (void)_attachToBin:(GstBin *)bin {
+	VMPForEachElement(bin, ^(GstElement *element) {
+		VMPElementTrace *trace;
+		BOOL isSink, isPayloader;
+		GstPadProbeType type;
+
+		// Only leaf elements do actual processing
+		if (GST_IS_BIN(element)) {
+			return;
+		}
+
+		trace = g_new0(VMPElementTrace, 1);
+		trace->session = _session;
+		trace->element = gst_object_ref(element);
+		trace->name = gst_element_get_name(element);
+		trace->factory = g_strdup(VMPElementFactoryName(element));
+		g_mutex_init(&trace->lock);
+		g_ptr_array_add(_session->traces, trace);
+
+		type = GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST;
+		isSink = GST_OBJECT_FLAG_IS_SET(element, GST_ELEMENT_FLAG_SINK);
+		isPayloader = g_str_has_prefix(trace->name, "pay");
+
+		// proctime is only defined for elements with inputs and outputs
+		if (element->numsinkpads > 0 && element->numsrcpads > 0) {
+			for (GList *l = element->sinkpads; l != NULL; l = l->next) {
+				[self _addProbeToPad:GST_PAD(l->data)
+								type:type
+							callback:entryProbeCallback
+							   trace:trace];
+			}
+			for (GList *l = element->srcpads; l != NULL; l = l->next) {
+				[self _addProbeToPad:GST_PAD(l->data)
+								type:type
+							callback:exitProbeCallback
+							   trace:trace];
+			}
+		}
+
+		// Latency is measured where buffers leave the pipeline
+		if (isSink) {
+			for (GList *l = element->sinkpads; l != NULL; l = l->next) {
+				[self _addProbeToPad:GST_PAD(l->data)
+								type:type
+							callback:latencyProbeCallback
+							   trace:trace];
+			}
+		} else if (isPayloader) {
+			for (GList *l = element->srcpads; l != NULL; l = l->next) {
+				[self _addProbeToPad:GST_PAD(l->data)
+								type:type
+							callback:latencyProbeCallback
+							   trace:trace];
+			}
+		}
+
+		// Any element with queue level properties (queue, queue2)
+		if (g_object_class_find_property(G_OBJECT_GET_CLASS(element), "current-level-time")) {
+			trace->isQueue = YES;
+			g_object_get(element, "max-size-buffers", &trace->maxSizeBuffers, "max-size-bytes",
+						 &trace->maxSizeBytes, "max-size-time", &trace->maxSizeTime, NULL);
+		}
+	});
+}
+
+- (void)_startQueueSampler {
+	VMPProfileSession *session;
+
+	// The sampler holds its own reference, as the handler may still run while the
+	// profiler is deallocated.
+	session = sessionRef(_session);
+
+	_sampler = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+	dispatch_source_set_timer(_sampler, dispatch_time(DISPATCH_TIME_NOW, 0),
+							  VMP_QUEUE_SAMPLE_INTERVAL, VMP_QUEUE_SAMPLE_INTERVAL / 10);
+	dispatch_source_set_event_handler(_sampler, ^{
+	  for (guint i = 0; i < session->traces->len; i++) {
+		  VMPElementTrace *trace = g_ptr_array_index(session->traces, i);
+		  guint buffers, bytes;
+		  guint64 time;
+
+		  if (!trace->isQueue) {
+			  continue;
+		  }
+
+		  g_object_get(trace->element, "current-level-buffers", &buffers, "current-level-bytes",
+					   &bytes, "current-level-time", &time, NULL);
+
+		  g_mutex_lock(&trace->lock);
+		  histogramAdd(&trace->queueTime, time / GST_USECOND);
+		  histogramAdd(&trace->queueBuffers, buffers);
+		  histogramAdd(&trace->queueBytes, bytes);
+		  g_mutex_unlock(&trace->lock);
+	  }
+	});
+	dispatch_source_set_cancel_handler(_sampler, ^{
+	  sessionUnref(session);
+	});
+	dispatch_resume(_sampler);
+}
+
+- (void)stop {
+	@synchronized(self) {
+		if (!_running) {
+			return;
+		}
+
+		dispatch_source_cancel(_sampler);
+		_sampler = nil;
+
+		for (guint i = 0; i < _probes->len; i++) {
+			VMPInstalledProbe *probe = &g_array_index(_probes, VMPInstalledProbe, i);
+
+			gst_pad_remove_probe(probe->pad, probe->id);
+			gst_object_unref(probe->pad);
+		}
+		g_array_set_size(_probes, 0);
+
+		_running = NO;
+	}
+
+	VMPInfo(@"Profiling of pipeline '%@' finished", _name);
+}
+
+- (NSDictionary *)report {
+	NSMutableDictionary *elements;
+	NSISO8601DateFormatter *formatter;
+
+	elements = [NSMutableDictionary dictionaryWithCapacity:_session->traces->len];
+
+	for (guint i = 0; i < _session->traces->len; i++) {
+		VMPElementTrace *trace = g_ptr_array_index(_session->traces, i);
+		NSMutableDictionary *entry;
+
+		entry = [NSMutableDictionary dictionary];
+		entry[@"factory"] = trace->factory ? @(trace->factory) : @"";
+
+		g_mutex_lock(&trace->lock);
+		if (trace->proctime.count > 0) {
+			entry[@"proctime"] = histogramPropertyList(&trace->proctime);
+		}
+		if (trace->latency.count > 0) {
+			entry[@"latency"] = histogramPropertyList(&trace->latency);
+		}
+		if (trace->isQueue && trace->queueTime.count > 0) {
+			entry[@"queue"] = @{
+				@"limits" : @{
+					@"buffers" : @(trace->maxSizeBuffers),
+					@"bytes" : @(trace->maxSizeBytes),
+					@"time" : @(trace->maxSizeTime / GST_USECOND),
+				},
+				@"time" : histogramPropertyList(&trace->queueTime),
+				@"buffers" : histogramPropertyList(&trace->queueBuffers),
+				@"bytes" : histogramPropertyList(&trace->queueBytes),
+			};
+		}
+		g_mutex_unlock(&trace->lock);
+
+		elements[@(trace->name)] = entry;
+	}
+
+	formatter = [[NSISO8601DateFormatter alloc] init];
+
+	return @{
+		@"name" : _name,
+		@"status" : [self isRunning] ? @"running" : @"finished",
+		@"startedAt" : [formatter stringFromDate:_startedAt],
+		@"duration" : @(_duration),
+		@"elements" : elements,
+	};
+}
+
+- (void)dealloc {
+	[self stop];
+	g_array_free(_probes, TRUE);
+	sessionUnref(_session);
+}
+
+@end
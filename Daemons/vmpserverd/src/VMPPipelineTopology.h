@@ -0,0 +1,64 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * @brief Live element graph of a pipeline as a property list
+ *
+ * @param pipeline A channel pipeline, or the top-level element of a mountpoint
+ * media
+ *
+ * In contrast to a dot graph, the topology is cheap to generate and contains
+ * live values, so it can be polled by dashboards.
+ *
+ * Example structure of the returned dictionary:
+ * @code
+ * {
+ *     "name": "pipeline0",
+ *     "state": "playing",
+ *     "latency": {"live": true, "min": 33333333, "max": null},
+ *     "elements": [
+ *         {
+ *             "id": "/pipeline0/queue0", // Unique path of the element
+ *             "name": "queue0",
+ *             "factory": "queue", // null for bins created in code
+ *             "parent": "/pipeline0",
+ *             "bin": false,
+ *             "state": "playing",
+ *             "pendingState": "void_pending",
+ *             "latency": {"live": true, "min": 33333333, "max": null},
+ *             "level": {
+ *                 "current": {"bytes": 6220800, "buffers": 2, "time": 66666666},
+ *                 "limit": {"bytes": 10485760, "buffers": 200, "time": 1000000000},
+ *                 "fill": 0.59
+ *             }
+ *         }
+ *     ],
+ *     "links": [
+ *         {
+ *             "source": "/pipeline0/v4l2src0",
+ *             "sourcePad": "src",
+ *             "sink": "/pipeline0/queue0",
+ *             "sinkPad": "sink",
+ *             "caps": "video/x-raw, format=(string)NV12, width=(int)1920, ..."
+ *         }
+ *     ]
+ * }
+ * @endcode
+ *
+ * Times are in nanoseconds. "latency" is the result of a latency query, and is
+ * omitted if the element did not answer it. A "max" of null means unlimited.
+ * "level" is only present for elements with queue levels (e.g. queue and
+ * queue2). "fill" is the highest ratio of a current level to its limit, where
+ * a limit of 0 means unlimited. "caps" is null if the link is not negotiated.
+ */
+NSDictionary *VMPPipelineTopology(GstElement *pipeline);
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,276 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import "VMPGStreamerUtils.h"
+#import "VMPPipelineTopology.h"
+
+static NSString *stateName(GstState state) {
+	return [@(gst_element_state_get_name(state)) lowercaseString];
+}
+
+static NSString *elementPath(GstElement *element) {
+	NSString *path;
+	gchar *str;
+
+	// Transfer: FULL
+	str = gst_object_get_path_string(GST_OBJECT(element));
+	path = @(str);
+	g_free(str);
+
+	return path;
+}
+
+/* Resolve the element and pad name of a pad. The internal proxy pad of a ghost
+ * pad is attributed to the ghost pad, so links end at the bin.
+ */
+static BOOL describePad(GstPad *pad, NSString **path, NSString **padName) {
+	GstObject *parent;
+
+	// Transfer: FULL
+	parent = gst_object_get_parent(GST_OBJECT(pad));
+	if (parent && GST_IS_PAD(parent)) {
+		GstObject *ghostParent;
+
+		*padName = @(GST_OBJECT_NAME(parent));
+		ghostParent = gst_object_get_parent(parent);
+		gst_object_unref(parent);
+		parent = ghostParent;
+	} else {
+		*padName = @(GST_OBJECT_NAME(pad));
+	}
+
+	if (!parent) {
+		return NO;
+	}
+	if (!GST_IS_ELEMENT(parent)) {
+		gst_object_unref(parent);
+		return NO;
+	}
+
+	*path = elementPath(GST_ELEMENT(parent));
+	gst_object_unref(parent);
+	return YES;
+}
+
+// Read an unsigned integer property of any width
+static BOOL readUnsignedProperty(GstElement *element, const gchar *name, guint64 *value) {
+	GParamSpec *pspec;
+	GValue raw = G_VALUE_INIT;
+	GValue transformed = G_VALUE_INIT;
+	BOOL ok;
+
+	pspec = g_object_class_find_property(G_OBJECT_GET_CLASS(element), name);
+	if (!pspec) {
+		return NO;
+	}
+
+	g_value_init(&raw, pspec->value_type);
+	g_value_init(&transformed, G_TYPE_UINT64);
+	g_object_get_property(G_OBJECT(element), name, &raw);
+
+	ok = g_value_transform(&raw, &transformed);
+	if (ok) {
+		*value = g_value_get_uint64(&transformed);
+	}
+
+	g_value_unset(&raw);
+	g_value_unset(&transformed);
+	return ok;
+}
+
+// Current queue levels against their limits, or nil if the element has no levels
+static NSDictionary *levelOfElement(GstElement *element) {
+	static const gchar *const units[] = {"bytes", "buffers", "time"};
+	NSMutableDictionary *current, *limit;
+	double fill = 0;
+
+	current = [NSMutableDictionary dictionary];
+	limit = [NSMutableDictionary dictionary];
+
+	for (size_t i = 0; i < G_N_ELEMENTS(units); i++) {
+		gchar *currentName, *limitName;
+		guint64 cur, max;
+		BOOL ok;
+
+		currentName = g_strdup_printf("current-level-%s", units[i]);
+		limitName = g_strdup_printf("max-size-%s", units[i]);
+		ok = readUnsignedProperty(element, currentName, &cur) &&
+			 readUnsignedProperty(element, limitName, &max);
+		g_free(currentName);
+		g_free(limitName);
+
+		if (!ok) {
+			continue;
+		}
+
+		current[@(units[i])] = @(cur);
+		limit[@(units[i])] = @(max);
+		if (max > 0) {
+			fill = MAX(fill, (double) cur / max);
+		}
+	}
+
+	if ([current count] == 0) {
+		return nil;
+	}
+
+	return @{@"current" : current, @"limit" : limit, @"fill" : @(fill)};
+}
+
+static NSDictionary *latencyOfElement(GstElement *element) {
+	NSDictionary *latency = nil;
+	GstQuery *query;
+
+	// Transfer: FULL
+	query = gst_query_new_latency();
+	if (gst_element_query(element, query)) {
+		gboolean live;
+		GstClockTime min, max;
+
+		gst_query_parse_latency(query, &live, &min, &max);
+		latency = @{
+			@"live" : @(live),
+			@"min" : @(min),
+			@"max" : GST_CLOCK_TIME_IS_VALID(max) ? @(max) : [NSNull null],
+		};
+	}
+	gst_query_unref(query);
+
+	return latency;
+}
+
+static gboolean addLink(GstElement *element, GstPad *pad, gpointer user_data) {
+	__unsafe_unretained NSMutableDictionary *links = (__bridge id) user_data;
+	NSString *source, *sourcePad, *sink, *sinkPad;
+	GstPad *peer;
+	GstCaps *caps;
+	id capsString;
+
+	// Transfer: FULL
+	peer = gst_pad_get_peer(pad);
+	if (!peer) {
+		return TRUE;
+	}
+
+	if (describePad(pad, &source, &sourcePad) && describePad(peer, &sink, &sinkPad)) {
+		capsString = [NSNull null];
+
+		// Transfer: FULL
+		caps = gst_pad_get_current_caps(pad);
+		if (caps) {
+			gchar *str = gst_caps_to_string(caps);
+			capsString = @(str);
+			g_free(str);
+			gst_caps_unref(caps);
+		}
+
+		links[[NSString stringWithFormat:@"%@.%@", source, sourcePad]] = @{
+			@"source" : source,
+			@"sourcePad" : sourcePad,
+			@"sink" : sink,
+			@"sinkPad" : sinkPad,
+			@"caps" : capsString,
+		};
+	}
+
+	gst_object_unref(peer);
+	return TRUE;
+}
+
+static NSMutableDictionary *describeElement(GstElement *element) {
+	NSMutableDictionary *info;
+	GstObject *parent;
+	const gchar *factory;
+	GstState state, pending;
+
+	GST_OBJECT_LOCK(element);
+	state = GST_STATE(element);
+	pending = GST_STATE_PENDING(element);
+	GST_OBJECT_UNLOCK(element);
+
+	factory = VMPElementFactoryName(element);
+
+	info = [NSMutableDictionary dictionaryWithDictionary:@{
+		@"id" : elementPath(element),
+		@"name" : @(GST_OBJECT_NAME(element)),
+		@"factory" : factory ? @(factory) : [NSNull null],
+		@"bin" : @(GST_IS_BIN(element)),
+		@"state" : stateName(state),
+		@"pendingState" : stateName(pending),
+	}];
+
+	// Transfer: FULL
+	parent = gst_object_get_parent(GST_OBJECT(element));
+	if (parent) {
+		if (GST_IS_ELEMENT(parent)) {
+			info[@"parent"] = elementPath(GST_ELEMENT(parent));
+		}
+		gst_object_unref(parent);
+	}
+
+	return info;
+}
+
+NSDictionary *VMPPipelineTopology(GstElement *pipeline) {
+	NSMutableDictionary<NSString *, NSDictionary *> *elements, *links;
+	NSMutableDictionary *topology;
+	NSDictionary *latency;
+	GstState state;
+
+	elements = [NSMutableDictionary dictionary];
+	links = [NSMutableDictionary dictionary];
+
+	// Links leaving the pipeline itself, e.g. ghost pads of a mountpoint bin
+	gst_element_foreach_src_pad(pipeline, addLink, (__bridge void *) links);
+
+	if (GST_IS_BIN(pipeline)) {
+		VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+		  NSMutableDictionary *info;
+		  NSDictionary *level, *elementLatency;
+
+		  info = describeElement(element);
+
+		  // Keyed by path, as the iterator may return an element twice after a resync
+		  if (elements[info[@"id"]]) {
+			  return;
+		  }
+
+		  // The latency of a bin is the aggregated latency of its sinks
+		  if (!GST_IS_BIN(element)) {
+			  elementLatency = latencyOfElement(element);
+			  if (elementLatency) {
+				  info[@"latency"] = elementLatency;
+			  }
+		  }
+
+		  level = levelOfElement(element);
+		  if (level) {
+			  info[@"level"] = level;
+		  }
+
+		  elements[info[@"id"]] = info;
+		  gst_element_foreach_src_pad(element, addLink, (__bridge void *) links);
+		});
+	}
+
+	GST_OBJECT_LOCK(pipeline);
+	state = GST_STATE(pipeline);
+	GST_OBJECT_UNLOCK(pipeline);
+
+	topology = [NSMutableDictionary dictionaryWithDictionary:@{
+		@"name" : @(GST_OBJECT_NAME(pipeline)),
+		@"state" : stateName(state),
+		@"elements" : [elements allValues],
+		@"links" : [links allValues],
+	}];
+
+	latency = latencyOfElement(pipeline);
+	if (latency) {
+		topology[@"latency"] = latency;
+	}
+
+	return topology;
+}
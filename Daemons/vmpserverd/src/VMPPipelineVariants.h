@@ -0,0 +1,112 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Time a probe pipeline has to produce output if not configured
+extern const NSTimeInterval kVMPPipelineVariantsDefaultProbeTimeout;
+
+/// Interval between attempts to return to a preferred variant if not configured
+extern const NSTimeInterval kVMPPipelineVariantsDefaultRetryInterval;
+
+/**
+ * @brief Ordered pipeline variants of a mountpoint
+ *
+ * Every variant is the launch description of the mountpoint built from one
+ * profile, e.g. a VA-API variant followed by a software variant. The first
+ * variant is preferred. If the active variant fails to reach PLAYING, the
+ * mountpoint falls back to the next one.
+ *
+ * Variants are probed by launching them in a standalone pipeline, with the
+ * payloaders linked to fake sinks. A variant passes the probe once every
+ * payloader produced a buffer, and fails on an error or a timeout.
+ *
+ * All methods are thread-safe. Probing blocks the calling thread.
+ */
+@interface VMPPipelineVariants : NSObject
+
+/// Profile identifiers of the variants, preferred first
+@property (nonatomic, readonly) NSArray<NSString *> *identifiers;
+
+/// Index of the active variant
+@property (atomic, readonly) NSUInteger activeIndex;
+
+/**
+ * @param name The name of the mountpoint
+ * @param identifiers The profile identifiers of the variants, preferred first
+ * @param launchDescriptions The launch descriptions of the variants. Must have
+ * as many entries as identifiers.
+ */
++ (instancetype)variantsWithName:(NSString *)name
+					 identifiers:(NSArray<NSString *> *)identifiers
+			  launchDescriptions:(NSArray<NSString *> *)launchDescriptions;
+
+- (instancetype)initWithName:(NSString *)name
+				 identifiers:(NSArray<NSString *> *)identifiers
+		  launchDescriptions:(NSArray<NSString *> *)launchDescriptions;
+
+/// Profile identifier of the active variant
+- (NSString *)activeIdentifier;
+
+/// Launch description of the active variant
+- (NSString *)activeLaunchDescription;
+
+/// Number of variants
+- (NSUInteger)count;
+
+/**
+ * @brief Activate the first variant passing the probe
+ *
+ * If no variant passes, the last variant is activated.
+ *
+ * @returns the launch description of the activated variant
+ */
+- (NSString *)selectWorkingVariantWithTimeout:(NSTimeInterval)timeout;
+
+/**
+ * @brief Fall back to the variant behind a failed one
+ *
+ * @param index The index of the variant that failed. Failures of variants
+ * other than the active one are ignored, as the mountpoint already fell back.
+ * @param reason Description of the failure
+ *
+ * @returns the launch description of the next variant, or nil if the active
+ * variant did not change
+ */
+- (nullable NSString *)fallBackFromIndex:(NSUInteger)index reason:(NSString *)reason;
+
+/**
+ * @brief Probe the variants preferred over the active one
+ *
+ * @returns the launch description of the first variant passing the probe,
+ * which is now active, or nil if none passed
+ */
+- (nullable NSString *)retryPreferredWithTimeout:(NSTimeInterval)timeout;
+
+/**
+ * @brief Active variant, fallbacks, and retries
+ *
+ * Example structure of the returned dictionary:
+ * @code
+ * {
+ *     "active": "com.hugomelder.software",
+ *     "activeIndex": 1,
+ *     "variants": ["com.hugomelder.vaapi", "com.hugomelder.software"],
+ *     "numberOfFallbacks": 1,
+ *     "numberOfRetries": 3,
+ *     "lastFailure": {"time": "2024-06-01T12:00:00+0000",
+ *                     "variant": "com.hugomelder.vaapi",
+ *                     "reason": "Could not open device"} // Only after a failure
+ * }
+ * @endcode
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
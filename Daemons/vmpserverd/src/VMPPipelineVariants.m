@@ -0,0 +1,313 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <gst/gst.h>
+
+#import "VMPJournal.h"
+#import "VMPPipelineVariants.h"
+
+const NSTimeInterval kVMPPipelineVariantsDefaultProbeTimeout = 5;
+const NSTimeInterval kVMPPipelineVariantsDefaultRetryInterval = 300;
+
+static NSString *const kProbeMessageName = @"vmp-probe-buffer";
+
+// Announce the first buffer reaching a fake sink of a probe pipeline
+static GstPadProbeReturn probe_buffer_cb(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+	GstObject *parent;
+
+	// Transfer: FULL
+	parent = gst_pad_get_parent(pad);
+	if (parent) {
+		gst_element_post_message(
+			GST_ELEMENT(parent),
+			gst_message_new_application(
+				parent, gst_structure_new_empty([kProbeMessageName UTF8String])));
+		gst_object_unref(parent);
+	}
+
+	return GST_PAD_PROBE_REMOVE;
+}
+
+static NSString *describeError(GstMessage *message) {
+	NSString *description;
+	GError *err = NULL;
+
+	gst_message_parse_error(message, &err, NULL);
+	description = [NSString stringWithFormat:@"%s: %s", GST_MESSAGE_SRC_NAME(message),
+											 err ? err->message : "Unknown error"];
+	g_clear_error(&err);
+
+	return description;
+}
+
+// Launch a variant in a standalone pipeline with fake sinks behind its payloaders. Returns nil if
+// every payloader produced a buffer within the timeout, and the reason of the failure otherwise.
+static NSString *probeLaunchDescription(NSString *launch, NSTimeInterval timeout) {
+	NSRegularExpression *regex;
+	NSMutableString *description;
+	NSString *reason = nil;
+	NSUInteger sinks, pending;
+	GstElement *pipeline;
+	GError *gerror = NULL;
+	GstBus *bus;
+	gint64 deadline;
+
+	regex = [NSRegularExpression regularExpressionWithPattern:@"name=(pay[0-9]+)"
+													  options:0
+														error:NULL];
+	description = [NSMutableString stringWithString:launch];
+	sinks = 0;
+	for (NSTextCheckingResult *match in [regex matchesInString:launch
+													   options:0
+														 range:NSMakeRange(0, [launch length])]) {
+		[description appendFormat:@" %@. ! fakesink name=vmpprobe%lu sync=false async=false",
+								  [launch substringWithRange:[match rangeAtIndex:1]],
+								  (unsigned long) sinks];
+		sinks++;
+	}
+
+	pipeline = gst_parse_launch([description UTF8String], &gerror);
+	if (gerror) {
+		reason = [NSString stringWithUTF8String:gerror->message];
+		g_error_free(gerror);
+		if (pipeline) {
+			gst_object_unref(pipeline);
+		}
+		return reason;
+	}
+	if (!GST_IS_BIN(pipeline)) {
+		gst_object_unref(pipeline);
+		return @"Launch description is not a pipeline";
+	}
+
+	for (NSUInteger i = 0; i < sinks; i++) {
+		GstElement *sink;
+		GstPad *pad;
+		gchar name[32];
+
+		g_snprintf(name, sizeof(name), "vmpprobe%lu", (unsigned long) i);
+		// Transfer: FULL
+		sink = gst_bin_get_by_name(GST_BIN(pipeline), name);
+		pad = gst_element_get_static_pad(sink, "sink");
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, probe_buffer_cb, NULL, NULL);
+		gst_object_unref(pad);
+		gst_object_unref(sink);
+	}
+
+	bus = gst_element_get_bus(pipeline);
+	if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+		GstMessage *message;
+
+		// The error message has a more useful description than the state change
+		message = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+		reason = message ? describeError(message) : @"Could not set pipeline to PLAYING";
+		if (message) {
+			gst_message_unref(message);
+		}
+	}
+
+	deadline = g_get_monotonic_time() + (gint64) (timeout * G_USEC_PER_SEC);
+	pending = reason ? 0 : sinks;
+	while (pending > 0) {
+		GstMessage *message;
+		gint64 remaining;
+
+		remaining = deadline - g_get_monotonic_time();
+		if (remaining <= 0) {
+			reason = [NSString stringWithFormat:@"No output within %.0f seconds", timeout];
+			break;
+		}
+
+		message = gst_bus_timed_pop_filtered(bus, (GstClockTime) remaining * GST_USECOND,
+											 GST_MESSAGE_ERROR | GST_MESSAGE_APPLICATION);
+		if (!message) {
+			continue;
+		}
+		if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+			reason = describeError(message);
+			pending = 0;
+		} else if (gst_message_has_name(message, [kProbeMessageName UTF8String])) {
+			pending--;
+		}
+		gst_message_unref(message);
+	}
+
+	gst_element_set_state(pipeline, GST_STATE_NULL);
+	gst_object_unref(bus);
+	gst_object_unref(pipeline);
+
+	return reason;
+}
+
+@implementation VMPPipelineVariants {
+	NSString *_name;
+	NSArray<NSString *> *_launchDescriptions;
+	// Protected by @synchronized(self)
+	NSUInteger _activeIndex;
+	NSUInteger _numberOfFallbacks;
+	NSUInteger _numberOfRetries;
+	NSDictionary *_lastFailure;
+}
+
++ (instancetype)variantsWithName:(NSString *)name
+					 identifiers:(NSArray<NSString *> *)identifiers
+			  launchDescriptions:(NSArray<NSString *> *)launchDescriptions {
+	return [[VMPPipelineVariants alloc] initWithName:name
+										 identifiers:identifiers
+								  launchDescriptions:launchDescriptions];
+}
+
+- (instancetype)initWithName:(NSString *)name
+				 identifiers:(NSArray<NSString *> *)identifiers
+		  launchDescriptions:(NSArray<NSString *> *)launchDescriptions {
+	VMP_ASSERT([identifiers count] > 0, @"A mountpoint needs at least one variant");
+	VMP_ASSERT([identifiers count] == [launchDescriptions count],
+			   @"Every variant needs a launch description");
+
+	self = [super init];
+	if (self) {
+		_name = name;
+		_identifiers = [identifiers copy];
+		_launchDescriptions = [launchDescriptions copy];
+	}
+	return self;
+}
+
+- (NSUInteger)activeIndex {
+	@synchronized(self) {
+		return _activeIndex;
+	}
+}
+
+- (NSString *)activeIdentifier {
+	return _identifiers[[self activeIndex]];
+}
+
+- (NSString *)activeLaunchDescription {
+	return _launchDescriptions[[self activeIndex]];
+}
+
+- (NSUInteger)count {
+	return [_identifiers count];
+}
+
+// Must be called with @synchronized(self)
+- (void)_recordFailureOfIndex:(NSUInteger)index reason:(NSString *)reason {
+	_lastFailure = @{
+		@"time" : [[[NSISO8601DateFormatter alloc] init] stringFromDate:[NSDate date]],
+		@"variant" : _identifiers[index],
+		@"reason" : reason,
+	};
+}
+
+- (NSString *)selectWorkingVariantWithTimeout:(NSTimeInterval)timeout {
+	NSUInteger count = [self count];
+
+	for (NSUInteger i = 0; i < count; i++) {
+		NSString *reason;
+
+		reason = probeLaunchDescription(_launchDescriptions[i], timeout);
+		if (!reason) {
+			VMPInfo(@"Mountpoint '%@' uses variant %@", _name, _identifiers[i]);
+			@synchronized(self) {
+				_activeIndex = i;
+			}
+			return _launchDescriptions[i];
+		}
+
+		VMPWarn(@"Variant %@ of mountpoint '%@' failed the probe: %@", _identifiers[i], _name,
+				reason);
+		@synchronized(self) {
+			[self _recordFailureOfIndex:i reason:reason];
+		}
+	}
+
+	VMPError(@"No variant of mountpoint '%@' passed the probe. Using %@.", _name,
+			 [_identifiers lastObject]);
+	@synchronized(self) {
+		_activeIndex = count - 1;
+	}
+	return [_launchDescriptions lastObject];
+}
+
+- (NSString *)fallBackFromIndex:(NSUInteger)index reason:(NSString *)reason {
+	@synchronized(self) {
+		if (index != _activeIndex) {
+			return nil;
+		}
+
+		[self _recordFailureOfIndex:index reason:reason];
+		if (index + 1 >= [self count]) {
+			VMPError(@"Last variant %@ of mountpoint '%@' failed: %@", _identifiers[index], _name,
+					 reason);
+			return nil;
+		}
+
+		_activeIndex = index + 1;
+		_numberOfFallbacks++;
+		VMPWarn(@"Mountpoint '%@' falls back from variant %@ to %@: %@", _name,
+				_identifiers[index], _identifiers[_activeIndex], reason);
+		return _launchDescriptions[_activeIndex];
+	}
+}
+
+- (NSString *)retryPreferredWithTimeout:(NSTimeInterval)timeout {
+	NSUInteger active;
+
+	active = [self activeIndex];
+	if (active == 0) {
+		return nil;
+	}
+
+	@synchronized(self) {
+		_numberOfRetries++;
+	}
+
+	// Probing blocks, so the lock is not held meanwhile
+	for (NSUInteger i = 0; i < active; i++) {
+		NSString *reason;
+
+		reason = probeLaunchDescription(_launchDescriptions[i], timeout);
+		if (reason) {
+			VMPDebug(@"Variant %@ of mountpoint '%@' still fails: %@", _identifiers[i], _name,
+					 reason);
+			continue;
+		}
+
+		@synchronized(self) {
+			// Another thread changed the variant in the meantime
+			if (_activeIndex != active) {
+				return nil;
+			}
+			_activeIndex = i;
+		}
+		VMPInfo(@"Mountpoint '%@' returns to variant %@", _name, _identifiers[i]);
+		return _launchDescriptions[i];
+	}
+
+	return nil;
+}
+
+- (NSDictionary *)statistics {
+	NSMutableDictionary *statistics;
+
+	@synchronized(self) {
+		statistics = [NSMutableDictionary dictionaryWithDictionary:@{
+			@"active" : _identifiers[_activeIndex],
+			@"activeIndex" : @(_activeIndex),
+			@"variants" : _identifiers,
+			@"numberOfFallbacks" : @(_numberOfFallbacks),
+			@"numberOfRetries" : @(_numberOfRetries),
+		}];
+		if (_lastFailure) {
+			statistics[@"lastFailure"] = _lastFailure;
+		}
+	}
+
+	return statistics;
+}
+
+@end
@@ -27,6 +27,14 @@ NS_ASSUME_NONNULL_BEGIN
 @property (readonly) VMPProfileModel *currentProfile;
 @property (strong) NSArray<VMPProfileModel *> *availableProfiles;
 
+/**
+ * @brief Profiles compatible with the runtime platform, best first
+ *
+ * The first profile is the current profile. The others are used as fallbacks
+ * if a pipeline of the current profile cannot be started.
+ */
+@property (readonly) NSArray<VMPProfileModel *> *compatibleProfiles;
+
 /**
  * @brief Profile manager convenience initialiser with platform auto-detection
  *
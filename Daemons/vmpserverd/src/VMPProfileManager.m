@@ -193,6 +193,33 @@ static NSString *const envBinary = @"/usr/bin/env";
 	return YES;
 }
 
+- (NSArray<VMPProfileModel *> *)compatibleProfiles {
+	NSMutableArray<VMPProfileModel *> *profiles;
+
+	profiles = [NSMutableArray arrayWithCapacity:[_availableProfiles count]];
+	for (VMPProfileModel *p in _availableProfiles) {
+		if (p != _currentProfile && [p compatiblityScoreForPlatform:_runtimePlatform] != -1) {
+			[profiles addObject:p];
+		}
+	}
+	// Stable, so profiles with equal scores keep their order
+	[profiles sortWithOptions:NSSortStable
+			  usingComparator:^NSComparisonResult(VMPProfileModel *a, VMPProfileModel *b) {
+				NSInteger scoreA = [a compatiblityScoreForPlatform:_runtimePlatform];
+				NSInteger scoreB = [b compatiblityScoreForPlatform:_runtimePlatform];
+
+				if (scoreA == scoreB) {
+					return NSOrderedSame;
+				}
+				return scoreA > scoreB ? NSOrderedAscending : NSOrderedDescending;
+			  }];
+	if (_currentProfile) {
+		[profiles insertObject:_currentProfile atIndex:0];
+	}
+
+	return profiles;
+}
+
 - (BOOL)_selectBestProfileWithError:(NSError **)error {
 	VMP_ASSERT(_availableProfiles, @"availableProfiles property must not be nil!");
 
@@ -37,6 +37,18 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, readonly) VMPProfileModel *currentProfile;
 
+/**
+ * @brief Profiles the pipeline variants of mountpoints are built from
+ *
+ * Profiles compatible with the runtime platform, best first. A mountpoint
+ * falls back to the pipeline of the next profile if the pipeline of the
+ * current one fails to reach PLAYING. Must be set before the server is
+ * started. Defaults to the current profile only.
+ *
+ * @see VMPPipelineVariants
+ */
+@property (nonatomic, copy) NSArray<VMPProfileModel *> *variantProfiles;
+
 /**
  * @brief Provides global statistics for all managed pipelines and the RTSP server.
  *
@@ -50,15 +62,37 @@ NS_ASSUME_NONNULL_BEGIN
  *             "name": "pipeline0", // The unique name of the pipeline
  *             "type": "v4l2", // The type of pipeline, e.g., 'v4l2' for video4linux2
  *             "state": "playing", // Current state of the pipeline, e.g., 'playing', 'paused'
- *             "numberOfRestarts": 2 // The number of times the pipeline has been restarted
+ *             "numberOfRestarts": 2, // The number of times the pipeline has been restarted
+ *             "threads": {...}, // Streaming threads and CPU usage
+ *             "memory": {...}, // Queue and buffer pool occupancy, if running
+ *             "memoryBudget": {...}, // Only if a memory budget is configured
+ *             "watchdog": {...} // Only if a watchdog timeout is configured
  *         }
  *         // Additional pipeline dictionaries...
- *     ]
+ *     ],
+ *     "mountpoints": [
+ *         {"name": "comb", "threads": {...}, "memory": {...}, "memoryBudget": {...},
+ *          "encoder": {...}, "variants": {...}},
+ *         {"name": "comb2", ..., "sharedWith": "comb"} // Shares the media of "comb"
+ *     ],
+ *     "recordings": [
+ *         {"path": "/tmp/rec.mkv", "state": "playing", "threads": {...}}
+ *     ],
+ *     "taskPool": {...}, // Only in low-footprint mode. @see VMPTaskPool.statistics
+ *     "degradation": {...}, // Only if configured. @see VMPDegradationController.statistics
+ *     "admission": {...}, // Sessions and rejections. @see VMPAdmissionControl.statistics
+ *     "deduplication": {
+ *         "sharedMountpoints": {"comb2": "comb"},
+ *         "savedEncoders": 2 // Video encoders of all shared mountpoint media
+ *     }
  * }
  * @endcode
  *
  * The "managed_pipelines" array within the dictionary contains one dictionary for each
- * managed pipeline.
+ * managed pipeline. The structure of "threads" is described in
+ * VMPThreadMonitor.statistics, "memory" and "memoryBudget" in VMPMemoryBudget, and
+ * "watchdog" in VMPFlowWatchdog.statistics. The "variants" of a mountpoint are described
+ * in VMPPipelineVariants.statistics.
  *
  * @return NSDictionary containing the global statistics of all managed pipelines and RTSP server.
  */
@@ -96,6 +130,9 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (nullable VMPPipelineManager *)pipelineManagerForChannel:(NSString *)channel;
 
+/// Whether a mountpoint with the given name is configured
+- (BOOL)hasMountPointName:(NSString *)name;
+
 /**
  * @brief GStreamer pipeline graph for a given mountpoint
  *
@@ -112,6 +149,119 @@ NS_ASSUME_NONNULL_BEGIN
  */
 - (nullable NSData *)dotGraphForMountPointName:(NSString *)name;
 
+/**
+ * @brief Live element graph of a mountpoint
+ *
+ * Only available while at least one client is connected to the mountpoint.
+ *
+ * @returns the topology as described in VMPPipelineTopology, or nil if the
+ * mountpoint was not found or has no active media
+ */
+- (nullable NSDictionary *)topologyForMountPointName:(NSString *)name;
+
+/**
+ * @brief Latency percentiles of a mountpoint
+ *
+ * Only available if the "latencyProbe" property of the mountpoint is set.
+ * Latencies are cumulative and in milliseconds, starting at the source element
+ * of the primary video channel. Samples are only collected while at least one
+ * client is connected to the mountpoint.
+ *
+ * Example structure of the returned dictionary:
+ * @code
+ * {
+ *     "mountpoint": "Presentation",
+ *     "stages": {
+ *         "capture": {"count": 1200, "p50": 1.2, "p90": 1.9, "p99": 3.1, "max": 4.0},
+ *         "composite": {...},
+ *         "encode": {...},
+ *         "payload": {...}
+ *     },
+ *     "breakdown": {"capture": 1.2, "composite": 20.3, "encode": 12.5, "payload": 0.1}
+ * }
+ * @endcode
+ *
+ * @returns a dictionary with latency statistics, or nil if the mountpoint was
+ * not found, or has no latency probe.
+ */
+- (nullable NSDictionary *)latencyStatisticsForMountPointName:(NSString *)name;
+
+/**
+ * @brief Encoder settings of a mountpoint
+ *
+ * @returns a dictionary as described in VMPEncoderSettings.statistics, or nil
+ * if the mountpoint was not found
+ */
+- (nullable NSDictionary *)encoderSettingsForMountPointName:(NSString *)name;
+
+/**
+ * @brief Change bitrate and keyframe interval of a mountpoint
+ *
+ * @param bitrate The new bitrate in kbit/s, or 0 to keep the current one
+ * @param keyframeInterval The new maximum distance between keyframes in
+ * frames, or 0 to keep the current one
+ * @param name The name of the mountpoint
+ * @param error The error if the settings could not be changed
+ *
+ * The encoders of the active media are reconfigured while playing, without
+ * reconstructing the media. The settings also apply to media constructed
+ * later on.
+ *
+ * Fails for a mountpoint sharing the media of an identical mountpoint. The
+ * settings of that mountpoint apply to all mountpoints sharing its media.
+ *
+ * @returns YES if the settings were changed, NO otherwise
+ */
+- (BOOL)setEncoderBitrate:(NSUInteger)bitrate
+		 keyframeInterval:(NSUInteger)keyframeInterval
+		forMountPointName:(NSString *)name
+					error:(NSError **)error;
+
+/**
+ * @brief Start a time-bounded profiling session for a channel pipeline
+ *
+ * @param channel The name of the channel
+ * @param duration The duration of the session in seconds. Clamped to
+ * kVMPProfilerMaximumDuration.
+ * @param error The error if the session could not be started
+ *
+ * Fails if the channel does not exist, its pipeline is not running, or
+ * another session for the channel is still running. The report of the previous
+ * session is discarded.
+ *
+ * @returns YES if the session was started, NO otherwise
+ */
+- (BOOL)startProfilingChannel:(NSString *)channel
+					 duration:(NSTimeInterval)duration
+						error:(NSError **)error;
+
+/**
+ * @brief Start a time-bounded profiling session for a mountpoint
+ *
+ * The media of the most recently connected client is profiled. Fails if no
+ * media is currently active for the mountpoint.
+ *
+ * @see startProfilingChannel:duration:error:
+ */
+- (BOOL)startProfilingMountPointName:(NSString *)name
+							duration:(NSTimeInterval)duration
+							   error:(NSError **)error;
+
+/**
+ * @brief Report of the current or last profiling session of a channel
+ *
+ * @returns a dictionary as described in VMPPipelineProfiler, or nil if the
+ * channel was never profiled
+ */
+- (nullable NSDictionary *)profilingReportForChannel:(NSString *)channel;
+
+/**
+ * @brief Report of the current or last profiling session of a mountpoint
+ *
+ * @see profilingReportForChannel:
+ */
+- (nullable NSDictionary *)profilingReportForMountPointName:(NSString *)name;
+
 /**
  * @brief Information about all active channels
  *
@@ -131,10 +281,13 @@ NS_ASSUME_NONNULL_BEGIN
  * Available Keys for Options:
  * - "videoChannel" (REQUIRED)
  * - "audioChannel" (REQUIRED)
- * - "videoBitrate" (OPTIONAL, in bbps. Default is 2500kbps)
+ * - "videoBitrate" (OPTIONAL, in kbps. Default is 2500kbps)
  * - "audioBitrate" (OPTIONAL, in kbps. Default is 96kbps)
- * - "scaledWidth"  (OPTIONAL)
- * - "scaledHeight" (OPTIONAL)
+ * - "width"  (OPTIONAL. Default is the width of the video channel)
+ * - "height" (OPTIONAL. Default is the height of the video channel)
+ *
+ * The H.264 stream of a passthrough channel is recorded as is, unless one
+ * of "videoBitrate", "width", or "height" is set.
  */
 - (VMPRecordingManager *)defaultRecordingWithOptions:(NSDictionary *)options
 												path:(NSURL *)path
@@ -10,19 +10,44 @@
 #import <dispatch/dispatch.h>
 
 #import "NSRunLoop+blockExecution.h"
+#import "NSString+canonicalPipeline.h"
 #import "NSString+substituteVariables.h"
 
+#import "VMPAdmissionControl.h"
 #import "VMPConfigChannelModel.h"
 #import "VMPConfigModel.h"
 #import "VMPConfigMountpointModel.h"
 
+#import "VMPDegradationController.h"
+#import "VMPEncoderSettings.h"
 #import "VMPErrors.h"
+#import "VMPGStreamerUtils.h"
 #import "VMPJournal.h"
+#import "VMPLowLatency.h"
+#import "VMPOverlay.h"
+#import "VMPPipelineManager+Private.h"
+#import "VMPPipelineProfiler.h"
+#import "VMPPipelineTopology.h"
+#import "VMPPipelineVariants.h"
 #import "VMPRTSPServer.h"
+#import "VMPV4L2Device.h"
 
 // Generated project configuration
 #include "../build/config.h"
 
+// Output resolution of the v4l2 channel templates
+static const NSUInteger kVMPV4L2TargetWidth = 1920;
+static const NSUInteger kVMPV4L2TargetHeight = 1080;
+
+// Default and maximum size of the jitter buffer of network channels in milliseconds
+static const NSUInteger kVMPNetworkDefaultLatency = 200;
+static const NSUInteger kVMPNetworkMaximumLatency = 5000;
+
+// Default format of the low-resolution proxy of a channel
+static const NSInteger kVMPProxyDefaultWidth = 320;
+static const NSInteger kVMPProxyDefaultHeight = 180;
+static const NSInteger kVMPProxyDefaultFramerate = 10;
+
 #define CONFIG_ERROR(error, description)                                                           \
 	VMPError(description);                                                                         \
 	if (error) {                                                                                   \
@@ -44,27 +69,126 @@
 @property (nonatomic) NSString *mountpointName;
 @property (nonatomic) NSData *lastDotGraph;
 @property (nonatomic) NSString *state;
+// Primary video channel of the mountpoint
+@property (nonatomic) NSString *videoChannel;
+// Optional latency probe attached to every constructed media
+@property (nonatomic) VMPLatencyProbe *latencyProbe;
+// Streaming threads of all constructed media
+@property (nonatomic) VMPThreadMonitor *threadMonitor;
+// Optional memory budget applied to every constructed media
+@property (nonatomic) VMPMemoryBudget *memoryBudget;
+// Optional overlays composited in front of the encoder
+@property (nonatomic) VMPOverlay *overlay;
+// Optional low-latency tuning of every constructed media
+@property (nonatomic) VMPLowLatency *lowLatency;
+// Encoder parameters of every constructed media
+@property (nonatomic) VMPEncoderSettings *encoderSettings;
+// Whether the quality of the mountpoint is lowered under load
+@property (nonatomic) BOOL degradable;
+// Video encoders of the most recently constructed media. Read from the HTTP thread.
+@property (atomic) NSUInteger numberOfEncoders;
+// Pipeline variants of the mountpoint, preferred first
+@property (nonatomic) VMPPipelineVariants *variants;
+// Media factory of the mountpoint. Owned by the mount points of the server.
+@property (nonatomic, assign) GstRTSPMediaFactory *factory;
 
 // Pointer to the RTSP server instance
 // Avoid a retain cycle by using a weak reference
 @property (nonatomic, weak) VMPRTSPServer *server;
 
 - (instancetype)initWithServer:(VMPRTSPServer *)server mountpointName:(NSString *)name;
+
+// Remember the top-level element of the most recently constructed media
+- (void)setMediaElement:(GstElement *)element;
+// Transfer: FULL. NULL if the media was already destroyed.
+- (GstElement *)copyMediaElement;
 @end
 
-@implementation _VMPRTSPPipelineState
+@implementation _VMPRTSPPipelineState {
+	// The media is owned by the RTSP server, so we only keep a weak reference
+	GWeakRef _mediaElement;
+}
+
 - (instancetype)initWithServer:(VMPRTSPServer *)server mountpointName:(NSString *)name {
 	self = [super init];
 	if (self) {
 		_server = server;
 		_mountpointName = name;
 		_state = kVMPStateCreated;
+		_threadMonitor = [VMPThreadMonitor monitorWithName:name];
+		g_weak_ref_init(&_mediaElement, NULL);
 	}
 	return self;
 }
 
+- (void)setMediaElement:(GstElement *)element {
+	g_weak_ref_set(&_mediaElement, element);
+}
+
+- (GstElement *)copyMediaElement {
+	return g_weak_ref_get(&_mediaElement);
+}
+
+- (void)dealloc {
+	g_weak_ref_clear(&_mediaElement);
+}
+
+@end
+
+@interface VMPRTSPServer ()
+// Register a mountpoint or recording pipeline with the channels it consumes. Returns the blocks
+// unregistering the pipeline again.
+- (NSArray<dispatch_block_t> *)_connectConsumersInPipeline:(GstElement *)pipeline;
+// Check, or reserve, a session of the mountpoint requested by a client
+- (GstRTSPStatusCode)_admissionStatusForClient:(GstRTSPClient *)client
+									   context:(GstRTSPContext *)ctx
+									   reserve:(BOOL)reserve;
+// Release the sessions of a client, or of an RTSP session
+- (void)_releaseClient:(const void *)client;
+// Release the session of the mountpoint torn down by a client
+- (void)_releaseSessionForContext:(GstRTSPContext *)ctx;
+// Bind the sessions reserved by a client to its new RTSP session
+- (void)_moveClient:(GstRTSPClient *)client toSession:(GstRTSPSession *)session;
 @end
 
+// Called when a pipeline consuming channels is finalized
+static void consumers_released_cb(gpointer user_data, GObject *where_the_object_was) {
+	NSArray<dispatch_block_t> *releaseBlocks = (__bridge_transfer NSArray *) user_data;
+
+	for (dispatch_block_t block in releaseBlocks) {
+		block();
+	}
+}
+
+#pragma mark - Media factory
+
+// Media factory of a mountpoint. The media of a shared factory is keyed without the path, so
+// identical mountpoints registered with the same factory share a single media.
+typedef struct {
+	GstRTSPMediaFactory parent;
+} VMPMediaFactory;
+
+typedef struct {
+	GstRTSPMediaFactoryClass parent_class;
+} VMPMediaFactoryClass;
+
+GType vmp_media_factory_get_type(void);
+G_DEFINE_TYPE(VMPMediaFactory, vmp_media_factory, GST_TYPE_RTSP_MEDIA_FACTORY)
+
+// Like the default key of GstRTSPMediaFactory, but without the path
+static gchar *vmp_media_factory_gen_key(GstRTSPMediaFactory *factory, const GstRTSPUrl *url) {
+	guint16 port;
+
+	gst_rtsp_url_get_port(url, &port);
+	return g_strdup_printf("%u%s%s", port, url->query ? "?" : "", url->query ? url->query : "");
+}
+
+static void vmp_media_factory_class_init(VMPMediaFactoryClass *klass) {
+	GST_RTSP_MEDIA_FACTORY_CLASS(klass)->gen_key = vmp_media_factory_gen_key;
+}
+
+static void vmp_media_factory_init(VMPMediaFactory *factory) {}
+
 #pragma mark - RTSP Media Construction Callbacks
 
 /* signal callback when the media is prepared for streaming. We can get the
@@ -76,6 +200,7 @@ static void media_prepared_cb(GstRTSPMedia *media, gpointer user_data) {
 		_VMPRTSPPipelineState *state;
 
 		state = (__bridge _VMPRTSPPipelineState *) user_data;
+		g_object_set_data(G_OBJECT(media), "vmp-prepared", GINT_TO_POINTER(TRUE));
 
 		element = gst_rtsp_media_get_element(media);
 		n_streams = gst_rtsp_media_n_streams(media);
@@ -103,6 +228,33 @@ static void media_prepared_cb(GstRTSPMedia *media, gpointer user_data) {
 	}
 }
 
+/* signal callback when the media is unprepared. A media that was never prepared failed to reach
+ * PLAYING, so later media of the mountpoint are constructed from the next pipeline variant. */
+static void media_unprepared_cb(GstRTSPMedia *media, gpointer user_data) {
+	@autoreleasepool {
+		_VMPRTSPPipelineState *state;
+		NSUInteger variant;
+		NSString *launch;
+
+		state = (__bridge _VMPRTSPPipelineState *) user_data;
+		if (g_object_get_data(G_OBJECT(media), "vmp-prepared")) {
+			return;
+		}
+
+		// Index of the variant the media was constructed from, plus one
+		variant = GPOINTER_TO_UINT(g_object_get_data(G_OBJECT(media), "vmp-variant"));
+		if (variant == 0) {
+			return;
+		}
+
+		launch = [[state variants] fallBackFromIndex:variant - 1
+											  reason:@"Media failed to reach PLAYING"];
+		if (launch) {
+			gst_rtsp_media_factory_set_launch([state factory], [launch UTF8String]);
+		}
+	}
+}
+
 static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *media,
 								 gpointer user_data) {
 	@autoreleasepool {
@@ -118,8 +270,42 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 		// Connect to the "prepared" signal to get more information about the streams once
 		// initialisation is complete
 		g_signal_connect(media, "prepared", (GCallback) media_prepared_cb, user_data);
+		// Fall back to the next variant if the media cannot be prepared
+		g_object_set_data(G_OBJECT(media), "vmp-variant",
+						  GUINT_TO_POINTER([[state variants] activeIndex] + 1));
+		g_signal_connect(media, "unprepared", (GCallback) media_unprepared_cb, user_data);
 
 		element = gst_rtsp_media_get_element(media);
+		[state setMediaElement:element];
+
+		// The media pipeline was already created, but is not yet prerolled. The element is a
+		// child of the media pipeline, so the monitor is attached to the bus of the pipeline.
+		GstElement *pipeline = VMPCopyTopLevelElement(element);
+		[[state threadMonitor] attachToPipeline:pipeline];
+		gst_object_unref(pipeline);
+
+		if ([state latencyProbe]) {
+			[[state latencyProbe] attachToMountpointElement:element];
+		}
+		if ([state memoryBudget]) {
+			[[state memoryBudget] applyToPipeline:element];
+		}
+		[[state encoderSettings] applyToPipeline:element];
+		[state setNumberOfEncoders:[VMPEncoderSettings numberOfEncodersInPipeline:element]];
+		// Overrides the queue limits of the memory budget
+		if ([state lowLatency]) {
+			[[state lowLatency] applyToPipeline:element];
+		}
+		if ([state overlay]) {
+			[[state overlay] attachToMountpointElement:element];
+		}
+
+		NSArray<dispatch_block_t> *releaseBlocks;
+		releaseBlocks = [[state server] _connectConsumersInPipeline:element];
+		if ([releaseBlocks count] > 0) {
+			g_object_weak_ref(G_OBJECT(element), consumers_released_cb,
+							  (__bridge_retained void *) releaseBlocks);
+		}
 
 		if (GST_IS_BIN(element)) {
 			VMPDebug(@"Pipeline for mountpoint '%@' is a bin", [state mountpointName]);
@@ -149,10 +335,89 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	}
 }
 
+#pragma mark - Admission Control Callbacks
+
+/* Reject clients exceeding the limits before the media is constructed. DESCRIBE only checks the
+ * limits, as clients may never set up a stream, while SETUP reserves a session. */
+static GstRTSPStatusCode pre_describe_request_cb(GstRTSPClient *client, GstRTSPContext *ctx,
+												 gpointer user_data) {
+	@autoreleasepool {
+		VMPRTSPServer *server = (__bridge VMPRTSPServer *) user_data;
+
+		return [server _admissionStatusForClient:client context:ctx reserve:NO];
+	}
+}
+
+static GstRTSPStatusCode pre_setup_request_cb(GstRTSPClient *client, GstRTSPContext *ctx,
+											  gpointer user_data) {
+	@autoreleasepool {
+		VMPRTSPServer *server = (__bridge VMPRTSPServer *) user_data;
+
+		return [server _admissionStatusForClient:client context:ctx reserve:YES];
+	}
+}
+
+/* A reservation belongs to the RTSP session, not to the control connection: a client can tear
+ * down its session and keep the connection alive, and UDP sessions outlive their connection.
+ * SETUP reserves for the client, as the session is only created afterwards, and the reservation
+ * is moved to the session once created. The reservation is released on TEARDOWN, or when the
+ * session is removed from the session pool (e.g. after a timeout). */
+static void new_session_cb(GstRTSPClient *client, GstRTSPSession *session, gpointer user_data) {
+	@autoreleasepool {
+		VMPRTSPServer *server = (__bridge VMPRTSPServer *) user_data;
+
+		[server _moveClient:client toSession:session];
+	}
+}
+
+static void teardown_request_cb(GstRTSPClient *client, GstRTSPContext *ctx, gpointer user_data) {
+	@autoreleasepool {
+		VMPRTSPServer *server = (__bridge VMPRTSPServer *) user_data;
+
+		[server _releaseSessionForContext:ctx];
+	}
+}
+
+static void session_removed_cb(GstRTSPSessionPool *pool, GstRTSPSession *session,
+							   gpointer user_data) {
+	@autoreleasepool {
+		VMPRTSPServer *server = (__bridge VMPRTSPServer *) user_data;
+
+		[server _releaseClient:session];
+	}
+}
+
+// Only releases reservations of SETUP requests that did not create a session
+static void client_closed_cb(GstRTSPClient *client, gpointer user_data) {
+	@autoreleasepool {
+		VMPRTSPServer *server = (__bridge VMPRTSPServer *) user_data;
+
+		[server _releaseClient:client];
+	}
+}
+
+static void client_connected_cb(GstRTSPServer *rtspServer, GstRTSPClient *client,
+								gpointer user_data) {
+	g_signal_connect(client, "pre-describe-request", (GCallback) pre_describe_request_cb,
+					 user_data);
+	g_signal_connect(client, "pre-setup-request", (GCallback) pre_setup_request_cb, user_data);
+	g_signal_connect(client, "new-session", (GCallback) new_session_cb, user_data);
+	g_signal_connect(client, "teardown-request", (GCallback) teardown_request_cb, user_data);
+	g_signal_connect(client, "closed", (GCallback) client_closed_cb, user_data);
+}
+
+// Removes expired sessions from the pool. Sessions of vanished UDP clients are only removed here.
+static gboolean session_pool_cleanup_cb(gpointer user_data) {
+	GstRTSPSessionPool *pool = user_data;
+
+	gst_rtsp_session_pool_cleanup(pool);
+	return G_SOURCE_CONTINUE;
+}
+
 #pragma mark - VMPRTSPServer
 
 // Redeclare properties as readwrite
-@interface VMPRTSPServer ()
+@interface VMPRTSPServer () <VMPDegradationControllerDelegate>
 @property (readwrite) VMPProfileModel *currentProfile;
 @end
 
@@ -162,10 +427,49 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 
 	// Registered source ID for the RTSP Server (GSource)
 	guint _serverSourceId;
+	// Session pool of the RTSP server, and the source removing its expired sessions
+	GstRTSPSessionPool *_sessionPool;
+	guint _sessionCleanupSourceId;
 
 	NSMutableArray<VMPPipelineManager *> *_managedPipelines;
 	NSMutableArray<VMPRecordingManager *> *_activeRecordings;
 	NSMutableDictionary<NSString *, _VMPRTSPPipelineState *> *_rtspPipelineStates;
+	// Most recent profiling session per pipeline. Keyed by "channel/<name>" or
+	// "mountpoint/<name>".
+	NSMutableDictionary<NSString *, VMPPipelineProfiler *> *_profilers;
+	// Shared task pool for all pipelines. nil if not configured.
+	VMPTaskPool *_taskPool;
+	// Channel pipelines with a scheduled restart. Only accessed on the main thread.
+	NSMutableSet<VMPPipelineManager *> *_pendingRestarts;
+	// Passthrough channels by name. Immutable after startup.
+	NSMutableDictionary<NSString *, VMPEncodedChannel *> *_encodedChannels;
+	// Consumer demand of video channels by name. Immutable after startup.
+	NSMutableDictionary<NSString *, VMPChannelDemand *> *_channelDemands;
+	// Static-content detectors by channel name. Immutable after startup.
+	NSMutableDictionary<NSString *, VMPStaticContentDetector *> *_staticContentDetectors;
+	// Low-resolution proxies by source channel name, with the keys "channel", "width", and
+	// "height". Immutable after startup.
+	NSMutableDictionary<NSString *, NSDictionary *> *_proxies;
+	// Pipeline managers of the proxies
+	NSMutableSet<VMPPipelineManager *> *_proxyManagers;
+	// Quality degradation under load. nil if not configured.
+	VMPDegradationController *_degradationController;
+	// Time a pipeline variant has to pass its probe
+	NSTimeInterval _probeTimeout;
+	// Interval between attempts to return to preferred pipeline variants. 0 disables retries.
+	NSTimeInterval _variantRetryInterval;
+	// Retries preferred pipeline variants. nil if no mountpoint has a fallback.
+	dispatch_source_t _variantRetryTimer;
+	// Names of mountpoints sharing the media of an identical mountpoint, mapped to the name of
+	// that mountpoint. Immutable after startup.
+	NSMutableDictionary<NSString *, NSString *> *_sharedMountpoints;
+	// Blocks unregistering running recordings from their channels, keyed by path. Protected by
+	// @synchronized(self).
+	NSMutableDictionary<NSString *, NSArray<dispatch_block_t> *> *_recordingReleaseBlocks;
+	// Limits of RTSP sessions. Created on startup.
+	VMPAdmissionControl *_admissionControl;
+	// Names of mountpoints by path. Immutable after startup.
+	NSMutableDictionary<NSString *, NSString *> *_mountpointPaths;
 
 	// Dispatch Queue for Recordings
 	dispatch_queue_t _recordingsQueue;
@@ -187,10 +491,22 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 		_server = gst_rtsp_server_new();
 		_mountPoints = gst_rtsp_server_get_mount_points(_server);
 		_currentProfile = profile;
+		_variantProfiles = @[ profile ];
 		_rtspPipelineStates =
 			[NSMutableDictionary dictionaryWithCapacity:[[_configuration mountpoints] count]];
 		_recordingsQueue =
 			dispatch_queue_create("com.hugomelder.vmpserverd.recq", DISPATCH_QUEUE_SERIAL);
+		_profilers = [NSMutableDictionary dictionary];
+		_activeRecordings = [NSMutableArray array];
+		_pendingRestarts = [NSMutableSet set];
+		_encodedChannels = [NSMutableDictionary dictionary];
+		_channelDemands = [NSMutableDictionary dictionary];
+		_staticContentDetectors = [NSMutableDictionary dictionary];
+		_proxies = [NSMutableDictionary dictionary];
+		_proxyManagers = [NSMutableSet set];
+		_sharedMountpoints = [NSMutableDictionary dictionary];
+		_recordingReleaseBlocks = [NSMutableDictionary dictionary];
+		_mountpointPaths = [NSMutableDictionary dictionary];
 
 		NSUInteger channelCount = [[_configuration channels] count];
 		_managedPipelines = [NSMutableArray arrayWithCapacity:channelCount];
@@ -256,6 +572,10 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 
 		g_error_free(err);
 		g_free(debug);
+
+		if ([mgr restartOnError]) {
+			[self _scheduleRestartOfManager:mgr];
+		}
 		break;
 	}
 	case GST_MESSAGE_WARNING: {
@@ -273,36 +593,26 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	}
 	case GST_MESSAGE_EOS: {
 		VMPError(@"End of stream for channel %@", channel);
+		[self _scheduleRestartOfManager:mgr];
+		break;
+	}
+	case GST_MESSAGE_ELEMENT: {
+		const GstStructure *structure;
+		const gchar *location;
+		gdouble stalledFor = 0;
 
-		NSTimeInterval initialDelay = 1.0;
-		NSTimeInterval delayIncrement = 2.0;
-		NSTimeInterval maxDelay = 30.0;
-
-		[[NSRunLoop currentRunLoop]
-			 scheduleBlock:^BOOL {
-				 VMPInfo(@"Stopping pipeline mgr %@ for scheduled restart...", mgr);
-				 [mgr stop];
-
-				 // Stop if pipeline was started successfully, continue
-				 // with increasing delay otherwise
-				 VMPInfo(@"Trying to restart pipeline mgr %@...", mgr);
-
-				 // Interference with new bus messages is not possible due
-				 // the NSRunLoop processing events and timers serially on a single
-				 // thread.
-				 BOOL status = [mgr start];
-				 if (status) {
-					 VMPInfo(@"Restart of %@ Successful!", mgr);
-				 } else {
-					 VMPError(@"Could not restart %@. Retrying...", mgr);
-				 }
-
-				 return status;
-			 }
-			  initialDelay:initialDelay
-			delayIncrement:delayIncrement
-				  maxDelay:maxDelay];
+		if (!gst_message_has_name(message, [kVMPWatchdogMessageName UTF8String])) {
+			break;
+		}
+
+		// Transfer: NONE
+		structure = gst_message_get_structure(message);
+		location = gst_structure_get_string(structure, "location");
+		gst_structure_get_double(structure, "stalled-for", &stalledFor);
 
+		VMPError(@"Buffer flow at the %s elements of channel %@ stalled for %.1f seconds",
+				 location ? location : "unknown", channel, stalledFor);
+		[self _scheduleRestartOfManager:mgr];
 		break;
 	}
 	default:
@@ -310,27 +620,137 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	}
 }
 
+- (void)onPipelineCreated:(GstElement *)pipeline manager:(VMPPipelineManager *)mgr {
+	NSArray<dispatch_block_t> *releaseBlocks;
+
+	// Consumers are connected before the recording is set to PLAYING, as the sources of
+	// passthrough channels must be configured before they preroll
+	if ([mgr isKindOfClass:[VMPRecordingManager class]]) {
+		VMPRecordingManager *recording = (VMPRecordingManager *) mgr;
+		NSArray<dispatch_block_t> *previousBlocks;
+
+		releaseBlocks = [self _connectConsumersInPipeline:pipeline];
+		@synchronized(self) {
+			previousBlocks = _recordingReleaseBlocks[[[recording path] path]];
+			_recordingReleaseBlocks[[[recording path] path]] = releaseBlocks;
+		}
+		// The pipeline of the recording was recreated
+		for (dispatch_block_t block in previousBlocks) {
+			block();
+		}
+		[[recording chapterIndexer] attachToRecordingPipeline:pipeline];
+		return;
+	}
+
+	// A proxy pipeline consumes its source channel like a mountpoint
+	if (![_proxyManagers containsObject:mgr]) {
+		return;
+	}
+
+	releaseBlocks = [self _connectConsumersInPipeline:pipeline];
+	g_object_weak_ref(G_OBJECT(pipeline), consumers_released_cb,
+					  (__bridge_retained void *) releaseBlocks);
+}
+
+#pragma mark - VMPDegradationControllerDelegate
+
+- (NSUInteger)numberOfQoSMessagesForDegradationController:(VMPDegradationController *)controller {
+	NSUInteger count = 0;
+
+	for (VMPPipelineManager *mgr in _managedPipelines) {
+		count += [[mgr threadMonitor] numberOfQoSMessages];
+	}
+	// Shared mountpoints have the same state
+	for (_VMPRTSPPipelineState *state in [NSSet setWithArray:[_rtspPipelineStates allValues]]) {
+		count += [[state threadMonitor] numberOfQoSMessages];
+	}
+
+	return count;
+}
+
+- (void)degradationController:(VMPDegradationController *)controller
+			  didChangeLimits:(NSDictionary *)limits {
+	for (_VMPRTSPPipelineState *state in [NSSet setWithArray:[_rtspPipelineStates allValues]]) {
+		GstElement *element;
+
+		if (![state degradable]) {
+			continue;
+		}
+
+		// Transfer: FULL
+		element = [state copyMediaElement];
+		[[state encoderSettings] applyLimits:limits pipeline:element];
+		if (element) {
+			gst_object_unref(element);
+		}
+	}
+}
+
 #pragma mark - Private methods
 
+// Restart a channel pipeline with increasing delay until it was started successfully
+- (void)_scheduleRestartOfManager:(VMPPipelineManager *)mgr {
+	NSTimeInterval initialDelay = 1.0;
+	NSTimeInterval delayIncrement = 2.0;
+	NSTimeInterval maxDelay = 30.0;
+
+	// A stall may be followed by an EOS or vice versa. Restart only once.
+	if ([_pendingRestarts containsObject:mgr]) {
+		VMPDebug(@"Restart of pipeline mgr %@ is already scheduled", mgr);
+		return;
+	}
+	[_pendingRestarts addObject:mgr];
+
+	[[NSRunLoop currentRunLoop]
+		 scheduleBlock:^BOOL {
+			 VMPInfo(@"Stopping pipeline mgr %@ for scheduled restart...", mgr);
+			 [mgr stop];
+
+			 // Stop if pipeline was started successfully, continue
+			 // with increasing delay otherwise
+			 VMPInfo(@"Trying to restart pipeline mgr %@...", mgr);
+
+			 // Interference with new bus messages is not possible due
+			 // the NSRunLoop processing events and timers serially on a single
+			 // thread.
+			 BOOL status = [mgr start];
+			 if (status) {
+				 VMPInfo(@"Restart of %@ Successful!", mgr);
+				 [_pendingRestarts removeObject:mgr];
+			 } else {
+				 VMPError(@"Could not restart %@. Retrying...", mgr);
+			 }
+
+			 return status;
+		 }
+		  initialDelay:initialDelay
+		delayIncrement:delayIncrement
+			  maxDelay:maxDelay];
+}
+
 // Iterate over the channelConfiguration array, create all pipeline managers accordingly, and
 // start them.
 - (BOOL)_startChannelPipelinesWithError:(NSError **)error {
 	NSArray *channels;
+	NSSet<NSString *> *probedChannels;
 	VMPInfo(@"Starting channel pipelines");
 
 	channels = [_configuration channels];
+	probedChannels = [self _latencyProbedChannels];
 	VMPDebug(@"Found %lu channels in configuration", [channels count]);
 
 	for (VMPConfigChannelModel *channel in channels) {
-		NSString *type, *name;
+		NSString *type, *name, *templateType;
 		NSDictionary<NSString *, id> *properties;
 		VMPPipelineManager *manager;
+		VMPEncodedChannel *encodedChannel = nil;
 		NSDictionary *vars = nil;
 		NSString *pipeline;
 
 		type = [channel type];
 		name = [channel name];
 		properties = [channel properties];
+		templateType = type;
 
 		if ([type isEqualToString:VMPConfigChannelTypeV4L2]) {
 			VMPInfo(@"Starting channel %@ of type %@", name, type);
@@ -342,7 +762,38 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 				return NO;
 			}
 
-			vars = @{@"V4L2DEV" : device, @"VIDEOCHANNEL.0" : name};
+			vars = [self _variablesForV4L2Channel:name device:device properties:properties];
+			if (!vars) {
+				CONFIG_ERROR(error, @"V4L2 channel has an invalid 'ioMode' property")
+				return NO;
+			}
+
+			// Keep the compressed camera output, and only decode it on demand
+			if (properties[@"passthrough"]) {
+				NSString *encoding = properties[@"passthrough"];
+
+				if ([encoding isEqual:kVMPEncodingH264]) {
+					templateType = @"v4l2H264";
+				} else if ([encoding isEqual:kVMPEncodingMJPEG]) {
+					templateType = @"v4l2MJPEG";
+				} else {
+					CONFIG_ERROR(error, @"'passthrough' must be 'h264' or 'mjpeg'")
+					return NO;
+				}
+				encodedChannel = [VMPEncodedChannel channelWithName:name encoding:encoding];
+			}
+		} else if ([type isEqualToString:VMPConfigChannelTypeNetwork]) {
+			VMPInfo(@"Starting channel %@ of type %@", name, type);
+			templateType = [self _templateTypeForNetworkChannel:name
+													 properties:properties
+													  variables:&vars
+														  error:error];
+			if (!templateType) {
+				return NO;
+			}
+
+			// Network streams are always H.264 and forwarded without transcoding
+			encodedChannel = [VMPEncodedChannel channelWithName:name encoding:kVMPEncodingH264];
 		} else if ([type isEqualToString:VMPConfigChannelTypeVideoTest]) {
 			NSNumber *width, *height;
 
@@ -384,12 +835,95 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 
 		VMPDebug(@"Substitution dictionary for pipeline with name '%@': %@", name, vars);
 
-		pipeline = [_currentProfile pipelineForChannelType:type variables:vars error:error];
+		pipeline = [_currentProfile pipelineForChannelType:templateType variables:vars error:error];
 		if (!pipeline) {
 			return NO;
 		}
 
 		manager = [VMPPipelineManager managerWithLaunchArgs:pipeline channel:name delegate:self];
+		if (encodedChannel) {
+			[manager setEncodedChannel:encodedChannel];
+			_encodedChannels[name] = encodedChannel;
+		}
+		// Adapt the output of the channel to the mountpoints and recordings reading from it
+		_channelDemands[name] = [VMPChannelDemand demandWithChannel:name];
+		[manager setDemand:_channelDemands[name]];
+		// Reconnect after the connection of a network source was lost
+		if ([type isEqualToString:VMPConfigChannelTypeNetwork]) {
+			[manager setRestartOnError:YES];
+		}
+		if (properties[@"slate"] &&
+			!([properties[@"slate"] isKindOfClass:[NSNumber class]] &&
+			  ![properties[@"slate"] boolValue])) {
+			NSDictionary<NSString *, NSString *> *templates;
+			VMPSignalSlate *slate;
+
+			templates = [_currentProfile channels];
+			if (!templates[@"slateImage"] || !templates[@"slateBlack"]) {
+				CONFIG_ERROR(error, @"Profile has no 'slateImage' or 'slateBlack' channel template")
+				return NO;
+			}
+
+			slate = [VMPSignalSlate slateWithChannel:name
+										propertyList:properties[@"slate"]
+									   imageTemplate:templates[@"slateImage"]
+									   blackTemplate:templates[@"slateBlack"]
+											   error:error];
+			if (!slate) {
+				VMPError(@"Invalid slate for channel %@", name);
+				return NO;
+			}
+			[manager setSlate:slate];
+			// The slate covers the restart after the capture device reported an error
+			[manager setRestartOnError:YES];
+		}
+		if ([probedChannels containsObject:name]) {
+			[manager setLatencyProbe:[[VMPLatencyProbe alloc] init]];
+		}
+		if (properties[@"scheduling"]) {
+			VMPSchedulingPolicy *policy;
+
+			policy = [VMPSchedulingPolicy policyWithPropertyList:properties[@"scheduling"]
+														   error:error];
+			if (!policy) {
+				VMPError(@"Invalid scheduling policy for channel %@", name);
+				return NO;
+			}
+			[[manager threadMonitor] setSchedulingPolicy:policy];
+		}
+		[[manager threadMonitor] setTaskPool:_taskPool];
+		if (properties[@"memoryBudget"]) {
+			VMPMemoryBudget *budget;
+
+			budget = [VMPMemoryBudget budgetWithPropertyList:properties[@"memoryBudget"]
+													   error:error];
+			if (!budget) {
+				VMPError(@"Invalid memory budget for channel %@", name);
+				return NO;
+			}
+			[manager setMemoryBudget:budget];
+		}
+		if (properties[@"staticContent"]) {
+			VMPStaticContentDetector *detector;
+
+			detector = [VMPStaticContentDetector detectorWithPropertyList:properties[@"staticContent"]
+																	error:error];
+			if (!detector) {
+				VMPError(@"Invalid static content detection for channel %@", name);
+				return NO;
+			}
+			[manager setStaticContentDetector:detector];
+			_staticContentDetectors[name] = detector;
+		}
+		if (properties[@"watchdogTimeout"]) {
+			id timeout = properties[@"watchdogTimeout"];
+
+			if (![timeout isKindOfClass:[NSNumber class]] || [timeout doubleValue] <= 0) {
+				CONFIG_ERROR(error, @"'watchdogTimeout' must be a positive number of seconds")
+				return NO;
+			}
+			[manager setWatchdogTimeout:[timeout doubleValue]];
+		}
 		if (![manager start]) {
 			CONFIG_ERROR(error, @"Failed to start pipeline")
 			return NO;
@@ -404,147 +938,813 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	return YES;
 }
 
-/*
-	We use intervideo{src,sink} for separating source, and pipelines managed by the GStreamer
-   RTSP server. Separating audio pipelines is much more difficult, and as of writing this, there
-   is a major bug in the interaudio{src,sink}, which makes multiple listening clients impossible
-   (see: https://gitlab.freedesktop.org/gstreamer/gst-plugins-bad/-/issues/1788)
-
-   Instead, we use the concept of channels for configuration, but use sub-pipelines for audio
-   processing for each mountpoint.
-
-   This method converts the channel description to a sub-pipeline.
-*/
+// Start a proxy pipeline for every video channel with a 'proxy' property. The proxy is published
+// as a separate channel, and shared by all mosaic mountpoints showing the channel.
+- (BOOL)_startProxyPipelinesWithError:(NSError **)error {
+	for (VMPConfigChannelModel *channel in [_configuration channels]) {
+		NSString *name, *pipeline;
+		NSDictionary *proxy, *vars;
+		VMPPipelineManager *manager;
+		id value;
 
-- (BOOL)_createMountpointsWithError:(NSError **)error {
-	VMPDebug(@"Creating mountpoints");
-	NSArray *mountpoints = [_configuration mountpoints];
+		name = [channel name];
+		value = [channel properties][@"proxy"];
+		if (!value || ([value isKindOfClass:[NSNumber class]] && ![value boolValue])) {
+			continue;
+		}
+		if (!_channelDemands[name]) {
+			CONFIG_ERROR(error, @"'proxy' is only supported by video channels")
+			return NO;
+		}
 
-	for (VMPConfigMountpointModel *mountpoint in mountpoints) {
-		NSString *name, *type, *path;
-		NSDictionary<NSString *, id> *properties;
-		_VMPRTSPPipelineState *state;
+		proxy = [self _proxyForChannel:name propertyList:value error:error];
+		if (!proxy) {
+			return NO;
+		}
 
-		name = [mountpoint name];
-		type = [mountpoint type];
-		path = [mountpoint path];
-		properties = [mountpoint properties];
+		vars = @{
+			@"VIDEOCHANNEL.0" : name,
+			@"PROXYCHANNEL" : proxy[@"channel"],
+			@"WIDTH" : [proxy[@"width"] stringValue],
+			@"HEIGHT" : [proxy[@"height"] stringValue],
+			@"FRAMERATE" : [proxy[@"framerate"] stringValue],
+		};
+		pipeline = [_currentProfile pipelineForChannelType:@"proxy" variables:vars error:error];
+		if (!pipeline) {
+			return NO;
+		}
 
-		state = [[_VMPRTSPPipelineState alloc] initWithServer:self mountpointName:name];
+		manager = [VMPPipelineManager managerWithLaunchArgs:pipeline
+												   channel:proxy[@"channel"]
+												  delegate:self];
+		[[manager threadMonitor] setTaskPool:_taskPool];
+		_proxies[name] = proxy;
+		[_proxyManagers addObject:manager];
+		if (![manager start]) {
+			CONFIG_ERROR(error, @"Failed to start proxy pipeline")
+			return NO;
+		}
 
-		// Add state object to dictionary
-		_rtspPipelineStates[name] = state;
+		[_managedPipelines addObject:manager];
 
-		VMPInfo(@"Creating mountpoint '%@' of type '%@' at path '%@'", name, type, path);
+		VMPInfo(@"Proxy %@ of channel %@ started with %@x%@ at %@ fps", proxy[@"channel"], name,
+				proxy[@"width"], proxy[@"height"], proxy[@"framerate"]);
+	}
 
-		/* Set up a combined mountpoint with two video channels, and one audio channel.
-		 * The secondary video channel can be used for a camera.
-		 */
-		if ([type isEqualToString:VMPConfigMountpointTypeCombined]) {
-			GstRTSPMediaFactory *factory;
-			NSString *videoChannel, *secondaryVideoChannel, *audioChannel;
-			NSString *pipeline, *audioPipeline;
-			NSDictionary<NSString *, NSString *> *vars;
-
-			videoChannel = properties[@"videoChannel"];
-			secondaryVideoChannel = properties[@"secondaryVideoChannel"];
-			audioChannel = properties[@"audioChannel"];
-			if (!videoChannel || !secondaryVideoChannel || !audioChannel) {
-				CONFIG_ERROR(error, @"Combined mountpoint is missing a channel "
-									@"('videoChannel', 'secondaryVideoChannel', or 'audioChannel')")
-				return NO;
-			}
+	return YES;
+}
 
-			vars = @{
-				@"VIDEOCHANNEL.0" : videoChannel,
-				@"VIDEOCHANNEL.1" : secondaryVideoChannel,
-			};
+// Parse the 'proxy' property of a channel. Either YES for the default format, or a dictionary
+// with the optional keys 'width', 'height', and 'framerate'.
+- (NSDictionary *)_proxyForChannel:(NSString *)name
+					  propertyList:(id)propertyList
+							 error:(NSError **)error {
+	NSInteger width, height, framerate;
 
-			pipeline = [_currentProfile pipelineForMountpointType:type variables:vars error:error];
-			if (!pipeline) {
-				return NO;
-			}
+	width = kVMPProxyDefaultWidth;
+	height = kVMPProxyDefaultHeight;
+	framerate = kVMPProxyDefaultFramerate;
 
-			audioPipeline = [self _pipelineFromAudioChannel:audioChannel error:error];
-			if (!audioPipeline) {
-				return NO;
-			}
+	if ([propertyList isKindOfClass:[NSDictionary class]]) {
+		NSDictionary *dict = propertyList;
 
-			VMPDebug(@"Video-only mountpoint pipeline: %@", pipeline);
-
-			pipeline = [NSString stringWithFormat:@"%@ %@", pipeline, audioPipeline];
-
-			VMPDebug(@"Combined mountpoint pipeline: %@", pipeline);
-
-			// Setup a new GStreamer RTSP media factory
-			factory = gst_rtsp_media_factory_new();
-			// Only create one pipeline and share it with other clients
-			gst_rtsp_media_factory_set_shared(factory, TRUE);
-
-			gst_rtsp_media_factory_set_launch(factory, (const gchar *) [pipeline UTF8String]);
-			g_signal_connect(factory, "media-constructed", (GCallback) media_constructed_cb,
-							 (__bridge void *) state);
-			gst_rtsp_mount_points_add_factory(_mountPoints, (const gchar *) [path UTF8String],
-											  factory);
-		} else if ([type isEqualToString:VMPConfigMountpointTypeSingle]) {
-			GstRTSPMediaFactory *factory;
-			NSString *videoChannel, *audioChannel;
-			NSString *pipeline, *audioPipeline;
-			NSDictionary<NSString *, NSString *> *vars;
-
-			videoChannel = properties[@"videoChannel"];
-			audioChannel = properties[@"audioChannel"];
-			if (!videoChannel || !audioChannel) {
-				CONFIG_ERROR(error, @"Combined mountpoint is missing a channel "
-									@"('videoChannel',  or 'audioChannel')")
-				return NO;
+		for (NSString *key in @[ @"width", @"height", @"framerate" ]) {
+			if (dict[key] && ![dict[key] isKindOfClass:[NSNumber class]]) {
+				CONFIG_ERROR(error, @"'proxy' width, height, and framerate must be numbers")
+				return nil;
 			}
+		}
+		width = dict[@"width"] ? [dict[@"width"] integerValue] : width;
+		height = dict[@"height"] ? [dict[@"height"] integerValue] : height;
+		framerate = dict[@"framerate"] ? [dict[@"framerate"] integerValue] : framerate;
+	} else if (![propertyList isKindOfClass:[NSNumber class]]) {
+		CONFIG_ERROR(error, @"'proxy' must be a boolean or a dictionary")
+		return nil;
+	}
 
-			factory = gst_rtsp_media_factory_new();
-			// Only create one pipeline and share it with other clients
-			gst_rtsp_media_factory_set_shared(factory, TRUE);
-
-			vars = @{
-				@"VIDEOCHANNEL.0" : videoChannel,
-			};
+	// Encoders require even dimensions for 4:2:0 chroma subsampling
+	if (width <= 0 || height <= 0 || width % 2 || height % 2 ||
+		(NSUInteger) width > kVMPV4L2TargetWidth || (NSUInteger) height > kVMPV4L2TargetHeight) {
+		CONFIG_ERROR(error, @"'proxy' width and height must be even, and at most 1920x1080")
+		return nil;
+	}
+	if (framerate <= 0 || framerate > 60) {
+		CONFIG_ERROR(error, @"'proxy' framerate must be between 1 and 60")
+		return nil;
+	}
 
-			pipeline = [_currentProfile pipelineForMountpointType:type variables:vars error:error];
-			if (!pipeline) {
-				return NO;
-			}
+	return @{
+		@"channel" : [name stringByAppendingString:@"-proxy"],
+		@"width" : @(width),
+		@"height" : @(height),
+		@"framerate" : @(framerate),
+	};
+}
 
-			audioPipeline = [self _pipelineFromAudioChannel:audioChannel error:error];
-			if (!audioPipeline) {
-				return NO;
-			}
+// Select the template of a network channel by the scheme of its URI. Pull: rtsp://, rtsps://, and
+// srt:// in caller mode. Push: srt:// in listener mode, and udp:// for plain RTP.
+- (NSString *)_templateTypeForNetworkChannel:(NSString *)name
+								  properties:(NSDictionary *)properties
+								   variables:(NSDictionary **)variables
+									   error:(NSError **)error {
+	NSString *uri, *scheme, *templateType;
+	NSUInteger latency;
+	id value;
+
+	uri = properties[@"uri"];
+	if (![uri isKindOfClass:[NSString class]]) {
+		CONFIG_ERROR(error, @"network channel is missing 'uri' property")
+		return nil;
+	}
 
-			VMPDebug(@"Video-only single mountpoint pipeline: %@", pipeline);
+	scheme = [[[NSURL URLWithString:uri] scheme] lowercaseString];
+	if ([scheme isEqualToString:@"rtsp"] || [scheme isEqualToString:@"rtsps"]) {
+		templateType = @"networkRTSP";
+	} else if ([scheme isEqualToString:@"srt"]) {
+		templateType = @"networkSRT";
+	} else if ([scheme isEqualToString:@"udp"]) {
+		templateType = @"networkRTP";
+	} else {
+		CONFIG_ERROR(error, @"'uri' of network channel must use rtsp, rtsps, srt, or udp")
+		return nil;
+	}
 
-			pipeline = [NSString stringWithFormat:@"%@ %@", pipeline, audioPipeline];
+	latency = kVMPNetworkDefaultLatency;
+	value = properties[@"latency"];
+	if (value) {
+		if (![value isKindOfClass:[NSNumber class]] || [value integerValue] < 0 ||
+			[value unsignedIntegerValue] > kVMPNetworkMaximumLatency) {
+			CONFIG_ERROR(error, @"'latency' of network channel must be between 0 and 5000 ms")
+			return nil;
+		}
+		latency = [value unsignedIntegerValue];
+	}
 
-			VMPDebug(@"Combined single mountpoint pipeline: %@", pipeline);
+	VMPInfo(@"Network channel %@ receives %@ with a latency of %lu ms", name, uri,
+			(unsigned long) latency);
 
-			gst_rtsp_media_factory_set_launch(factory, (const gchar *) [pipeline UTF8String]);
+	*variables = @{
+		@"VIDEOCHANNEL.0" : name,
+		@"URI" : uri,
+		@"LATENCY" : [NSString stringWithFormat:@"%lu", (unsigned long) latency],
+	};
+	return templateType;
+}
 
-			g_signal_connect(factory, "media-constructed", (GCallback) media_constructed_cb,
-							 (__bridge void *) state);
+// Probe a V4L2 device and select the native capture format and I/O mode.
+// Returns nil if the 'ioMode' property is invalid.
+- (NSDictionary *)_variablesForV4L2Channel:(NSString *)name
+									device:(NSString *)device
+								properties:(NSDictionary *)properties {
+	VMPV4L2Device *v4l2;
+	VMPV4L2Format *format;
+	NSString *caps, *ioMode;
+	NSError *error = nil;
+
+	ioMode = properties[@"ioMode"];
+	if (ioMode && ![ioMode isKindOfClass:[NSString class]]) {
+		return nil;
+	}
 
-			gst_rtsp_mount_points_add_factory(_mountPoints, (const gchar *) [path UTF8String],
-											  factory);
+	// Fall back to letting v4l2src negotiate if the device cannot be probed (e.g. not
+	// plugged in yet)
+	caps = @"video/x-raw";
+	v4l2 = [VMPV4L2Device deviceWithPath:device error:&error];
+	if (v4l2) {
+		format = [v4l2 preferredFormatForWidth:kVMPV4L2TargetWidth height:kVMPV4L2TargetHeight];
+		if (format) {
+			caps = [format capsString];
+			VMPInfo(@"Selected native format %@ for V4L2 device %@", format, v4l2);
+		} else {
+			VMPWarn(@"V4L2 device %@ has no supported raw format", v4l2);
+		}
+		if (!ioMode) {
+			ioMode = [v4l2 supportsDMABUFExport] ? @"dmabuf" : @"auto";
 		}
+	} else {
+		VMPWarn(@"Could not probe V4L2 device: %@", error);
 	}
 
-	VMPDebug(@"Finished creating mountpoints");
-	return YES;
+	return @{
+		@"VIDEOCHANNEL.0" : name,
+		@"V4L2DEV" : device,
+		@"V4L2CAPS" : caps,
+		@"V4L2IOMODE" : ioMode ?: @"auto",
+	};
 }
 
-- (NSString *)_pipelineFromAudioChannel:(NSString *)channel error:(NSError **)error {
-	NSArray *channels;
+// Video channels consumed by at least one mountpoint with an enabled latency probe
+- (NSSet<NSString *> *)_latencyProbedChannels {
+	NSMutableSet<NSString *> *channels;
 
-	channels = [_configuration channels];
+	channels = [NSMutableSet set];
+	for (VMPConfigMountpointModel *mountpoint in [_configuration mountpoints]) {
+		NSDictionary<NSString *, id> *properties;
 
-	for (VMPConfigChannelModel *chan in channels) {
-		NSString *name;
+		properties = [mountpoint properties];
+		if (![properties[@"latencyProbe"] boolValue] && ![properties[@"lowLatency"] boolValue]) {
+			continue;
+		}
+		if (properties[@"videoChannel"]) {
+			[channels addObject:properties[@"videoChannel"]];
+		}
+		if (properties[@"secondaryVideoChannel"]) {
+			[channels addObject:properties[@"secondaryVideoChannel"]];
+		}
+	}
+
+	return channels;
+}
+
+// Parse the optional "pipelineVariants" dictionary of the configuration
+- (BOOL)_configurePipelineVariantsWithError:(NSError **)error {
+	NSDictionary *config;
+	id probeTimeout, retryInterval;
+
+	_probeTimeout = kVMPPipelineVariantsDefaultProbeTimeout;
+	_variantRetryInterval = kVMPPipelineVariantsDefaultRetryInterval;
+
+	config = [_configuration pipelineVariants];
+	if (!config) {
+		return YES;
+	}
+	if (![config isKindOfClass:[NSDictionary class]]) {
+		CONFIG_ERROR(error, @"'pipelineVariants' must be a dictionary")
+		return NO;
+	}
+
+	probeTimeout = config[@"probeTimeout"];
+	if (probeTimeout) {
+		if (![probeTimeout isKindOfClass:[NSNumber class]] || [probeTimeout doubleValue] <= 0) {
+			CONFIG_ERROR(error, @"'probeTimeout' of 'pipelineVariants' must be positive")
+			return NO;
+		}
+		_probeTimeout = [probeTimeout doubleValue];
+	}
+	retryInterval = config[@"retryInterval"];
+	if (retryInterval) {
+		if (![retryInterval isKindOfClass:[NSNumber class]] || [retryInterval doubleValue] < 0) {
+			CONFIG_ERROR(error, @"'retryInterval' of 'pipelineVariants' must not be negative")
+			return NO;
+		}
+		_variantRetryInterval = [retryInterval doubleValue];
+	}
+
+	return YES;
+}
+
+// Periodically probe the preferred variants of mountpoints that fell back
+- (void)_startVariantRetries {
+	__weak VMPRTSPServer *weakSelf = self;
+	dispatch_queue_t queue;
+	uint64_t interval;
+	BOOL hasFallback = NO;
+
+	for (_VMPRTSPPipelineState *state in [_rtspPipelineStates allValues]) {
+		if ([[state variants] count] > 1) {
+			hasFallback = YES;
+		}
+	}
+	if (!hasFallback || _variantRetryInterval <= 0) {
+		return;
+	}
+
+	VMPInfo(@"Retrying preferred pipeline variants every %.0f seconds", _variantRetryInterval);
+
+	// Probes block, so they run on their own queue
+	queue = dispatch_queue_create("com.hugomelder.vmpserverd.variants", DISPATCH_QUEUE_SERIAL);
+	interval = (uint64_t) (_variantRetryInterval * NSEC_PER_SEC);
+	_variantRetryTimer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+	dispatch_source_set_timer(_variantRetryTimer, dispatch_time(DISPATCH_TIME_NOW, interval),
+							  interval, interval / 10);
+	dispatch_source_set_event_handler(_variantRetryTimer, ^{
+	  [weakSelf _retryPreferredVariants];
+	});
+	dispatch_resume(_variantRetryTimer);
+}
+
+// Called on the queue of _variantRetryTimer
+- (void)_retryPreferredVariants {
+	for (_VMPRTSPPipelineState *state in [NSSet setWithArray:[_rtspPipelineStates allValues]]) {
+		NSString *launch;
+
+		launch = [[state variants] retryPreferredWithTimeout:_probeTimeout];
+		if (launch) {
+			// Clients of the running media keep the fallback until the media is unprepared
+			gst_rtsp_media_factory_set_launch([state factory], [launch UTF8String]);
+		}
+	}
+}
+
+// Everything that makes the media of a mountpoint differ from the media of another mountpoint
+// with the same pipeline description
+- (NSDictionary *)_mediaSettingsOfMountpointState:(_VMPRTSPPipelineState *)state
+									   properties:(NSDictionary *)properties {
+	VMPEncoderSettings *encoder = [state encoderSettings];
+
+	return @{
+		@"encoder" : @[
+			@([encoder bitrate]), @([encoder keyframeInterval]), [encoder rateControl] ?: @"",
+			[encoder preset] ?: @"", [encoder profile] ?: @""
+		],
+		@"lowLatency" : @([state lowLatency] != nil),
+		@"latencyProbe" : @([state latencyProbe] != nil),
+		@"memoryBudget" : [[state memoryBudget] propertyList] ?: @{},
+		@"scheduling" : properties[@"scheduling"] ?: @{},
+		@"degradable" : @([state degradable]),
+	};
+}
+
+// Profiles of the pipeline variants of a mountpoint, preferred first. The optional "variants"
+// property of the mountpoint selects and orders them by identifier.
+- (NSArray<VMPProfileModel *> *)_variantProfilesForMountpoint:(VMPConfigMountpointModel *)mountpoint
+														error:(NSError **)error {
+	NSArray *identifiers;
+	NSMutableArray<VMPProfileModel *> *profiles;
+
+	identifiers = [mountpoint properties][@"variants"];
+	if (!identifiers) {
+		return _variantProfiles;
+	}
+	if (![identifiers isKindOfClass:[NSArray class]] || [identifiers count] == 0) {
+		CONFIG_ERROR(error, @"'variants' of mountpoint must be a list of profile identifiers")
+		return nil;
+	}
+
+	profiles = [NSMutableArray arrayWithCapacity:[identifiers count]];
+	for (id identifier in identifiers) {
+		VMPProfileModel *match = nil;
+
+		for (VMPProfileModel *profile in _variantProfiles) {
+			if ([[profile identifier] isEqual:identifier]) {
+				match = profile;
+				break;
+			}
+		}
+		if (!match) {
+			VMPWarn(@"Variant %@ of mountpoint '%@' is not a compatible profile", identifier,
+					[mountpoint name]);
+			continue;
+		}
+		[profiles addObject:match];
+	}
+	if ([profiles count] == 0) {
+		CONFIG_ERROR(error, @"No variant of mountpoint is a compatible profile")
+		return nil;
+	}
+
+	return profiles;
+}
+
+// Launch description of a mountpoint built from the templates of a profile
+- (NSString *)_launchDescriptionForMountpoint:(VMPConfigMountpointModel *)mountpoint
+										state:(_VMPRTSPPipelineState *)state
+									  profile:(VMPProfileModel *)profile
+										error:(NSError **)error {
+	NSString *name, *type;
+	NSDictionary<NSString *, id> *properties;
+	NSString *overlayCompositor = @"", *overlaySources = @"";
+	NSString *bitrate;
+
+	name = [mountpoint name];
+	type = [mountpoint type];
+	properties = [mountpoint properties];
+	bitrate = [NSString stringWithFormat:@"%lu", (unsigned long) [[state encoderSettings] bitrate]];
+
+	if ([state overlay]) {
+		// Substituted for {OVERLAY} in front of the encoder
+		overlayCompositor = [[state overlay] compositorWithProfile:profile error:error];
+		overlaySources = [[state overlay] sourcesWithProfile:profile error:error];
+		if (!overlayCompositor || !overlaySources) {
+			return nil;
+		}
+	}
+
+	/* Set up a combined mountpoint with two video channels, and one audio channel.
+	 * The secondary video channel can be used for a camera.
+	 */
+	if ([type isEqualToString:VMPConfigMountpointTypeCombined]) {
+		NSString *videoChannel, *secondaryVideoChannel, *audioChannel;
+		NSString *pipeline, *audioPipeline;
+		NSDictionary<NSString *, NSString *> *vars;
+
+		videoChannel = properties[@"videoChannel"];
+		secondaryVideoChannel = properties[@"secondaryVideoChannel"];
+		audioChannel = properties[@"audioChannel"];
+		if (!videoChannel || !secondaryVideoChannel || !audioChannel) {
+			CONFIG_ERROR(error, @"Combined mountpoint is missing a channel "
+								@"('videoChannel', 'secondaryVideoChannel', or 'audioChannel')")
+			return nil;
+		}
+
+		vars = @{
+			@"VIDEOCHANNEL.0" : videoChannel,
+			@"VIDEOCHANNEL.1" : secondaryVideoChannel,
+			@"OVERLAY" : overlayCompositor,
+			@"BITRATE" : bitrate,
+		};
+
+		pipeline = [profile pipelineForMountpointType:type variables:vars error:error];
+		if (!pipeline) {
+			return nil;
+		}
+
+		audioPipeline = [self _pipelineFromAudioChannel:audioChannel profile:profile error:error];
+		if (!audioPipeline) {
+			return nil;
+		}
+
+		VMPDebug(@"Video-only mountpoint pipeline: %@", pipeline);
+
+		pipeline = [NSString stringWithFormat:@"%@%@ %@", pipeline, overlaySources, audioPipeline];
+
+		VMPDebug(@"Combined mountpoint pipeline: %@", pipeline);
+		return pipeline;
+	} else if ([type isEqualToString:VMPConfigMountpointTypeSingle]) {
+		NSString *videoChannel, *audioChannel;
+		NSString *pipeline, *audioPipeline, *templateType;
+		NSDictionary<NSString *, NSString *> *vars;
+		VMPEncodedChannel *encodedChannel;
+
+		videoChannel = properties[@"videoChannel"];
+		audioChannel = properties[@"audioChannel"];
+		if (!videoChannel || !audioChannel) {
+			CONFIG_ERROR(error, @"Combined mountpoint is missing a channel "
+								@"('videoChannel',  or 'audioChannel')")
+			return nil;
+		}
+
+		vars = @{
+			@"VIDEOCHANNEL.0" : videoChannel,
+			@"OVERLAY" : overlayCompositor,
+			@"BITRATE" : bitrate,
+		};
+		templateType = type;
+
+		// Payload the stream of a passthrough channel without transcoding
+		encodedChannel = _encodedChannels[videoChannel];
+		if (encodedChannel) {
+			templateType = [[encodedChannel encoding] isEqual:kVMPEncodingH264] ? @"singleH264"
+																		 : @"singleMJPEG";
+			VMPInfo(@"Mountpoint '%@' uses passthrough channel %@", name, videoChannel);
+			if ([state overlay]) {
+				VMPWarn(@"Overlays of mountpoint '%@' are ignored without transcoding", name);
+				[state setOverlay:nil];
+				overlaySources = @"";
+			}
+		}
+
+		pipeline = [profile pipelineForMountpointType:templateType variables:vars error:error];
+		if (!pipeline) {
+			return nil;
+		}
+
+		audioPipeline = [self _pipelineFromAudioChannel:audioChannel profile:profile error:error];
+		if (!audioPipeline) {
+			return nil;
+		}
+
+		VMPDebug(@"Video-only single mountpoint pipeline: %@", pipeline);
+
+		pipeline = [NSString stringWithFormat:@"%@%@ %@", pipeline, overlaySources, audioPipeline];
+
+		VMPDebug(@"Combined single mountpoint pipeline: %@", pipeline);
+		return pipeline;
+	} else if ([type isEqualToString:VMPConfigMountpointTypeMosaic]) {
+		NSString *pipeline;
+
+		pipeline = [self _mosaicPipelineWithProperties:properties
+											   overlay:overlayCompositor
+											   bitrate:bitrate
+											   profile:profile
+												 error:error];
+		if (!pipeline) {
+			return nil;
+		}
+		pipeline = [pipeline stringByAppendingString:overlaySources];
+
+		VMPDebug(@"Mosaic mountpoint pipeline: %@", pipeline);
+		return pipeline;
+	}
+
+	CONFIG_ERROR(error, @"Unknown mountpoint type")
+	return nil;
+}
+
+/*
+	We use intervideo{src,sink} for separating source, and pipelines managed by the GStreamer
+   RTSP server. Separating audio pipelines is much more difficult, and as of writing this, there
+   is a major bug in the interaudio{src,sink}, which makes multiple listening clients impossible
+   (see: https://gitlab.freedesktop.org/gstreamer/gst-plugins-bad/-/issues/1788)
+
+   Instead, we use the concept of channels for configuration, but use sub-pipelines for audio
+   processing for each mountpoint.
+
+   This method converts the channel description to a sub-pipeline.
+*/
+
+- (BOOL)_createMountpointsWithError:(NSError **)error {
+	VMPDebug(@"Creating mountpoints");
+	NSArray *mountpoints = [_configuration mountpoints];
+	// Names of mountpoints by the signature of their media
+	NSMutableDictionary<NSArray *, NSString *> *signatures = [NSMutableDictionary dictionary];
+
+	for (VMPConfigMountpointModel *mountpoint in mountpoints) {
+		NSString *name, *type, *path, *launch;
+		NSDictionary<NSString *, id> *properties;
+		_VMPRTSPPipelineState *state;
+		id encoderProperties;
+		VMPEncoderSettings *encoderSettings;
+		NSArray<VMPProfileModel *> *profiles;
+		NSMutableArray<NSString *> *identifiers, *launchDescriptions;
+		VMPPipelineVariants *variants;
+		GstRTSPMediaFactory *factory;
+
+		name = [mountpoint name];
+		type = [mountpoint type];
+		path = [mountpoint path];
+		properties = [mountpoint properties];
+
+		state = [[_VMPRTSPPipelineState alloc] initWithServer:self mountpointName:name];
+		[state setVideoChannel:properties[@"videoChannel"]];
+		// The latency of low-latency mountpoints is always measured
+		if ([properties[@"latencyProbe"] boolValue] || [properties[@"lowLatency"] boolValue]) {
+			[state setLatencyProbe:[[VMPLatencyProbe alloc] init]];
+		}
+		if ([properties[@"lowLatency"] boolValue]) {
+			[state setLowLatency:[[VMPLowLatency alloc] init]];
+		}
+		if (properties[@"scheduling"]) {
+			VMPSchedulingPolicy *policy;
+
+			policy = [VMPSchedulingPolicy policyWithPropertyList:properties[@"scheduling"]
+														   error:error];
+			if (!policy) {
+				VMPError(@"Invalid scheduling policy for mountpoint %@", name);
+				return NO;
+			}
+			[[state threadMonitor] setSchedulingPolicy:policy];
+		}
+		[[state threadMonitor] setTaskPool:_taskPool];
+		if (properties[@"memoryBudget"]) {
+			VMPMemoryBudget *budget;
+
+			budget = [VMPMemoryBudget budgetWithPropertyList:properties[@"memoryBudget"]
+													   error:error];
+			if (!budget) {
+				VMPError(@"Invalid memory budget for mountpoint %@", name);
+				return NO;
+			}
+			[state setMemoryBudget:budget];
+		}
+		// The "bitrate" of mosaic mountpoints predates encoder settings
+		encoderProperties = properties[@"encoder"];
+		if ((!encoderProperties || [encoderProperties isKindOfClass:[NSDictionary class]]) &&
+			properties[@"bitrate"] && !encoderProperties[@"bitrate"]) {
+			NSMutableDictionary *merged;
+
+			merged = [NSMutableDictionary dictionaryWithDictionary:encoderProperties ?: @{}];
+			merged[@"bitrate"] = properties[@"bitrate"];
+			encoderProperties = merged;
+		}
+		encoderSettings = [VMPEncoderSettings settingsWithPropertyList:encoderProperties
+																 error:error];
+		if (!encoderSettings) {
+			VMPError(@"Invalid encoder settings for mountpoint %@", name);
+			return NO;
+		}
+		[state setEncoderSettings:encoderSettings];
+		[state setDegradable:![properties[@"degradation"] isEqual:@NO]];
+		// The videorate adds a frame of latency, so only degradable media get one
+		[encoderSettings setFramerateLimitable:[_configuration degradation] != nil &&
+											   [state degradable] && ![state lowLatency]];
+		if (properties[@"overlays"]) {
+			VMPOverlay *overlay;
+
+			overlay = [VMPOverlay overlayWithPropertyList:properties[@"overlays"] error:error];
+			if (!overlay) {
+				VMPError(@"Invalid overlays for mountpoint %@", name);
+				return NO;
+			}
+			[state setOverlay:overlay];
+		}
+		if (properties[@"admission"] &&
+			![_admissionControl setLimitsWithPropertyList:properties[@"admission"]
+											forMountpoint:name
+													error:error]) {
+			VMPError(@"Invalid admission limits for mountpoint %@", name);
+			return NO;
+		}
+
+		// Add state object to dictionary
+		_rtspPipelineStates[name] = state;
+		_mountpointPaths[path] = name;
+
+		// Mountpoints of other types are ignored
+		if (![type isEqualToString:VMPConfigMountpointTypeCombined] &&
+			![type isEqualToString:VMPConfigMountpointTypeSingle] &&
+			![type isEqualToString:VMPConfigMountpointTypeMosaic]) {
+			continue;
+		}
+
+		VMPInfo(@"Creating mountpoint '%@' of type '%@' at path '%@'", name, type, path);
+
+		profiles = [self _variantProfilesForMountpoint:mountpoint error:error];
+		if (!profiles) {
+			return NO;
+		}
+		// Passthrough streams are not transcoded, so there is nothing to fall back to
+		if ([type isEqualToString:VMPConfigMountpointTypeSingle] &&
+			_encodedChannels[properties[@"videoChannel"]]) {
+			profiles = @[ profiles[0] ];
+		}
+
+		identifiers = [NSMutableArray arrayWithCapacity:[profiles count]];
+		launchDescriptions = [NSMutableArray arrayWithCapacity:[profiles count]];
+		for (VMPProfileModel *profile in profiles) {
+			NSError *variantError = nil;
+
+			launch = [self _launchDescriptionForMountpoint:mountpoint
+													 state:state
+												   profile:profile
+													 error:&variantError];
+			if (!launch) {
+				// Errors in the preferred variant are configuration errors
+				if (profile == profiles[0]) {
+					if (error) {
+						*error = variantError;
+					}
+					return NO;
+				}
+				VMPWarn(@"Skipping variant %@ of mountpoint '%@': %@", [profile identifier], name,
+						[variantError localizedDescription]);
+				continue;
+			}
+			[identifiers addObject:[profile identifier]];
+			[launchDescriptions addObject:launch];
+		}
+
+		// Identical mountpoints share the media of the first one. Overlays are updated per
+		// mountpoint, so mountpoints with overlays are never shared.
+		if (![properties[@"deduplicate"] isEqual:@NO] && ![state overlay]) {
+			NSMutableArray<NSString *> *canonical;
+			NSArray *signature;
+			NSString *primary;
+
+			canonical = [NSMutableArray arrayWithCapacity:[launchDescriptions count]];
+			for (NSString *description in launchDescriptions) {
+				[canonical addObject:[description canonicalPipelineDescription]];
+			}
+			signature = @[
+				identifiers, canonical,
+				[self _mediaSettingsOfMountpointState:state properties:properties]
+			];
+
+			primary = signatures[signature];
+			if (primary) {
+				_VMPRTSPPipelineState *primaryState = _rtspPipelineStates[primary];
+
+				VMPInfo(@"Mountpoint '%@' shares the media of identical mountpoint '%@'", name,
+						primary);
+				_rtspPipelineStates[name] = primaryState;
+				_sharedMountpoints[name] = primary;
+				gst_rtsp_mount_points_add_factory(_mountPoints, (const gchar *) [path UTF8String],
+												  g_object_ref([primaryState factory]));
+				continue;
+			}
+			signatures[signature] = name;
+		}
+
+		variants = [VMPPipelineVariants variantsWithName:name
+											 identifiers:identifiers
+									  launchDescriptions:launchDescriptions];
+		[state setVariants:variants];
+		if ([variants count] > 1) {
+			launch = [variants selectWorkingVariantWithTimeout:_probeTimeout];
+		} else {
+			launch = [variants activeLaunchDescription];
+		}
+
+		// Setup a new GStreamer RTSP media factory. Its media is shared with identical
+		// mountpoints.
+		factory = GST_RTSP_MEDIA_FACTORY(g_object_new(vmp_media_factory_get_type(), NULL));
+		// Only create one pipeline and share it with other clients
+		gst_rtsp_media_factory_set_shared(factory, TRUE);
+		if ([state lowLatency]) {
+			gst_rtsp_media_factory_set_latency(factory, kVMPLowLatencyRTSPLatency);
+		}
+
+		gst_rtsp_media_factory_set_launch(factory, (const gchar *) [launch UTF8String]);
+		g_signal_connect(factory, "media-constructed", (GCallback) media_constructed_cb,
+						 (__bridge void *) state);
+		[state setFactory:factory];
+		gst_rtsp_mount_points_add_factory(_mountPoints, (const gchar *) [path UTF8String],
+										  factory);
+	}
+
+	VMPDebug(@"Finished creating mountpoints");
+	return YES;
+}
+
+// Tile the proxies of the video channels of a mosaic mountpoint row by row into a grid. Every
+// tile has the size of the proxy of the first channel.
+- (NSString *)_mosaicPipelineWithProperties:(NSDictionary *)properties
+									overlay:(NSString *)overlay
+									bitrate:(NSString *)bitrate
+									profile:(VMPProfileModel *)profile
+									  error:(NSError **)error {
+	NSArray *videoChannels;
+	NSMutableString *pads, *tiles;
+	NSDictionary *vars, *firstProxy;
+	NSInteger columns, rows, tileWidth, tileHeight;
+	NSString *pipeline;
+	NSUInteger count;
+
+	videoChannels = properties[@"videoChannels"];
+	if (![videoChannels isKindOfClass:[NSArray class]] || [videoChannels count] == 0) {
+		CONFIG_ERROR(error, @"Mosaic mountpoint is missing 'videoChannels'")
+		return nil;
+	}
+	count = [videoChannels count];
+
+	// Square grid by default
+	columns = 1;
+	while ((NSUInteger) (columns * columns) < count) {
+		columns++;
+	}
+	if (properties[@"columns"]) {
+		columns = [properties[@"columns"] integerValue];
+		if (columns <= 0) {
+			CONFIG_ERROR(error, @"'columns' of mosaic mountpoint must be positive")
+			return nil;
+		}
+	}
+	rows = ((NSInteger) count + columns - 1) / columns;
+
+	firstProxy = _proxies[videoChannels[0]];
+	tileWidth = [firstProxy[@"width"] integerValue];
+	tileHeight = [firstProxy[@"height"] integerValue];
+
+	pads = [NSMutableString string];
+	tiles = [NSMutableString string];
+	for (NSUInteger i = 0; i < count; i++) {
+		NSString *channel, *tile;
+		NSDictionary *proxy;
+
+		channel = videoChannels[i];
+		proxy = [channel isKindOfClass:[NSString class]] ? _proxies[channel] : nil;
+		if (!proxy) {
+			CONFIG_ERROR(error, @"Every channel of a mosaic mountpoint needs a 'proxy'")
+			return nil;
+		}
+
+		[pads appendFormat:@" sink_%lu::xpos=%ld sink_%lu::ypos=%ld sink_%lu::width=%ld "
+						   @"sink_%lu::height=%ld",
+						   (unsigned long) i, (long) ((NSInteger) i % columns * tileWidth),
+						   (unsigned long) i, (long) ((NSInteger) i / columns * tileHeight),
+						   (unsigned long) i, (long) tileWidth, (unsigned long) i,
+						   (long) tileHeight];
+
+		vars = @{
+			@"VIDEOCHANNEL.0" : proxy[@"channel"],
+			@"PAD" : [NSString stringWithFormat:@"sink_%lu", (unsigned long) i],
+		};
+		tile = [profile pipelineForMountpointType:@"mosaicTile" variables:vars error:error];
+		if (!tile) {
+			return nil;
+		}
+		[tiles appendFormat:@" %@", tile];
+	}
+
+	VMPInfo(@"Mosaic of %lu channels in a %ldx%ld grid of %ldx%ld tiles", (unsigned long) count,
+			(long) columns, (long) rows, (long) tileWidth, (long) tileHeight);
+
+	vars = @{
+		@"PADS" : pads,
+		@"WIDTH" : [NSString stringWithFormat:@"%ld", (long) (columns * tileWidth)],
+		@"HEIGHT" : [NSString stringWithFormat:@"%ld", (long) (rows * tileHeight)],
+		@"BITRATE" : bitrate,
+		@"OVERLAY" : overlay,
+	};
+	pipeline = [profile pipelineForMountpointType:VMPConfigMountpointTypeMosaic
+										variables:vars
+											error:error];
+	if (!pipeline) {
+		return nil;
+	}
+
+	return [pipeline stringByAppendingString:tiles];
+}
+
+- (NSString *)_pipelineFromAudioChannel:(NSString *)channel
+								profile:(VMPProfileModel *)profile
+								  error:(NSError **)error {
+	NSArray *channels;
+
+	channels = [_configuration channels];
+
+	for (VMPConfigChannelModel *chan in channels) {
+		NSString *name;
 
 		name = [chan name];
 		if ([name isEqualToString:channel]) {
@@ -567,7 +1767,7 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 
 				vars = @{@"PULSEDEV" : device};
 
-				return [_currentProfile pipelineForChannelType:type variables:vars error:error];
+				return [profile pipelineForChannelType:type variables:vars error:error];
 			} else if ([type isEqualToString:@"audioTest"]) {
 				NSString *type;
 				NSDictionary<NSString *, id> *vars;
@@ -575,7 +1775,7 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 				type = [chan type];
 				vars = @{};
 
-				return [_currentProfile pipelineForChannelType:type variables:vars error:error];
+				return [profile pipelineForChannelType:type variables:vars error:error];
 			} else {
 				CONFIG_ERROR(error, @"Unknown audio channel type")
 				return nil;
@@ -586,6 +1786,74 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	return nil;
 }
 
+// Name of the mountpoint requested by a client, or nil
+- (NSString *)_mountpointNameForContext:(GstRTSPContext *)ctx {
+	GstRTSPMediaFactory *factory;
+	NSString *prefix;
+	gint matched;
+
+	if (!ctx->uri || !ctx->uri->abspath) {
+		return nil;
+	}
+
+	// Transfer: FULL
+	factory = gst_rtsp_mount_points_match(_mountPoints, ctx->uri->abspath, &matched);
+	if (!factory) {
+		return nil;
+	}
+	g_object_unref(factory);
+
+	// The matched length is in bytes
+	prefix = [[NSString alloc] initWithBytes:ctx->uri->abspath
+									  length:(NSUInteger) matched
+									encoding:NSUTF8StringEncoding];
+	return prefix ? _mountpointPaths[prefix] : nil;
+}
+
+- (GstRTSPStatusCode)_admissionStatusForClient:(GstRTSPClient *)client
+									   context:(GstRTSPContext *)ctx
+									   reserve:(BOOL)reserve {
+	_VMPRTSPPipelineState *state;
+	NSString *name;
+	NSUInteger bitrate;
+	BOOL admitted;
+
+	// Unknown paths are answered with 404 Not Found by the client
+	name = [self _mountpointNameForContext:ctx];
+	if (!name) {
+		return GST_RTSP_STS_OK;
+	}
+
+	state = _rtspPipelineStates[name];
+	bitrate = [[state encoderSettings] effectiveBitrate];
+	if (reserve) {
+		// Further streams of an existing session are admitted to the session
+		const void *owner = ctx->session ? (const void *) ctx->session : (const void *) client;
+		admitted = [_admissionControl admitClient:owner toMountpoint:name bitrate:bitrate];
+	} else {
+		admitted = [_admissionControl canAdmitToMountpoint:name bitrate:bitrate];
+	}
+
+	return admitted ? GST_RTSP_STS_OK : GST_RTSP_STS_NOT_ENOUGH_BANDWIDTH;
+}
+
+- (void)_releaseClient:(const void *)client {
+	[_admissionControl releaseClient:client];
+}
+
+- (void)_releaseSessionForContext:(GstRTSPContext *)ctx {
+	NSString *name;
+
+	name = [self _mountpointNameForContext:ctx];
+	if (ctx->session && name) {
+		[_admissionControl releaseClient:ctx->session fromMountpoint:name];
+	}
+}
+
+- (void)_moveClient:(GstRTSPClient *)client toSession:(GstRTSPSession *)session {
+	[_admissionControl moveClient:client toClient:session];
+}
+
 #pragma mark - Public methods
 
 - (NSData *)dotGraphForMountPointName:(NSString *)name {
@@ -599,6 +1867,210 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	return [state lastDotGraph];
 }
 
+- (NSDictionary *)topologyForMountPointName:(NSString *)name {
+	_VMPRTSPPipelineState *state;
+	NSDictionary *topology;
+	GstElement *element;
+
+	state = _rtspPipelineStates[name];
+	if (!state) {
+		return nil;
+	}
+
+	// Transfer: FULL
+	element = [state copyMediaElement];
+	if (!element) {
+		return nil;
+	}
+
+	topology = VMPPipelineTopology(element);
+	gst_object_unref(element);
+
+	return topology;
+}
+
+- (NSDictionary *)latencyStatisticsForMountPointName:(NSString *)name {
+	_VMPRTSPPipelineState *state;
+	NSMutableDictionary *stages;
+	NSMutableDictionary *breakdown;
+	NSDictionary *capture;
+	double previous;
+
+	state = _rtspPipelineStates[name];
+	if (!state || ![state latencyProbe]) {
+		return nil;
+	}
+
+	stages = [[[state latencyProbe] statistics] mutableCopy];
+
+	// The capture stage is measured in the channel pipeline
+	capture = [[[self pipelineManagerForChannel:[state videoChannel]] latencyProbe]
+		statistics][kVMPLatencyStageCapture];
+	if (capture) {
+		stages[kVMPLatencyStageCapture] = capture;
+	}
+
+	// Latencies are cumulative. The breakdown is the median latency added by each stage.
+	breakdown = [NSMutableDictionary dictionaryWithCapacity:[stages count]];
+	previous = 0;
+	for (NSString *stage in @[
+			 kVMPLatencyStageCapture, kVMPLatencyStageComposite, kVMPLatencyStageEncode,
+			 kVMPLatencyStagePayload
+		 ]) {
+		double median;
+
+		if (!stages[stage]) {
+			continue;
+		}
+		median = [stages[stage][@"p50"] doubleValue];
+		breakdown[stage] = @(MAX(median - previous, 0));
+		previous = median;
+	}
+
+	return @{
+		@"mountpoint" : name,
+		@"stages" : stages,
+		@"breakdown" : breakdown,
+	};
+}
+
+- (NSDictionary *)encoderSettingsForMountPointName:(NSString *)name {
+	return [[_rtspPipelineStates[name] encoderSettings] statistics];
+}
+
+- (BOOL)setEncoderBitrate:(NSUInteger)bitrate
+		 keyframeInterval:(NSUInteger)keyframeInterval
+		forMountPointName:(NSString *)name
+					error:(NSError **)error {
+	_VMPRTSPPipelineState *state;
+	GstElement *element;
+	BOOL updated;
+
+	state = _rtspPipelineStates[name];
+	if (!state) {
+		VMP_FAST_ERROR(error, VMPErrorCodeEncoderError, @"Mountpoint %@ not found", name);
+		return NO;
+	}
+	// The encoders belong to the media of the primary mountpoint
+	if (_sharedMountpoints[name]) {
+		VMP_FAST_ERROR(error, VMPErrorCodeEncoderError,
+					   @"Mountpoint %@ shares the media of mountpoint %@. Change the encoder of %@ "
+					   @"instead.",
+					   name, _sharedMountpoints[name], _sharedMountpoints[name]);
+		return NO;
+	}
+
+	// Transfer: FULL. The media is shared by all clients of the mountpoint.
+	element = [state copyMediaElement];
+	updated = [[state encoderSettings] updateBitrate:bitrate
+									keyframeInterval:keyframeInterval
+											pipeline:element
+											   error:error];
+	if (element) {
+		gst_object_unref(element);
+	}
+
+	return updated;
+}
+
+- (BOOL)_startProfilerWithElement:(GstElement *)element
+							 key:(NSString *)key
+							name:(NSString *)name
+						duration:(NSTimeInterval)duration
+						   error:(NSError **)error {
+	// HTTP handlers may call us concurrently
+	@synchronized(_profilers) {
+		if ([_profilers[key] isRunning]) {
+			VMP_FAST_ERROR(error, VMPErrorCodeProfilerError,
+						   @"A profiling session for '%@' is already running", name);
+			return NO;
+		}
+
+		_profilers[key] = [VMPPipelineProfiler profilerWithElement:element
+															  name:name
+														  duration:duration];
+	}
+	return YES;
+}
+
+- (BOOL)startProfilingChannel:(NSString *)channel
+					 duration:(NSTimeInterval)duration
+						error:(NSError **)error {
+	VMPPipelineManager *mgr;
+	GstElement *pipeline;
+	BOOL ret;
+
+	mgr = [self pipelineManagerForChannel:channel];
+	if (!mgr) {
+		VMP_FAST_ERROR(error, VMPErrorCodeProfilerError, @"Channel '%@' does not exist", channel);
+		return NO;
+	}
+	// Transfer: FULL. The pipeline may be stopped on the main queue meanwhile.
+	pipeline = [mgr copyPipeline];
+	if (!pipeline) {
+		VMP_FAST_ERROR(error, VMPErrorCodeProfilerError,
+					   @"Pipeline of channel '%@' is not running", channel);
+		return NO;
+	}
+
+	ret = [self _startProfilerWithElement:pipeline
+									  key:[@"channel/" stringByAppendingString:channel]
+									 name:channel
+								 duration:duration
+									error:error];
+	gst_object_unref(pipeline);
+
+	return ret;
+}
+
+- (BOOL)startProfilingMountPointName:(NSString *)name
+							duration:(NSTimeInterval)duration
+							   error:(NSError **)error {
+	_VMPRTSPPipelineState *state;
+	GstElement *element;
+	BOOL ret;
+
+	state = _rtspPipelineStates[name];
+	if (!state) {
+		VMP_FAST_ERROR(error, VMPErrorCodeProfilerError, @"Mountpoint '%@' does not exist", name);
+		return NO;
+	}
+
+	// Transfer: FULL
+	element = [state copyMediaElement];
+	if (!element) {
+		VMP_FAST_ERROR(error, VMPErrorCodeProfilerError,
+					   @"Mountpoint '%@' has no active media. Connect a client first.", name);
+		return NO;
+	}
+
+	ret = [self _startProfilerWithElement:element
+									  key:[@"mountpoint/" stringByAppendingString:name]
+									 name:name
+								 duration:duration
+									error:error];
+	gst_object_unref(element);
+
+	return ret;
+}
+
+- (NSDictionary *)_profilingReportForKey:(NSString *)key {
+	VMPPipelineProfiler *profiler;
+
+	@synchronized(_profilers) {
+		profiler = _profilers[key];
+	}
+	return [profiler report];
+}
+
+- (NSDictionary *)profilingReportForChannel:(NSString *)channel {
+	return [self _profilingReportForKey:[@"channel/" stringByAppendingString:channel]];
+}
+
+- (NSDictionary *)profilingReportForMountPointName:(NSString *)name {
+	return [self _profilingReportForKey:[@"mountpoint/" stringByAppendingString:name]];
+}
+
 - (VMPPipelineManager *)pipelineManagerForChannel:(NSString *)channel {
 	for (VMPPipelineManager *mgr in _managedPipelines) {
 		if ([[mgr channel] isEqualToString:channel]) {
@@ -609,6 +2081,144 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	return nil;
 }
 
+- (BOOL)hasMountPointName:(NSString *)name {
+	return _rtspPipelineStates[name] != nil;
+}
+
+- (NSDictionary *)globalStatistics {
+	NSMutableDictionary *statistics;
+	NSMutableArray *pipelines, *mountpoints, *recordings;
+	NSMutableDictionary<NSString *, NSString *> *channelTypes;
+	NSUInteger savedEncoders;
+	GstElement *pipeline;
+
+	channelTypes = [NSMutableDictionary dictionary];
+	for (VMPConfigChannelModel *channel in [_configuration channels]) {
+		channelTypes[[channel name]] = [channel type];
+	}
+	for (NSDictionary *proxy in [_proxies allValues]) {
+		channelTypes[proxy[@"channel"]] = @"proxy";
+	}
+
+	pipelines = [NSMutableArray arrayWithCapacity:[_managedPipelines count]];
+	for (VMPPipelineManager *mgr in _managedPipelines) {
+		NSMutableDictionary *info;
+
+		info = [NSMutableDictionary dictionaryWithDictionary:@{
+			@"name" : [mgr channel],
+			@"type" : channelTypes[[mgr channel]] ?: @"unknown",
+			@"state" : [mgr state],
+			@"numberOfRestarts" : [mgr statistics][kVMPStatisticsNumberOfRestarts],
+			@"threads" : [[mgr threadMonitor] statistics],
+		}];
+		// Transfer: FULL. The pipeline may be stopped on the main queue meanwhile.
+		pipeline = [mgr copyPipeline];
+		if (pipeline) {
+			info[@"memory"] = [VMPMemoryBudget memoryStatisticsForPipeline:pipeline];
+			gst_object_unref(pipeline);
+		}
+		if ([mgr memoryBudget]) {
+			info[@"memoryBudget"] = [[mgr memoryBudget] propertyList];
+		}
+		if ([mgr watchdog]) {
+			info[@"watchdog"] = [[mgr watchdog] statistics];
+		}
+		if ([mgr encodedChannel]) {
+			info[@"passthrough"] = [[mgr encodedChannel] statistics];
+		}
+		if ([mgr demand]) {
+			info[@"demand"] = [[mgr demand] statistics];
+		}
+		if ([mgr staticContentDetector]) {
+			info[@"staticContent"] = [[mgr staticContentDetector] statistics];
+		}
+		if ([mgr slate]) {
+			info[@"slate"] = [[mgr slate] statistics];
+		}
+		[pipelines addObject:info];
+	}
+
+	mountpoints = [NSMutableArray arrayWithCapacity:[_rtspPipelineStates count]];
+	for (NSString *name in _rtspPipelineStates) {
+		_VMPRTSPPipelineState *state = _rtspPipelineStates[name];
+		NSMutableDictionary *info;
+		GstElement *element;
+
+		info = [NSMutableDictionary dictionaryWithDictionary:@{
+			@"name" : name,
+			@"threads" : [[state threadMonitor] statistics],
+		}];
+
+		// Transfer: FULL
+		element = [state copyMediaElement];
+		if (element) {
+			info[@"memory"] = [VMPMemoryBudget memoryStatisticsForPipeline:element];
+			gst_object_unref(element);
+		}
+		if ([state memoryBudget]) {
+			info[@"memoryBudget"] = [[state memoryBudget] propertyList];
+		}
+		if ([state overlay]) {
+			info[@"overlays"] = [[state overlay] statistics];
+		}
+		info[@"encoder"] = [[state encoderSettings] statistics];
+		if ([state variants]) {
+			info[@"variants"] = [[state variants] statistics];
+		}
+		if (_sharedMountpoints[name]) {
+			info[@"sharedWith"] = _sharedMountpoints[name];
+		}
+		if ([state lowLatency]) {
+			info[@"lowLatency"] = [[state lowLatency] statistics];
+			info[@"latency"] = [self latencyStatisticsForMountPointName:name][@"breakdown"] ?: @{};
+		}
+		[mountpoints addObject:info];
+	}
+
+	recordings = [NSMutableArray array];
+	for (VMPRecordingManager *recording in [self recordings]) {
+		NSMutableDictionary *info;
+
+		info = [NSMutableDictionary dictionaryWithDictionary:@{
+			@"path" : [[recording path] path],
+			@"state" : [recording state],
+			@"threads" : [[recording threadMonitor] statistics],
+		}];
+		if ([recording chapterIndexer]) {
+			info[@"chapters"] = [[recording chapterIndexer] statistics];
+		}
+		[recordings addObject:info];
+	}
+
+	// Every mountpoint sharing a media saves the encoders of that media. Shared mountpoints have
+	// the state of the mountpoint they share the media of.
+	savedEncoders = 0;
+	for (NSString *name in _sharedMountpoints) {
+		savedEncoders += [_rtspPipelineStates[name] numberOfEncoders];
+	}
+
+	statistics = [NSMutableDictionary dictionaryWithDictionary:@{
+		@"managed_pipelines" : pipelines,
+		@"mountpoints" : mountpoints,
+		@"recordings" : recordings,
+	}];
+	if (_taskPool) {
+		statistics[@"taskPool"] = [_taskPool statistics];
+	}
+	if (_degradationController) {
+		statistics[@"degradation"] = [_degradationController statistics];
+	}
+	statistics[@"admission"] = [_admissionControl statistics];
+	@synchronized(self) {
+		statistics[@"deduplication"] = @{
+			@"sharedMountpoints" : _sharedMountpoints,
+			@"savedEncoders" : @(savedEncoders),
+		};
+	}
+
+	return statistics;
+}
+
 - (NSArray *)channelInfo {
 	NSMutableArray *info = [NSMutableArray arrayWithCapacity:[_managedPipelines count]];
 
@@ -626,15 +2236,64 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 
 - (BOOL)startWithError:(NSError **)error {
 	VMPInfo(@"Starting RTSP server...");
+
+	// Low-footprint mode: Run all streaming threads in a shared, bounded pool
+	if ([_configuration taskPool]) {
+		_taskPool = [VMPTaskPool taskPoolWithPropertyList:[_configuration taskPool] error:error];
+		if (!_taskPool) {
+			return NO;
+		}
+	}
+
 	// Create and start all (ingress) pipelines
 	if (![self _startChannelPipelinesWithError:error]) {
 		return NO;
 	}
 
+	// Proxies register with the demand of their source channel
+	if (![self _startProxyPipelinesWithError:error]) {
+		return NO;
+	}
+
+	// Mountpoints probe their pipeline variants when created
+	if (![self _configurePipelineVariantsWithError:error]) {
+		return NO;
+	}
+
+	// Mountpoints configure their limits when created
+	_admissionControl =
+		[VMPAdmissionControl admissionControlWithPropertyList:[_configuration admission]
+														error:error];
+	if (!_admissionControl) {
+		return NO;
+	}
+
 	// Create all mountpoints
 	if (![self _createMountpointsWithError:error]) {
 		return NO;
 	}
+	[self _startVariantRetries];
+
+	// Lower the quality of mountpoints under load
+	if ([_configuration degradation]) {
+		_degradationController =
+			[VMPDegradationController controllerWithPropertyList:[_configuration degradation]
+														   error:error];
+		if (!_degradationController) {
+			return NO;
+		}
+		[_degradationController setDelegate:self];
+		[_degradationController start];
+	}
+
+	// Reject clients exceeding the admission limits with 453 Not Enough Bandwidth
+	g_signal_connect(_server, "client-connected", (GCallback) client_connected_cb,
+					 (__bridge void *) self);
+	// Transfer: FULL
+	_sessionPool = gst_rtsp_server_get_session_pool(_server);
+	g_signal_connect(_sessionPool, "session-removed", (GCallback) session_removed_cb,
+					 (__bridge void *) self);
+	_sessionCleanupSourceId = g_timeout_add_seconds(2, session_pool_cleanup_cb, _sessionPool);
 
 	// Start the RTSP server
 	_serverSourceId = gst_rtsp_server_attach(_server, NULL);
@@ -654,8 +2313,19 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 		[mgr stop];
 	}
 
+	[_degradationController invalidate];
+	if (_variantRetryTimer) {
+		dispatch_source_cancel(_variantRetryTimer);
+		_variantRetryTimer = nil;
+	}
+
 	// Stop the RTSP server
 	g_source_remove(_serverSourceId);
+	if (_sessionPool) {
+		g_source_remove(_sessionCleanupSourceId);
+		g_signal_handlers_disconnect_by_data(_sessionPool, (__bridge void *) self);
+		g_clear_object(&_sessionPool);
+	}
 
 	return;
 }
@@ -720,35 +2390,50 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 
 	width = options[@"width"];
 	height = options[@"height"];
-	// Try to use channel presets
-	if (!width || !height) {
-		width = [video properties][@"width"];
-		height = [video properties][@"height"];
-	}
-
-	// Give up
-	if (!width || !height) {
-		CONFIG_ERROR(error, @"'width' or 'height' not in options nor in channel properties");
-		return nil;
-	}
 
 	NSDictionary<NSString *, NSString *> *vars;
 	NSString *template;
 	NSMutableString *pipeline;
+	BOOL chapters = NO;
+
+	// Record the H.264 stream of a passthrough channel as is, unless it is explicitly scaled or
+	// re-encoded
+	if ([[_encodedChannels[videoChannel] encoding] isEqual:kVMPEncodingH264] && !width &&
+		!height && !options[@"videoBitrate"]) {
+		template = [_currentProfile recordings][@"videoH264"];
+		if (!template) {
+			CONFIG_ERROR(error, @"'videoH264' key not present in 'recordings' profile");
+			return nil;
+		}
 
-	template = [_currentProfile recordings][@"video"];
-	if (!template) {
-		CONFIG_ERROR(error, @"'video' key not present in 'recordings' profile");
-		return nil;
-	}
+		vars = @{@"VIDEOCHANNEL" : videoChannel};
+	} else {
+		// Try to use channel presets
+		if (!width || !height) {
+			width = [video properties][@"width"];
+			height = [video properties][@"height"];
+		}
 
-	// Substitution dictionary for video pipeline
-	vars = @{
-		@"VIDEOCHANNEL" : videoChannel,
-		@"WIDTH" : [width stringValue],
-		@"HEIGHT" : [height stringValue],
-		@"BITRATE" : [videoBitrate stringValue]
-	};
+		// Give up
+		if (!width || !height) {
+			CONFIG_ERROR(error, @"'width' or 'height' not in options nor in channel properties");
+			return nil;
+		}
+
+		template = [_currentProfile recordings][@"video"];
+		if (!template) {
+			CONFIG_ERROR(error, @"'video' key not present in 'recordings' profile");
+			return nil;
+		}
+
+		// Substitution dictionary for video pipeline
+		vars = @{
+			@"VIDEOCHANNEL" : videoChannel,
+			@"WIDTH" : [width stringValue],
+			@"HEIGHT" : [height stringValue],
+			@"BITRATE" : [videoBitrate stringValue]
+		};
+	}
 	template = [template stringBySubstitutingVariables:vars error:error];
 	if (!template) {
 		return nil;
@@ -773,6 +2458,19 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	[pipeline appendString:template];
 	[pipeline appendString:@" ! mux."];
 
+	// Low-resolution proxy of the video channel for slide-change detection
+	template = [_currentProfile recordings][@"chapterProxy"];
+	if (template && ![options[@"chapters"] isEqual:@NO]) {
+		template = [template stringBySubstitutingVariables:@{@"VIDEOCHANNEL" : videoChannel}
+													 error:error];
+		if (!template) {
+			return nil;
+		}
+
+		[pipeline appendFormat:@" %@", template];
+		chapters = YES;
+	}
+
 	/* pipeline now contains a full GStreamer pipeline for encoding
 	   and writing out a matroska file to path.
 
@@ -780,10 +2478,18 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	   filesink location=<PATH> <AUDIO_PIPELINE> ! mux. -e
 	*/
 
-	return [VMPRecordingManager recorderWithLaunchArgs:pipeline
-												  path:path
-										   recordUntil:date
-											  delegate:self];
+	VMPRecordingManager *recording;
+
+	recording = [VMPRecordingManager recorderWithLaunchArgs:pipeline
+													   path:path
+												recordUntil:date
+												   delegate:self];
+	[[recording threadMonitor] setTaskPool:_taskPool];
+	if (chapters) {
+		[recording setChapterIndexer:[VMPChapterIndexer indexerWithRecordingPath:path]];
+	}
+
+	return recording;
 }
 
 /*
@@ -808,6 +2514,7 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
  * receiving an EOS, the eosReceived flag within the recording manager is
  * activated, indicating the completion of the recording process.
  */
+
 - (BOOL)scheduleRecording:(VMPRecordingManager *)recording {
 	NSDate *deadline, *now;
 	NSTimeInterval interval;
@@ -829,6 +2536,7 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	dispatchTime = dispatch_time(DISPATCH_TIME_NOW, (int64_t) (interval * NSEC_PER_SEC));
 
 	VMPInfo(@"Starting Recording %@ at %@ for %ld seconds", recording, now, interval);
+	// Consumers are connected in onPipelineCreated:manager:
 	[recording start];
 
 	// Schedule end of recording at later date on the recordingsQueue
@@ -851,6 +2559,15 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 		[recording stop];
 		VMPDebug(@"Recording %@ stopped", recording);
 
+		NSArray<dispatch_block_t> *releaseBlocks;
+		@synchronized(self) {
+			releaseBlocks = _recordingReleaseBlocks[[[recording path] path]];
+			[_recordingReleaseBlocks removeObjectForKey:[[recording path] path]];
+		}
+		for (dispatch_block_t block in releaseBlocks) {
+			block();
+		}
+
 		@synchronized(self) {
 			[_activeRecordings removeObject:recording];
 		}
@@ -859,11 +2576,95 @@ static void media_constructed_cb(GstRTSPMediaFactory *factory, GstRTSPMedia *med
 	return YES;
 }
 
+- (NSArray<dispatch_block_t> *)_connectConsumersInPipeline:(GstElement *)pipeline {
+	NSMutableArray<dispatch_block_t> *releaseBlocks;
+	NSDictionary<NSString *, VMPEncodedChannel *> *encodedChannels;
+	NSDictionary<NSString *, VMPChannelDemand *> *demands;
+	NSDictionary<NSString *, VMPStaticContentDetector *> *detectors;
+
+	releaseBlocks = [NSMutableArray array];
+	encodedChannels = _encodedChannels;
+	demands = _channelDemands;
+	detectors = _staticContentDetectors;
+	if (!pipeline || !GST_IS_BIN(pipeline)) {
+		return releaseBlocks;
+	}
+
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+	  const gchar *factoryName;
+	  NSString *elementName, *channelName;
+	  VMPEncodedChannel *channel;
+	  VMPChannelDemand *demand;
+
+	  factoryName = VMPElementFactoryName(element);
+	  if (!factoryName) {
+		  return;
+	  }
+
+	  if (g_str_equal(factoryName, "appsrc")) {
+		  elementName = @(GST_OBJECT_NAME(element));
+		  if (![elementName hasPrefix:kVMPEncodedSourcePrefix]) {
+			  return;
+		  }
+
+		  elementName = [elementName substringFromIndex:[kVMPEncodedSourcePrefix length]];
+		  channel = encodedChannels[elementName];
+		  if (channel) {
+			  [channel addConsumer:element];
+		  } else {
+			  VMPWarn(@"Channel %@ of an encoded source is not a passthrough channel",
+					  elementName);
+		  }
+	  } else if (g_str_equal(factoryName, "intervideosrc")) {
+		  gchar *name = NULL;
+
+		  // Transfer: FULL
+		  g_object_get(element, "channel", &name, NULL);
+		  channelName = name ? @(name) : nil;
+		  g_free(name);
+		  if (!channelName) {
+			  return;
+		  }
+
+		  channel = encodedChannels[channelName];
+		  if (channel) {
+			  dispatch_block_t release = ^{
+				[channel releaseRawConsumer];
+			  };
+
+			  [channel retainRawConsumer];
+			  [releaseBlocks addObject:release];
+		  }
+
+		  demand = demands[channelName];
+		  if (demand) {
+			  VMPConsumerFormat format = [VMPChannelDemand consumerFormatOfSource:element];
+			  id token = [demand addConsumerWithFormat:format];
+			  dispatch_block_t release = ^{
+				[demand removeConsumer:token];
+			  };
+
+			  [releaseBlocks addObject:release];
+		  }
+
+		  // Thin out the frames of static content
+		  [detectors[channelName] attachGateToSource:element];
+	  }
+	});
+
+	return releaseBlocks;
+}
+
 - (NSArray<VMPRecordingManager *> *)recordings {
-	return [_activeRecordings copy];
+	@synchronized(self) {
+		return [_activeRecordings copy];
+	}
 }
 
 - (void)dealloc {
+	if (_variantRetryTimer) {
+		dispatch_source_cancel(_variantRetryTimer);
+	}
 	g_object_unref(_mountPoints);
 	g_object_unref(_server);
 }
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: MIT
  */
 
+#import "VMPChapterIndexer.h"
 #import "VMPPipelineManager.h"
 
 /**
@@ -34,6 +35,12 @@
 
 @property (atomic, assign) BOOL eosReceived;
 
+/**
+ * Optional slide-change detection writing chapters and thumbnails
+ * while recording. @see VMPChapterIndexer
+ */
+@property (nullable) VMPChapterIndexer *chapterIndexer;
+
 + (instancetype)recorderWithLaunchArgs:(NSString *)launchArgs
 								  path:(NSURL *)path
 						   recordUntil:(NSDate *)date
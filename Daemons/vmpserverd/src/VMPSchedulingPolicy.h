@@ -0,0 +1,89 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Default time-sharing scheduling policy (SCHED_OTHER)
+extern NSString *const kVMPSchedulingPolicyOther;
+/// Real-time first-in, first-out policy (SCHED_FIFO)
+extern NSString *const kVMPSchedulingPolicyFIFO;
+/// Real-time round-robin policy (SCHED_RR)
+extern NSString *const kVMPSchedulingPolicyRR;
+
+/**
+ * @brief CPU affinity, scheduling policy, and niceness for streaming threads
+ *
+ * The policy is configured with the optional "scheduling" dictionary in the
+ * properties of a channel or mountpoint:
+ *
+ * @code
+ * <key>scheduling</key>
+ * <dict>
+ *     <key>cpus</key>
+ *     <array><integer>2</integer><integer>3</integer></array>
+ *     <key>policy</key>
+ *     <string>fifo</string>
+ *     <key>priority</key>
+ *     <integer>50</integer>
+ *     <key>nice</key>
+ *     <integer>-5</integer>
+ * </dict>
+ * @endcode
+ *
+ * All keys are optional. "priority" is required for the "fifo" and "rr"
+ * policies. Real-time policies and negative niceness require CAP_SYS_NICE, or
+ * a matching RLIMIT_RTPRIO/RLIMIT_NICE.
+ */
+@interface VMPSchedulingPolicy : NSObject
+
+/// CPUs the threads may run on. nil to keep the inherited affinity.
+@property (nonatomic, readonly, nullable) NSArray<NSNumber *> *cpus;
+
+/// One of kVMPSchedulingPolicyOther, FIFO, or RR. nil to keep the inherited policy.
+@property (nonatomic, readonly, nullable) NSString *policy;
+
+/// Static priority for real-time policies
+@property (nonatomic, readonly) NSInteger priority;
+
+/// Niceness (-20 to 19). nil to keep the inherited niceness.
+@property (nonatomic, readonly, nullable) NSNumber *nice;
+
+/**
+ * @brief Parse and validate the "scheduling" dictionary
+ *
+ * @returns a policy, or nil if the property list is invalid
+ */
++ (nullable instancetype)policyWithPropertyList:(id)propertyList error:(NSError **)error;
+
+- (nullable instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error;
+
+/**
+ * @brief Apply the policy to the calling thread
+ *
+ * @param errors Receives a description of every setting that could not be
+ * applied. The remaining settings are still applied.
+ *
+ * @returns an opaque snapshot of the previous settings of the thread, for use
+ * with restoreCurrentThreadFromSnapshot:
+ */
+- (NSData *)applyToCurrentThreadWithErrors:(NSArray<NSString *> *_Nullable *_Nonnull)errors;
+
+/**
+ * @brief Restore the settings of the calling thread
+ *
+ * Streaming threads may be pooled and reused by other pipelines, so the
+ * settings are restored when a thread leaves a task.
+ */
++ (void)restoreCurrentThreadFromSnapshot:(NSData *)snapshot;
+
+/// The policy in the same format as the configuration
+- (NSDictionary *)propertyList;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,230 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+// For CPU affinity functions
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#import "VMPErrors.h"
+#import "VMPSchedulingPolicy.h"
+
+NSString *const kVMPSchedulingPolicyOther = @"other";
+NSString *const kVMPSchedulingPolicyFIFO = @"fifo";
+NSString *const kVMPSchedulingPolicyRR = @"rr";
+
+// Settings of a thread before the policy was applied
+typedef struct {
+	cpu_set_t affinity;
+	BOOL hasAffinity;
+	int policy;
+	struct sched_param param;
+	BOOL hasPolicy;
+	int nice;
+	BOOL hasNice;
+} VMPSchedulingSnapshot;
+
+static int schedulingPolicyFromString(NSString *policy) {
+	if ([policy isEqualToString:kVMPSchedulingPolicyFIFO]) {
+		return SCHED_FIFO;
+	} else if ([policy isEqualToString:kVMPSchedulingPolicyRR]) {
+		return SCHED_RR;
+	}
+	return SCHED_OTHER;
+}
+
+static pid_t currentThreadID(void) {
+	return (pid_t) syscall(SYS_gettid);
+}
+
+@implementation VMPSchedulingPolicy
+
++ (instancetype)policyWithPropertyList:(id)propertyList error:(NSError **)error {
+	return [[VMPSchedulingPolicy alloc] initWithPropertyList:propertyList error:error];
+}
+
+- (instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error {
+	id cpus, policy, priority, nice;
+
+	if (![propertyList isKindOfClass:[NSDictionary class]]) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'scheduling' must be a dictionary");
+		return nil;
+	}
+
+	cpus = propertyList[@"cpus"];
+	policy = propertyList[@"policy"];
+	priority = propertyList[@"priority"];
+	nice = propertyList[@"nice"];
+
+	if (cpus) {
+		if (![cpus isKindOfClass:[NSArray class]] || [cpus count] == 0) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'cpus' must be a non-empty array of CPU numbers");
+			return nil;
+		}
+		for (id cpu in cpus) {
+			if (![cpu isKindOfClass:[NSNumber class]] || [cpu integerValue] < 0 ||
+				[cpu integerValue] >= CPU_SETSIZE) {
+				VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+							   @"Invalid CPU number '%@' in 'cpus'", cpu);
+				return nil;
+			}
+		}
+	}
+
+	if (policy) {
+		if (![policy isKindOfClass:[NSString class]] ||
+			!([policy isEqualToString:kVMPSchedulingPolicyOther] ||
+			  [policy isEqualToString:kVMPSchedulingPolicyFIFO] ||
+			  [policy isEqualToString:kVMPSchedulingPolicyRR])) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'policy' must be one of 'other', 'fifo', or 'rr'");
+			return nil;
+		}
+
+		if (![policy isEqualToString:kVMPSchedulingPolicyOther]) {
+			int sched, min, max;
+
+			sched = schedulingPolicyFromString(policy);
+			min = sched_get_priority_min(sched);
+			max = sched_get_priority_max(sched);
+			if (![priority isKindOfClass:[NSNumber class]] || [priority intValue] < min ||
+				[priority intValue] > max) {
+				VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+							   @"'priority' between %d and %d is required for policy '%@'", min,
+							   max, policy);
+				return nil;
+			}
+		}
+	}
+
+	if (nice && (![nice isKindOfClass:[NSNumber class]] || [nice integerValue] < -20 ||
+				 [nice integerValue] > 19)) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'nice' must be a number between -20 and 19");
+		return nil;
+	}
+
+	self = [super init];
+	if (self) {
+		_cpus = [cpus copy];
+		_policy = [policy copy];
+		_priority = [priority integerValue];
+		_nice = nice;
+	}
+	return self;
+}
+
+- (NSData *)applyToCurrentThreadWithErrors:(NSArray<NSString *> **)errors {
+	NSMutableArray<NSString *> *failures;
+	VMPSchedulingSnapshot snapshot;
+	pid_t tid;
+	int ret;
+
+	failures = [NSMutableArray array];
+	memset(&snapshot, 0, sizeof(snapshot));
+	tid = currentThreadID();
+
+	if (_cpus) {
+		cpu_set_t set;
+
+		snapshot.hasAffinity =
+			pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &snapshot.affinity) == 0;
+
+		CPU_ZERO(&set);
+		for (NSNumber *cpu in _cpus) {
+			CPU_SET([cpu intValue], &set);
+		}
+
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+		if (ret != 0) {
+			[failures addObject:[NSString stringWithFormat:@"affinity: %s", strerror(ret)]];
+		}
+	}
+
+	if (_policy) {
+		struct sched_param param;
+
+		snapshot.hasPolicy =
+			pthread_getschedparam(pthread_self(), &snapshot.policy, &snapshot.param) == 0;
+
+		param.sched_priority = (int) _priority;
+		if ([_policy isEqualToString:kVMPSchedulingPolicyOther]) {
+			param.sched_priority = 0;
+		}
+
+		ret = pthread_setschedparam(pthread_self(), schedulingPolicyFromString(_policy), &param);
+		if (ret != 0) {
+			[failures addObject:[NSString stringWithFormat:@"policy: %s", strerror(ret)]];
+		}
+	}
+
+	if (_nice) {
+		// getpriority may legitimately return -1
+		errno = 0;
+		snapshot.nice = getpriority(PRIO_PROCESS, tid);
+		snapshot.hasNice = errno == 0;
+
+		// On Linux, niceness is a per-thread attribute
+		if (setpriority(PRIO_PROCESS, tid, [_nice intValue]) != 0) {
+			[failures addObject:[NSString stringWithFormat:@"nice: %s", strerror(errno)]];
+		}
+	}
+
+	*errors = failures;
+	return [NSData dataWithBytes:&snapshot length:sizeof(snapshot)];
+}
+
++ (void)restoreCurrentThreadFromSnapshot:(NSData *)data {
+	VMPSchedulingSnapshot snapshot;
+
+	if ([data length] != sizeof(snapshot)) {
+		return;
+	}
+	[data getBytes:&snapshot length:sizeof(snapshot)];
+
+	// Failures are ignored, as we are only restoring what we could read before
+	if (snapshot.hasAffinity) {
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &snapshot.affinity);
+	}
+	if (snapshot.hasPolicy) {
+		pthread_setschedparam(pthread_self(), snapshot.policy, &snapshot.param);
+	}
+	if (snapshot.hasNice) {
+		setpriority(PRIO_PROCESS, currentThreadID(), snapshot.nice);
+	}
+}
+
+- (NSDictionary *)propertyList {
+	NSMutableDictionary *plist;
+
+	plist = [NSMutableDictionary dictionary];
+	if (_cpus) {
+		plist[@"cpus"] = _cpus;
+	}
+	if (_policy) {
+		plist[@"policy"] = _policy;
+		if (![_policy isEqualToString:kVMPSchedulingPolicyOther]) {
+			plist[@"priority"] = @(_priority);
+		}
+	}
+	if (_nice) {
+		plist[@"nice"] = _nice;
+	}
+
+	return plist;
+}
+
+@end
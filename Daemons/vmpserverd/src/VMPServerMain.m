@@ -10,6 +10,7 @@
 #import "VMPCalendarSync.h"
 #import "VMPConfigModel.h"
 #import "VMPJournal.h"
+#import "VMPPipelineProfiler.h"
 #import "VMPProfileManager.h"
 #import "VMPRTSPServer.h"
 #import "VMPServerMain.h"
@@ -135,6 +136,8 @@ static NSData *convertDOTtoSVG(NSData *dotData, NSError **error) {
 		// Create RTSP server
 		_rtspServer = [VMPRTSPServer serverWithConfiguration:configuration
 													 profile:[_profileMgr currentProfile]];
+		// Mountpoints fall back to other compatible profiles
+		[_rtspServer setVariantProfiles:[_profileMgr compatibleProfiles]];
 
 		// Create HTTP server
 		port = [[configuration httpPort] integerValue];
@@ -308,6 +311,24 @@ static NSData *convertDOTtoSVG(NSData *dotData, NSError **error) {
 	};
 }
 
+/*
+ * GET /api/v1/statistics
+ *
+ * State, restarts, streaming threads, and CPU usage of all channels,
+ * mountpoints, and recordings. @see VMPRTSPServer.globalStatistics
+ */
+- (HKHandlerBlock)_statisticsHandlerV1 {
+	return ^HKHTTPResponse *(HKHTTPRequest *request) {
+		HKHTTPJSONResponse *response;
+
+		response = [HKHTTPJSONResponse responseWithJSONObject:[_rtspServer globalStatistics]
+													   status:200
+														error:NULL];
+		[response setHeaders:DEFAULT_HEADERS];
+		return response;
+	};
+}
+
 - (HKHandlerBlock)_configHandlerV1 {
 	return ^HKHTTPResponse *(HKHTTPRequest *request) {
 		return [HKHTTPJSONResponse responseWithJSONObject:[_configuration propertyList]
@@ -441,6 +462,339 @@ static NSData *convertDOTtoSVG(NSData *dotData, NSError **error) {
 	};
 }
 
+- (HKHandlerBlock)_channelTopologyHandlerV1 {
+	return ^HKHTTPResponse *(HKHTTPRequest *request) {
+		NSString *channel;
+		NSDictionary *topology;
+		VMPPipelineManager *mgr;
+		HKHTTPJSONResponse *response;
+
+		channel = [request queryParameters][@"channel"];
+		if (!channel) {
+			NSDictionary *response = @{
+				@"error" : @"Missing channel parameter",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+		}
+
+		mgr = [_rtspServer pipelineManagerForChannel:channel];
+		if (!mgr) {
+			NSDictionary *response = @{
+				@"error" : @"Channel not found",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:404 error:NULL];
+		}
+
+		topology = [mgr pipelineTopology];
+		if (!topology) {
+			NSDictionary *response = @{
+				@"error" : @"Channel pipeline is not running",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:503 error:NULL];
+		}
+
+		response = [HKHTTPJSONResponse responseWithJSONObject:topology status:200 error:NULL];
+		[response setHeaders:DEFAULT_HEADERS];
+		return response;
+	};
+}
+
+/*
+ * GET /api/v1/channel/events?channel=NAME&cursor=N&limit=M
+ *
+ * Returns the events recorded after the cursor, oldest first. The cursor
+ * defaults to 0 (oldest retained event), and the limit to 100.
+ */
+- (HKHandlerBlock)_channelEventsHandlerV1 {
+	return ^HKHTTPResponse *(HKHTTPRequest *request) {
+		NSString *channel, *cursor, *limit;
+		NSDictionary *events;
+		VMPPipelineManager *mgr;
+		HKHTTPJSONResponse *response;
+		NSInteger cursorValue, limitValue;
+
+		channel = [request queryParameters][@"channel"];
+		cursor = [request queryParameters][@"cursor"];
+		limit = [request queryParameters][@"limit"];
+
+		if (!channel) {
+			NSDictionary *response = @{
+				@"error" : @"Missing channel parameter",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+		}
+
+		cursorValue = cursor ? [cursor integerValue] : 0;
+		limitValue = limit ? [limit integerValue] : 100;
+		if (cursorValue < 0 || limitValue <= 0) {
+			NSDictionary *response = @{
+				@"error" : @"cursor must be non-negative and limit must be positive",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+		}
+
+		mgr = [_rtspServer pipelineManagerForChannel:channel];
+		if (!mgr) {
+			NSDictionary *response = @{
+				@"error" : @"Channel not found",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:404 error:NULL];
+		}
+
+		events = [[mgr timeline] eventsAfterCursor:(NSUInteger) cursorValue
+											 limit:MIN((NSUInteger) limitValue,
+													   kVMPEventTimelineCapacity)];
+
+		response = [HKHTTPJSONResponse responseWithJSONObject:events status:200 error:NULL];
+		[response setHeaders:DEFAULT_HEADERS];
+		return response;
+	};
+}
+
+- (HKHandlerBlock)_mountpointTopologyHandlerV1 {
+	return ^HKHTTPResponse *(HKHTTPRequest *request) {
+		NSString *mountpoint;
+		NSDictionary *topology;
+		HKHTTPJSONResponse *response;
+
+		mountpoint = [request queryParameters][@"mountpoint"];
+		if (!mountpoint) {
+			NSDictionary *response = @{
+				@"error" : @"Missing mountpoint parameter",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+		}
+
+		topology = [_rtspServer topologyForMountPointName:mountpoint];
+		if (!topology) {
+			NSDictionary *response = @{
+				@"error" : @"Mountpoint not found or no client connected",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:404 error:NULL];
+		}
+
+		response = [HKHTTPJSONResponse responseWithJSONObject:topology status:200 error:NULL];
+		[response setHeaders:DEFAULT_HEADERS];
+		return response;
+	};
+}
+
+- (HKHandlerBlock)_mountpointLatencyHandlerV1 {
+	return ^HKHTTPResponse *(HKHTTPRequest *request) {
+		NSString *mountpoint;
+		NSDictionary *statistics;
+		HKHTTPJSONResponse *response;
+
+		mountpoint = [request queryParameters][@"mountpoint"];
+		if (!mountpoint) {
+			NSDictionary *response = @{
+				@"error" : @"Missing mountpoint parameter",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+		}
+
+		statistics = [_rtspServer latencyStatisticsForMountPointName:mountpoint];
+		if (!statistics) {
+			NSDictionary *response = @{
+				@"error" : @"Mountpoint not found or latency probe not enabled",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:404 error:NULL];
+		}
+
+		response = [HKHTTPJSONResponse responseWithJSONObject:statistics status:200 error:NULL];
+		[response setHeaders:DEFAULT_HEADERS];
+		return response;
+	};
+}
+
+/*
+ * POST /api/v1/mountpoint/encoder
+ *
+ * Example request body:
+ * {
+ *  "mountpoint": "comb",
+ *  "bitrate": 1500,
+ *  "keyframeInterval": 60
+ * }
+ *
+ * Either "bitrate" (in kbit/s) or "keyframeInterval" (in frames) must be set.
+ * The response contains the current encoder settings of the mountpoint.
+ */
+- (HKHandlerBlock)_mountpointEncoderHandlerV1 {
+	return ^HKHTTPResponse *(HKHTTPRequest *request) {
+		id decodedBody;
+		NSString *mountpoint;
+		NSNumber *bitrate, *keyframeInterval;
+		NSError *error = nil;
+		HKHTTPJSONResponse *response;
+
+		decodedBody = [NSJSONSerialization JSONObjectWithData:[request HTTPBody]
+													  options:0
+														error:NULL];
+		if (!decodedBody || ![decodedBody isKindOfClass:[NSDictionary class]]) {
+			NSDictionary *response = @{
+				@"error" : @"Invalid JSON body",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+		}
+
+		mountpoint = decodedBody[@"mountpoint"];
+		bitrate = decodedBody[@"bitrate"];
+		keyframeInterval = decodedBody[@"keyframeInterval"];
+		if (![mountpoint isKindOfClass:[NSString class]] || (!bitrate && !keyframeInterval) ||
+			(bitrate &&
+			 (![bitrate isKindOfClass:[NSNumber class]] || [bitrate integerValue] <= 0)) ||
+			(keyframeInterval && (![keyframeInterval isKindOfClass:[NSNumber class]] ||
+								  [keyframeInterval integerValue] <= 0))) {
+			NSDictionary *response = @{
+				@"error" : @"Expected 'mountpoint', and a positive 'bitrate' or 'keyframeInterval'",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+		}
+
+		if (![_rtspServer hasMountPointName:mountpoint]) {
+			NSDictionary *response = @{
+				@"error" : @"Mountpoint not found",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:404 error:NULL];
+		}
+
+		if (![_rtspServer setEncoderBitrate:[bitrate unsignedIntegerValue]
+						   keyframeInterval:[keyframeInterval unsignedIntegerValue]
+						  forMountPointName:mountpoint
+									  error:&error]) {
+			NSDictionary *response = @{
+				@"error" : [error localizedDescription],
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:409 error:NULL];
+		}
+
+		response = [HKHTTPJSONResponse
+			responseWithJSONObject:[_rtspServer encoderSettingsForMountPointName:mountpoint]
+							status:200
+							 error:NULL];
+		[response setHeaders:DEFAULT_HEADERS];
+		return response;
+	};
+}
+
+/*
+ * POST /api/v1/profile/start
+ *
+ * Example request body:
+ * {
+ *  "mountpoint": "comb",
+ *  "duration": 10
+ * }
+ *
+ * Either "channel" or "mountpoint" must be set. The duration is optional and
+ * defaults to 10 seconds. Unknown names are answered with 404, and channels or
+ * mountpoints that are already profiled, or not running, with 409.
+ */
+- (HKHandlerBlock)_profileStartHandlerV1 {
+	return ^HKHTTPResponse *(HKHTTPRequest *request) {
+		id decodedBody;
+		NSString *channel, *mountpoint;
+		NSNumber *duration;
+		NSError *error = nil;
+		BOOL started;
+
+		decodedBody = [NSJSONSerialization JSONObjectWithData:[request HTTPBody]
+													  options:0
+														error:NULL];
+		if (!decodedBody || ![decodedBody isKindOfClass:[NSDictionary class]]) {
+			NSDictionary *response = @{
+				@"error" : @"Invalid JSON body",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+		}
+
+		channel = decodedBody[@"channel"];
+		mountpoint = decodedBody[@"mountpoint"];
+		duration = decodedBody[@"duration"];
+		if ((!channel && !mountpoint) || (channel && ![channel isKindOfClass:[NSString class]]) ||
+			(mountpoint && ![mountpoint isKindOfClass:[NSString class]]) ||
+			(duration && ![duration isKindOfClass:[NSNumber class]])) {
+			NSDictionary *response = @{
+				@"error" : @"Expected 'channel' or 'mountpoint', and an optional numeric 'duration'",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+		}
+		if (!duration) {
+			duration = @10;
+		}
+
+		if ((channel && ![_rtspServer pipelineManagerForChannel:channel]) ||
+			(!channel && ![_rtspServer hasMountPointName:mountpoint])) {
+			NSDictionary *response = @{
+				@"error" : channel ? @"Channel not found" : @"Mountpoint not found",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:404 error:NULL];
+		}
+
+		// Already profiling, or no running pipeline
+		if (channel) {
+			started = [_rtspServer startProfilingChannel:channel
+												duration:[duration doubleValue]
+												   error:&error];
+		} else {
+			started = [_rtspServer startProfilingMountPointName:mountpoint
+													   duration:[duration doubleValue]
+														  error:&error];
+		}
+		if (!started) {
+			NSDictionary *response = @{
+				@"error" : [error localizedDescription],
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:409 error:NULL];
+		}
+
+		return [HKHTTPJSONResponse responseWithJSONObject:@{
+			@"status" : @"ok",
+			@"duration" : @(MAX(MIN([duration doubleValue], kVMPProfilerMaximumDuration), 1.0)),
+		}
+												   status:200
+													error:NULL];
+	};
+}
+
+/*
+ * GET /api/v1/profile/report?channel=<name>
+ * GET /api/v1/profile/report?mountpoint=<name>
+ */
+- (HKHandlerBlock)_profileReportHandlerV1 {
+	return ^HKHTTPResponse *(HKHTTPRequest *request) {
+		NSString *channel, *mountpoint;
+		NSDictionary *report;
+		HKHTTPJSONResponse *response;
+
+		channel = [request queryParameters][@"channel"];
+		mountpoint = [request queryParameters][@"mountpoint"];
+		if (!channel && !mountpoint) {
+			NSDictionary *response = @{
+				@"error" : @"Missing channel or mountpoint parameter",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+		}
+
+		if (channel) {
+			report = [_rtspServer profilingReportForChannel:channel];
+		} else {
+			report = [_rtspServer profilingReportForMountPointName:mountpoint];
+		}
+		if (!report) {
+			NSDictionary *response = @{
+				@"error" : @"No profiling session found",
+			};
+			return [HKHTTPJSONResponse responseWithJSONObject:response status:404 error:NULL];
+		}
+
+		response = [HKHTTPJSONResponse responseWithJSONObject:report status:200 error:NULL];
+		[response setHeaders:DEFAULT_HEADERS];
+		return response;
+	};
+}
+
 /*
  * POST /api/v1/recording/create
  *
@@ -448,9 +802,14 @@ static NSData *convertDOTtoSVG(NSData *dotData, NSError **error) {
  * {
  *  "videoChannel": "present0",
  *  "audioChannel": "audio0",
- *  "stopAt": "2024-03-11T13:06:00Z"
+ *  "stopAt": "2024-03-11T13:06:00Z",
+ *  "videoBitrate": 4000
  * }
  *
+ * The optional keys "videoBitrate", "audioBitrate" (both in kbps), "width", and
+ * "height" are passed on to the recording. @see
+ * VMPRTSPServer.defaultRecordingWithOptions:path:deadline:error:
+ *
  * Example response:
  * {
  *	"status": "ok",
@@ -528,14 +887,17 @@ static NSData *convertDOTtoSVG(NSData *dotData, NSError **error) {
 			return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
 		}
 
-		// Create a new recording with default options
-		// TODO: Allow for user to specify options
-		[recordingOptions addEntriesFromDictionary:@{
-			@"videoBitrate" : @2500,
-			@"audioBitrate" : @96,
-			@"scaledWidth" : @1920,
-			@"scaledHeight" : @1080
-		}];
+		// Unset options default to the settings of the channels
+		for (NSString *key in @[ @"videoBitrate", @"audioBitrate", @"width", @"height" ]) {
+			id value = recordingOptions[key];
+
+			if (value && (![value isKindOfClass:[NSNumber class]] || [value integerValue] <= 0)) {
+				NSDictionary *response = @{
+					@"error" : [NSString stringWithFormat:@"'%@' must be a positive integer", key],
+				};
+				return [HKHTTPJSONResponse responseWithJSONObject:response status:400 error:NULL];
+			}
+		}
 
 		NSURL *url;
 		NSDate *now;
@@ -581,9 +943,17 @@ static NSData *convertDOTtoSVG(NSData *dotData, NSError **error) {
 	HKRouter *router;
 	HKRoute *statusRoute;
 	HKRoute *configRoute;
+	HKRoute *statisticsRoute;
 	HKRoute *channelGraphRoute;
 	HKRoute *mountpointGraphRoute;
+	HKRoute *mountpointLatencyRoute;
+	HKRoute *mountpointEncoderRoute;
 	HKRoute *recordingCreateRoute;
+	HKRoute *profileStartRoute;
+	HKRoute *profileReportRoute;
+	HKRoute *channelTopologyRoute;
+	HKRoute *mountpointTopologyRoute;
+	HKRoute *channelEventsRoute;
 	HKHandlerBlock CORSHandler;
 
 	router = [_httpServer router];
@@ -607,6 +977,10 @@ static NSData *convertDOTtoSVG(NSData *dotData, NSError **error) {
 	configRoute = [HKRoute routeWithPath:@"/api/v1/config"
 								  method:HKHTTPMethodGET
 								 handler:[self _configHandlerV1]];
+	// GET /api/v1/statistics
+	statisticsRoute = [HKRoute routeWithPath:@"/api/v1/statistics"
+									  method:HKHTTPMethodGET
+									 handler:[self _statisticsHandlerV1]];
 	// GET /api/v1/channel/graph
 	channelGraphRoute = [HKRoute routeWithPath:@"/api/v1/channel/graph"
 										method:HKHTTPMethodGET
@@ -615,16 +989,52 @@ static NSData *convertDOTtoSVG(NSData *dotData, NSError **error) {
 	mountpointGraphRoute = [HKRoute routeWithPath:@"/api/v1/mountpoint/graph"
 										   method:HKHTTPMethodGET
 										  handler:[self _mountpointGraphHandlerV1]];
+	// GET /api/v1/channel/topology
+	channelTopologyRoute = [HKRoute routeWithPath:@"/api/v1/channel/topology"
+										   method:HKHTTPMethodGET
+										  handler:[self _channelTopologyHandlerV1]];
+	// GET /api/v1/channel/events
+	channelEventsRoute = [HKRoute routeWithPath:@"/api/v1/channel/events"
+										 method:HKHTTPMethodGET
+										handler:[self _channelEventsHandlerV1]];
+	// GET /api/v1/mountpoint/topology
+	mountpointTopologyRoute = [HKRoute routeWithPath:@"/api/v1/mountpoint/topology"
+											  method:HKHTTPMethodGET
+											 handler:[self _mountpointTopologyHandlerV1]];
+	// GET /api/v1/mountpoint/latency
+	mountpointLatencyRoute = [HKRoute routeWithPath:@"/api/v1/mountpoint/latency"
+											 method:HKHTTPMethodGET
+											handler:[self _mountpointLatencyHandlerV1]];
+	// POST /api/v1/mountpoint/encoder
+	mountpointEncoderRoute = [HKRoute routeWithPath:@"/api/v1/mountpoint/encoder"
+											 method:HKHTTPMethodPOST
+											handler:[self _mountpointEncoderHandlerV1]];
 	// POST /api/v1/recording/create
 	recordingCreateRoute = [HKRoute routeWithPath:@"/api/v1/recording/create"
 										   method:HKHTTPMethodPOST
 										  handler:[self _recordingCreateV1]];
+	// POST /api/v1/profile/start
+	profileStartRoute = [HKRoute routeWithPath:@"/api/v1/profile/start"
+										method:HKHTTPMethodPOST
+									   handler:[self _profileStartHandlerV1]];
+	// GET /api/v1/profile/report
+	profileReportRoute = [HKRoute routeWithPath:@"/api/v1/profile/report"
+										 method:HKHTTPMethodGET
+										handler:[self _profileReportHandlerV1]];
 
 	[router registerRoute:statusRoute withCORSHandler:CORSHandler];
 	[router registerRoute:configRoute withCORSHandler:CORSHandler];
+	[router registerRoute:statisticsRoute withCORSHandler:CORSHandler];
 	[router registerRoute:channelGraphRoute withCORSHandler:CORSHandler];
 	[router registerRoute:mountpointGraphRoute withCORSHandler:CORSHandler];
+	[router registerRoute:channelTopologyRoute withCORSHandler:CORSHandler];
+	[router registerRoute:mountpointTopologyRoute withCORSHandler:CORSHandler];
+	[router registerRoute:channelEventsRoute withCORSHandler:CORSHandler];
+	[router registerRoute:mountpointLatencyRoute withCORSHandler:CORSHandler];
+	[router registerRoute:mountpointEncoderRoute withCORSHandler:CORSHandler];
 	[router registerRoute:recordingCreateRoute withCORSHandler:CORSHandler];
+	[router registerRoute:profileStartRoute withCORSHandler:CORSHandler];
+	[router registerRoute:profileReportRoute withCORSHandler:CORSHandler];
 }
 
 #pragma mark - Server Lifecycle
@@ -0,0 +1,98 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * @brief Replaces a channel with a slate while its input has no signal
+ *
+ * The slate is configured with the optional "slate" property of a channel.
+ * Either YES for a black frame, or a dictionary:
+ *
+ * @code
+ * <key>slate</key>
+ * <dict>
+ *     <key>image</key>
+ *     <string>/etc/vmpserverd/no-signal.png</string>
+ *     <key>timeout</key>
+ *     <real>0.5</real>
+ * </dict>
+ * @endcode
+ *
+ * If no frame reached the intervideosink of the channel for "timeout" seconds
+ * (default 0.5), a slate pipeline is started which publishes the image (or a
+ * black frame) to the same intervideo channel, with the caps last negotiated
+ * by the channel. The slate is rendered once, and repeated by imagefreeze.
+ * Frames of the encoded branch of a passthrough channel also count, as its
+ * decoder only runs while a consumer needs decoded frames.
+ *
+ * As soon as the channel delivers frames again, they are dropped until the
+ * slate pipeline was stopped, and then passed on. Consumers of the channel
+ * never renegotiate, and the slate covers restarts of the channel pipeline.
+ */
+@interface VMPSignalSlate : NSObject
+
+/// Time without frames until the slate is shown, in seconds
+@property (nonatomic, readonly) NSTimeInterval timeout;
+
+/// Path of the slate image, or nil for a black frame
+@property (nonatomic, readonly, nullable) NSString *imagePath;
+
+/// Whether the slate is currently shown
+@property (nonatomic, readonly, getter=isActive) BOOL active;
+
+/**
+ * @brief Parse and validate the "slate" property
+ *
+ * @param channel Name of the channel
+ * @param imageTemplate Pipeline template showing an image. The variables
+ * {VIDEOCHANNEL.0}, {PATH}, and {CAPS} are substituted when the slate is
+ * shown.
+ * @param blackTemplate Pipeline template showing a black frame. The variables
+ * {VIDEOCHANNEL.0} and {CAPS} are substituted when the slate is shown.
+ *
+ * @returns a slate, or nil if the property list is invalid
+ */
++ (nullable instancetype)slateWithChannel:(NSString *)channel
+							 propertyList:(id)propertyList
+							imageTemplate:(NSString *)imageTemplate
+							blackTemplate:(NSString *)blackTemplate
+									error:(NSError **)error;
+
+- (nullable instancetype)initWithChannel:(NSString *)channel
+							propertyList:(id)propertyList
+						   imageTemplate:(NSString *)imageTemplate
+						   blackTemplate:(NSString *)blackTemplate
+								   error:(NSError **)error;
+
+/**
+ * @brief Monitor the intervideosink of a channel pipeline
+ *
+ * Called for every pipeline created for the channel, including restarts.
+ */
+- (void)attachToChannelPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Stop the slate and monitoring
+ *
+ * The slate is also stopped on deallocation.
+ */
+- (void)invalidate;
+
+/**
+ * @brief Slate state and signal loss count
+ *
+ * @returns a dictionary with the keys "active", "activations", and
+ * "lastFrame" (seconds since the last frame of the channel)
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,379 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdatomic.h>
+
+#import <dispatch/dispatch.h>
+
+#import "NSString+substituteVariables.h"
+#import "VMPChannelDemand.h"
+#import "VMPEncodedChannel.h"
+#import "VMPErrors.h"
+#import "VMPGStreamerUtils.h"
+#import "VMPJournal.h"
+#import "VMPSignalSlate.h"
+
+static const NSTimeInterval kDefaultTimeout = 0.5;
+
+// Interval of checking for a lost or returned signal
+static const NSTimeInterval kCheckInterval = 0.1;
+
+// Shared between the slate and the probes, which may outlive each other
+typedef struct {
+	gint refcount;
+	// Monotonic time in microseconds of the last frame of the channel
+	_Atomic gint64 lastFrame;
+	// Frames of the channel are dropped while the slate is shown
+	_Atomic gboolean active;
+} VMPSignalState;
+
+static VMPSignalState *signalStateRef(VMPSignalState *state) {
+	g_atomic_int_inc(&state->refcount);
+	return state;
+}
+
+static void signalStateUnref(gpointer data) {
+	VMPSignalState *state = data;
+
+	if (g_atomic_int_dec_and_test(&state->refcount)) {
+		g_free(state);
+	}
+}
+
+// Called from the streaming thread of the channel
+static GstPadProbeReturn frameProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											gpointer user_data) {
+	VMPSignalState *state = user_data;
+
+	atomic_store_explicit(&state->lastFrame, g_get_monotonic_time(), memory_order_relaxed);
+	if (atomic_load(&state->active)) {
+		return GST_PAD_PROBE_DROP;
+	}
+	return GST_PAD_PROBE_OK;
+}
+
+// Called from the streaming thread of the encoded branch of a passthrough channel. Its frames
+// only reach the intervideosink while a consumer needs decoded frames.
+static GstPadProbeReturn encodedFrameProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+												   gpointer user_data) {
+	VMPSignalState *state = user_data;
+
+	atomic_store_explicit(&state->lastFrame, g_get_monotonic_time(), memory_order_relaxed);
+	return GST_PAD_PROBE_OK;
+}
+
+@implementation VMPSignalSlate {
+	NSString *_channel;
+	NSString *_imageTemplate;
+	NSString *_blackTemplate;
+	VMPSignalState *_state;
+	// intervideosink of the current channel pipeline
+	GWeakRef _sink;
+	dispatch_queue_t _queue;
+	dispatch_source_t _timer;
+	// Only accessed on _queue
+	GstCaps *_lastCaps;
+	GstElement *_slatePipeline;
+	// Protected by @synchronized(self)
+	NSUInteger _activations;
+}
+
++ (instancetype)slateWithChannel:(NSString *)channel
+					propertyList:(id)propertyList
+				   imageTemplate:(NSString *)imageTemplate
+				   blackTemplate:(NSString *)blackTemplate
+						   error:(NSError **)error {
+	return [[VMPSignalSlate alloc] initWithChannel:channel
+									  propertyList:propertyList
+									 imageTemplate:imageTemplate
+									 blackTemplate:blackTemplate
+											 error:error];
+}
+
+- (instancetype)initWithChannel:(NSString *)channel
+				   propertyList:(id)propertyList
+				  imageTemplate:(NSString *)imageTemplate
+				  blackTemplate:(NSString *)blackTemplate
+						  error:(NSError **)error {
+	NSTimeInterval timeout;
+	NSString *imagePath;
+
+	timeout = kDefaultTimeout;
+	imagePath = nil;
+	if ([propertyList isKindOfClass:[NSDictionary class]]) {
+		id value;
+
+		value = propertyList[@"timeout"];
+		if (value) {
+			if (![value isKindOfClass:[NSNumber class]] || [value doubleValue] <= 0) {
+				VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+							   @"'timeout' in 'slate' must be a positive number of seconds");
+				return nil;
+			}
+			timeout = [value doubleValue];
+		}
+
+		imagePath = propertyList[@"image"];
+		// The path is quoted in the pipeline description
+		if (imagePath && (![imagePath isKindOfClass:[NSString class]] ||
+						  [imagePath containsString:@"\""] ||
+						  ![[NSFileManager defaultManager] fileExistsAtPath:imagePath])) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'image' in 'slate' must be the path of an existing image");
+			return nil;
+		}
+	} else if (![propertyList isKindOfClass:[NSNumber class]]) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'slate' must be a boolean or a dictionary");
+		return nil;
+	}
+
+	self = [super init];
+	if (self) {
+		_channel = [channel copy];
+		_timeout = timeout;
+		_imagePath = [imagePath copy];
+		_imageTemplate = [imageTemplate copy];
+		_blackTemplate = [blackTemplate copy];
+		_state = g_new0(VMPSignalState, 1);
+		_state->refcount = 1;
+		atomic_init(&_state->lastFrame, g_get_monotonic_time());
+		atomic_init(&_state->active, FALSE);
+		g_weak_ref_init(&_sink, NULL);
+		_queue = dispatch_queue_create("com.hugomelder.vmpserverd.slate", DISPATCH_QUEUE_SERIAL);
+
+		__weak VMPSignalSlate *weakSelf = self;
+		_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+		dispatch_source_set_timer(_timer, dispatch_time(DISPATCH_TIME_NOW, 0),
+								  (uint64_t) (kCheckInterval * NSEC_PER_SEC),
+								  (uint64_t) (kCheckInterval * NSEC_PER_SEC / 10));
+		dispatch_source_set_event_handler(_timer, ^{
+		  [weakSelf _check];
+		});
+		dispatch_resume(_timer);
+	}
+	return self;
+}
+
+- (BOOL)isActive {
+	return atomic_load(&_state->active);
+}
+
+- (void)attachToChannelPipeline:(GstElement *)pipeline {
+	__block GstElement *sink = NULL;
+	GstElement *capsfilter, *encodedSink;
+	GstPad *pad;
+
+	if (!GST_IS_BIN(pipeline)) {
+		return;
+	}
+
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+	  const gchar *factoryName = VMPElementFactoryName(element);
+	  if (!sink && factoryName && g_str_equal(factoryName, "intervideosink")) {
+		  sink = gst_object_ref(element);
+	  }
+	});
+	if (!sink) {
+		VMPWarn(@"Channel %@ has no intervideosink. The slate is not shown.", _channel);
+		return;
+	}
+
+	// Transfer: FULL
+	pad = gst_element_get_static_pad(sink, "sink");
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+					  frameProbeCallback, signalStateRef(_state), signalStateUnref);
+	gst_object_unref(pad);
+	g_weak_ref_set(&_sink, sink);
+	gst_object_unref(sink);
+
+	// The decoder of a passthrough channel is closed while no consumer needs decoded frames, so
+	// the input has a signal as long as encoded frames arrive
+	// Transfer: FULL
+	encodedSink = gst_bin_get_by_name(GST_BIN(pipeline), [kVMPEncodedSinkName UTF8String]);
+	if (encodedSink) {
+		// Transfer: FULL
+		pad = gst_element_get_static_pad(encodedSink, "sink");
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+						  encodedFrameProbeCallback, signalStateRef(_state), signalStateUnref);
+		gst_object_unref(pad);
+		gst_object_unref(encodedSink);
+	}
+
+	// Caps of the slate until the channel negotiated its own
+	// Transfer: FULL
+	capsfilter = gst_bin_get_by_name(GST_BIN(pipeline), [kVMPScaleFilterName UTF8String]);
+	if (capsfilter) {
+		GstCaps *caps = NULL;
+
+		// Transfer: FULL
+		g_object_get(capsfilter, "caps", &caps, NULL);
+		dispatch_async(_queue, ^{
+		  if (!_lastCaps && caps) {
+			  gst_caps_replace(&_lastCaps, caps);
+		  }
+		  if (caps) {
+			  gst_caps_unref(caps);
+		  }
+		});
+		gst_object_unref(capsfilter);
+	}
+}
+
+// Called on _queue
+- (void)_check {
+	GstElement *sink;
+	gint64 age;
+
+	// Remember the negotiated caps, which are gone once the channel pipeline is destroyed
+	// Transfer: FULL
+	sink = g_weak_ref_get(&_sink);
+	if (sink) {
+		GstPad *pad;
+		GstCaps *caps;
+
+		// Transfer: FULL
+		pad = gst_element_get_static_pad(sink, "sink");
+		caps = pad ? gst_pad_get_current_caps(pad) : NULL;
+		if (caps) {
+			gst_caps_replace(&_lastCaps, caps);
+			gst_caps_unref(caps);
+		}
+		if (pad) {
+			gst_object_unref(pad);
+		}
+		gst_object_unref(sink);
+	}
+
+	age = g_get_monotonic_time() - atomic_load(&_state->lastFrame);
+	if (!_slatePipeline && age > _timeout * G_USEC_PER_SEC) {
+		[self _startSlate];
+	} else if (_slatePipeline && age <= _timeout * G_USEC_PER_SEC) {
+		[self _stopSlate];
+	}
+}
+
+// Called on _queue. Transfer: FULL
+- (GstElement *)_launchTemplate:(NSString *)templateString caps:(NSString *)caps {
+	NSDictionary *vars;
+	NSString *launch;
+	NSError *error = nil;
+	GError *gerror = NULL;
+	GstElement *pipeline;
+
+	vars = @{@"VIDEOCHANNEL.0" : _channel, @"CAPS" : caps, @"PATH" : _imagePath ?: @""};
+	launch = [templateString stringBySubstitutingVariables:vars error:&error];
+	if (!launch) {
+		VMPError(@"Invalid slate template for channel %@: %@", _channel, error);
+		return NULL;
+	}
+
+	pipeline = gst_parse_launch([launch UTF8String], &gerror);
+	if (!pipeline) {
+		VMPError(@"Failed to create slate of channel %@: %s", _channel,
+				 gerror ? gerror->message : "unknown error");
+		g_clear_error(&gerror);
+		return NULL;
+	}
+	g_clear_error(&gerror);
+
+	if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+		VMPError(@"Failed to start slate of channel %@", _channel);
+		gst_element_set_state(pipeline, GST_STATE_NULL);
+		gst_object_unref(pipeline);
+		return NULL;
+	}
+
+	return pipeline;
+}
+
+// Called on _queue
+- (void)_startSlate {
+	gchar *str;
+	NSString *caps;
+
+	str = _lastCaps ? gst_caps_to_string(_lastCaps) : NULL;
+	caps = str ? @(str) : @"video/x-raw";
+	g_free(str);
+
+	// Drop late frames of the channel while both pipelines publish to the channel
+	atomic_store(&_state->active, TRUE);
+
+	if (_imagePath) {
+		_slatePipeline = [self _launchTemplate:_imageTemplate caps:caps];
+	}
+	if (!_slatePipeline) {
+		_slatePipeline = [self _launchTemplate:_blackTemplate caps:caps];
+	}
+	if (!_slatePipeline) {
+		atomic_store(&_state->active, FALSE);
+		// Retry once the timeout expired again
+		atomic_store(&_state->lastFrame, g_get_monotonic_time());
+		return;
+	}
+
+	@synchronized(self) {
+		_activations++;
+	}
+	VMPWarn(@"Channel %@ has no signal. Showing slate with %@.", _channel, caps);
+}
+
+// Called on _queue
+- (void)_stopSlate {
+	gst_element_set_state(_slatePipeline, GST_STATE_NULL);
+	gst_object_unref(_slatePipeline);
+	_slatePipeline = NULL;
+
+	atomic_store(&_state->active, FALSE);
+	VMPInfo(@"Channel %@ has a signal again", _channel);
+}
+
+- (void)invalidate {
+	@synchronized(self) {
+		if (_timer) {
+			dispatch_source_cancel(_timer);
+			_timer = nil;
+		}
+	}
+
+	dispatch_async(_queue, ^{
+	  if (_slatePipeline) {
+		  [self _stopSlate];
+	  }
+	});
+}
+
+- (NSDictionary *)statistics {
+	NSUInteger activations;
+	gint64 age;
+
+	@synchronized(self) {
+		activations = _activations;
+	}
+	age = g_get_monotonic_time() - atomic_load(&_state->lastFrame);
+
+	return @{
+		@"active" : @([self isActive]),
+		@"activations" : @(activations),
+		@"lastFrame" : @((double) age / G_USEC_PER_SEC),
+	};
+}
+
+// May be called on _queue, when the timer handler held the last reference
+- (void)dealloc {
+	if (_timer) {
+		dispatch_source_cancel(_timer);
+	}
+	if (_slatePipeline) {
+		gst_element_set_state(_slatePipeline, GST_STATE_NULL);
+		gst_object_unref(_slatePipeline);
+	}
+	g_weak_ref_clear(&_sink);
+	gst_caps_replace(&_lastCaps, NULL);
+	signalStateUnref(_state);
+}
+
+@end
@@ -0,0 +1,98 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * @brief Name of the element message posted when the content changes between
+ * static and moving
+ *
+ * The structure has the boolean field "static".
+ */
+extern NSString *const kVMPStaticContentMessageName;
+
+/**
+ * @brief Detects static content (e.g. slides) in a channel, and thins out its
+ * consumers accordingly
+ *
+ * The detector is configured with the optional "staticContent" dictionary in
+ * the properties of a channel:
+ *
+ * @code
+ * <key>staticContent</key>
+ * <dict>
+ *     <key>threshold</key>
+ *     <real>1.5</real>
+ *     <key>holdTime</key>
+ *     <real>2</real>
+ *     <key>keepaliveInterval</key>
+ *     <real>1</real>
+ * </dict>
+ * @endcode
+ *
+ * Every frame reaching the intervideosink of the channel is sampled on a
+ * 64x36 grid of the first plane. If the mean absolute difference to the
+ * previous frame stays below "threshold" (0-255, default 1.5) for "holdTime"
+ * seconds (default 2), the content is static.
+ *
+ * Consumers of the channel get a gate behind their intervideosrc. While the
+ * content is static, the gate only passes one frame every "keepaliveInterval"
+ * seconds (default 1), so encoders process a fraction of the frames. Once
+ * motion returns, frames pass again, and a keyframe is requested from the
+ * encoder with a force-key-unit event.
+ */
+@interface VMPStaticContentDetector : NSObject
+
+/// Maximum mean absolute difference of a static frame
+@property (nonatomic, readonly) double threshold;
+
+/// Time without motion until the content is static, in seconds
+@property (nonatomic, readonly) NSTimeInterval holdTime;
+
+/// Interval of frames passed to consumers while static, in seconds
+@property (nonatomic, readonly) NSTimeInterval keepaliveInterval;
+
+/// Whether the content is currently static
+@property (nonatomic, readonly, getter=isStatic) BOOL isStatic;
+
+/**
+ * @brief Parse and validate the "staticContent" dictionary
+ *
+ * @returns a detector, or nil if the property list is invalid
+ */
++ (nullable instancetype)detectorWithPropertyList:(id)propertyList error:(NSError **)error;
+
+- (nullable instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error;
+
+/**
+ * @brief Analyse the frames reaching the intervideosink of a channel pipeline
+ *
+ * Called for every pipeline created for the channel, including restarts.
+ */
+- (void)attachToChannelPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Gate the frames of an intervideosrc reading from the channel
+ *
+ * The gate is removed together with the pad of the source.
+ */
+- (void)attachGateToSource:(GstElement *)source;
+
+/**
+ * @brief Detection state and frame counts
+ *
+ * @returns a dictionary with the keys "static", "transitions",
+ * "framesAnalyzed", "framesDropped", "keyframesRequested", and
+ * "lastDifference"
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,367 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#import <gst/video/video.h>
+
+#import "VMPErrors.h"
+#import "VMPGStreamerUtils.h"
+#import "VMPJournal.h"
+#import "VMPStaticContentDetector.h"
+
+NSString *const kVMPStaticContentMessageName = @"vmp-static-content";
+
+// Sampling grid of the frame difference
+#define GRID_WIDTH 64
+#define GRID_HEIGHT 36
+
+static const double kDefaultThreshold = 1.5;
+static const NSTimeInterval kDefaultHoldTime = 2.0;
+static const NSTimeInterval kDefaultKeepaliveInterval = 1.0;
+
+// Shared between the detector, its probe, and the gates, which may outlive each other
+typedef struct {
+	gint refcount;
+	_Atomic gboolean isStatic;
+	// Incremented whenever motion returns after static content
+	_Atomic guint motionSequence;
+	// Keepalive interval in microseconds
+	gint64 keepaliveInterval;
+
+	_Atomic guint64 transitions;
+	_Atomic guint64 framesAnalyzed;
+	_Atomic guint64 framesDropped;
+	_Atomic guint64 keyframesRequested;
+	// Mean absolute difference of the last frame, multiplied by 100
+	_Atomic guint lastDifference;
+} VMPContentState;
+
+static VMPContentState *contentStateRef(VMPContentState *state) {
+	g_atomic_int_inc(&state->refcount);
+	return state;
+}
+
+static void contentStateUnref(gpointer data) {
+	VMPContentState *state = data;
+
+	if (g_atomic_int_dec_and_test(&state->refcount)) {
+		g_free(state);
+	}
+}
+
+// State of the probe at the intervideosink. Only accessed from its streaming thread.
+typedef struct {
+	VMPContentState *shared;
+	double threshold;
+	gint64 holdTime;
+
+	GstCaps *caps;
+	GstVideoInfo info;
+	guint8 signature[GRID_WIDTH * GRID_HEIGHT];
+	gboolean haveSignature;
+	gint64 lastMotion;
+} VMPDetectorProbe;
+
+static void detectorProbeFree(gpointer data) {
+	VMPDetectorProbe *probe = data;
+
+	gst_caps_replace(&probe->caps, NULL);
+	contentStateUnref(probe->shared);
+	g_free(probe);
+}
+
+// State of a gate behind an intervideosrc. Only accessed from its streaming thread.
+typedef struct {
+	VMPContentState *shared;
+	guint motionSequence;
+	gint64 lastPassed;
+} VMPContentGate;
+
+static void contentGateFree(gpointer data) {
+	VMPContentGate *gate = data;
+
+	contentStateUnref(gate->shared);
+	g_free(gate);
+}
+
+// Sample the first plane of a frame into signature. Returns NO if the frame cannot be mapped.
+static BOOL sampleFrame(VMPDetectorProbe *probe, GstBuffer *buffer, guint8 *signature) {
+	GstVideoFrame frame;
+	const guint8 *data;
+	gint width, height, stride, pixelStride;
+
+	if (!gst_video_frame_map(&frame, &probe->info, buffer, GST_MAP_READ)) {
+		return NO;
+	}
+
+	data = GST_VIDEO_FRAME_COMP_DATA(&frame, 0);
+	width = GST_VIDEO_FRAME_COMP_WIDTH(&frame, 0);
+	height = GST_VIDEO_FRAME_COMP_HEIGHT(&frame, 0);
+	stride = GST_VIDEO_FRAME_COMP_STRIDE(&frame, 0);
+	pixelStride = GST_VIDEO_FRAME_COMP_PSTRIDE(&frame, 0);
+
+	for (gint y = 0; y < GRID_HEIGHT; y++) {
+		const guint8 *row = data + (gsize) ((y * height + height / 2) / GRID_HEIGHT) * stride;
+
+		for (gint x = 0; x < GRID_WIDTH; x++) {
+			gint column = (x * width + width / 2) / GRID_WIDTH;
+			signature[y * GRID_WIDTH + x] = row[column * pixelStride];
+		}
+	}
+
+	gst_video_frame_unmap(&frame);
+	return YES;
+}
+
+static void postStateMessage(GstPad *pad, gboolean isStatic) {
+	GstElement *element;
+	GstStructure *structure;
+
+	// Transfer: FULL
+	element = gst_pad_get_parent_element(pad);
+	if (!element) {
+		return;
+	}
+
+	structure = gst_structure_new([kVMPStaticContentMessageName UTF8String], "static",
+								  G_TYPE_BOOLEAN, isStatic, NULL);
+	gst_element_post_message(element, gst_message_new_element(GST_OBJECT(element), structure));
+	gst_object_unref(element);
+}
+
+static GstPadProbeReturn detectorProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+											   gpointer user_data) {
+	VMPDetectorProbe *probe = user_data;
+	VMPContentState *shared = probe->shared;
+	guint8 signature[GRID_WIDTH * GRID_HEIGHT];
+	GstBuffer *buffer;
+	GstCaps *caps;
+	guint64 sum = 0;
+	double difference;
+	gint64 now;
+
+	buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+	// Transfer: FULL
+	caps = gst_pad_get_current_caps(pad);
+	if (!caps) {
+		return GST_PAD_PROBE_OK;
+	}
+	if (caps != probe->caps) {
+		gst_caps_replace(&probe->caps, caps);
+		probe->haveSignature = FALSE;
+		if (!gst_video_info_from_caps(&probe->info, caps)) {
+			gst_caps_replace(&probe->caps, NULL);
+		}
+	}
+	gst_caps_unref(caps);
+
+	if (!probe->caps || !sampleFrame(probe, buffer, signature)) {
+		return GST_PAD_PROBE_OK;
+	}
+
+	now = g_get_monotonic_time();
+	atomic_fetch_add_explicit(&shared->framesAnalyzed, 1, memory_order_relaxed);
+
+	// A new format is treated as motion
+	if (!probe->haveSignature) {
+		difference = G_MAXDOUBLE;
+	} else {
+		for (gsize i = 0; i < G_N_ELEMENTS(signature); i++) {
+			sum += (guint64) abs((gint) signature[i] - (gint) probe->signature[i]);
+		}
+		difference = (double) sum / G_N_ELEMENTS(signature);
+		atomic_store_explicit(&shared->lastDifference, (guint) (difference * 100),
+							  memory_order_relaxed);
+	}
+	memcpy(probe->signature, signature, sizeof(signature));
+	probe->haveSignature = TRUE;
+
+	if (difference > probe->threshold) {
+		probe->lastMotion = now;
+		if (atomic_exchange(&shared->isStatic, FALSE)) {
+			atomic_fetch_add(&shared->motionSequence, 1);
+			atomic_fetch_add_explicit(&shared->transitions, 1, memory_order_relaxed);
+			postStateMessage(pad, FALSE);
+		}
+	} else if (now - probe->lastMotion >= probe->holdTime && !atomic_load(&shared->isStatic)) {
+		atomic_store(&shared->isStatic, TRUE);
+		atomic_fetch_add_explicit(&shared->transitions, 1, memory_order_relaxed);
+		postStateMessage(pad, TRUE);
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn gateProbeCallback(GstPad *pad, GstPadProbeInfo *info,
+										   gpointer user_data) {
+	VMPContentGate *gate = user_data;
+	VMPContentState *shared = gate->shared;
+	guint motionSequence;
+	gint64 now;
+
+	now = g_get_monotonic_time();
+
+	// Motion returned. Start with a keyframe, so clients see the change immediately.
+	motionSequence = atomic_load(&shared->motionSequence);
+	if (motionSequence != gate->motionSequence) {
+		GstEvent *event;
+
+		gate->motionSequence = motionSequence;
+		gate->lastPassed = now;
+
+		event = gst_video_event_new_downstream_force_key_unit(
+			GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, TRUE, 0);
+		gst_pad_push_event(pad, event);
+		atomic_fetch_add_explicit(&shared->keyframesRequested, 1, memory_order_relaxed);
+
+		return GST_PAD_PROBE_OK;
+	}
+
+	if (!atomic_load(&shared->isStatic) || now - gate->lastPassed >= shared->keepaliveInterval) {
+		gate->lastPassed = now;
+		return GST_PAD_PROBE_OK;
+	}
+
+	atomic_fetch_add_explicit(&shared->framesDropped, 1, memory_order_relaxed);
+	return GST_PAD_PROBE_DROP;
+}
+
+@implementation VMPStaticContentDetector {
+	VMPContentState *_state;
+}
+
++ (instancetype)detectorWithPropertyList:(id)propertyList error:(NSError **)error {
+	return [[VMPStaticContentDetector alloc] initWithPropertyList:propertyList error:error];
+}
+
+- (instancetype)initWithPropertyList:(id)propertyList error:(NSError **)error {
+	id threshold, holdTime, keepaliveInterval;
+
+	if (![propertyList isKindOfClass:[NSDictionary class]]) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'staticContent' must be a dictionary");
+		return nil;
+	}
+
+	threshold = propertyList[@"threshold"] ?: @(kDefaultThreshold);
+	holdTime = propertyList[@"holdTime"] ?: @(kDefaultHoldTime);
+	keepaliveInterval = propertyList[@"keepaliveInterval"] ?: @(kDefaultKeepaliveInterval);
+
+	if (![threshold isKindOfClass:[NSNumber class]] || [threshold doubleValue] < 0 ||
+		[threshold doubleValue] > 255) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'threshold' in 'staticContent' must be between 0 and 255");
+		return nil;
+	}
+	if (![holdTime isKindOfClass:[NSNumber class]] || [holdTime doubleValue] <= 0) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'holdTime' in 'staticContent' must be a positive number of seconds");
+		return nil;
+	}
+	if (![keepaliveInterval isKindOfClass:[NSNumber class]] ||
+		[keepaliveInterval doubleValue] <= 0) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+					   @"'keepaliveInterval' in 'staticContent' must be a positive number of "
+					   @"seconds");
+		return nil;
+	}
+
+	self = [super init];
+	if (self) {
+		_threshold = [threshold doubleValue];
+		_holdTime = [holdTime doubleValue];
+		_keepaliveInterval = [keepaliveInterval doubleValue];
+
+		_state = g_new0(VMPContentState, 1);
+		_state->refcount = 1;
+		_state->keepaliveInterval = (gint64) (_keepaliveInterval * G_USEC_PER_SEC);
+	}
+	return self;
+}
+
+- (void)attachToChannelPipeline:(GstElement *)pipeline {
+	__block GstElement *sink = NULL;
+	VMPDetectorProbe *probe;
+	GstPad *pad;
+
+	if (!GST_IS_BIN(pipeline)) {
+		return;
+	}
+
+	VMPForEachElement(GST_BIN(pipeline), ^(GstElement *element) {
+	  const gchar *factoryName = VMPElementFactoryName(element);
+	  if (!sink && factoryName && g_str_equal(factoryName, "intervideosink")) {
+		  sink = gst_object_ref(element);
+	  }
+	});
+	if (!sink) {
+		VMPWarn(@"No intervideosink in pipeline %s. Static content is not detected.",
+				GST_OBJECT_NAME(pipeline));
+		return;
+	}
+
+	// Transfer: FULL
+	pad = gst_element_get_static_pad(sink, "sink");
+	gst_object_unref(sink);
+	if (!pad) {
+		return;
+	}
+
+	probe = g_new0(VMPDetectorProbe, 1);
+	probe->shared = contentStateRef(_state);
+	probe->threshold = _threshold;
+	probe->holdTime = (gint64) (_holdTime * G_USEC_PER_SEC);
+	probe->lastMotion = g_get_monotonic_time();
+
+	// A restarted channel starts with moving content
+	atomic_store(&_state->isStatic, FALSE);
+
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, detectorProbeCallback, probe,
+					  detectorProbeFree);
+	gst_object_unref(pad);
+}
+
+- (void)attachGateToSource:(GstElement *)source {
+	VMPContentGate *gate;
+	GstPad *pad;
+
+	// Transfer: FULL
+	pad = gst_element_get_static_pad(source, "src");
+	if (!pad) {
+		return;
+	}
+
+	gate = g_new0(VMPContentGate, 1);
+	gate->shared = contentStateRef(_state);
+	gate->motionSequence = atomic_load(&_state->motionSequence);
+
+	gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, gateProbeCallback, gate, contentGateFree);
+	gst_object_unref(pad);
+}
+
+- (BOOL)isStatic {
+	return atomic_load(&_state->isStatic);
+}
+
+- (NSDictionary *)statistics {
+	return @{
+		@"static" : @([self isStatic]),
+		@"transitions" : @(atomic_load(&_state->transitions)),
+		@"framesAnalyzed" : @(atomic_load(&_state->framesAnalyzed)),
+		@"framesDropped" : @(atomic_load(&_state->framesDropped)),
+		@"keyframesRequested" : @(atomic_load(&_state->keyframesRequested)),
+		@"lastDifference" : @(atomic_load(&_state->lastDifference) / 100.0),
+	};
+}
+
+- (void)dealloc {
+	contentStateUnref(_state);
+}
+
+@end
@@ -0,0 +1,78 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/// Default maximum number of threads in the shared task pool
+extern const NSUInteger kVMPTaskPoolDefaultMaxThreads;
+/// Default stack size of task pool threads in bytes
+extern const NSUInteger kVMPTaskPoolDefaultStackSize;
+
+/**
+ * @brief Size-bounded GstTaskPool shared by multiple pipelines
+ *
+ * By default, every GstTask (e.g. the streaming thread of a queue) runs in a
+ * thread of the default GLib thread pool with the default stack size (usually
+ * 8 MiB, see RLIMIT_STACK). The shared pool instead creates threads with a
+ * smaller stack, and keeps threads of finished tasks around for reuse (e.g. by
+ * a pipeline restart).
+ *
+ * The pool lowers the stack memory of streaming threads, not their number. A
+ * task occupies a thread until it is stopped, so every running task still needs
+ * its own thread, and tasks cannot be queued. If all threads are busy and
+ * maxThreads is reached, starting a task fails, and the pipeline posts an
+ * error. The limit is a safety net against runaway thread creation. A warning
+ * is logged once 90% of the threads are busy, and the statistics report how
+ * close the pool came to the limit.
+ *
+ * The pool is assigned to a task in the stream-status sync handler of
+ * VMPThreadMonitor, before the task is started.
+ */
+@interface VMPTaskPool : NSObject
+
+/// Maximum number of threads
+@property (nonatomic, readonly) NSUInteger maxThreads;
+
+/// Stack size of each thread in bytes
+@property (nonatomic, readonly) NSUInteger stackSize;
+
+/**
+ * @brief Create a task pool from the "taskPool" configuration dictionary
+ *
+ * Recognised keys are "maxThreads", and "stackSize" (in KiB). Missing keys
+ * use the defaults.
+ *
+ * @returns a task pool, or nil if the configuration is invalid
+ */
++ (nullable instancetype)taskPoolWithPropertyList:(id)propertyList error:(NSError **)error;
+
+- (instancetype)initWithMaxThreads:(NSUInteger)maxThreads stackSize:(NSUInteger)stackSize;
+
+/**
+ * @brief The underlying GstTaskPool
+ *
+ * Transfer: NONE. Valid for the lifetime of the receiver.
+ */
+- (GstTaskPool *)pool;
+
+/**
+ * @brief Thread counts of the pool
+ *
+ * @returns a dictionary with the keys "maxThreads", "threads" (created
+ * threads), "busyThreads" (threads running a task), "peakBusyThreads" (highest
+ * number of busy threads), "utilisation" (busy threads relative to maxThreads,
+ * 0 to 1), "rejectedTasks" (tasks that failed to start at the limit),
+ * "stackSize" (bytes per thread), and "stackMemory" (reserved stack memory of
+ * all threads in bytes)
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
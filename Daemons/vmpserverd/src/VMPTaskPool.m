@@ -0,0 +1,327 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <limits.h>
+#include <pthread.h>
+
+#import "VMPErrors.h"
+#import "VMPJournal.h"
+#import "VMPTaskPool.h"
+
+const NSUInteger kVMPTaskPoolDefaultMaxThreads = 64;
+const NSUInteger kVMPTaskPoolDefaultStackSize = 512 * 1024;
+
+#pragma mark - GstTaskPool subclass
+
+// A pushed task. One reference is owned by the worker, one by the handle
+// returned to GstTask.
+typedef struct {
+	gint refcount;
+	GstTaskPoolFunction func;
+	gpointer data;
+	gboolean done;
+} VMPPoolJob;
+
+typedef struct _VMPBoundedTaskPool VMPBoundedTaskPool;
+
+typedef struct {
+	VMPBoundedTaskPool *pool;
+	GCond cond;
+	// Protected by the pool lock. NULL while idle.
+	VMPPoolJob *job;
+} VMPPoolWorker;
+
+struct _VMPBoundedTaskPool {
+	GstTaskPool parent;
+
+	GMutex lock;
+	// Signalled when a job finished
+	GCond done;
+	guint maxThreads;
+	gsize stackSize;
+	guint numThreads;
+	guint numBusy;
+	// Highest number of busy threads so far
+	guint peakBusy;
+	// Tasks that failed to start, as the limit was reached
+	guint numRejected;
+	// Whether the pool came close to the limit, which is only logged once
+	gboolean nearLimit;
+	// Idle workers
+	GQueue idle;
+};
+
+typedef struct {
+	GstTaskPoolClass parent_class;
+} VMPBoundedTaskPoolClass;
+
+GType vmp_bounded_task_pool_get_type(void);
+G_DEFINE_TYPE(VMPBoundedTaskPool, vmp_bounded_task_pool, GST_TYPE_TASK_POOL)
+
+#define VMP_BOUNDED_TASK_POOL(obj)                                                                 \
+	(G_TYPE_CHECK_INSTANCE_CAST((obj), vmp_bounded_task_pool_get_type(), VMPBoundedTaskPool))
+
+static void jobUnref(VMPPoolJob *job) {
+	if (g_atomic_int_dec_and_test(&job->refcount)) {
+		g_free(job);
+	}
+}
+
+static void *workerMain(void *data) {
+	VMPPoolWorker *worker = data;
+	VMPBoundedTaskPool *pool = worker->pool;
+
+	g_mutex_lock(&pool->lock);
+	for (;;) {
+		VMPPoolJob *job;
+
+		while (!worker->job) {
+			g_cond_wait(&worker->cond, &pool->lock);
+		}
+		job = worker->job;
+
+		g_mutex_unlock(&pool->lock);
+		job->func(job->data);
+		g_mutex_lock(&pool->lock);
+
+		worker->job = NULL;
+		job->done = TRUE;
+		jobUnref(job);
+		pool->numBusy--;
+		g_queue_push_head(&pool->idle, worker);
+		g_cond_broadcast(&pool->done);
+	}
+
+	// Workers live as long as the process, as the pool is never finalised
+	return NULL;
+}
+
+static gpointer vmp_bounded_task_pool_push(GstTaskPool *taskPool, GstTaskPoolFunction func,
+										   gpointer data, GError **error) {
+	VMPBoundedTaskPool *pool = VMP_BOUNDED_TASK_POOL(taskPool);
+	VMPPoolWorker *worker;
+	VMPPoolJob *job;
+	guint busy;
+	gboolean warn;
+
+	g_mutex_lock(&pool->lock);
+
+	worker = g_queue_pop_head(&pool->idle);
+	if (!worker) {
+		pthread_attr_t attr;
+		pthread_t thread;
+		int ret;
+
+		if (pool->numThreads >= pool->maxThreads) {
+			pool->numRejected++;
+			g_mutex_unlock(&pool->lock);
+			@autoreleasepool {
+				VMPError(@"Shared task pool exhausted. All %u threads are busy.", pool->maxThreads);
+			}
+			g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED,
+						"Shared task pool exhausted (%u threads). Increase 'maxThreads'.",
+						pool->maxThreads);
+			return NULL;
+		}
+
+		worker = g_new0(VMPPoolWorker, 1);
+		worker->pool = pool;
+		g_cond_init(&worker->cond);
+
+		pthread_attr_init(&attr);
+		pthread_attr_setstacksize(&attr, pool->stackSize);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		ret = pthread_create(&thread, &attr, workerMain, worker);
+		pthread_attr_destroy(&attr);
+
+		if (ret != 0) {
+			g_mutex_unlock(&pool->lock);
+			g_cond_clear(&worker->cond);
+			g_free(worker);
+			g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED,
+						"Failed to create task pool thread: %s", g_strerror(ret));
+			return NULL;
+		}
+		pool->numThreads++;
+	}
+
+	job = g_new0(VMPPoolJob, 1);
+	job->refcount = 2;
+	job->func = func;
+	job->data = data;
+
+	worker->job = job;
+	pool->numBusy++;
+	pool->peakBusy = MAX(pool->peakBusy, pool->numBusy);
+	g_cond_signal(&worker->cond);
+
+	// Warn once at 90% of the limit, as every further task needs another thread
+	busy = pool->numBusy;
+	warn = !pool->nearLimit && busy >= pool->maxThreads - pool->maxThreads / 10;
+	if (warn) {
+		pool->nearLimit = TRUE;
+	}
+
+	g_mutex_unlock(&pool->lock);
+
+	if (warn) {
+		@autoreleasepool {
+			VMPWarn(@"Shared task pool is close to its limit: %u of %u threads are busy", busy,
+					pool->maxThreads);
+		}
+	}
+
+	return job;
+}
+
+static void vmp_bounded_task_pool_join(GstTaskPool *taskPool, gpointer id) {
+	VMPBoundedTaskPool *pool = VMP_BOUNDED_TASK_POOL(taskPool);
+	VMPPoolJob *job = id;
+
+	g_mutex_lock(&pool->lock);
+	while (!job->done) {
+		g_cond_wait(&pool->done, &pool->lock);
+	}
+	g_mutex_unlock(&pool->lock);
+
+	jobUnref(job);
+}
+
+#if GST_CHECK_VERSION(1, 20, 0)
+// Handles of tasks that are never joined
+static void vmp_bounded_task_pool_dispose_handle(GstTaskPool *taskPool, gpointer id) {
+	jobUnref(id);
+}
+#endif
+
+// Nothing to do, threads are created on demand
+static void vmp_bounded_task_pool_prepare(GstTaskPool *taskPool, GError **error) {
+}
+
+static void vmp_bounded_task_pool_cleanup(GstTaskPool *taskPool) {
+}
+
+static void vmp_bounded_task_pool_finalize(GObject *object) {
+	VMPBoundedTaskPool *pool = VMP_BOUNDED_TASK_POOL(object);
+
+	// Only reached if no thread was ever created
+	g_mutex_clear(&pool->lock);
+	g_cond_clear(&pool->done);
+
+	G_OBJECT_CLASS(vmp_bounded_task_pool_parent_class)->finalize(object);
+}
+
+static void vmp_bounded_task_pool_class_init(VMPBoundedTaskPoolClass *klass) {
+	GstTaskPoolClass *poolClass = GST_TASK_POOL_CLASS(klass);
+
+	G_OBJECT_CLASS(klass)->finalize = vmp_bounded_task_pool_finalize;
+	poolClass->prepare = vmp_bounded_task_pool_prepare;
+	poolClass->cleanup = vmp_bounded_task_pool_cleanup;
+	poolClass->push = vmp_bounded_task_pool_push;
+	poolClass->join = vmp_bounded_task_pool_join;
+#if GST_CHECK_VERSION(1, 20, 0)
+	poolClass->dispose_handle = vmp_bounded_task_pool_dispose_handle;
+#endif
+}
+
+static void vmp_bounded_task_pool_init(VMPBoundedTaskPool *pool) {
+	g_mutex_init(&pool->lock);
+	g_cond_init(&pool->done);
+	g_queue_init(&pool->idle);
+}
+
+#pragma mark - VMPTaskPool
+
+@implementation VMPTaskPool {
+	VMPBoundedTaskPool *_pool;
+}
+
++ (instancetype)taskPoolWithPropertyList:(id)propertyList error:(NSError **)error {
+	NSUInteger maxThreads, stackSize;
+	id value;
+
+	if (![propertyList isKindOfClass:[NSDictionary class]]) {
+		VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError, @"'taskPool' must be a dictionary");
+		return nil;
+	}
+
+	maxThreads = kVMPTaskPoolDefaultMaxThreads;
+	stackSize = kVMPTaskPoolDefaultStackSize;
+
+	value = propertyList[@"maxThreads"];
+	if (value) {
+		if (![value isKindOfClass:[NSNumber class]] || [value integerValue] <= 0) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'maxThreads' must be a positive number");
+			return nil;
+		}
+		maxThreads = [value unsignedIntegerValue];
+	}
+
+	value = propertyList[@"stackSize"];
+	if (value) {
+		if (![value isKindOfClass:[NSNumber class]] ||
+			[value unsignedIntegerValue] * 1024 < PTHREAD_STACK_MIN) {
+			VMP_FAST_ERROR(error, VMPErrorCodeConfigurationError,
+						   @"'stackSize' must be at least %lu KiB",
+						   (unsigned long) PTHREAD_STACK_MIN / 1024);
+			return nil;
+		}
+		stackSize = [value unsignedIntegerValue] * 1024;
+	}
+
+	return [[VMPTaskPool alloc] initWithMaxThreads:maxThreads stackSize:stackSize];
+}
+
+- (instancetype)initWithMaxThreads:(NSUInteger)maxThreads stackSize:(NSUInteger)stackSize {
+	self = [super init];
+	if (self) {
+		_maxThreads = maxThreads;
+		_stackSize = stackSize;
+
+		_pool = g_object_new(vmp_bounded_task_pool_get_type(), NULL);
+		_pool->maxThreads = (guint) maxThreads;
+		_pool->stackSize = stackSize;
+		// Keep the pool alive for the lifetime of the process, as idle worker threads
+		// reference it
+		gst_object_ref_sink(_pool);
+
+		VMPInfo(@"Created shared task pool with at most %lu threads and %lu KiB stack",
+				(unsigned long) maxThreads, (unsigned long) stackSize / 1024);
+	}
+	return self;
+}
+
+- (GstTaskPool *)pool {
+	return GST_TASK_POOL(_pool);
+}
+
+- (NSDictionary *)statistics {
+	guint threads, busy, peak, rejected;
+
+	g_mutex_lock(&_pool->lock);
+	threads = _pool->numThreads;
+	busy = _pool->numBusy;
+	peak = _pool->peakBusy;
+	rejected = _pool->numRejected;
+	g_mutex_unlock(&_pool->lock);
+
+	return @{
+		@"maxThreads" : @(_maxThreads),
+		@"threads" : @(threads),
+		@"busyThreads" : @(busy),
+		@"peakBusyThreads" : @(peak),
+		@"utilisation" : @((double) busy / (double) _maxThreads),
+		@"rejectedTasks" : @(rejected),
+		@"stackSize" : @(_stackSize),
+		@"stackMemory" : @(threads * _stackSize),
+	};
+}
+
+// The pool is deliberately not released in dealloc, as worker threads may still
+// wait for jobs.
+
+@end
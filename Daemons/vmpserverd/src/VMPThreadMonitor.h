@@ -0,0 +1,133 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+#import <gst/gst.h>
+
+#import "VMPSchedulingPolicy.h"
+#import "VMPTaskPool.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * @brief CPU time of a thread of this process in seconds
+ *
+ * @param tid The kernel thread id
+ *
+ * Reads utime and stime from /proc/self/task/<tid>/stat.
+ *
+ * @returns the CPU time, or a negative value if the thread does not exist
+ */
+double VMPThreadCPUTime(pid_t tid);
+
+/**
+ * @brief Tracks the streaming threads of one or more pipelines
+ *
+ * GStreamer posts a GST_MESSAGE_STREAM_STATUS message when a streaming thread
+ * enters or leaves the task of an element. The monitor handles these messages
+ * synchronously in a bus sync handler, which runs in the streaming thread
+ * itself. Threads are named "<name>/<element>" (truncated to 15 characters by
+ * the kernel), so they can be identified in top(1) or perf(1).
+ *
+ * CPU time of active threads is sampled from /proc/self/task. Streaming threads
+ * may come from a thread pool and serve several tasks during their lifetime, so
+ * only CPU time spent between entering and leaving a task is attributed to
+ * the monitor.
+ *
+ * If a scheduling policy is set, it is applied to a thread when it enters a
+ * task, and the previous settings are restored when it leaves the task.
+ *
+ * If a task pool is set, it is assigned to every task created in the
+ * monitored pipelines, so their threads are taken from the shared pool.
+ *
+ * All pipelines of a channel, including those created by restarts, share one
+ * monitor.
+ */
+@interface VMPThreadMonitor : NSObject
+
+/// Name of the channel or mountpoint. Used as a thread name prefix.
+@property (nonatomic, readonly) NSString *name;
+
+/**
+ * @brief Optional scheduling policy for streaming threads
+ *
+ * Takes effect for threads entering a task after the policy was set.
+ */
+@property (atomic, strong, nullable) VMPSchedulingPolicy *schedulingPolicy;
+
+/**
+ * @brief Optional shared task pool for new tasks
+ *
+ * Takes effect for tasks created after the pool was set. @see VMPTaskPool
+ */
+@property (atomic, strong, nullable) VMPTaskPool *taskPool;
+
+/**
+ * @brief Number of QoS messages posted on the monitored buses
+ *
+ * Elements post QoS messages when they drop buffers that arrived too late,
+ * which indicates that the pipelines cannot keep up.
+ */
+@property (atomic, readonly) NSUInteger numberOfQoSMessages;
+
++ (instancetype)monitorWithName:(NSString *)name;
+
+- (instancetype)initWithName:(NSString *)name;
+
+/**
+ * @brief Install a sync handler on the bus of a pipeline
+ *
+ * @param pipeline A top-level pipeline. The bus of an element inside a bin is
+ * the child bus of the bin, which already has a sync handler forwarding
+ * messages to the parent, so attaching to it fails.
+ *
+ * Must be called before the pipeline is set to PLAYING. The monitor is
+ * retained until the bus is destroyed.
+ *
+ * @returns NO if the pipeline is not top-level or has no bus
+ */
+- (BOOL)attachToPipeline:(GstElement *)pipeline;
+
+/**
+ * @brief Thread and CPU statistics
+ *
+ * Example structure of the returned dictionary:
+ * @code
+ * {
+ *     "numberOfThreads": 3,
+ *     "cpuTime": 12.3, // CPU seconds, including threads that left already
+ *     "cpuUsage": 42.5, // Percent of a single core since the last sample
+ *     "stackMemory": 25165824, // Reserved stack memory of all threads in bytes
+ *     "qosMessages": 0, // @see numberOfQoSMessages
+ *     "pooledTasks": 5, // Tasks assigned the shared task pool. Only with a pool.
+ *     "scheduling": {"cpus": [2, 3], "policy": "fifo", "priority": 50,
+ *                    "appliedThreads": 3, "failedThreads": 0},
+ *     "threads": [
+ *         {
+ *             "tid": 1234,
+ *             "name": "present0/queue0",
+ *             "element": "queue0",
+ *             "cpuTime": 4.2,
+ *             "stackSize": 8388608, // Bytes
+ *             "scheduling": "applied", // or "failed", or "inherited" without a policy
+ *             "schedulingErrors": ["policy: Operation not permitted"] // Only on failure
+ *         },
+ *         // Additional threads...
+ *     ]
+ * }
+ * @endcode
+ *
+ * "scheduling" is only present if a scheduling policy is set. Its thread
+ * counts only include active threads.
+ *
+ * The CPU usage is computed from the difference to the previous call, but at
+ * most once per second. It is 0 on the first call.
+ */
+- (NSDictionary *)statistics;
+
+@end
+
+NS_ASSUME_NONNULL_END
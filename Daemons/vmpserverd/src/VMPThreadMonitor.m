@@ -0,0 +1,364 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+// For pthread_getattr_np
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#import "VMPJournal.h"
+#import "VMPThreadMonitor.h"
+
+double VMPThreadCPUTime(pid_t tid) {
+	char path[64];
+	char buf[1024];
+	unsigned long utime, stime;
+	const char *fields;
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int) tid);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0) {
+		return -1;
+	}
+	buf[len] = '\0';
+
+	// The thread name may contain spaces and parentheses, so skip to the last ')'
+	fields = strrchr(buf, ')');
+	if (!fields) {
+		return -1;
+	}
+
+	// Fields after the name start at field 3 (state). utime and stime are fields 14 and 15.
+	if (sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime,
+			   &stime) != 2) {
+		return -1;
+	}
+
+	return (double) (utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static pid_t currentThreadID(void) {
+	return (pid_t) syscall(SYS_gettid);
+}
+
+// Stack size of the calling thread in bytes, or 0 if unknown
+static size_t currentThreadStackSize(void) {
+	pthread_attr_t attr;
+	size_t size = 0;
+	void *addr;
+
+	if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+		pthread_attr_getstack(&attr, &addr, &size);
+		pthread_attr_destroy(&attr);
+	}
+	return size;
+}
+
+// A streaming thread currently running a task of the monitored pipelines
+@interface _VMPStreamingThread : NSObject
+@property (nonatomic) pid_t tid;
+@property (nonatomic, copy) NSString *name;
+@property (nonatomic, copy) NSString *element;
+// CPU time of the thread when it entered the task
+@property (nonatomic) double baseCPUTime;
+@property (nonatomic) size_t stackSize;
+// Settings before the scheduling policy was applied. nil without a policy.
+@property (nonatomic) NSData *schedulingSnapshot;
+// Settings of the policy that could not be applied
+@property (nonatomic) NSArray<NSString *> *schedulingErrors;
+@end
+
+@implementation _VMPStreamingThread
+@end
+
+static GstBusSyncReply bus_sync_handler(GstBus *bus, GstMessage *message, gpointer user_data);
+
+static void bus_sync_handler_notify(gpointer user_data) {
+	// Balance the retain from attachToPipeline:
+	(void) (__bridge_transfer VMPThreadMonitor *) user_data;
+}
+
+@implementation VMPThreadMonitor {
+	NSMutableDictionary<NSNumber *, _VMPStreamingThread *> *_threads;
+	// CPU time of tasks that were left
+	double _retiredCPUTime;
+	// Last sample for computing the CPU usage
+	NSTimeInterval _lastSampleTime;
+	double _lastSampleCPUTime;
+	double _cpuUsage;
+	// QoS messages posted by elements dropping or throttling buffers
+	_Atomic unsigned long _qosMessages;
+	// Tasks that were assigned the shared task pool
+	_Atomic unsigned long _pooledTasks;
+}
+
++ (instancetype)monitorWithName:(NSString *)name {
+	return [[VMPThreadMonitor alloc] initWithName:name];
+}
+
+- (instancetype)initWithName:(NSString *)name {
+	self = [super init];
+	if (self) {
+		_name = [name copy];
+		_threads = [NSMutableDictionary dictionary];
+		_lastSampleTime = -1;
+		atomic_init(&_qosMessages, 0);
+		atomic_init(&_pooledTasks, 0);
+	}
+	return self;
+}
+
+- (NSUInteger)numberOfQoSMessages {
+	return atomic_load(&_qosMessages);
+}
+
+// Called in the streaming thread
+- (void)_qosMessagePosted {
+	atomic_fetch_add_explicit(&_qosMessages, 1, memory_order_relaxed);
+}
+
+// Called in the thread starting a task
+- (void)_taskAssignedToPool {
+	atomic_fetch_add_explicit(&_pooledTasks, 1, memory_order_relaxed);
+}
+
+- (BOOL)attachToPipeline:(GstElement *)pipeline {
+	GstObject *parent;
+	GstBus *bus;
+
+	// Transfer: FULL
+	parent = gst_object_get_parent(GST_OBJECT(pipeline));
+	if (parent) {
+		VMPError(@"Cannot monitor threads of %@: %s is not a top-level pipeline", _name,
+				 GST_OBJECT_NAME(pipeline));
+		gst_object_unref(parent);
+		return NO;
+	}
+
+	// Transfer: FULL
+	bus = gst_element_get_bus(pipeline);
+	if (!bus) {
+		return NO;
+	}
+	gst_bus_set_sync_handler(bus, bus_sync_handler, (__bridge_retained void *) self,
+							 bus_sync_handler_notify);
+	gst_object_unref(bus);
+
+	return YES;
+}
+
+// Called in the streaming thread
+- (void)_threadEnteredTaskOfElement:(GstElement *)owner {
+	_VMPStreamingThread *thread;
+	VMPSchedulingPolicy *policy;
+	NSString *element;
+	pid_t tid;
+
+	tid = currentThreadID();
+	policy = [self schedulingPolicy];
+	element = @(GST_OBJECT_NAME(owner));
+
+	thread = [[_VMPStreamingThread alloc] init];
+	[thread setTid:tid];
+	[thread setElement:element];
+	[thread setName:[NSString stringWithFormat:@"%@/%@", _name, element]];
+	[thread setBaseCPUTime:MAX(VMPThreadCPUTime(tid), 0)];
+	[thread setStackSize:currentThreadStackSize()];
+
+	// The kernel truncates the name to 15 characters
+	prctl(PR_SET_NAME, [[thread name] UTF8String], 0, 0, 0);
+
+	if (policy) {
+		NSArray<NSString *> *errors;
+
+		[thread setSchedulingSnapshot:[policy applyToCurrentThreadWithErrors:&errors]];
+		[thread setSchedulingErrors:errors];
+		if ([errors count] > 0) {
+			VMPWarn(@"Failed to apply scheduling policy to thread %@: %@", [thread name],
+					[errors componentsJoinedByString:@", "]);
+		}
+	}
+
+	@synchronized(self) {
+		_threads[@(tid)] = thread;
+	}
+
+	VMPDebug(@"Streaming thread %d entered task of element %@ in %@", tid, element, _name);
+}
+
+// Called in the streaming thread
+- (void)_threadLeftTask {
+	_VMPStreamingThread *thread;
+	double cpuTime;
+	pid_t tid;
+
+	tid = currentThreadID();
+	cpuTime = VMPThreadCPUTime(tid);
+
+	@synchronized(self) {
+		thread = _threads[@(tid)];
+		if (thread) {
+			_retiredCPUTime += MAX(cpuTime - [thread baseCPUTime], 0);
+			[_threads removeObjectForKey:@(tid)];
+		}
+	}
+
+	// The thread may be returned to a pool and reused by another pipeline
+	if ([thread schedulingSnapshot]) {
+		[VMPSchedulingPolicy restoreCurrentThreadFromSnapshot:[thread schedulingSnapshot]];
+	}
+}
+
+- (NSDictionary *)statistics {
+	NSMutableArray *threads;
+	NSMutableDictionary *statistics;
+	VMPSchedulingPolicy *policy;
+	NSMutableDictionary *schedulingInfo;
+	NSTimeInterval now;
+	double total;
+	size_t stackMemory;
+	NSUInteger applied, failed;
+
+	threads = [NSMutableArray array];
+	stackMemory = 0;
+	applied = 0;
+	failed = 0;
+	now = [[NSProcessInfo processInfo] systemUptime];
+
+	@synchronized(self) {
+		total = _retiredCPUTime;
+
+		for (_VMPStreamingThread *thread in [_threads allValues]) {
+			NSMutableDictionary *info;
+			NSString *scheduling;
+			double cpuTime;
+
+			cpuTime = VMPThreadCPUTime([thread tid]);
+			if (cpuTime < 0) {
+				continue;
+			}
+			cpuTime = MAX(cpuTime - [thread baseCPUTime], 0);
+			total += cpuTime;
+			stackMemory += [thread stackSize];
+
+			if (![thread schedulingSnapshot]) {
+				scheduling = @"inherited";
+			} else if ([[thread schedulingErrors] count] > 0) {
+				scheduling = @"failed";
+				failed++;
+			} else {
+				scheduling = @"applied";
+				applied++;
+			}
+
+			info = [NSMutableDictionary dictionaryWithDictionary:@{
+				@"tid" : @([thread tid]),
+				@"name" : [thread name],
+				@"element" : [thread element],
+				@"cpuTime" : @(cpuTime),
+				@"stackSize" : @([thread stackSize]),
+				@"scheduling" : scheduling,
+			}];
+			if ([[thread schedulingErrors] count] > 0) {
+				info[@"schedulingErrors"] = [thread schedulingErrors];
+			}
+			[threads addObject:info];
+		}
+
+		if (_lastSampleTime < 0) {
+			_lastSampleTime = now;
+			_lastSampleCPUTime = total;
+		} else if (now - _lastSampleTime >= 1.0) {
+			_cpuUsage = MAX(total - _lastSampleCPUTime, 0) / (now - _lastSampleTime) * 100.0;
+			_lastSampleTime = now;
+			_lastSampleCPUTime = total;
+		}
+
+		statistics = [NSMutableDictionary dictionaryWithDictionary:@{
+			@"numberOfThreads" : @([threads count]),
+			@"cpuTime" : @(total),
+			@"cpuUsage" : @(_cpuUsage),
+			@"stackMemory" : @(stackMemory),
+			@"qosMessages" : @([self numberOfQoSMessages]),
+			@"threads" : threads,
+		}];
+	}
+
+	if ([self taskPool]) {
+		statistics[@"pooledTasks"] = @(atomic_load(&_pooledTasks));
+	}
+
+	policy = [self schedulingPolicy];
+	if (policy) {
+		schedulingInfo = [NSMutableDictionary dictionaryWithDictionary:[policy propertyList]];
+		schedulingInfo[@"appliedThreads"] = @(applied);
+		schedulingInfo[@"failedThreads"] = @(failed);
+		statistics[@"scheduling"] = schedulingInfo;
+	}
+
+	return statistics;
+}
+
+@end
+
+static GstBusSyncReply bus_sync_handler(GstBus *bus, GstMessage *message, gpointer user_data) {
+	GstStreamStatusType type;
+	GstElement *owner;
+
+	if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_QOS) {
+		[(__bridge VMPThreadMonitor *) user_data _qosMessagePosted];
+		return GST_BUS_PASS;
+	}
+	if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_STREAM_STATUS) {
+		return GST_BUS_PASS;
+	}
+
+	@autoreleasepool {
+		__unsafe_unretained VMPThreadMonitor *monitor = (__bridge id) user_data;
+
+		gst_message_parse_stream_status(message, &type, &owner);
+
+		switch (type) {
+		case GST_STREAM_STATUS_TYPE_CREATE: {
+			VMPTaskPool *pool;
+			const GValue *value;
+
+			// Posted by the thread starting the task, before the task is pushed to a pool
+			pool = [monitor taskPool];
+			value = gst_message_get_stream_status_object(message);
+			if (pool && value && G_VALUE_HOLDS(value, GST_TYPE_TASK)) {
+				gst_task_set_pool(GST_TASK(g_value_get_object(value)), [pool pool]);
+				[monitor _taskAssignedToPool];
+			}
+			break;
+		}
+		case GST_STREAM_STATUS_TYPE_ENTER:
+			[monitor _threadEnteredTaskOfElement:owner];
+			break;
+		case GST_STREAM_STATUS_TYPE_LEAVE:
+			[monitor _threadLeftTask];
+			break;
+		default:
+			break;
+		}
+	}
+
+	return GST_BUS_PASS;
+}
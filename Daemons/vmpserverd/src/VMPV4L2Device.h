@@ -0,0 +1,98 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * @brief A pixel format, frame size, and maximum framerate supported by a
+ * V4L2 device
+ */
+@interface VMPV4L2Format : NSObject
+
+/// The V4L2 fourcc (e.g. "NV12" or "YUYV")
+@property (nonatomic, readonly) NSString *fourcc;
+
+/// The corresponding GStreamer video format (e.g. "NV12" or "YUY2")
+@property (nonatomic, readonly) NSString *videoFormat;
+
+@property (nonatomic, readonly) NSUInteger width;
+@property (nonatomic, readonly) NSUInteger height;
+
+/// Highest framerate supported for this size as a fraction
+@property (nonatomic, readonly) NSUInteger framerateNumerator;
+@property (nonatomic, readonly) NSUInteger framerateDenominator;
+
+/**
+ * @brief Relative cost of processing the format downstream
+ *
+ * 0 for formats that encoders consume directly (NV12), higher values for
+ * formats requiring a conversion. Lower is better.
+ */
+@property (nonatomic, readonly) NSUInteger cost;
+
+/// GStreamer caps describing the format (e.g. "video/x-raw,format=NV12,...")
+- (NSString *)capsString;
+
+- (NSDictionary *)propertyList;
+
+@end
+
+/**
+ * @brief Capabilities of a V4L2 capture device
+ *
+ * The device is probed once on creation with VIDIOC_QUERYCAP, VIDIOC_ENUM_FMT,
+ * VIDIOC_ENUM_FRAMESIZES, VIDIOC_ENUM_FRAMEINTERVALS, and VIDIOC_EXPBUF, and
+ * closed afterwards. Only raw formats with a known GStreamer equivalent are listed.
+ */
+@interface VMPV4L2Device : NSObject
+
+@property (nonatomic, readonly) NSString *path;
+
+/// Name of the driver (e.g. "uvcvideo")
+@property (nonatomic, readonly) NSString *driver;
+
+/// Name of the device (e.g. "USB Video: USB Video")
+@property (nonatomic, readonly) NSString *card;
+
+/// Whether the device supports streaming I/O
+@property (nonatomic, readonly) BOOL supportsStreaming;
+
+/// Whether buffers of the device can be exported as DMABUF (VIDIOC_EXPBUF)
+@property (nonatomic, readonly) BOOL supportsDMABUFExport;
+
+/// All supported combinations of raw format and frame size
+@property (nonatomic, readonly) NSArray<VMPV4L2Format *> *formats;
+
+/**
+ * @brief Probe a V4L2 device
+ *
+ * @param path Path to the device node (e.g. "/dev/video0")
+ *
+ * @returns the device capabilities, or nil if the device could not be opened,
+ * or is not a video capture device
+ */
++ (nullable instancetype)deviceWithPath:(NSString *)path error:(NSError **)error;
+
+- (nullable instancetype)initWithPath:(NSString *)path error:(NSError **)error;
+
+/**
+ * @brief Select the cheapest native format for a target resolution
+ *
+ * Formats are ranked by:
+ * @li Frame size: the target size, then the smallest larger size (downscaled),
+ * then the largest smaller size (upscaled)
+ * @li Framerate: the highest framerate, up to 60 fps
+ * @li Cost: formats that can be consumed without conversion
+ *
+ * @returns the best format, or nil if the device has no supported raw format
+ */
+- (nullable VMPV4L2Format *)preferredFormatForWidth:(NSUInteger)width height:(NSUInteger)height;
+
+@end
+
+NS_ASSUME_NONNULL_END
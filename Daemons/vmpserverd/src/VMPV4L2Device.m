@@ -0,0 +1,381 @@
+/* vmpserverd - A virtual multimedia processor
+ * Copyright (C) 2024 Hugo Melder
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#import <glib.h>
+
+#import "VMPErrors.h"
+#import "VMPV4L2Device.h"
+
+// Framerates above this value do not improve the ranking of a format
+static const double kMaximumUsefulFramerate = 60.0;
+
+// Raw V4L2 formats with a GStreamer equivalent, and the cost of consuming them
+static const struct {
+	uint32_t pixelformat;
+	const char *videoFormat;
+	NSUInteger cost;
+} kFormatTable[] = {
+	{V4L2_PIX_FMT_NV12, "NV12", 0},	  {V4L2_PIX_FMT_YUV420, "I420", 1},
+	{V4L2_PIX_FMT_YVU420, "YV12", 1}, {V4L2_PIX_FMT_YUYV, "YUY2", 1},
+	{V4L2_PIX_FMT_UYVY, "UYVY", 1},	  {V4L2_PIX_FMT_NV16, "NV16", 2},
+	{V4L2_PIX_FMT_XBGR32, "BGRx", 2}, {V4L2_PIX_FMT_BGR24, "BGR", 3},
+	{V4L2_PIX_FMT_RGB24, "RGB", 3},
+};
+
+static int xioctl(int fd, unsigned long request, void *arg) {
+	int ret;
+
+	do {
+		ret = ioctl(fd, request, arg);
+	} while (ret == -1 && errno == EINTR);
+
+	return ret;
+}
+
+// Whether buffers of the device can be exported as DMABUF. Streaming I/O does not imply
+// VIDIOC_EXPBUF, so a single MMAP buffer is allocated and exported.
+static BOOL probeDMABUFExport(int fd, uint32_t type) {
+	struct v4l2_requestbuffers req;
+	struct v4l2_exportbuffer exp;
+	BOOL supported;
+
+	memset(&req, 0, sizeof(req));
+	req.count = 1;
+	req.type = type;
+	req.memory = V4L2_MEMORY_MMAP;
+	// Fails e.g. with EBUSY if the device is streaming
+	if (xioctl(fd, VIDIOC_REQBUFS, &req) < 0 || req.count == 0) {
+		return NO;
+	}
+
+	memset(&exp, 0, sizeof(exp));
+	exp.type = type;
+	exp.index = 0;
+	exp.plane = 0;
+	exp.flags = O_CLOEXEC | O_RDONLY;
+	supported = xioctl(fd, VIDIOC_EXPBUF, &exp) == 0;
+	if (supported) {
+		close(exp.fd);
+	}
+
+	// Free the buffer again
+	memset(&req, 0, sizeof(req));
+	req.count = 0;
+	req.type = type;
+	req.memory = V4L2_MEMORY_MMAP;
+	xioctl(fd, VIDIOC_REQBUFS, &req);
+
+	return supported;
+}
+
+static NSString *fourccString(uint32_t fourcc) {
+	char str[5] = {(char) (fourcc & 0xFF), (char) ((fourcc >> 8) & 0xFF),
+				   (char) ((fourcc >> 16) & 0xFF), (char) ((fourcc >> 24) & 0xFF), '\0'};
+
+	return [@(str) stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+}
+
+@interface VMPV4L2Format ()
+- (instancetype)initWithFourcc:(NSString *)fourcc
+				   videoFormat:(NSString *)videoFormat
+						 width:(NSUInteger)width
+						height:(NSUInteger)height
+			framerateNumerator:(NSUInteger)numerator
+		  framerateDenominator:(NSUInteger)denominator
+						  cost:(NSUInteger)cost;
+- (double)framerate;
+@end
+
+@implementation VMPV4L2Format
+
+- (instancetype)initWithFourcc:(NSString *)fourcc
+				   videoFormat:(NSString *)videoFormat
+						 width:(NSUInteger)width
+						height:(NSUInteger)height
+			framerateNumerator:(NSUInteger)numerator
+		  framerateDenominator:(NSUInteger)denominator
+						  cost:(NSUInteger)cost {
+	self = [super init];
+	if (self) {
+		_fourcc = fourcc;
+		_videoFormat = videoFormat;
+		_width = width;
+		_height = height;
+		_framerateNumerator = numerator;
+		_framerateDenominator = denominator;
+		_cost = cost;
+	}
+	return self;
+}
+
+- (double)framerate {
+	if (_framerateDenominator == 0) {
+		return 0;
+	}
+	return (double) _framerateNumerator / _framerateDenominator;
+}
+
+- (NSString *)capsString {
+	NSMutableString *caps;
+
+	caps = [NSMutableString stringWithFormat:@"video/x-raw,format=%@,width=%lu,height=%lu",
+											 _videoFormat, (unsigned long) _width,
+											 (unsigned long) _height];
+	// Unknown if the driver does not enumerate frame intervals
+	if (_framerateNumerator > 0) {
+		[caps appendFormat:@",framerate=%lu/%lu", (unsigned long) _framerateNumerator,
+						   (unsigned long) _framerateDenominator];
+	}
+
+	return caps;
+}
+
+- (NSDictionary *)propertyList {
+	return @{
+		@"fourcc" : _fourcc,
+		@"format" : _videoFormat,
+		@"width" : @(_width),
+		@"height" : @(_height),
+		@"framerate" : @([self framerate]),
+	};
+}
+
+- (NSString *)description {
+	return [NSString stringWithFormat:@"<%@: %p> %@ %lux%lu@%.2f", NSStringFromClass([self class]),
+									  self, _fourcc, (unsigned long) _width,
+									  (unsigned long) _height, [self framerate]];
+}
+
+@end
+
+// Highest framerate of a frame size as a fraction. 0/1 if unknown.
+static void maximumFramerate(int fd, uint32_t pixelformat, uint32_t width, uint32_t height,
+							 NSUInteger *numerator, NSUInteger *denominator) {
+	*numerator = 0;
+	*denominator = 1;
+
+	for (__u32 index = 0;; index++) {
+		struct v4l2_frmivalenum ival;
+		struct v4l2_fract interval;
+
+		memset(&ival, 0, sizeof(ival));
+		ival.index = index;
+		ival.pixel_format = pixelformat;
+		ival.width = width;
+		ival.height = height;
+		if (xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &ival) < 0) {
+			break;
+		}
+
+		// The shortest interval of a range is its minimum
+		interval = ival.type == V4L2_FRMIVAL_TYPE_DISCRETE ? ival.discrete : ival.stepwise.min;
+		if (interval.numerator == 0) {
+			continue;
+		}
+
+		// framerate = 1 / interval. Keep the larger framerate.
+		if ((uint64_t) interval.denominator * *denominator >
+			(uint64_t) *numerator * interval.numerator) {
+			*numerator = interval.denominator;
+			*denominator = interval.numerator;
+		}
+
+		if (ival.type != V4L2_FRMIVAL_TYPE_DISCRETE) {
+			break;
+		}
+	}
+}
+
+// Append all frame sizes of a format to result
+static void enumerateFrameSizes(int fd, uint32_t pixelformat, NSString *videoFormat,
+								NSUInteger cost, NSMutableArray<VMPV4L2Format *> *result) {
+	for (__u32 index = 0;; index++) {
+		struct v4l2_frmsizeenum size;
+		uint32_t sizes[2][2];
+		NSUInteger count = 0;
+
+		memset(&size, 0, sizeof(size));
+		size.index = index;
+		size.pixel_format = pixelformat;
+		if (xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) < 0) {
+			break;
+		}
+
+		if (size.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+			sizes[count][0] = size.discrete.width;
+			sizes[count][1] = size.discrete.height;
+			count++;
+		} else {
+			// Continuous or stepwise ranges are represented by the common 1080p
+			// size (if in range) and the maximum size
+			const struct v4l2_frmsize_stepwise *sw = &size.stepwise;
+
+			if (sw->min_width <= 1920 && sw->max_width >= 1920 && sw->min_height <= 1080 &&
+				sw->max_height >= 1080) {
+				sizes[count][0] = 1920;
+				sizes[count][1] = 1080;
+				count++;
+			}
+			sizes[count][0] = sw->max_width;
+			sizes[count][1] = sw->max_height;
+			count++;
+		}
+
+		for (NSUInteger i = 0; i < count; i++) {
+			NSUInteger numerator, denominator;
+
+			maximumFramerate(fd, pixelformat, sizes[i][0], sizes[i][1], &numerator, &denominator);
+
+			[result addObject:[[VMPV4L2Format alloc] initWithFourcc:fourccString(pixelformat)
+														videoFormat:videoFormat
+															  width:sizes[i][0]
+															 height:sizes[i][1]
+												 framerateNumerator:numerator
+											   framerateDenominator:denominator
+															   cost:cost]];
+		}
+
+		if (size.type != V4L2_FRMSIZE_TYPE_DISCRETE) {
+			break;
+		}
+	}
+}
+
+@implementation VMPV4L2Device
+
++ (instancetype)deviceWithPath:(NSString *)path error:(NSError **)error {
+	return [[VMPV4L2Device alloc] initWithPath:path error:error];
+}
+
+- (instancetype)initWithPath:(NSString *)path error:(NSError **)error {
+	struct v4l2_capability cap;
+	uint32_t caps;
+	enum v4l2_buf_type type;
+	NSMutableArray<VMPV4L2Format *> *formats;
+	BOOL supportsStreaming, supportsDMABUFExport;
+	int fd;
+
+	fd = open([path fileSystemRepresentation], O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		VMP_FAST_ERROR(error, VMPErrorCodeDeviceNotFound, @"Failed to open V4L2 device %@: %s",
+					   path, strerror(errno));
+		return nil;
+	}
+
+	memset(&cap, 0, sizeof(cap));
+	if (xioctl(fd, VIDIOC_QUERYCAP, &cap) < 0) {
+		VMP_FAST_ERROR(error, VMPErrorV4L2DeviceCapabilities,
+					   @"VIDIOC_QUERYCAP failed for V4L2 device %@: %s", path, strerror(errno));
+		close(fd);
+		return nil;
+	}
+
+	caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+	if (caps & V4L2_CAP_VIDEO_CAPTURE) {
+		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	} else if (caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE) {
+		type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	} else {
+		VMP_FAST_ERROR(error, VMPErrorV4L2DeviceCapabilities,
+					   @"V4L2 device %@ is not a video capture device", path);
+		close(fd);
+		return nil;
+	}
+
+	formats = [NSMutableArray array];
+	for (__u32 index = 0;; index++) {
+		struct v4l2_fmtdesc desc;
+
+		memset(&desc, 0, sizeof(desc));
+		desc.index = index;
+		desc.type = type;
+		if (xioctl(fd, VIDIOC_ENUM_FMT, &desc) < 0) {
+			break;
+		}
+
+		for (size_t i = 0; i < G_N_ELEMENTS(kFormatTable); i++) {
+			if (kFormatTable[i].pixelformat == desc.pixelformat) {
+				enumerateFrameSizes(fd, desc.pixelformat, @(kFormatTable[i].videoFormat),
+									kFormatTable[i].cost, formats);
+				break;
+			}
+		}
+	}
+	supportsStreaming = (caps & V4L2_CAP_STREAMING) != 0;
+	supportsDMABUFExport = supportsStreaming && probeDMABUFExport(fd, type);
+	close(fd);
+
+	self = [super init];
+	if (self) {
+		_path = [path copy];
+		_driver = @((const char *) cap.driver);
+		_card = @((const char *) cap.card);
+		_supportsStreaming = supportsStreaming;
+		_supportsDMABUFExport = supportsDMABUFExport;
+		_formats = formats;
+	}
+	return self;
+}
+
+- (VMPV4L2Format *)preferredFormatForWidth:(NSUInteger)width height:(NSUInteger)height {
+	NSArray<VMPV4L2Format *> *sorted;
+
+	// 0: exact size, 1: larger (downscaled), 2: smaller (upscaled)
+	NSUInteger (^sizeClass)(VMPV4L2Format *) = ^NSUInteger(VMPV4L2Format *f) {
+	  if ([f width] == width && [f height] == height) {
+		  return 0;
+	  }
+	  return ([f width] >= width && [f height] >= height) ? 1 : 2;
+	};
+
+	sorted = [_formats sortedArrayUsingComparator:^NSComparisonResult(VMPV4L2Format *a,
+																	   VMPV4L2Format *b) {
+	  NSUInteger classA, classB, areaA, areaB;
+	  double rateA, rateB;
+
+	  classA = sizeClass(a);
+	  classB = sizeClass(b);
+	  if (classA != classB) {
+		  return classA < classB ? NSOrderedAscending : NSOrderedDescending;
+	  }
+
+	  // Prefer the size closest to the target
+	  areaA = [a width] * [a height];
+	  areaB = [b width] * [b height];
+	  if (areaA != areaB) {
+		  BOOL smaller = classA == 1 ? areaA < areaB : areaA > areaB;
+		  return smaller ? NSOrderedAscending : NSOrderedDescending;
+	  }
+
+	  rateA = MIN([a framerate], kMaximumUsefulFramerate);
+	  rateB = MIN([b framerate], kMaximumUsefulFramerate);
+	  if (rateA != rateB) {
+		  return rateA > rateB ? NSOrderedAscending : NSOrderedDescending;
+	  }
+
+	  if ([a cost] != [b cost]) {
+		  return [a cost] < [b cost] ? NSOrderedAscending : NSOrderedDescending;
+	  }
+	  return NSOrderedSame;
+	}];
+
+	return [sorted firstObject];
+}
+
+- (NSString *)description {
+	return [NSString stringWithFormat:@"<%@: %p> %@ (%@, %@), %lu formats",
+									  NSStringFromClass([self class]), self, _path, _card,
+									  _driver, (unsigned long) [_formats count]];
+}
+
+@end
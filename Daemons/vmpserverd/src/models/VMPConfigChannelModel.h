@@ -12,6 +12,8 @@
 extern NSString *const VMPConfigChannelTypeV4L2;
 /// Channel for capturing from Decklinks
 extern NSString *const VMPConfigChannelTypeDecklink;
+/// Channel for ingesting an H.264 stream over RTSP, SRT, or RTP
+extern NSString *const VMPConfigChannelTypeNetwork;
 /// Channel for creating a reproducible video test pattern
 extern NSString *const VMPConfigChannelTypeVideoTest;
 /// Channel for creating a reproducible audio test tone
@@ -11,6 +11,7 @@
 
 NSString *const VMPConfigChannelTypeV4L2 = @"v4l2";
 NSString *const VMPConfigChannelTypeDecklink = @"decklink";
+NSString *const VMPConfigChannelTypeNetwork = @"network";
 NSString *const VMPConfigChannelTypeVideoTest = @"videoTest";
 NSString *const VMPConfigChannelTypeAudioTest = @"audioTest";
 NSString *const VMPConfigChannelTypePulseAudio = @"pulse";
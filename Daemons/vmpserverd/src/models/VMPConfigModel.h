@@ -36,6 +36,18 @@
 
 @property (nonatomic, strong) NSArray<id> *locations;
 
+// Optional. Enables the shared task pool (low-footprint mode) if set.
+@property (nonatomic, strong) NSDictionary *taskPool;
+
+// Optional. Enables quality degradation under load if set.
+@property (nonatomic, strong) NSDictionary *degradation;
+
+// Optional. Probe timeout and retry interval of mountpoint pipeline variants.
+@property (nonatomic, strong) NSDictionary *pipelineVariants;
+
+// Optional. Global limits of RTSP sessions and their estimated bandwidth.
+@property (nonatomic, strong) NSDictionary *admission;
+
 @property (nonatomic, strong) NSArray<VMPConfigMountpointModel *> *mountpoints;
 
 @property (nonatomic, strong) NSArray<VMPConfigChannelModel *> *channels;
@@ -31,6 +31,10 @@
 		SET_PROPERTY(_httpPassword, @"httpPassword");
 		SET_PROPERTY(_gstDebug, @"gstDebug");
 		SET_PROPERTY(_locations, @"locations");
+		_taskPool = propertyList[@"taskPool"];
+		_degradation = propertyList[@"degradation"];
+		_pipelineVariants = propertyList[@"pipelineVariants"];
+		_admission = propertyList[@"admission"];
 
 		SET_PROPERTY(plistMountpoints, @"mountpoints");
 		SET_PROPERTY(plistChannels, @"channels");
@@ -99,7 +103,9 @@
 	VMP_ASSERT(_mountpoints, @"mountpoints is nil");
 	VMP_ASSERT(_channels, @"channels is nil");
 
-	return @{
+	NSMutableDictionary *plist;
+
+	plist = [NSMutableDictionary dictionaryWithDictionary:@{
 		@"name" : _name,
 		@"icalURL" : _icalURL,
 		@"rtspAddress" : _rtspAddress,
@@ -110,7 +116,21 @@
 		@"gstDebug" : _gstDebug,
 		@"mountpoints" : [self propertyListMountpoints],
 		@"channels" : [self propertyListChannels],
-	};
+	}];
+	if (_taskPool) {
+		plist[@"taskPool"] = _taskPool;
+	}
+	if (_degradation) {
+		plist[@"degradation"] = _degradation;
+	}
+	if (_pipelineVariants) {
+		plist[@"pipelineVariants"] = _pipelineVariants;
+	}
+	if (_admission) {
+		plist[@"admission"] = _admission;
+	}
+
+	return plist;
 }
 
 @end
\ No newline at end of file
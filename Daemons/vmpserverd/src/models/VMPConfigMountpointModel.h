@@ -10,6 +10,7 @@
 
 extern NSString *const VMPConfigMountpointTypeSingle;
 extern NSString *const VMPConfigMountpointTypeCombined;
+extern NSString *const VMPConfigMountpointTypeMosaic;
 
 @interface VMPConfigMountpointModel : NSObject <VMPPropertyListProtocol>
 
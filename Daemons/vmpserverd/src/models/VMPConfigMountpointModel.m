@@ -11,6 +11,7 @@
 
 NSString *const VMPConfigMountpointTypeSingle = @"single";
 NSString *const VMPConfigMountpointTypeCombined = @"combined";
+NSString *const VMPConfigMountpointTypeMosaic = @"mosaic";
 
 @implementation VMPConfigMountpointModel
 